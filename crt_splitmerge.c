@@ -29,6 +29,35 @@
 //
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
+#include <threads.h>
+
+#if defined(_WIN32)
+#  include <direct.h>
+#  include <io.h>
+#  include <fcntl.h>
+#  include <intrin.h>
+#  include <process.h>
+#  define crt_mkdir(directory_name) _mkdir(directory_name)
+#  define crt_rmdir(directory_name) _rmdir(directory_name)
+#  define crt_tell(handle) _ftelli64(handle)
+#  define crt_seek(handle, offset) _fseeki64(handle, offset, SEEK_SET)
+#else
+#  include <sys/stat.h>
+#  include <sys/time.h>
+#  include <sys/resource.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  if defined(__linux__)
+#    include <sys/syscall.h>
+#    include <linux/falloc.h>
+#  endif
+#  define crt_mkdir(directory_name) mkdir(directory_name, 0777)
+#  define crt_rmdir(directory_name) rmdir(directory_name)
+#  define crt_tell(handle) ftello(handle)
+#  define crt_seek(handle, offset) fseeko(handle, offset, SEEK_SET)
+#endif
 
 
 //~~~~~~~~~~~~~~~~
@@ -43,16 +72,61 @@
 #define os_close_file crt_close_file
 #define os_open_file_for_reading crt_open_file_for_reading
 #define os_open_file_for_writing crt_open_file_for_writing
+#define os_open_file_for_updating crt_open_file_for_updating
 #define os_move_file_pointer crt_move_file_pointer
+#define os_set_file_pointer crt_set_file_pointer
 #define os_read_file crt_read_file
+#define os_read_standard_input crt_read_standard_input
+#define os_write_standard_output crt_write_standard_output
 #define os_write_file crt_write_file
 
+#define os_create_directory crt_create_directory
+#define os_delete_file crt_delete_file
+#define os_delete_directory crt_delete_directory
+#define os_move_file crt_move_file
+
+#define os_open_directory crt_open_directory
+#define os_close_directory crt_close_directory
+#define os_open_file_in_directory_for_reading crt_open_file_in_directory_for_reading
+#define os_open_file_in_directory_for_writing crt_open_file_in_directory_for_writing
+
+#define os_flush_file crt_flush_file
+#define os_begin_flush_file crt_begin_flush_file
+#define os_flush_directory crt_flush_directory
+
+#define os_advise_sequential crt_advise_sequential
+#define os_drop_cache crt_drop_cache
+
 #define os_get_size_of_file crt_get_size_of_file
 #define os_get_remaining_size_of_file crt_get_remaining_size_of_file
+#define os_get_file_identity crt_get_file_identity
+#define os_set_size_of_file crt_set_size_of_file
+#define os_collapse_file_range crt_collapse_file_range
+
+#define os_get_next_data crt_get_next_data
+#define os_set_sparse crt_set_sparse
 
 #define os_get_random_u64 crt_get_random_u64
 #define os_set_random_seed crt_set_random_seed
 
+#define os_get_time crt_get_time
+#define os_get_process_usage crt_get_process_usage
+#define os_sleep crt_sleep
+#define os_enter_background_mode crt_enter_background_mode
+#define os_run_process crt_run_process
+
+#define os_create_thread crt_create_thread
+#define os_join_thread crt_join_thread
+#define os_create_semaphore crt_create_semaphore
+#define os_wait_semaphore crt_wait_semaphore
+#define os_signal_semaphore crt_signal_semaphore
+#define os_free_semaphore crt_free_semaphore
+#define os_atomic_add crt_atomic_add
+#define os_get_processor_count crt_get_processor_count
+#define os_get_max_open_files crt_get_max_open_files
+
+#define SPLITMERGE_BACKEND_NAME "crt"
+
 
 //~~~~~~~~~~~~~~~~
 //
@@ -60,6 +134,31 @@
 //
 typedef FILE * File_Handle;
 
+//~ NOTE(Patrik): Where there is no openat the files are opened by joining
+// path and the name instead, path ends with a separator.
+typedef struct Crt_Directory {
+    int  descriptor;
+    i32  path_length;
+    char path[1];
+} Crt_Directory;
+
+typedef Crt_Directory * Directory_Handle;
+typedef struct Crt_Thread {
+    thrd_t       thread;
+    Thread_Proc *proc;
+    void        *data;
+} Crt_Thread;
+
+typedef Crt_Thread * Thread_Handle;
+
+typedef struct Crt_Semaphore {
+    mtx_t mutex;
+    cnd_t condition;
+    i32   count;
+} Crt_Semaphore;
+
+typedef Crt_Semaphore * Semaphore_Handle;
+
 
 //~~~~~~~~~~~~~~~~
 //
@@ -102,7 +201,13 @@ PLATFORM_IS_HANDLE_VALID(crt_is_handle_valid) {
 
 static
 PLATFORM_CLOSE_FILE(crt_close_file) {
-    fclose(handle);
+    if(handle) {
+        SPLITMERGE_PROBE1(crt_close_begin, handle);
+        
+        fclose(handle);
+        
+        SPLITMERGE_PROBE1(crt_close_end, handle);
+    }
 }
 
 static
@@ -110,7 +215,11 @@ PLATFORM_OPEN_FILE_FOR_READING(crt_open_file_for_reading) {
     File_Handle result = 0;
     
     if(file_name) {
+        SPLITMERGE_PROBE1(crt_open_begin, file_name);
+        
         result = fopen(file_name, "rb");
+        
+        SPLITMERGE_PROBE2(crt_open_end, file_name, result);
     }
     
     return result;
@@ -121,7 +230,30 @@ PLATFORM_OPEN_FILE_FOR_WRITING(crt_open_file_for_writing) {
     File_Handle result = 0;
     
     if(file_name) {
+        SPLITMERGE_PROBE1(crt_open_begin, file_name);
+        
         result = fopen(file_name, "wb");
+        
+        SPLITMERGE_PROBE2(crt_open_end, file_name, result);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_FOR_UPDATING(crt_open_file_for_updating) {
+    File_Handle result = 0;
+    
+    if(file_name) {
+        SPLITMERGE_PROBE1(crt_open_begin, file_name);
+        
+        result = fopen(file_name, "r+b");
+        
+        if(!result) {
+            result = fopen(file_name, "w+b");
+        }
+        
+        SPLITMERGE_PROBE2(crt_open_end, file_name, result);
     }
     
     return result;
@@ -130,11 +262,14 @@ PLATFORM_OPEN_FILE_FOR_WRITING(crt_open_file_for_writing) {
 static
 PLATFORM_MOVE_FILE_POINTER(crt_move_file_pointer) {
     if(handle) {
-        fpos_t current = 0;
-        fgetpos(handle, &current);
+        SPLITMERGE_PROBE2(crt_seek_begin, handle, desired_offset);
+        
+        i64 current = crt_tell(handle);
         
         current += desired_offset;
-        fsetpos(handle, &current);
+        crt_seek(handle, current);
+        
+        SPLITMERGE_PROBE2(crt_seek_end, handle, current);
         
         return true;
     }
@@ -142,6 +277,61 @@ PLATFORM_MOVE_FILE_POINTER(crt_move_file_pointer) {
     return false;
 }
 
+static
+PLATFORM_SET_FILE_POINTER(crt_set_file_pointer) {
+    if(handle) {
+        SPLITMERGE_PROBE2(crt_seek_begin, handle, desired_offset);
+        
+        bool result = (crt_seek(handle, desired_offset) == 0);
+        
+        SPLITMERGE_PROBE2(crt_seek_end, handle, desired_offset);
+        
+        return result;
+    }
+    
+    return false;
+}
+
+//~ NOTE(Patrik): Not through crt_read_file, since seeking in a pipe can throw
+// away what is buffered.
+static
+PLATFORM_READ_STANDARD_INPUT(crt_read_standard_input) {
+    i64 result = 0;
+    
+    if(file) {
+        if(read_amount > file->capacity - file->length) {
+            read_amount = file->capacity - file->length;
+        }
+        
+#if defined(_WIN32)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        
+        result = fread(file->data + file->length, 1, read_amount, stdin);
+        
+        file->length += result;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_WRITE_STANDARD_OUTPUT(crt_write_standard_output) {
+    i64 result = 0;
+    
+    if(data) {
+#if defined(_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        
+        result = fwrite(data, 1, length, stdout);
+        
+        fflush(stdout);
+    }
+    
+    return result;
+}
+
 static
 PLATFORM_READ_FILE(crt_read_file) {
     i64 result = 0;
@@ -151,15 +341,18 @@ PLATFORM_READ_FILE(crt_read_file) {
             read_amount = file->capacity - file->length;
         }
         
-        fpos_t offset = 0;
-        fgetpos(handle, &offset);
+        SPLITMERGE_PROBE2(crt_read_begin, handle, read_amount);
+        
+        i64 offset = crt_tell(handle);
         
         result = fread(file->data + file->length, 1, read_amount, handle);
         
         file->length += result;
         
         offset += result;
-        fsetpos(handle, &offset);
+        crt_seek(handle, offset);
+        
+        SPLITMERGE_PROBE2(crt_read_end, handle, result);
     }
     
     return result;
@@ -170,37 +363,291 @@ PLATFORM_WRITE_FILE(crt_write_file) {
     i64 result = 0;
     
     if(handle) {
-        fpos_t offset = 0;
-        fgetpos(handle, &offset);
+        SPLITMERGE_PROBE2(crt_write_begin, handle, length);
+        
+        i64 offset = crt_tell(handle);
         
         result = fwrite(data, 1, length, handle);
         
         offset += result;
-        fsetpos(handle, &offset);
+        crt_seek(handle, offset);
+        
+        SPLITMERGE_PROBE2(crt_write_end, handle, result);
     }
     
     return result;
 }
 
+static
+PLATFORM_CREATE_DIRECTORY(crt_create_directory) {
+    if(directory_name) {
+        if(crt_mkdir(directory_name) == 0 || errno == EEXIST) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_DELETE_FILE(crt_delete_file) {
+    if(file_name && remove(file_name) == 0) {
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_DELETE_DIRECTORY(crt_delete_directory) {
+    if(directory_name && crt_rmdir(directory_name) == 0) {
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_MOVE_FILE(crt_move_file) {
+    if(old_name && new_name) {
+#if defined(_WIN32)
+        remove(new_name);
+#endif
+        
+        if(rename(old_name, new_name) == 0) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_FLUSH_FILE(crt_flush_file) {
+    bool result = false;
+    
+    if(handle && fflush(handle) == 0) {
+#if defined(_WIN32)
+        result = (_commit(_fileno(handle)) == 0);
+#else
+        result = (fsync(fileno(handle)) == 0);
+#endif
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Only where sync_file_range is there, the flush does all of
+// the work otherwise.
+static
+PLATFORM_BEGIN_FLUSH_FILE(crt_begin_flush_file) {
+    if(handle) {
+        fflush(handle);
+        
+#if defined(SYNC_FILE_RANGE_WRITE)
+        sync_file_range(fileno(handle), 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+    }
+}
+
+static
+PLATFORM_OPEN_DIRECTORY(crt_open_directory) {
+    Crt_Directory *result = 0;
+    
+    if(directory_name) {
+        i32 path_length = 0;
+        
+        while(directory_name[path_length]) {
+            path_length += 1;
+        }
+        
+        int descriptor = -1;
+        
+#if !defined(_WIN32)
+        descriptor = open(directory_name, O_RDONLY | O_DIRECTORY);
+        
+        if(descriptor < 0) {
+            return 0;
+        }
+#endif
+        
+        result = (Crt_Directory*)crt_alloc(sizeof(Crt_Directory) + path_length + 1);
+        
+        result->descriptor = descriptor;
+        
+        For(i32, it_index, path_length) {
+            result->path[it_index] = directory_name[it_index];
+        }
+        
+        if(path_length > 0 && directory_name[path_length - 1] != '/' && directory_name[path_length - 1] != '\\') {
+            result->path[path_length] = '/';
+            path_length += 1;
+        }
+        
+        result->path_length = path_length;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_CLOSE_DIRECTORY(crt_close_directory) {
+    if(directory) {
+#if !defined(_WIN32)
+        close(directory->descriptor);
+#endif
+        
+        crt_free(directory);
+    }
+}
+
+static
+PLATFORM_FLUSH_DIRECTORY(crt_flush_directory) {
+    bool result = true;
+    
+#if !defined(_WIN32)
+    if(directory) {
+        result = (fsync(directory->descriptor) == 0);
+    }
+#endif
+    
+    return result;
+}
+
+static File_Handle
+crt_open_file_in_directory(Crt_Directory *directory, char *file_name, bool is_writing) {
+    File_Handle result = 0;
+    
+    if(directory && file_name) {
+        SPLITMERGE_PROBE1(crt_open_begin, file_name);
+        
+#if defined(_WIN32)
+        i32 name_length = 0;
+        
+        while(file_name[name_length]) {
+            name_length += 1;
+        }
+        
+        char *path = (char*)crt_alloc(directory->path_length + name_length + 1);
+        
+        For(i32, it_index, directory->path_length) {
+            path[it_index] = directory->path[it_index];
+        }
+        
+        For(i32, it_index, name_length) {
+            path[directory->path_length + it_index] = file_name[it_index];
+        }
+        
+        result = fopen(path, is_writing ? "wb" : "rb");
+        
+        crt_free(path);
+#else
+        int flags      = is_writing ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+        int descriptor = openat(directory->descriptor, file_name, flags, 0666);
+        
+        if(descriptor >= 0) {
+            result = fdopen(descriptor, is_writing ? "wb" : "rb");
+            
+            if(!result) {
+                close(descriptor);
+            }
+        }
+#endif
+        
+        SPLITMERGE_PROBE2(crt_open_end, file_name, result);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_READING(crt_open_file_in_directory_for_reading) {
+    return crt_open_file_in_directory(directory, file_name, false);
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_WRITING(crt_open_file_in_directory_for_writing) {
+    return crt_open_file_in_directory(directory, file_name, true);
+}
+
+//~ NOTE(Patrik): Only where posix_fadvise is there, it does nothing otherwise.
+static
+PLATFORM_ADVISE_SEQUENTIAL(crt_advise_sequential) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+    if(handle) {
+        posix_fadvise(fileno(handle), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+}
+
+//~ NOTE(Patrik): Dirty pages can not be dropped, so a written range is flushed
+// out of the FILE buffer and then written back before it is dropped.
+// sync_file_range only waits for the range itself and not for a journal
+// commit the way fdatasync would.
+static
+PLATFORM_DROP_CACHE(crt_drop_cache) {
+#if defined(POSIX_FADV_DONTNEED)
+    if(handle) {
+        int file_descriptor = fileno(handle);
+        
+        fflush(handle);
+        
+#  if defined(SYNC_FILE_RANGE_WRITE)
+        sync_file_range(file_descriptor, offset, length, (SYNC_FILE_RANGE_WAIT_BEFORE |
+                                                          SYNC_FILE_RANGE_WRITE |
+                                                          SYNC_FILE_RANGE_WAIT_AFTER));
+#  endif
+        
+        posix_fadvise(file_descriptor, offset, length, POSIX_FADV_DONTNEED);
+    }
+#endif
+}
+
 static
 PLATFORM_GET_SIZE_OF_FILE(crt_get_size_of_file) {
     i64 result = 0;
     
     if(handle) {
-        fpos_t current_offset = 0;
-        fpos_t end_offset     = 0;
-        fpos_t begin_offset   = 0;
+        i64 current_offset = 0;
+        i64 end_offset     = 0;
+        i64 begin_offset   = 0;
         
-        fgetpos(handle, &current_offset);
+        current_offset = crt_tell(handle);
         fseek(handle, 0, SEEK_SET);
-        fgetpos(handle, &begin_offset);
+        begin_offset = crt_tell(handle);
         fseek(handle, 0, SEEK_END);
-        fgetpos(handle, &end_offset);
+        end_offset = crt_tell(handle);
         
         result = end_offset - begin_offset;
         
-        fsetpos(handle, &current_offset);
+        crt_seek(handle, current_offset);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The C runtime on Windows has no file ids, st_ino is always 0.
+static
+PLATFORM_GET_FILE_IDENTITY(crt_get_file_identity) {
+    bool result = false;
+    
+#if !defined(_WIN32)
+    struct stat status;
+    
+    if(handle && fstat(fileno(handle), &status) == 0) {
+        identity->device  = (u64)status.st_dev;
+        identity->file_id = (u64)status.st_ino;
+        identity->size    = (i64)status.st_size;
+        
+#  if defined(__APPLE__)
+        identity->modify_time = (i64)status.st_mtimespec.tv_sec * 1000000000 + status.st_mtimespec.tv_nsec;
+#  else
+        identity->modify_time = (i64)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#  endif
+        
+        result = true;
     }
+#endif
     
     return result;
 }
@@ -210,21 +657,105 @@ PLATFORM_GET_REMAINING_SIZE_OF_FILE(crt_get_remaining_size_of_file) {
     i64 result = 0;
     
     if(handle) {
-        fpos_t current_offset = 0;
-        fpos_t end_offset     = 0;
+        i64 current_offset = 0;
+        i64 end_offset     = 0;
         
-        fgetpos(handle, &current_offset);
+        current_offset = crt_tell(handle);
         fseek(handle, 0, SEEK_END);
-        fgetpos(handle, &end_offset);
+        end_offset = crt_tell(handle);
         
         result = end_offset - current_offset;
         
-        fsetpos(handle, &current_offset);
+        crt_seek(handle, current_offset);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_SET_SIZE_OF_FILE(crt_set_size_of_file) {
+    bool result = false;
+    
+    if(handle) {
+        fflush(handle);
+        
+#if defined(_WIN32)
+        result = (_chsize_s(_fileno(handle), size) == 0);
+#else
+        result = (ftruncate(fileno(handle), size) == 0);
+#endif
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Only fallocate on Linux can, and only on some file systems.
+// It goes through syscall like ioprio_set, since the fallocate wrapper is only
+// declared with _GNU_SOURCE.
+static
+PLATFORM_COLLAPSE_FILE_RANGE(crt_collapse_file_range) {
+    bool result = false;
+    
+#if defined(__linux__) && defined(FALLOC_FL_COLLAPSE_RANGE) && defined(SYS_fallocate) && defined(__LP64__)
+    if(handle) {
+        fflush(handle);
+        
+        result = (syscall(SYS_fallocate, fileno(handle), FALLOC_FL_COLLAPSE_RANGE, offset, length) == 0);
+    }
+#endif
+    
+    return result;
+}
+
+//~ NOTE(Patrik): lseek moves the descriptor under the FILE, so the position
+// of the FILE is put back afterwards.
+static
+PLATFORM_GET_NEXT_DATA(crt_get_next_data) {
+    bool result = false;
+    
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    if(handle) {
+        int file_descriptor = fileno(handle);
+        i64 position        = crt_tell(handle);
+        
+        off_t start = lseek(file_descriptor, offset, SEEK_DATA);
+        
+        if(start >= 0) {
+            off_t end = lseek(file_descriptor, start, SEEK_HOLE);
+            
+            if(end >= start) {
+                *data_start = start;
+                *data_end   = end;
+                
+                result = true;
+            }
+        } else if(errno == ENXIO) {
+            off_t size = lseek(file_descriptor, 0, SEEK_END);
+            
+            if(size >= 0) {
+                *data_start = size;
+                *data_end   = size;
+                
+                result = true;
+            }
+        }
+        
+        crt_seek(handle, position);
     }
+#endif
     
     return result;
 }
 
+//~ NOTE(Patrik): Skipping past the end and writing makes a hole by itself on
+// the file systems that have them.
+static
+PLATFORM_SET_SPARSE(crt_set_sparse) {
+    (void)handle;
+    
+    return true;
+}
+
 static
 PLATFORM_GET_RANDOM_U64(crt_get_random_u64) {
     u64 result = 0;
@@ -252,3 +783,272 @@ PLATFORM_SET_RANDOM_SEED(crt_set_random_seed) {
     
     return result;
 }
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TIME
+//
+static
+PLATFORM_GET_TIME(crt_get_time) {
+    struct timespec time = {0};
+    
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &time);
+#else
+    timespec_get(&time, TIME_UTC);
+#endif
+    
+    return (i64)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+//~ NOTE(Patrik): The C runtime has no peak memory, so it is only filled in
+// where getrusage is there. clock() is wall time with the Microsoft CRT.
+static
+PLATFORM_GET_PROCESS_USAGE(crt_get_process_usage) {
+    Process_Usage result = {0};
+    
+#if defined(_WIN32)
+    result.user_time = (i64)clock() * (1000000000 / CLOCKS_PER_SEC);
+#else
+    struct rusage usage = {0};
+    
+    if(getrusage(RUSAGE_SELF, &usage) == 0) {
+        result.user_time   = (i64)usage.ru_utime.tv_sec * 1000000000 + (i64)usage.ru_utime.tv_usec * 1000;
+        result.system_time = (i64)usage.ru_stime.tv_sec * 1000000000 + (i64)usage.ru_stime.tv_usec * 1000;
+        
+#if defined(__APPLE__)
+        result.peak_memory = usage.ru_maxrss;
+#else
+        result.peak_memory = (i64)usage.ru_maxrss * 1024;
+#endif
+    }
+#endif
+    
+    return result;
+}
+
+static
+PLATFORM_SLEEP(crt_sleep) {
+    if(nanoseconds > 0) {
+        struct timespec duration = {0};
+        duration.tv_sec  = nanoseconds / 1000000000;
+        duration.tv_nsec = nanoseconds % 1000000000;
+        
+        thrd_sleep(&duration, 0);
+    }
+}
+
+//~ NOTE(Patrik): The lowest level of the best effort I/O class rather than the
+// idle class, since idle can starve a merge completely on a busy disk.
+// The priorities are inherited by threads that are started after this.
+static
+PLATFORM_ENTER_BACKGROUND_MODE(crt_enter_background_mode) {
+    bool result = false;
+    
+#if !defined(_WIN32)
+    if(setpriority(PRIO_PROCESS, 0, 19) == 0) {
+        result = true;
+    }
+    
+#  if defined(__linux__) && defined(SYS_ioprio_set)
+    i32 best_effort_class = 2;
+    i32 lowest_level      = 7;
+    
+    if(syscall(SYS_ioprio_set, 1, 0, (best_effort_class << 13) | lowest_level) != 0) {
+        result = false;
+    }
+#  endif
+#endif
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The C runtime on Windows can not tell the usage of another
+// process, so it is left at 0 there.
+static
+PLATFORM_RUN_PROCESS(crt_run_process) {
+    Process_Usage result = {0};
+    
+    //~ NOTE(Patrik): So what was printed so far comes before what the child prints.
+    fflush(stdout);
+    
+#if defined(_WIN32)
+    intptr_t status = _spawnv(_P_WAIT, program, (const char * const *)args);
+    
+    if(status == -1) {
+        return false;
+    }
+    
+    *exit_code = (i32)status;
+#else
+    pid_t pid = fork();
+    
+    if(pid < 0) {
+        return false;
+    }
+    
+    if(pid == 0) {
+        execv(program, args);
+        _exit(127);
+    }
+    
+    int           status      = 0;
+    struct rusage child_usage = {0};
+    
+    while(wait4(pid, &status, 0, &child_usage) < 0) {
+        if(errno != EINTR) {
+            return false;
+        }
+    }
+    
+    if(WIFEXITED(status)) {
+        *exit_code = WEXITSTATUS(status);
+    } else {
+        *exit_code = 128 + WTERMSIG(status);
+    }
+    
+    result.user_time   = (i64)child_usage.ru_utime.tv_sec * 1000000000 + (i64)child_usage.ru_utime.tv_usec * 1000;
+    result.system_time = (i64)child_usage.ru_stime.tv_sec * 1000000000 + (i64)child_usage.ru_stime.tv_usec * 1000;
+    
+#  if defined(__APPLE__)
+    result.peak_memory = child_usage.ru_maxrss;
+#  else
+    result.peak_memory = (i64)child_usage.ru_maxrss * 1024;
+#  endif
+#endif
+    
+    *usage = result;
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// THREAD
+//
+static int
+crt_thread_start(void *data) {
+    Crt_Thread *thread = (Crt_Thread*)data;
+    
+    thread->proc(thread->data);
+    
+    return 0;
+}
+
+static
+PLATFORM_CREATE_THREAD(crt_create_thread) {
+    Crt_Thread *result = (Crt_Thread*)crt_alloc(sizeof(Crt_Thread));
+    
+    result->proc = proc;
+    result->data = data;
+    
+    if(thrd_create(&result->thread, crt_thread_start, result) != thrd_success) {
+        crt_free(result);
+        result = 0;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_JOIN_THREAD(crt_join_thread) {
+    if(handle) {
+        thrd_join(handle->thread, 0);
+        crt_free(handle);
+    }
+}
+
+//~ NOTE(Patrik): C11 has no semaphore, so it is a count behind a mutex.
+static
+PLATFORM_CREATE_SEMAPHORE(crt_create_semaphore) {
+    Crt_Semaphore *result = (Crt_Semaphore*)crt_alloc(sizeof(Crt_Semaphore));
+    
+    mtx_init(&result->mutex, mtx_plain);
+    cnd_init(&result->condition);
+    
+    result->count = initial_count;
+    
+    return result;
+}
+
+static
+PLATFORM_WAIT_SEMAPHORE(crt_wait_semaphore) {
+    mtx_lock(&handle->mutex);
+    
+    while(handle->count == 0) {
+        cnd_wait(&handle->condition, &handle->mutex);
+    }
+    
+    handle->count -= 1;
+    
+    mtx_unlock(&handle->mutex);
+}
+
+static
+PLATFORM_SIGNAL_SEMAPHORE(crt_signal_semaphore) {
+    mtx_lock(&handle->mutex);
+    
+    handle->count += 1;
+    
+    cnd_signal(&handle->condition);
+    mtx_unlock(&handle->mutex);
+}
+
+static
+PLATFORM_FREE_SEMAPHORE(crt_free_semaphore) {
+    if(handle) {
+        cnd_destroy(&handle->condition);
+        mtx_destroy(&handle->mutex);
+        
+        crt_free(handle);
+    }
+}
+
+static
+PLATFORM_ATOMIC_ADD(crt_atomic_add) {
+#if defined(_WIN32)
+    return _InterlockedExchangeAdd64(value, amount);
+#else
+    return __atomic_fetch_add(value, amount, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static
+PLATFORM_GET_PROCESSOR_COUNT(crt_get_processor_count) {
+    i32 result = 1;
+    
+#if defined(_WIN32)
+    char *count = getenv("NUMBER_OF_PROCESSORS");
+    
+    if(count && atoi(count) > 0) {
+        result = atoi(count);
+    }
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    if(count > 0) {
+        result = (i32)count;
+    }
+#endif
+    
+    return result;
+}
+
+//~ NOTE(Patrik): With the Microsoft CRT the limit is on FILE streams, not on
+// the handles underneath.
+static
+PLATFORM_GET_MAX_OPEN_FILES(crt_get_max_open_files) {
+#if defined(_WIN32)
+    return _getmaxstdio();
+#else
+    struct rlimit limit = {0};
+    
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        return (i64)limit.rlim_cur;
+    }
+    
+    return 1024;
+#endif
+}
@@ -0,0 +1,1050 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MEMORY BACKEND
+//
+//~ NOTE(Patrik): Compile with SPLITMERGE_MEMORY to keep every file in memory
+// instead of on a disk, to measure what split and merge cost in CPU time
+// alone, and to see how they hold up when the I/O is slow or goes wrong.
+// Threads, time, allocation and random numbers come from the native backend,
+// which is included first with its handle types renamed so they do not
+// clash with the ones here.
+//
+// SPLITMERGE_MEMORY_OPTIONS in the environment sets how the files behave, as
+// a list like "latency=200,read-rate=500M,short-reads=0.01":
+//
+// latency      Microseconds every read, write and flush waits.
+// read-rate    Bytes per second reads are held to, with a K, M or G suffix.
+// write-rate   The same for writes.
+// capacity     Bytes of free room, writes past it are cut short like on a
+//              full disk. Files read in from the disk are already on it and
+//              do not take from the room, until they are deleted and give
+//              their room back.
+// short-reads  Chance from 0 to 1 that a read gives back less than it could.
+// torn-writes  Chance from 0 to 1 that a write stops part of the way, like
+//              an I/O error in the middle of it, and says how much it kept.
+// seed         Seed for the chances, so a run can be repeated.
+// save         A folder, files in it that were written are also written to
+//              the disk when they are closed, so another process can read
+//              them. It is how the benchmark hands chunks to merge.
+//
+// A file that is not in memory is read in from the disk the first time it is
+// opened for reading, so split can be given real files. Only the --stats
+// report, since measuring is what this is for, and files in the save folder
+// are written to the disk.
+//
+// One file is never read and written by two threads at the same time,
+// splitmerge does not do that, so only the table of files is locked.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// NATIVE BACKEND
+//
+#define File_Handle      Native_File_Handle
+#define Directory_Handle Native_Directory_Handle
+
+#if defined(SPLITMERGE_WIN32)
+#  include "win32_splitmerge.c"
+#  define native_is_handle_valid       win32_is_handle_valid
+#  define native_open_file_for_reading win32_open_file_for_reading
+#  define native_get_size_of_file      win32_get_size_of_file
+#  define native_read_file             win32_read_file
+#  define native_open_file_for_writing win32_open_file_for_writing
+#  define native_write_file            win32_write_file
+#  define native_close_file            win32_close_file
+#else
+#  include "crt_splitmerge.c"
+#  define native_is_handle_valid       crt_is_handle_valid
+#  define native_open_file_for_reading crt_open_file_for_reading
+#  define native_get_size_of_file      crt_get_size_of_file
+#  define native_read_file             crt_read_file
+#  define native_open_file_for_writing crt_open_file_for_writing
+#  define native_write_file            crt_write_file
+#  define native_close_file            crt_close_file
+#endif
+
+#undef File_Handle
+#undef Directory_Handle
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PLATFORM API
+//
+#undef os_is_handle_valid
+#undef os_close_file
+#undef os_open_file_for_reading
+#undef os_open_file_for_writing
+#undef os_open_file_for_updating
+#undef os_move_file_pointer
+#undef os_set_file_pointer
+#undef os_read_file
+#undef os_write_file
+#undef os_create_directory
+#undef os_delete_file
+#undef os_delete_directory
+#undef os_move_file
+#undef os_open_directory
+#undef os_close_directory
+#undef os_open_file_in_directory_for_reading
+#undef os_open_file_in_directory_for_writing
+#undef os_flush_file
+#undef os_begin_flush_file
+#undef os_flush_directory
+#undef os_advise_sequential
+#undef os_drop_cache
+#undef os_get_size_of_file
+#undef os_get_remaining_size_of_file
+#undef os_get_file_identity
+#undef os_set_size_of_file
+#undef os_collapse_file_range
+#undef os_get_next_data
+#undef os_set_sparse
+
+#define os_is_handle_valid mem_is_handle_valid
+#define os_close_file mem_close_file
+#define os_open_file_for_reading mem_open_file_for_reading
+#define os_open_file_for_writing mem_open_file_for_writing
+#define os_open_file_for_updating mem_open_file_for_updating
+#define os_move_file_pointer mem_move_file_pointer
+#define os_set_file_pointer mem_set_file_pointer
+#define os_read_file mem_read_file
+#define os_write_file mem_write_file
+
+#define os_create_directory mem_create_directory
+#define os_delete_file mem_delete_file
+#define os_delete_directory mem_delete_directory
+#define os_move_file mem_move_file
+
+#define os_open_directory mem_open_directory
+#define os_close_directory mem_close_directory
+#define os_open_file_in_directory_for_reading mem_open_file_in_directory_for_reading
+#define os_open_file_in_directory_for_writing mem_open_file_in_directory_for_writing
+
+#define os_flush_file mem_flush_file
+#define os_begin_flush_file mem_begin_flush_file
+#define os_flush_directory mem_flush_directory
+
+#define os_advise_sequential mem_advise_sequential
+#define os_drop_cache mem_drop_cache
+
+#define os_get_size_of_file mem_get_size_of_file
+#define os_get_remaining_size_of_file mem_get_remaining_size_of_file
+#define os_get_file_identity mem_get_file_identity
+#define os_set_size_of_file mem_set_size_of_file
+#define os_collapse_file_range mem_collapse_file_range
+
+#define os_get_next_data mem_get_next_data
+#define os_set_sparse mem_set_sparse
+
+#undef SPLITMERGE_BACKEND_NAME
+#define SPLITMERGE_BACKEND_NAME "memory"
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef struct Mem_File {
+    char            *name;
+    u8              *data;
+    i64              length;
+    i64              capacity;
+    u64              file_id;
+    i64              modify_time;
+    i32              open_count;
+    bool             is_deleted;
+    struct Mem_File *next;
+} Mem_File;
+
+typedef struct Mem_Handle {
+    Mem_File *file;
+    i64       offset;
+    bool      is_writable;
+} Mem_Handle;
+
+typedef Mem_Handle * File_Handle;
+
+//~ NOTE(Patrik): Folders are not kept track of, a file is just known by its
+// whole path, so a directory is only the path to put in front of the name.
+// path ends with a separator.
+typedef struct Mem_Directory {
+    i32  path_length;
+    char path[1];
+} Mem_Directory;
+
+typedef Mem_Directory * Directory_Handle;
+
+typedef struct Mem_Options {
+    i64    latency;
+    i64    read_rate;
+    i64    write_rate;
+    i64    capacity;
+    double short_read_chance;
+    double torn_write_chance;
+    u64    seed;
+    char  *save_path;
+    i32    save_path_length;
+} Mem_Options;
+
+#define MEM_BUCKET_COUNT 4096
+
+typedef struct Mem_State {
+    Mem_Options      options;
+    Mem_File        *buckets[MEM_BUCKET_COUNT];
+    i64              used_size;
+    i64              loaded_size;
+    u64              next_file_id;
+    i64              next_modify_time;
+    u64              random_state;
+    Semaphore_Handle lock;
+    bool             is_initialized;
+} Mem_State;
+
+static Mem_State global_mem_state;
+
+typedef enum Mem_Open_Mode {
+    Mem_Open_Mode__Read,
+    Mem_Open_Mode__Write,
+    Mem_Open_Mode__Update,
+} Mem_Open_Mode;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// OPTIONS
+//
+//~ NOTE(Patrik): Takes the value after the '=' and a K, M or G suffix.
+static double
+mem_parse_value(char *value) {
+    char   *end    = value;
+    double  result = strtod(value, &end);
+    
+    if(*end == 'K' || *end == 'k') {
+        result *= 1024.0;
+    } else if(*end == 'M' || *end == 'm') {
+        result *= 1024.0 * 1024.0;
+    } else if(*end == 'G' || *end == 'g') {
+        result *= 1024.0 * 1024.0 * 1024.0;
+    }
+    
+    return result;
+}
+
+static void
+mem_parse_options(Mem_Options *options, char *text) {
+    while(text && *text) {
+        while(*text == ',' || *text == ' ') {
+            text += 1;
+        }
+        
+        char *key    = text;
+        char *equals = 0;
+        
+        while(*text && *text != ',' && *text != ' ') {
+            if(*text == '=' && !equals) {
+                equals = text;
+            }
+            
+            text += 1;
+        }
+        
+        if(!equals) {
+            continue;
+        }
+        
+        i64    key_length = equals - key;
+        double value      = mem_parse_value(equals + 1);
+        
+        if(key_length == 7 && strncmp(key, "latency", 7) == 0) {
+            options->latency = (i64)(value * 1000.0);
+        } else if(key_length == 9 && strncmp(key, "read-rate", 9) == 0) {
+            options->read_rate = (i64)value;
+        } else if(key_length == 10 && strncmp(key, "write-rate", 10) == 0) {
+            options->write_rate = (i64)value;
+        } else if(key_length == 8 && strncmp(key, "capacity", 8) == 0) {
+            options->capacity = (i64)value;
+        } else if(key_length == 11 && strncmp(key, "short-reads", 11) == 0) {
+            options->short_read_chance = value;
+        } else if(key_length == 11 && strncmp(key, "torn-writes", 11) == 0) {
+            options->torn_write_chance = value;
+        } else if(key_length == 4 && strncmp(key, "seed", 4) == 0) {
+            options->seed = (u64)value;
+        } else if(key_length == 4 && strncmp(key, "save", 4) == 0) {
+            options->save_path        = equals + 1;
+            options->save_path_length = (i32)(text - (equals + 1));
+        } else {
+            printf("Unknown memory backend option: %.*s\n", (int)key_length, key);
+        }
+    }
+}
+
+//~ NOTE(Patrik): The first call is from main before any thread is started,
+// so setting it up does not need a lock.
+static Mem_State *
+mem_get_state() {
+    Mem_State *state = &global_mem_state;
+    
+    if(!state->is_initialized) {
+        mem_parse_options(&state->options, getenv("SPLITMERGE_MEMORY_OPTIONS"));
+        
+        state->random_state   = state->options.seed ? state->options.seed : 0x9E3779B97F4A7C15;
+        state->lock           = os_create_semaphore(1);
+        state->is_initialized = true;
+    }
+    
+    return state;
+}
+
+static bool
+mem_roll_chance(Mem_State *state, double chance) {
+    bool result = false;
+    
+    if(chance > 0.0) {
+        os_wait_semaphore(state->lock);
+        u64 value = os_get_random_u64(&state->random_state);
+        os_signal_semaphore(state->lock);
+        
+        result = ((double)(value >> 11) * (1.0 / 9007199254740992.0) < chance);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Returns a number from 0 to count - 1.
+static i64
+mem_roll_below(Mem_State *state, i64 count) {
+    os_wait_semaphore(state->lock);
+    u64 value = os_get_random_u64(&state->random_state);
+    os_signal_semaphore(state->lock);
+    
+    return (i64)(value % (u64)count);
+}
+
+//~ NOTE(Patrik): Waits as long as the call would have taken on the disk.
+static void
+mem_wait(Mem_State *state, i64 length, i64 rate) {
+    i64 nanoseconds = state->options.latency;
+    
+    if(rate > 0 && length > 0) {
+        nanoseconds += (i64)((double)length * 1000000000.0 / (double)rate);
+    }
+    
+    if(nanoseconds > 0) {
+        os_sleep(nanoseconds);
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// FILE TABLE
+//
+//~ NOTE(Patrik): '\\' and '/' are the same, the paths are made with both.
+static u64
+mem_hash_name(char *name) {
+    u64 result = 0xCBF29CE484222325;
+    
+    for(char *it = name; *it; it += 1) {
+        char c = (*it == '\\') ? '/' : *it;
+        
+        result ^= (u8)c;
+        result *= 0x100000001B3;
+    }
+    
+    return result;
+}
+
+static bool
+mem_are_names_equal(char *a, char *b) {
+    for(;;) {
+        char c_a = (*a == '\\') ? '/' : *a;
+        char c_b = (*b == '\\') ? '/' : *b;
+        
+        if(c_a != c_b) {
+            return false;
+        }
+        
+        if(c_a == 0) {
+            return true;
+        }
+        
+        a += 1;
+        b += 1;
+    }
+}
+
+//~ NOTE(Patrik): Only with the lock held.
+static Mem_File **
+mem_find_file_slot(Mem_State *state, char *name) {
+    Mem_File **slot = &state->buckets[mem_hash_name(name) % MEM_BUCKET_COUNT];
+    
+    while(*slot && !mem_are_names_equal((*slot)->name, name)) {
+        slot = &(*slot)->next;
+    }
+    
+    return slot;
+}
+
+static char *
+mem_copy_name(char *name) {
+    i64   length = strlen(name);
+    char *result = (char*)os_alloc(length + 1);
+    
+    memcpy(result, name, length);
+    
+    return result;
+}
+
+static void
+mem_free_file(Mem_File *file) {
+    if(file->data) {
+        os_free(file->data);
+    }
+    
+    os_free(file->name);
+    os_free(file);
+}
+
+//~ NOTE(Patrik): Only with the lock held. A file that is still open is freed
+// when the last handle to it is closed.
+static void
+mem_unlink_file(Mem_State *state, Mem_File **slot) {
+    Mem_File *file = *slot;
+    
+    *slot = file->next;
+    
+    state->used_size -= file->length;
+    
+    if(file->open_count > 0) {
+        file->is_deleted = true;
+    } else {
+        mem_free_file(file);
+    }
+}
+
+//~ NOTE(Patrik): Only with the lock held. The room left counts the files read
+// in from the disk as already there.
+static i64
+mem_get_free_size(Mem_State *state) {
+    return state->options.capacity + state->loaded_size - state->used_size;
+}
+
+//~ NOTE(Patrik): Only with the lock held. Grows or cuts the file to length,
+// a grown part is zero. Returns false if it does not fit in the capacity.
+static bool
+mem_resize_file(Mem_State *state, Mem_File *file, i64 length) {
+    i64 growth = length - file->length;
+    
+    if(state->options.capacity > 0 && growth > 0 && growth > mem_get_free_size(state)) {
+        return false;
+    }
+    
+    if(length > file->capacity) {
+        i64 capacity = (file->capacity > 0) ? file->capacity : 4096;
+        
+        while(capacity < length) {
+            capacity *= 2;
+        }
+        
+        if(file->data) {
+            file->data = (u8*)os_realloc(file->data, capacity);
+        } else {
+            file->data = (u8*)os_alloc(capacity);
+        }
+        
+        file->capacity = capacity;
+    }
+    
+    if(growth > 0) {
+        memset(file->data + file->length, 0, growth);
+    }
+    
+    state->used_size        += growth;
+    state->next_modify_time += 1;
+    
+    file->length      = length;
+    file->modify_time = state->next_modify_time;
+    
+    return true;
+}
+
+//~ NOTE(Patrik): Only with the lock held.
+static Mem_File *
+mem_add_file(Mem_State *state, Mem_File **slot, char *name) {
+    Mem_File *result = (Mem_File*)os_alloc(sizeof(Mem_File));
+    
+    state->next_file_id += 1;
+    
+    result->name    = mem_copy_name(name);
+    result->file_id = state->next_file_id;
+    
+    *slot = result;
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Only with the lock held. Returns 0 if there is no such file
+// on the disk either.
+static Mem_File *
+mem_load_file(Mem_State *state, Mem_File **slot, char *name) {
+    Mem_File *result = 0;
+    
+    Native_File_Handle handle = native_open_file_for_reading(name);
+    
+    if(native_is_handle_valid(handle)) {
+        i64       size = native_get_size_of_file(handle);
+        Mem_File *file = mem_add_file(state, slot, name);
+        
+        state->loaded_size += size;
+        
+        mem_resize_file(state, file, size);
+        
+        File_Data data = {0};
+        data.data     = file->data;
+        data.capacity = size;
+        
+        while(data.length < size && native_read_file(&data, handle, size - data.length) > 0);
+        
+        native_close_file(handle);
+        
+        result = file;
+    }
+    
+    return result;
+}
+
+static File_Handle
+mem_open_file(char *file_name, Mem_Open_Mode mode) {
+    File_Handle result = 0;
+    
+    if(file_name) {
+        Mem_State *state = mem_get_state();
+        
+        os_wait_semaphore(state->lock);
+        
+        Mem_File **slot = mem_find_file_slot(state, file_name);
+        Mem_File  *file = *slot;
+        
+        if(!file && mode == Mem_Open_Mode__Read) {
+            file = mem_load_file(state, slot, file_name);
+        } else if(!file) {
+            file = mem_add_file(state, slot, file_name);
+        } else if(mode == Mem_Open_Mode__Write) {
+            mem_resize_file(state, file, 0);
+        }
+        
+        if(file) {
+            result = (Mem_Handle*)os_alloc(sizeof(Mem_Handle));
+            
+            result->file        = file;
+            result->is_writable = (mode != Mem_Open_Mode__Read);
+            
+            file->open_count += 1;
+        }
+        
+        os_signal_semaphore(state->lock);
+        
+        mem_wait(state, 0, 0);
+    }
+    
+    return result;
+}
+
+
+//~ NOTE(Patrik): '\\' and '/' are the same here too.
+static bool
+mem_is_file_saved(Mem_State *state, Mem_File *file) {
+    char *path = state->options.save_path;
+    
+    if(!path || state->options.save_path_length <= 0) {
+        return false;
+    }
+    
+    For(i32, it_index, state->options.save_path_length) {
+        char c_path = (path[it_index] == '\\') ? '/' : path[it_index];
+        char c_name = (file->name[it_index] == '\\') ? '/' : file->name[it_index];
+        
+        if(c_path != c_name) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+static void
+mem_save_file(Mem_File *file) {
+    Native_File_Handle handle = native_open_file_for_writing(file->name);
+    
+    if(native_is_handle_valid(handle)) {
+        native_write_file(handle, file->data, file->length);
+        native_close_file(handle);
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// FILE
+//
+static
+PLATFORM_IS_HANDLE_VALID(mem_is_handle_valid) {
+    if(handle) {
+        return true;
+    }
+    return false;
+}
+
+static
+PLATFORM_CLOSE_FILE(mem_close_file) {
+    if(handle) {
+        Mem_State *state = mem_get_state();
+        Mem_File  *file  = handle->file;
+        
+        if(handle->is_writable && mem_is_file_saved(state, file)) {
+            mem_save_file(file);
+        }
+        
+        os_wait_semaphore(state->lock);
+        
+        file->open_count -= 1;
+        
+        if(file->is_deleted && file->open_count == 0) {
+            mem_free_file(file);
+        }
+        
+        os_signal_semaphore(state->lock);
+        
+        os_free(handle);
+    }
+}
+
+static
+PLATFORM_OPEN_FILE_FOR_READING(mem_open_file_for_reading) {
+    return mem_open_file(file_name, Mem_Open_Mode__Read);
+}
+
+static
+PLATFORM_OPEN_FILE_FOR_WRITING(mem_open_file_for_writing) {
+    return mem_open_file(file_name, Mem_Open_Mode__Write);
+}
+
+static
+PLATFORM_OPEN_FILE_FOR_UPDATING(mem_open_file_for_updating) {
+    return mem_open_file(file_name, Mem_Open_Mode__Update);
+}
+
+static
+PLATFORM_MOVE_FILE_POINTER(mem_move_file_pointer) {
+    if(handle && handle->offset + desired_offset >= 0) {
+        handle->offset += desired_offset;
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_SET_FILE_POINTER(mem_set_file_pointer) {
+    if(handle && desired_offset >= 0) {
+        handle->offset = desired_offset;
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_READ_FILE(mem_read_file) {
+    i64 result = 0;
+    
+    if(file && handle) {
+        Mem_State *state = mem_get_state();
+        Mem_File  *data  = handle->file;
+        
+        if(read_amount > file->capacity - file->length) {
+            read_amount = file->capacity - file->length;
+        }
+        
+        result = data->length - handle->offset;
+        
+        if(result > read_amount) {
+            result = read_amount;
+        }
+        
+        if(result < 0) {
+            result = 0;
+        }
+        
+        if(result > 1 && mem_roll_chance(state, state->options.short_read_chance)) {
+            result = 1 + mem_roll_below(state, result - 1);
+        }
+        
+        memcpy(file->data + file->length, data->data + handle->offset, result);
+        
+        file->length   += result;
+        handle->offset += result;
+        
+        mem_wait(state, result, state->options.read_rate);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): A torn write only keeps a part, like an I/O error in the
+// middle of it would, and a write past the capacity is cut short like on a
+// full disk. Both say how much was kept.
+static
+PLATFORM_WRITE_FILE(mem_write_file) {
+    i64 result = 0;
+    
+    if(handle && handle->is_writable && length > 0) {
+        Mem_State *state = mem_get_state();
+        Mem_File  *file  = handle->file;
+        
+        i64 kept_length = length;
+        
+        if(mem_roll_chance(state, state->options.torn_write_chance)) {
+            kept_length = mem_roll_below(state, length);
+        }
+        
+        os_wait_semaphore(state->lock);
+        
+        i64 end = handle->offset + kept_length;
+        
+        if(end > file->length && !mem_resize_file(state, file, end)) {
+            end = file->length + mem_get_free_size(state);
+            
+            if(end < handle->offset) {
+                end = handle->offset;
+            }
+            
+            mem_resize_file(state, file, end);
+            
+            kept_length = end - handle->offset;
+        }
+        
+        state->next_modify_time += 1;
+        file->modify_time        = state->next_modify_time;
+        
+        os_signal_semaphore(state->lock);
+        
+        memcpy(file->data + handle->offset, data, kept_length);
+        
+        handle->offset += kept_length;
+        result          = kept_length;
+        
+        mem_wait(state, result, state->options.write_rate);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Folders are not kept track of, so every folder already exists.
+// Failing on a null name would only teach the compiler that the name is null
+// whenever this fails, which it then warns about in every caller.
+static
+PLATFORM_CREATE_DIRECTORY(mem_create_directory) {
+    (void)directory_name;
+    
+    return true;
+}
+
+static
+PLATFORM_DELETE_FILE(mem_delete_file) {
+    bool result = false;
+    
+    if(file_name) {
+        Mem_State *state = mem_get_state();
+        
+        os_wait_semaphore(state->lock);
+        
+        Mem_File **slot = mem_find_file_slot(state, file_name);
+        
+        if(*slot) {
+            mem_unlink_file(state, slot);
+            result = true;
+        }
+        
+        os_signal_semaphore(state->lock);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_DELETE_DIRECTORY(mem_delete_directory) {
+    (void)directory_name;
+    
+    return true;
+}
+
+static
+PLATFORM_MOVE_FILE(mem_move_file) {
+    bool result = false;
+    
+    if(old_name && new_name) {
+        Mem_State *state = mem_get_state();
+        
+        os_wait_semaphore(state->lock);
+        
+        Mem_File **old_slot = mem_find_file_slot(state, old_name);
+        Mem_File  *file     = *old_slot;
+        
+        if(file) {
+            *old_slot = file->next;
+            
+            Mem_File **new_slot = mem_find_file_slot(state, new_name);
+            
+            if(*new_slot) {
+                mem_unlink_file(state, new_slot);
+            }
+            
+            os_free(file->name);
+            
+            file->name = mem_copy_name(new_name);
+            file->next = 0;
+            
+            *mem_find_file_slot(state, new_name) = file;
+            
+            result = true;
+        }
+        
+        os_signal_semaphore(state->lock);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_FLUSH_FILE(mem_flush_file) {
+    if(handle) {
+        mem_wait(mem_get_state(), 0, 0);
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_BEGIN_FLUSH_FILE(mem_begin_flush_file) {
+}
+
+static
+PLATFORM_OPEN_DIRECTORY(mem_open_directory) {
+    Mem_Directory *result = 0;
+    
+    if(directory_name) {
+        i64 length = strlen(directory_name);
+        
+        result = (Mem_Directory*)os_alloc(sizeof(Mem_Directory) + length + 1);
+        
+        For(i64, it_index, length) {
+            result->path[it_index] = directory_name[it_index];
+        }
+        
+        if(length > 0 && directory_name[length - 1] != '/' && directory_name[length - 1] != '\\') {
+            result->path[length] = '/';
+            length += 1;
+        }
+        
+        result->path_length = (i32)length;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_CLOSE_DIRECTORY(mem_close_directory) {
+    if(directory) {
+        os_free(directory);
+    }
+}
+
+static
+PLATFORM_FLUSH_DIRECTORY(mem_flush_directory) {
+    return true;
+}
+
+static File_Handle
+mem_open_file_in_directory(Mem_Directory *directory, char *file_name, Mem_Open_Mode mode) {
+    File_Handle result = 0;
+    
+    if(directory && file_name) {
+        i64   name_length = strlen(file_name);
+        char *path        = (char*)os_alloc(directory->path_length + name_length + 1);
+        
+        memcpy(path, directory->path, directory->path_length);
+        memcpy(path + directory->path_length, file_name, name_length);
+        
+        result = mem_open_file(path, mode);
+        
+        os_free(path);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_READING(mem_open_file_in_directory_for_reading) {
+    return mem_open_file_in_directory(directory, file_name, Mem_Open_Mode__Read);
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_WRITING(mem_open_file_in_directory_for_writing) {
+    return mem_open_file_in_directory(directory, file_name, Mem_Open_Mode__Write);
+}
+
+static
+PLATFORM_ADVISE_SEQUENTIAL(mem_advise_sequential) {
+}
+
+static
+PLATFORM_DROP_CACHE(mem_drop_cache) {
+}
+
+static
+PLATFORM_GET_SIZE_OF_FILE(mem_get_size_of_file) {
+    if(handle) {
+        return handle->file->length;
+    }
+    
+    return 0;
+}
+
+static
+PLATFORM_GET_FILE_IDENTITY(mem_get_file_identity) {
+    if(handle) {
+        identity->device      = 0;
+        identity->file_id     = handle->file->file_id;
+        identity->size        = handle->file->length;
+        identity->modify_time = handle->file->modify_time;
+        
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_GET_REMAINING_SIZE_OF_FILE(mem_get_remaining_size_of_file) {
+    i64 result = 0;
+    
+    if(handle && handle->file->length > handle->offset) {
+        result = handle->file->length - handle->offset;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_SET_SIZE_OF_FILE(mem_set_size_of_file) {
+    bool result = false;
+    
+    if(handle && handle->is_writable && size >= 0) {
+        Mem_State *state = mem_get_state();
+        
+        os_wait_semaphore(state->lock);
+        result = mem_resize_file(state, handle->file, size);
+        os_signal_semaphore(state->lock);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Acts like a file system with 4KB blocks, so only whole
+// blocks can be cut out and the same calls fail here as on a disk.
+#define MEM_BLOCK_SIZE 4096
+
+static
+PLATFORM_COLLAPSE_FILE_RANGE(mem_collapse_file_range) {
+    bool result = false;
+    
+    if(handle && handle->is_writable && offset >= 0 && length > 0 &&
+       offset % MEM_BLOCK_SIZE == 0 && length % MEM_BLOCK_SIZE == 0)
+    {
+        Mem_State *state = mem_get_state();
+        Mem_File  *file  = handle->file;
+        
+        os_wait_semaphore(state->lock);
+        
+        if(offset + length < file->length) {
+            memmove(file->data + offset, file->data + offset + length, file->length - offset - length);
+            
+            result = mem_resize_file(state, file, file->length - length);
+        }
+        
+        os_signal_semaphore(state->lock);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The files have no holes, a hole is written out as zeros.
+static
+PLATFORM_GET_NEXT_DATA(mem_get_next_data) {
+    return false;
+}
+
+static
+PLATFORM_SET_SPARSE(mem_set_sparse) {
+    if(handle) {
+        return true;
+    }
+    
+    return false;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// STATS
+//
+//~ NOTE(Patrik): Used by write_stats_file instead of the os_ calls, a report
+// kept in memory would be gone when the process exits.
+static bool
+mem_write_stats_report(char *file_name, u8 *data, i64 length) {
+    bool result = false;
+    
+    Native_File_Handle handle = native_open_file_for_writing(file_name);
+    
+    if(native_is_handle_valid(handle)) {
+        result = (native_write_file(handle, data, length) == length);
+        
+        native_close_file(handle);
+    }
+    
+    return result;
+}
+
+#define write_stats_report mem_write_stats_report
@@ -29,7 +29,9 @@
 //
 #include "splitmerge.h"
 
-#if defined(SPLITMERGE_WIN32)
+#if defined(SPLITMERGE_MEMORY)
+#  include "mem_splitmerge.c"
+#elif defined(SPLITMERGE_WIN32)
 #  include "win32_splitmerge.c"
 #else
 #  include "crt_splitmerge.c"
@@ -65,6 +67,48 @@ make_file_data(i64 capacity) {
     return result;
 }
 
+static void
+maybe_grow_file_data(File_Data *file, i64 new_length) {
+    if(file) {
+        if(new_length > file->capacity) {
+            while(new_length > file->capacity) {
+                file->capacity *= 2;
+            }
+            
+            file->data = SPLTMRG_REALLOC(u8, file->data, file->capacity);
+        }
+    }
+}
+
+static void
+zero_memory(u8 *dest, i64 length) {
+    For(i64, it_index, length) {
+        dest[it_index] = 0;
+    }
+}
+
+//~ NOTE(Patrik): Copies forward, so it is safe to use when dest is before source.
+static void
+copy_memory(u8 *dest, u8 *source, i64 length) {
+    For(i64, it_index, length) {
+        dest[it_index] = source[it_index];
+    }
+}
+
+static void
+append_file_data(File_Data *file, u8 *data, i64 length) {
+    if(file) {
+        if(length >= file->capacity - file->length) {
+            length = file->capacity - file->length;
+        }
+        
+        For(i64, it_index, length) {
+            file->data[file->length] = data[it_index];
+            file->length += 1;
+        }
+    }
+}
+
 
 //~~~~~~~~~~~~~~~~
 //
@@ -164,6 +208,24 @@ begins_with_ntstring(String a, char *b) {
     return begins_with_cstring(a, b, get_length_of_ntstring(b));
 }
 
+static bool
+are_cstrings_equal(String a, char *b_data, i32 b_length) {
+    if(a.length == b_length) {
+        return begins_with_cstring(a, b_data, b_length);
+    }
+    return false;
+}
+
+static bool
+are_strings_equal(String a, String b) {
+    return are_cstrings_equal(a, b.data, b.length);
+}
+
+static bool
+is_equal_to_ntstring(String a, char *b) {
+    return are_cstrings_equal(a, b, get_length_of_ntstring(b));
+}
+
 static bool
 ends_with_char(String a, char b) {
     if(a.data && a.data[a.length - 1] == b) {
@@ -195,6 +257,68 @@ ends_with_ntstring(String a, char *b) {
     return ends_with_cstring(a, b, get_length_of_ntstring(b));
 }
 
+//~ NOTE(Patrik): Parses a decimal number, the whole string has to be digits
+// and it has to fit in a u64.
+static bool
+parse_u64(String str, u64 *value) {
+    bool result = false;
+    
+    if(str.data && str.length > 0 && value) {
+        *value = 0;
+        result = true;
+        
+        For(i32, it_index, str.length) {
+            char c = str.data[it_index];
+            
+            if(c < '0' || c > '9') {
+                result = false;
+                break;
+            }
+            
+            u64 digit = (u64)(c - '0');
+            
+            if(*value > (0xFFFFFFFFFFFFFFFF - digit) / 10) {
+                result = false;
+                break;
+            }
+            
+            *value = *value * 10 + digit;
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Accepts a plain byte count or one with a K, M, G or T suffix.
+// Sizes are i64 everywhere else, so anything bigger than that is rejected.
+static bool
+parse_size(String str, u64 *value) {
+    u64 scale = 1;
+    
+    if(str.length > 0) {
+        switch(str.data[str.length - 1]) {
+            case 'K': case 'k': scale = (u64)1 << 10; break;
+            case 'M': case 'm': scale = (u64)1 << 20; break;
+            case 'G': case 'g': scale = (u64)1 << 30; break;
+            case 'T': case 't': scale = (u64)1 << 40; break;
+        }
+    }
+    
+    if(scale > 1) {
+        str.length -= 1;
+    }
+    
+    bool result = parse_u64(str, value);
+    
+    if(result && *value > 0x7FFFFFFFFFFFFFFF / scale) {
+        result = false;
+    }
+    
+    *value *= scale;
+    
+    return result;
+}
+
 static void
 advance_string(String *str, i32 amount) {
     if(str) {
@@ -400,3 +524,351 @@ static void
 append_u64(String *str, u64 value, i32 base) {
     append_bits(str, value, base, false);
 }
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CACHE
+//
+//~ NOTE(Patrik): Files are streamed through once, so what was read or written
+// is dropped from the page cache right away instead of pushing out the data of
+// everything else on the machine. --keep-cache turns it off, for when the
+// output is about to be read again, like merging right after splitting.
+static bool global_should_drop_cache = true;
+
+static void
+drop_streamed_range(File_Handle handle, i64 offset, i64 length) {
+    if(global_should_drop_cache && length > 0) {
+        os_drop_cache(handle, offset, length);
+    }
+}
+
+//~ NOTE(Patrik): For files that are read whole, after the last read.
+static void
+drop_streamed_file(File_Handle handle) {
+    if(global_should_drop_cache) {
+        os_drop_cache(handle, 0, 0);
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MEMORY BUDGET
+//
+//~ NOTE(Patrik): Set by --max-memory, 0 is no limit. With a limit the chunks
+// are never held in memory whole, they go through slices of a quarter of it,
+// which leaves the rest for the buffers that do not grow with the chunk size.
+// The smallest limit still fits a whole first header in a slice.
+#define MIN_MAX_MEMORY (1024 * 1024)
+
+static i64 global_max_memory = 0;
+
+//~ NOTE(Patrik): Returns size, or less if a buffer of size would not fit.
+// A smaller size is kept to whole 4KB blocks.
+static i64
+get_slice_size(i64 size) {
+    i64 max_size = global_max_memory / 4;
+    
+    max_size -= max_size % 4096;
+    
+    if(global_max_memory > 0 && size > max_size) {
+        size = max_size;
+    }
+    
+    return size;
+}
+
+//~~~~~~~~~~~~~~~~
+//
+// DIRECTORY
+//
+//~ NOTE(Patrik): With --fan-out the chunks are spread over subfolders named
+// 00 to FF, so no single folder ends up with hundreds of thousands of files.
+#define FAN_OUT_FOLDER_COUNT 256
+
+//~ NOTE(Patrik): The id is mixed in so chunk n of every bundle does not go to
+// the same subfolder.
+static u32
+get_fan_out_folder(u32 unique_id, u16 file_index) {
+    u32 result = unique_id ^ ((u32)file_index * 0x9E3779B1);
+    
+    result ^= result >> 16;
+    result *= 0x85EBCA6B;
+    result ^= result >> 13;
+    
+    return result % FAN_OUT_FOLDER_COUNT;
+}
+
+static void
+append_fan_out_folder(String *str, u32 unique_id, u16 file_index) {
+    u32 folder = get_fan_out_folder(unique_id, file_index);
+    
+    append_char(str, digit_value_to_char(folder / 16));
+    append_char(str, digit_value_to_char(folder % 16));
+    append_char(str, '/');
+}
+
+//~ NOTE(Patrik): Folders that are kept open so the files in them are opened
+// relative to the folder instead of by their whole path. A folder that could
+// not be opened is kept as 0 so it is not tried again. Every thread that opens
+// files needs a cache of its own.
+typedef struct Directory_Cache {
+    String           *paths;
+    Directory_Handle *handles;
+    i32               count;
+    i32               capacity;
+} Directory_Cache;
+
+//~ NOTE(Patrik): Returns the length of the folder part of file_name, with the
+// separator, or 0 if it is only a name.
+static i32
+get_folder_length(String file_name) {
+    i32 result = find_index_of_last(file_name, '/');
+    i32 index  = find_index_of_last(file_name, '\\');
+    
+    if(result < index) {
+        result = index;
+    }
+    
+    return result + 1;
+}
+
+static Directory_Handle
+get_cached_directory(Directory_Cache *cache, String folder, bool should_create) {
+    For(i32, it_index, cache->count) {
+        if(are_strings_equal(cache->paths[it_index], folder)) {
+            return cache->handles[it_index];
+        }
+    }
+    
+    if(cache->count == cache->capacity) {
+        cache->capacity += 64;
+        
+        if(cache->paths) {
+            cache->paths   = SPLTMRG_REALLOC(String, cache->paths, cache->capacity);
+            cache->handles = SPLTMRG_REALLOC(Directory_Handle, cache->handles, cache->capacity);
+        } else {
+            cache->paths   = SPLTMRG_ALLOC(String, cache->capacity);
+            cache->handles = SPLTMRG_ALLOC(Directory_Handle, cache->capacity);
+        }
+    }
+    
+    String path = make_string(folder.length + 1);
+    
+    append_string(&path, folder);
+    null_terminate(&path);
+    
+    if(should_create) {
+        os_create_directory(path.data);
+    }
+    
+    Directory_Handle result = os_open_directory(path.data);
+    
+    cache->paths[cache->count]   = path;
+    cache->handles[cache->count] = result;
+    cache->count += 1;
+    
+    return result;
+}
+
+static void
+free_directory_cache(Directory_Cache *cache) {
+    For(i32, it_index, cache->count) {
+        if(cache->handles[it_index]) {
+            os_close_directory(cache->handles[it_index]);
+        }
+        
+        SPLTMRG_FREE(cache->paths[it_index].data);
+    }
+    
+    if(cache->paths) {
+        SPLTMRG_FREE(cache->paths);
+        SPLTMRG_FREE(cache->handles);
+    }
+    
+    cache->paths    = 0;
+    cache->handles  = 0;
+    cache->count    = 0;
+    cache->capacity = 0;
+}
+
+//~~~~~~~~~~~~~~~~
+//
+// THREAD
+//
+//~ NOTE(Patrik): Runs proc on thread_count threads and waits for all of them.
+// proc has to pull its own work, so if only some of the threads could be
+// started they still get through all of it, and if none could be started
+// proc is run on this thread instead.
+static void
+run_on_threads(Thread_Proc *proc, void *data, i32 thread_count) {
+    if(thread_count > 1) {
+        Thread_Handle *threads       = SPLTMRG_ALLOC(Thread_Handle, thread_count);
+        i32            started_count = 0;
+        
+        For(i32, it_index, thread_count) {
+            threads[it_index] = os_create_thread(proc, data);
+            
+            if(threads[it_index]) {
+                started_count += 1;
+            }
+        }
+        
+        if(started_count == 0) {
+            proc(data);
+        }
+        
+        For(i32, it_index, thread_count) {
+            os_join_thread(threads[it_index]);
+        }
+        
+        SPLTMRG_FREE(threads);
+    } else {
+        proc(data);
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// ARGUMENTS
+//
+//~ NOTE(Patrik): A batch of 100k chunks does not fit on a command line, so the
+// names can come from a list too. @path reads one name per line from a file,
+// and so does --files-from path, while --files-from - reads them from what is
+// piped in. With -0 the names in every list end with a null byte instead of a
+// line break, the way find -print0 writes them.
+// The lists are read a block at a time and their names take the place of the
+// argument, so the rest of main sees one long command line.
+#define ARG_LIST_READ_SIZE (64 * 1024)
+
+typedef struct Arg_List {
+    char **data;
+    i32    count;
+    i32    capacity;
+} Arg_List;
+
+static void
+push_arg(Arg_List *list, char *arg) {
+    if(list->count == list->capacity) {
+        list->capacity *= 2;
+        list->data      = SPLTMRG_REALLOC(char*, list->data, list->capacity);
+    }
+    
+    list->data[list->count] = arg;
+    list->count += 1;
+}
+
+//~ NOTE(Patrik): Lines can end with "\r\n" and empty ones are skipped.
+static void
+add_listed_arg(Arg_List *list, u8 *data, i64 length, char delimiter) {
+    if(delimiter == '\n' && length > 0 && data[length - 1] == '\r') {
+        length -= 1;
+    }
+    
+    if(length > 0) {
+        char *arg = SPLTMRG_ALLOC(char, length + 1);
+        
+        copy_memory((u8*)arg, data, length);
+        push_arg(list, arg);
+    }
+}
+
+//~ NOTE(Patrik): The last name of a block can go on in the next one, so what
+// is left after the last delimiter is moved to the front and read after.
+static void
+add_arg_list(Arg_List *list, File_Handle handle, bool is_standard_input, char delimiter) {
+    File_Data block       = make_file_data(ARG_LIST_READ_SIZE);
+    i64       scan_offset = 0;
+    
+    for(;;) {
+        //~ NOTE(Patrik): Only a name longer than the whole block fills it.
+        if(block.length == block.capacity) {
+            maybe_grow_file_data(&block, block.capacity * 2);
+        }
+        
+        i64 read_length;
+        
+        if(is_standard_input) {
+            read_length = os_read_standard_input(&block, block.capacity - block.length);
+        } else {
+            read_length = os_read_file(&block, handle, block.capacity - block.length);
+        }
+        
+        i64 name_offset = 0;
+        
+        for_range(i64, it_index, scan_offset, block.length) {
+            if(block.data[it_index] == delimiter) {
+                add_listed_arg(list, block.data + name_offset, it_index - name_offset, delimiter);
+                
+                name_offset = it_index + 1;
+            }
+        }
+        
+        if(read_length <= 0) {
+            add_listed_arg(list, block.data + name_offset, block.length - name_offset, delimiter);
+            break;
+        }
+        
+        copy_memory(block.data, block.data + name_offset, block.length - name_offset);
+        
+        block.length -= name_offset;
+        scan_offset   = block.length;
+    }
+    
+    SPLTMRG_FREE(block.data);
+}
+
+//~ NOTE(Patrik): list is the command line with every list read into it, and
+// without -0 and --files-from. Returns false if a list could not be opened.
+static bool
+expand_args(i32 arg_count, char **arg_data, Arg_List *list) {
+    char delimiter = '\n';
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        if(is_equal_to_ntstring(set_string_from_ntstring(arg_data[arg_index]), "-0")) {
+            delimiter = 0;
+        }
+    }
+    
+    list->capacity = arg_count + 1;
+    list->count    = 0;
+    list->data     = SPLTMRG_ALLOC(char*, list->capacity);
+    
+    push_arg(list, arg_data[0]);
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg       = set_string_from_ntstring(arg_data[arg_index]);
+        char  *list_name = 0;
+        
+        if(is_equal_to_ntstring(arg, "-0")) {
+            continue;
+        } else if(is_equal_to_ntstring(arg, "--files-from") && arg_index + 1 < arg_count) {
+            arg_index += 1;
+            list_name  = arg_data[arg_index];
+        } else if(arg.length > 1 && arg.data[0] == '@') {
+            list_name = arg.data + 1;
+        } else {
+            push_arg(list, arg.data);
+            continue;
+        }
+        
+        if(is_equal_to_ntstring(set_string_from_ntstring(list_name), "-")) {
+            add_arg_list(list, 0, true, delimiter);
+        } else {
+            File_Handle handle = os_open_file_for_reading(list_name);
+            
+            if(!os_is_handle_valid(handle)) {
+                printf("Invalid file list: \"%s\"\n", list_name);
+                return false;
+            }
+            
+            add_arg_list(list, handle, false, delimiter);
+            
+            os_close_file(handle);
+        }
+    }
+    
+    return true;
+}
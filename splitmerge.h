@@ -27,10 +27,36 @@
 //
 // INCLUDES
 //
+//~ NOTE(Patrik): For sync_file_range in the C runtime backend, it has to be
+// defined before the first system header.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdint.h>
 
 
+//~~~~~~~~~~~~~~~~
+//
+// PROBES
+//
+//~ NOTE(Patrik): Defining SPLITMERGE_USDT puts static tracepoints in the
+// executable that bpftrace and perf can attach to, with the provider name
+// "splitmerge". They cost a nop each when nothing is attached. The arguments
+// are not evaluated at all without SPLITMERGE_USDT.
+#if defined(SPLITMERGE_USDT)
+#  include <sys/sdt.h>
+#  define SPLITMERGE_PROBE1(name, a)       DTRACE_PROBE1(splitmerge, name, a)
+#  define SPLITMERGE_PROBE2(name, a, b)    DTRACE_PROBE2(splitmerge, name, a, b)
+#  define SPLITMERGE_PROBE3(name, a, b, c) DTRACE_PROBE3(splitmerge, name, a, b, c)
+#else
+#  define SPLITMERGE_PROBE1(name, a)
+#  define SPLITMERGE_PROBE2(name, a, b)
+#  define SPLITMERGE_PROBE3(name, a, b, c)
+#endif
+
+
 //~~~~~~~~~~~~~~~~
 //
 // PLATFORM API
@@ -43,16 +69,98 @@
 #define PLATFORM_CLOSE_FILE(name) void name(File_Handle handle)
 #define PLATFORM_OPEN_FILE_FOR_READING(name) File_Handle name(char *file_name)
 #define PLATFORM_OPEN_FILE_FOR_WRITING(name) File_Handle name(char *file_name)
+#define PLATFORM_OPEN_FILE_FOR_UPDATING(name) File_Handle name(char *file_name)
 #define PLATFORM_MOVE_FILE_POINTER(name) bool name(File_Handle handle, i64 desired_offset)
+#define PLATFORM_SET_FILE_POINTER(name) bool name(File_Handle handle, i64 desired_offset)
 #define PLATFORM_READ_FILE(name) i64 name(File_Data *file, File_Handle handle, i64 read_amount)
 #define PLATFORM_WRITE_FILE(name) i64 name(File_Handle handle, u8 *data, i64 length)
+//~ NOTE(Patrik): Reads what is piped in, which can not be seeked in like a
+// file. Returns 0 at the end of it.
+#define PLATFORM_READ_STANDARD_INPUT(name) i64 name(File_Data *file, i64 read_amount)
+#define PLATFORM_WRITE_STANDARD_OUTPUT(name) i64 name(u8 *data, i64 length)
+
+#define PLATFORM_CREATE_DIRECTORY(name) bool name(char *directory_name)
+#define PLATFORM_DELETE_FILE(name) bool name(char *file_name)
+//~ NOTE(Patrik): Only deletes a directory that is empty.
+#define PLATFORM_DELETE_DIRECTORY(name) bool name(char *directory_name)
+//~ NOTE(Patrik): Replaces new_name if it is there.
+#define PLATFORM_MOVE_FILE(name) bool name(char *old_name, char *new_name)
+
+//~ NOTE(Patrik): Waits until everything written to the file is on the disk.
+#define PLATFORM_FLUSH_FILE(name) bool name(File_Handle handle)
+//~ NOTE(Patrik): Starts writing the file out to the disk without waiting for
+// it, so a flush later on has less left to wait for.
+#define PLATFORM_BEGIN_FLUSH_FILE(name) void name(File_Handle handle)
+//~ NOTE(Patrik): Makes files that were made or renamed in the directory stay
+// that way after a crash, where the file system needs that.
+#define PLATFORM_FLUSH_DIRECTORY(name) bool name(Directory_Handle directory)
+
+//~ NOTE(Patrik): A directory that is kept open so the files in it can be
+// opened by a name relative to it, without the whole path being looked up
+// again for every file. Returns 0 if the directory could not be opened.
+#define PLATFORM_OPEN_DIRECTORY(name) Directory_Handle name(char *directory_name)
+#define PLATFORM_CLOSE_DIRECTORY(name) void name(Directory_Handle directory)
+#define PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_READING(name) File_Handle name(Directory_Handle directory, char *file_name)
+#define PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_WRITING(name) File_Handle name(Directory_Handle directory, char *file_name)
+
+//~ NOTE(Patrik): Hints that the file is read from start to end, so more of it
+// can be read ahead.
+#define PLATFORM_ADVISE_SEQUENTIAL(name) void name(File_Handle handle)
+//~ NOTE(Patrik): Drops a range of the file that will not be read again from
+// the page cache, after writing it out if it is dirty. A length of 0 goes to
+// the end of the file.
+#define PLATFORM_DROP_CACHE(name) void name(File_Handle handle, i64 offset, i64 length)
 
 #define PLATFORM_GET_SIZE_OF_FILE(name) i64 name(File_Handle handle)
 #define PLATFORM_GET_REMAINING_SIZE_OF_FILE(name) i64 name(File_Handle handle)
+//~ NOTE(Patrik): Returns false if the platform can not tell files apart.
+#define PLATFORM_GET_FILE_IDENTITY(name) bool name(File_Handle handle, File_Identity *identity)
+//~ NOTE(Patrik): Cuts or extends the file to size, an extended part is a hole
+// where the file system has them. The file pointer is left where it was.
+#define PLATFORM_SET_SIZE_OF_FILE(name) bool name(File_Handle handle, i64 size)
+//~ NOTE(Patrik): Cuts length bytes out of the file at offset and moves the
+// rest of it down without copying it. Returns false where the file system can
+// not, which is also when offset and length are not whole blocks of it.
+#define PLATFORM_COLLAPSE_FILE_RANGE(name) bool name(File_Handle handle, i64 offset, i64 length)
+
+//~ NOTE(Patrik): Finds the first range at or after offset that is not a hole.
+// Without more data both are set to the size of the file. Returns false if the
+// file system can not tell, then the whole file has to be treated as data.
+#define PLATFORM_GET_NEXT_DATA(name) bool name(File_Handle handle, i64 offset, i64 *data_start, i64 *data_end)
+//~ NOTE(Patrik): Lets parts of a file that are skipped over with the file
+// pointer become holes. Only needed on Windows.
+#define PLATFORM_SET_SPARSE(name) bool name(File_Handle handle)
 
 #define PLATFORM_GET_RANDOM_U64(name) u64 name(u64 *state)
 #define PLATFORM_SET_RANDOM_SEED(name) u64 name()
 
+//~ NOTE(Patrik): Nanoseconds from an arbitrary point, only good for differences.
+#define PLATFORM_GET_TIME(name) i64 name()
+#define PLATFORM_GET_PROCESS_USAGE(name) Process_Usage name()
+#define PLATFORM_SLEEP(name) void name(i64 nanoseconds)
+//~ NOTE(Patrik): Lowers the CPU and I/O priority of the whole process, for
+// runs that share the machine with something more important.
+#define PLATFORM_ENTER_BACKGROUND_MODE(name) bool name()
+//~ NOTE(Patrik): Runs program with args, which ends with a 0, and waits for
+// it to exit. args[0] is the name the program sees for itself, which does not
+// have to be where it is. usage is for that process alone. Returns false if it
+// could not be started.
+#define PLATFORM_RUN_PROCESS(name) bool name(char *program, char **args, i32 *exit_code, Process_Usage *usage)
+
+#define PLATFORM_THREAD_PROC(name) void name(void *data)
+//~ NOTE(Patrik): Returns 0 if the thread could not be started.
+#define PLATFORM_CREATE_THREAD(name) Thread_Handle name(Thread_Proc *proc, void *data)
+#define PLATFORM_JOIN_THREAD(name) void name(Thread_Handle handle)
+#define PLATFORM_CREATE_SEMAPHORE(name) Semaphore_Handle name(i32 initial_count)
+#define PLATFORM_WAIT_SEMAPHORE(name) void name(Semaphore_Handle handle)
+#define PLATFORM_SIGNAL_SEMAPHORE(name) void name(Semaphore_Handle handle)
+#define PLATFORM_FREE_SEMAPHORE(name) void name(Semaphore_Handle handle)
+//~ NOTE(Patrik): Returns the value from before the add.
+#define PLATFORM_ATOMIC_ADD(name) i64 name(i64 volatile *value, i64 amount)
+#define PLATFORM_GET_PROCESSOR_COUNT(name) i32 name()
+//~ NOTE(Patrik): How many files the process can have open at once.
+#define PLATFORM_GET_MAX_OPEN_FILES(name) i64 name()
+
 
 //~~~~~~~~~~~~~~~~
 //
@@ -70,6 +178,7 @@
 //
 //
 #define is_flag_set(var, flag) (((var) & (flag)) == (flag))
+#define array_count(array) (sizeof(array) / sizeof((array)[0]))
 
 //~ NOTE(Patrik): ntstring is a null-terminated string (char *str)
 // cstring is a pointer and a length (char *data, i32 length)
@@ -112,6 +221,26 @@ typedef struct File_Data {
     i64  capacity;
 } File_Data;
 
+//~ NOTE(Patrik): Times are in nanoseconds. Anything the platform can not
+// tell is left at 0.
+typedef struct Process_Usage {
+    i64 user_time;
+    i64 system_time;
+    i64 peak_memory;
+} Process_Usage;
+
+//~ NOTE(Patrik): Tells a file apart from every other file on the machine, and
+// a version of it from the next one. modify_time is in nanoseconds from a
+// point the platform picks, so it is only good for comparing.
+typedef struct File_Identity {
+    u64 device;
+    u64 file_id;
+    i64 size;
+    i64 modify_time;
+} File_Identity;
+
+typedef PLATFORM_THREAD_PROC(Thread_Proc);
+
 typedef struct String {
     char *data;
     i32   length;
@@ -123,13 +252,27 @@ typedef struct String {
 enum Header_Flags {
     Header_Flag__None       = 0x0,
 	Header_Flag__Big_Endian = 0x1,
+    Header_Flag__Dedup      = 0x2,
+    Header_Flag__Delta      = 0x4,
+    Header_Flag__Parity     = 0x8,
+    Header_Flag__Pack       = 0x10,
+    Header_Flag__Manifest   = 0x20,
+    Header_Flag__Sparse     = 0x40,
 };
 
+//~ NOTE(Patrik): Merge refuses bundles with flags it does not know about,
+// since the payload would be written out as garbage.
+#define SPLITMERGE_KNOWN_HEADER_FLAGS (Header_Flag__Big_Endian | Header_Flag__Dedup | \
+                                       Header_Flag__Delta | Header_Flag__Parity | \
+                                       Header_Flag__Pack | Header_Flag__Sparse)
+
 #include "splitmerge_header.h"
 
 #define SPLITMERGE_HEADER_VALIDATION "S+M"
 #define SPLITMERGE_FILE_EXTENSION ".spltmrg"
 #define SPLITMERGE_FILE_EXTENSION_CSTRING UNPACK_NTSTRING(SPLITMERGE_FILE_EXTENSION)
+#define SPLITMERGE_MANIFEST_EXTENSION ".manifest"
+#define SPLITMERGE_MANIFEST_EXTENSION_CSTRING UNPACK_NTSTRING(SPLITMERGE_MANIFEST_EXTENSION)
 
 #define SPLITMERGE_MAX_FILE_NAME_LENGTH 0xFFFF
 
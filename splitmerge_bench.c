@@ -0,0 +1,1061 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// INCLUDES
+//
+#include "splitmerge.c"
+#include "splitmerge_hash.c"
+
+#include <stdlib.h>
+
+//~ NOTE(Patrik): The backend that is measured is the one the tools were built
+// with. The tools run in their own processes and could not see files that
+// only exist in the memory of this one.
+#if defined(SPLITMERGE_MEMORY)
+#  error "Build splitmerge_bench without SPLITMERGE_MEMORY and give it --tools built with it"
+#endif
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANT
+//
+#define BENCH_BUFFER_SIZE (4 * 1024 * 1024)
+#define BENCH_MAX_ARGS    64
+
+#define BENCH_MEMORY_OPTIONS "SPLITMERGE_MEMORY_OPTIONS"
+
+//~ NOTE(Patrik): Split is given this id, so the names of the chunks and the
+// manifest are known without looking.
+#define BENCH_UNIQUE_ID "0x5B1E7C00"
+
+//~ NOTE(Patrik): Sparse inputs have this much data at the start of every
+// BENCH_SPARSE_STRIDE bytes and a hole for the rest.
+#define BENCH_SPARSE_STRIDE (16 * 1024 * 1024)
+#define BENCH_SPARSE_DATA   (1024 * 1024)
+
+#if defined(_WIN32)
+#  define BENCH_EXECUTABLE_EXTENSION ".exe"
+#else
+#  define BENCH_EXECUTABLE_EXTENSION ""
+#endif
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef enum Bench_Pattern {
+    Bench_Pattern__Random,
+    Bench_Pattern__Compressible,
+    Bench_Pattern__Sparse,
+    
+    Bench_Pattern__Count,
+} Bench_Pattern;
+
+static char *global_pattern_names[Bench_Pattern__Count] = {
+    "random",
+    "compressible",
+    "sparse",
+};
+
+//~ NOTE(Patrik): The custom profile is a split built with
+// SPLITMERGE_CUSTOM_FILE_LIMIT, which only the tool itself knows, so the first
+// chunk is checked to be chunk_limit long.
+typedef struct Bench_Profile {
+    char *name;
+    char *tool_name;
+    i64   chunk_limit;
+    bool  is_custom;
+} Bench_Profile;
+
+//~ NOTE(Patrik): Every result is one run of a tool, so the usage and the peak
+// memory are for that case alone. The backend is the one from the --stats
+// file of the tool.
+typedef struct Bench_Result {
+    Bench_Profile profile;
+    Bench_Pattern pattern;
+    i64           size;
+    char         *phase;
+    char          backend[16];
+    
+    i64           time;
+    i64           platform_calls;
+    Process_Usage usage;
+} Bench_Result;
+
+typedef struct Bench_Args {
+    char *data[BENCH_MAX_ARGS];
+    i32   count;
+} Bench_Args;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// HELPERS
+//
+//~ NOTE(Patrik): Splits a comma separated list, returns false when it is empty.
+static bool
+next_list_item(String *list, String *item) {
+    if(list->length <= 0) {
+        return false;
+    }
+    
+    *item = *list;
+    
+    For(i32, it_index, list->length) {
+        if(list->data[it_index] == ',') {
+            item->length = it_index;
+            break;
+        }
+    }
+    
+    advance_string(list, item->length);
+    
+    if(list->length > 0) {
+        advance_string(list, 1);
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): value is scaled up by 10^decimals.
+static void
+append_fixed_point(String *str, u64 value, i32 decimals) {
+    u64 scale = 1;
+    
+    For(i32, it_index, decimals) {
+        scale *= 10;
+    }
+    
+    append_u64(str, value / scale, 10);
+    append_char(str, '.');
+    
+    u64 fraction = value % scale;
+    
+    rfor(i32, it_index, decimals) {
+        u64 digit_scale = 1;
+        
+        For(i32, scale_index, it_index) {
+            digit_scale *= 10;
+        }
+        
+        append_char(str, digit_value_to_char((i32)((fraction / digit_scale) % 10)));
+    }
+}
+
+static void
+append_bench_directory(String *dest, char *name) {
+    append_ntstring(dest, name);
+    
+    if(!ends_with_char(*dest, '/') && !ends_with_char(*dest, '\\')) {
+        append_char(dest, '/');
+    }
+}
+
+//~ NOTE(Patrik): Where the platform keeps temporary files, if it says.
+static char *
+get_bench_temp_path() {
+    char *names[] = {"TMPDIR", "TEMP", "TMP"};
+    
+    For(i32, it_index, array_count(names)) {
+        char *value = getenv(names[it_index]);
+        
+        if(value && *value) {
+            return value;
+        }
+    }
+    
+#if defined(_WIN32)
+    return ".";
+#else
+    return "/tmp";
+#endif
+}
+
+//~ NOTE(Patrik): A value of 0 takes the variable away.
+static void
+set_bench_environment(char *name, char *value) {
+#if defined(_WIN32)
+    _putenv_s(name, value ? value : "");
+#else
+    if(value) {
+        setenv(name, value, 1);
+    } else {
+        unsetenv(name);
+    }
+#endif
+}
+
+static void
+make_bench_file_name(String *dest, String directory, char *name, i32 index) {
+    dest->length = 0;
+    
+    append_string(dest, directory);
+    append_ntstring(dest, name);
+    
+    if(index >= 0) {
+        append_char(dest, '_');
+        append_u32(dest, (u32)index, 10);
+        append_cstring(dest, SPLITMERGE_FILE_EXTENSION_CSTRING);
+    }
+    
+    null_terminate(dest);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// INPUT
+//
+static void
+fill_bench_data(u8 *data, i64 length, Bench_Pattern pattern, u64 *random_state) {
+    if(pattern == Bench_Pattern__Compressible) {
+        //~ NOTE(Patrik): Words from a small set, which compresses about as well
+        // as text or logs do.
+        static char *words[] = {
+            "split ", "merge ", "chunk ", "header ", "file ", "the ", "of ", "and ",
+            "0x7AF001C3 ", "payload ", "index ", "data\n", "to ", "is ", "a ", "bundle ",
+        };
+        
+        i64 offset = 0;
+        
+        while(offset < length) {
+            char *word = words[os_get_random_u64(random_state) & 15];
+            
+            while(*word && offset < length) {
+                data[offset] = *word;
+                offset += 1;
+                word   += 1;
+            }
+        }
+    } else {
+        i64 offset = 0;
+        
+        while(offset + 8 <= length) {
+            *(u64*)(data + offset) = os_get_random_u64(random_state);
+            offset += 8;
+        }
+        
+        while(offset < length) {
+            data[offset] = (u8)os_get_random_u64(random_state);
+            offset += 1;
+        }
+    }
+}
+
+static bool
+make_bench_input(char *file_name, i64 size, Bench_Pattern pattern, File_Data *buffer) {
+    bool result = false;
+    
+    File_Handle handle = os_open_file_for_writing(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        u64 random_state = 0x9E3779B97F4A7C15;
+        i64 offset       = 0;
+        
+        result = true;
+        
+        while(result && offset < size) {
+            i64 length = buffer->capacity;
+            
+            if(pattern == Bench_Pattern__Sparse) {
+                i64 stride_offset = offset % BENCH_SPARSE_STRIDE;
+                
+                if(stride_offset >= BENCH_SPARSE_DATA) {
+                    i64 hole_length = BENCH_SPARSE_STRIDE - stride_offset;
+                    
+                    if(hole_length > size - offset) {
+                        hole_length = size - offset;
+                    }
+                    
+                    //~ NOTE(Patrik): The last byte is always written so that
+                    // the file ends up as big as it should be.
+                    if(offset + hole_length == size) {
+                        hole_length -= 1;
+                    }
+                    
+                    if(hole_length > 0) {
+                        result  = os_move_file_pointer(handle, hole_length);
+                        offset += hole_length;
+                        continue;
+                    }
+                    
+                    length = 1;
+                    zero_memory(buffer->data, length);
+                } else if(length > BENCH_SPARSE_DATA - stride_offset) {
+                    length = BENCH_SPARSE_DATA - stride_offset;
+                }
+            }
+            
+            if(length > size - offset) {
+                length = size - offset;
+            }
+            
+            if(pattern != Bench_Pattern__Sparse || offset % BENCH_SPARSE_STRIDE < BENCH_SPARSE_DATA) {
+                fill_bench_data(buffer->data, length, pattern, &random_state);
+            }
+            
+            result  = (os_write_file(handle, buffer->data, length) == length);
+            offset += length;
+        }
+        
+        os_close_file(handle);
+    }
+    
+    return result;
+}
+
+static bool
+hash_bench_file(char *file_name, File_Data *buffer, Hash128 *digest) {
+    File_Handle handle = os_open_file_for_reading(file_name);
+    
+    if(!os_is_handle_valid(handle)) {
+        return false;
+    }
+    
+    Hash_State state = begin_hash(0);
+    
+    buffer->length = 0;
+    
+    while(os_read_file(buffer, handle, buffer->capacity) > 0) {
+        update_hash(&state, buffer->data, buffer->length);
+        buffer->length = 0;
+    }
+    
+    os_close_file(handle);
+    
+    *digest = end_hash(&state);
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PHASES
+//
+//~ NOTE(Patrik): The last slot is kept for the 0 at the end, main makes sure
+// that the options given to the tools fit.
+static void
+push_bench_arg(Bench_Args *args, char *arg) {
+    if(args->count + 1 < array_count(args->data)) {
+        args->data[args->count] = arg;
+        args->count += 1;
+    }
+}
+
+//~ NOTE(Patrik): Moves stats past the next "name": in the --stats file of a
+// tool, the value is what is left.
+static bool
+find_bench_stat(String stats, char *name, String *value) {
+    String key = make_string(64);
+    
+    append_char(&key, '"');
+    append_ntstring(&key, name);
+    append_cstring(&key, UNPACK_NTSTRING("\": "));
+    
+    bool result = false;
+    
+    while(stats.length > 0) {
+        if(begins_with_cstring(stats, key.data, key.length)) {
+            advance_string(&stats, key.length);
+            
+            *value = stats;
+            result = true;
+            break;
+        }
+        
+        advance_string(&stats, 1);
+    }
+    
+    SPLTMRG_FREE(key.data);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Takes "platform_calls" and "backend" out of the --stats file.
+static void
+read_bench_stats(Bench_Result *result, char *file_name, File_Data *buffer) {
+    File_Handle handle = os_open_file_for_reading(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        buffer->length = 0;
+        
+        os_read_file(buffer, handle, buffer->capacity);
+        os_close_file(handle);
+        
+        String stats = {0};
+        stats.data   = (char*)buffer->data;
+        stats.length = (i32)buffer->length;
+        
+        String value = {0};
+        
+        if(find_bench_stat(stats, "platform_calls", &value)) {
+            i32 digit_count = 0;
+            
+            while(digit_count < value.length && value.data[digit_count] >= '0' && value.data[digit_count] <= '9') {
+                digit_count += 1;
+            }
+            
+            value.length = digit_count;
+            
+            u64 calls = 0;
+            
+            if(parse_u64(value, &calls)) {
+                result->platform_calls = (i64)calls;
+            }
+        }
+        
+        if(find_bench_stat(stats, "backend", &value) && value.length > 0 && value.data[0] == '"') {
+            i32 length = 0;
+            
+            while(length + 1 < value.length && value.data[length + 1] != '"' &&
+                  length + 1 < array_count(result->backend))
+            {
+                result->backend[length] = value.data[length + 1];
+                length += 1;
+            }
+            
+            result->backend[length] = 0;
+        }
+    }
+}
+
+//~ NOTE(Patrik): The time includes starting the process, which is small next
+// to splitting or merging anything worth measuring.
+static bool
+run_bench_tool(Bench_Result *result, char *program, Bench_Args *args, char *stats_name, File_Data *buffer) {
+    args->data[args->count] = 0;
+    
+    i32 exit_code  = 0;
+    i64 start_time = os_get_time();
+    
+    bool is_started = os_run_process(program, args->data, &exit_code, &result->usage);
+    
+    result->time = os_get_time() - start_time;
+    
+    if(!is_started) {
+        printf("Could not run \"%s\"\n", program);
+        return false;
+    }
+    
+    if(exit_code != 0) {
+        printf("%s exited with %d\n", program, exit_code);
+        return false;
+    }
+    
+    read_bench_stats(result, stats_name, buffer);
+    
+    os_delete_file(stats_name);
+    
+    return true;
+}
+
+//~ NOTE(Patrik): Tools built with the memory backend keep what they write in
+// memory, so it is gone when they exit. To have something to merge and to
+// check, they are run once more, untimed, with the save option of the memory
+// backend writing the files in save_path to the disk.
+static bool
+run_bench_tool_saved(char *program, Bench_Args *args, char *memory_options, String save_path) {
+    String options = make_string(256);
+    
+    if(memory_options) {
+        append_ntstring(&options, memory_options);
+        append_char(&options, ',');
+    }
+    
+    append_cstring(&options, UNPACK_NTSTRING("save="));
+    append_string(&options, save_path);
+    null_terminate(&options);
+    
+    set_bench_environment(BENCH_MEMORY_OPTIONS, options.data);
+    
+    args->data[args->count] = 0;
+    
+    i32           exit_code  = 0;
+    Process_Usage usage      = {0};
+    bool          is_started = os_run_process(program, args->data, &exit_code, &usage);
+    
+    set_bench_environment(BENCH_MEMORY_OPTIONS, memory_options);
+    
+    SPLTMRG_FREE(options.data);
+    
+    if(!is_started || exit_code != 0) {
+        printf("Could not run \"%s\" again to save its files\n", program);
+        return false;
+    }
+    
+    return true;
+}
+
+static Bench_Result
+make_bench_result(Bench_Profile profile, Bench_Pattern pattern, i64 size, char *phase) {
+    Bench_Result result = {0};
+    
+    result.profile = profile;
+    result.pattern = pattern;
+    result.size    = size;
+    result.phase   = phase;
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Returns -1 if the file is not there.
+static i64
+get_bench_file_size(char *file_name) {
+    i64 result = -1;
+    
+    File_Handle handle = os_open_file_for_reading(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        result = os_get_size_of_file(handle);
+        os_close_file(handle);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The amount of chunks is not known here, they are deleted
+// until one is not there.
+static void
+delete_bench_chunks(String *file_name, String directory) {
+    make_bench_file_name(file_name, directory, BENCH_UNIQUE_ID SPLITMERGE_MANIFEST_EXTENSION, -1);
+    os_delete_file(file_name->data);
+    
+    i32 chunk_index = 0;
+    
+    while(chunk_index < 0xFFFF) {
+        make_bench_file_name(file_name, directory, BENCH_UNIQUE_ID, chunk_index);
+        
+        if(!os_delete_file(file_name->data)) {
+            break;
+        }
+        
+        chunk_index += 1;
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// REPORT
+//
+static void
+append_bench_result(String *report, Bench_Result *result, bool is_json, bool is_first) {
+    u64 megabytes_per_second = 0;
+    
+    if(result->time > 0) {
+        //~ NOTE(Patrik): In hundredths, so it prints with two decimals.
+        double rate = ((double)result->size / (1024.0 * 1024.0)) / ((double)result->time / 1e9);
+        megabytes_per_second = (u64)(rate * 100.0);
+    }
+    
+    if(is_json) {
+        append_ntstring(report, is_first ? "\n  {" : ",\n  {");
+        append_cstring(report, UNPACK_NTSTRING("\"backend\": \""));
+        append_ntstring(report, result->backend);
+        append_cstring(report, UNPACK_NTSTRING("\", \"profile\": \""));
+        append_ntstring(report, result->profile.name);
+        append_cstring(report, UNPACK_NTSTRING("\", \"chunk_limit\": "));
+        append_u64(report, result->profile.chunk_limit, 10);
+        append_cstring(report, UNPACK_NTSTRING(", \"pattern\": \""));
+        append_ntstring(report, global_pattern_names[result->pattern]);
+        append_cstring(report, UNPACK_NTSTRING("\", \"size\": "));
+        append_u64(report, result->size, 10);
+        append_cstring(report, UNPACK_NTSTRING(", \"phase\": \""));
+        append_ntstring(report, result->phase);
+        append_cstring(report, UNPACK_NTSTRING("\", \"seconds\": "));
+        append_fixed_point(report, result->time / 1000, 6);
+        append_cstring(report, UNPACK_NTSTRING(", \"mb_per_second\": "));
+        append_fixed_point(report, megabytes_per_second, 2);
+        append_cstring(report, UNPACK_NTSTRING(", \"platform_calls\": "));
+        append_u64(report, result->platform_calls, 10);
+        append_cstring(report, UNPACK_NTSTRING(", \"user_seconds\": "));
+        append_fixed_point(report, result->usage.user_time / 1000, 6);
+        append_cstring(report, UNPACK_NTSTRING(", \"system_seconds\": "));
+        append_fixed_point(report, result->usage.system_time / 1000, 6);
+        append_cstring(report, UNPACK_NTSTRING(", \"peak_memory\": "));
+        append_u64(report, result->usage.peak_memory, 10);
+        append_char(report, '}');
+    } else {
+        append_ntstring(report, result->backend);
+        append_char(report, ',');
+        append_ntstring(report, result->profile.name);
+        append_char(report, ',');
+        append_u64(report, result->profile.chunk_limit, 10);
+        append_char(report, ',');
+        append_ntstring(report, global_pattern_names[result->pattern]);
+        append_char(report, ',');
+        append_u64(report, result->size, 10);
+        append_char(report, ',');
+        append_ntstring(report, result->phase);
+        append_char(report, ',');
+        append_fixed_point(report, result->time / 1000, 6);
+        append_char(report, ',');
+        append_fixed_point(report, megabytes_per_second, 2);
+        append_char(report, ',');
+        append_u64(report, result->platform_calls, 10);
+        append_char(report, ',');
+        append_fixed_point(report, result->usage.user_time / 1000, 6);
+        append_char(report, ',');
+        append_fixed_point(report, result->usage.system_time / 1000, 6);
+        append_char(report, ',');
+        append_u64(report, result->usage.peak_memory, 10);
+        append_char(report, '\n');
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MAIN
+//
+//~ NOTE(Patrik): Splits and merges with the real tools, so the chunk files,
+// the read-ahead and the durability options are all part of the time. Every
+// split and every merge is its own process, which keeps the peak memory of one
+// case out of the next. Everything is done in a folder of its own under the
+// temporary path, merge is told that is where it is so merged_output ends up
+// there too.
+int
+main(int arg_count, char **arg_data) {
+    printf("%s <bench>\n", SPLITMERGE_WELCOME_MSG);
+    
+    Bench_Profile profiles[16]      = {0};
+    i32           profile_count     = 0;
+    i64           sizes[64]         = {0};
+    i32           size_count        = 0;
+    char         *directory_name    = 0;
+    char         *tools_name        = 0;
+    char         *report_name       = 0;
+    char        **tool_options      = 0;
+    i32           tool_option_count = 0;
+    bool          has_pattern       = false;
+    bool          is_json           = false;
+    bool          should_keep       = false;
+    bool          should_verify     = true;
+    
+    bool patterns[Bench_Pattern__Count] = {0};
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg   = set_string_from_ntstring(arg_data[arg_index]);
+        String value = {0};
+        
+        if(arg_index + 1 < arg_count) {
+            value = set_string_from_ntstring(arg_data[arg_index + 1]);
+        }
+        
+        String item = {0};
+        
+        if(is_equal_to_ntstring(arg, "--")) {
+            //~ NOTE(Patrik): The rest goes to both tools, half of the slots
+            // are kept for the options of the benchmark itself.
+            tool_options      = arg_data + arg_index + 1;
+            tool_option_count = arg_count - arg_index - 1;
+            
+            if(tool_option_count > BENCH_MAX_ARGS / 2) {
+                printf("Too many options for the tools\n");
+                return 1;
+            }
+            
+            break;
+        } else if(is_equal_to_ntstring(arg, "--size") && value.data) {
+            while(next_list_item(&value, &item)) {
+                u64 size = 0;
+                
+                if(!parse_size(item, &size) || size == 0 || size_count == array_count(sizes)) {
+                    printf("Invalid size: %.*s\n", item.length, item.data);
+                    return 1;
+                }
+                
+                sizes[size_count] = (i64)size;
+                size_count += 1;
+            }
+            
+            arg_index += 1;
+        } else if(is_equal_to_ntstring(arg, "--pattern") && value.data) {
+            while(next_list_item(&value, &item)) {
+                bool is_known = false;
+                
+                For(i32, pattern_index, Bench_Pattern__Count) {
+                    if(is_equal_to_ntstring(item, global_pattern_names[pattern_index])) {
+                        patterns[pattern_index] = true;
+                        is_known                = true;
+                    }
+                }
+                
+                if(!is_known) {
+                    printf("Unknown pattern: %.*s\n", item.length, item.data);
+                    return 1;
+                }
+                
+                has_pattern = true;
+            }
+            
+            arg_index += 1;
+        } else if(is_equal_to_ntstring(arg, "--chunk-size") && value.data) {
+            while(next_list_item(&value, &item)) {
+                Bench_Profile profile    = {0};
+                u64           chunk_size = 0;
+                
+                //~ NOTE(Patrik): A size is the custom profile, which needs a
+                // split that was built with that SPLITMERGE_CUSTOM_FILE_LIMIT.
+                if(is_equal_to_ntstring(item, "normal")) {
+                    profile.name        = "normal";
+                    profile.tool_name   = "splitmerge_split" BENCH_EXECUTABLE_EXTENSION;
+                    profile.chunk_limit = SPLITMERGE_FILE_LIMIT;
+                } else if(is_equal_to_ntstring(item, "nitro")) {
+                    profile.name        = "nitro";
+                    profile.tool_name   = "splitmerge_split_nitro" BENCH_EXECUTABLE_EXTENSION;
+                    profile.chunk_limit = SPLITMERGE_NITRO_FILE_LIMIT;
+                } else if(parse_size(item, &chunk_size) && chunk_size > 0 && chunk_size <= SPLITMERGE_NITRO_FILE_LIMIT) {
+                    profile.name        = "custom";
+                    profile.tool_name   = "splitmerge_split_custom" BENCH_EXECUTABLE_EXTENSION;
+                    profile.chunk_limit = (i64)chunk_size;
+                    profile.is_custom   = true;
+                } else {
+                    printf("Invalid chunk size: %.*s, it is normal, nitro or a size\n", item.length, item.data);
+                    return 1;
+                }
+                
+                if(profile_count == array_count(profiles)) {
+                    printf("Too many chunk sizes\n");
+                    return 1;
+                }
+                
+                profiles[profile_count] = profile;
+                profile_count += 1;
+            }
+            
+            arg_index += 1;
+        } else if(is_equal_to_ntstring(arg, "--dir") && value.data) {
+            directory_name  = value.data;
+            arg_index      += 1;
+        } else if(is_equal_to_ntstring(arg, "--tools") && value.data) {
+            tools_name  = value.data;
+            arg_index  += 1;
+        } else if(is_equal_to_ntstring(arg, "--output") && value.data) {
+            report_name  = value.data;
+            arg_index   += 1;
+        } else if(is_equal_to_ntstring(arg, "--format") && value.data) {
+            if(is_equal_to_ntstring(value, "json")) {
+                is_json = true;
+            } else if(!is_equal_to_ntstring(value, "csv")) {
+                printf("Unknown format: %s\n", value.data);
+                return 1;
+            }
+            
+            arg_index += 1;
+        } else if(is_equal_to_ntstring(arg, "--keep")) {
+            should_keep = true;
+        } else if(is_equal_to_ntstring(arg, "--no-verify")) {
+            should_verify = false;
+        } else {
+            printf("Unknown option: %s\n", arg.data);
+            return 1;
+        }
+    }
+    
+    if(size_count == 0) {
+        sizes[0]   = 32 * 1024 * 1024;
+        sizes[1]   = 256 * 1024 * 1024;
+        size_count = 2;
+    }
+    
+    if(!has_pattern) {
+        For(i32, pattern_index, Bench_Pattern__Count) {
+            patterns[pattern_index] = true;
+        }
+    }
+    
+    if(profile_count == 0) {
+        profiles[0].name        = "normal";
+        profiles[0].tool_name   = "splitmerge_split" BENCH_EXECUTABLE_EXTENSION;
+        profiles[0].chunk_limit = SPLITMERGE_FILE_LIMIT;
+        profiles[1].name        = "nitro";
+        profiles[1].tool_name   = "splitmerge_split_nitro" BENCH_EXECUTABLE_EXTENSION;
+        profiles[1].chunk_limit = SPLITMERGE_NITRO_FILE_LIMIT;
+        profile_count           = 2;
+    }
+    
+    String executable_path = make_string(128);
+    
+    {
+        append_ntstring(&executable_path, arg_data[0]);
+        
+        i32 index = find_index_of_last(executable_path, '/');
+        
+        if(index < 0) {
+            index = find_index_of_last(executable_path, '\\');
+        }
+        
+        executable_path.length = index + 1;
+    }
+    
+    String directory  = make_string(128);
+    String tools_path = make_string(128);
+    
+    //~ NOTE(Patrik): A new folder every run, so nothing from an earlier run or
+    // next to the tools is ever written over.
+    {
+        u64 random_state = os_set_random_seed();
+        
+        append_bench_directory(&directory, directory_name ? directory_name : get_bench_temp_path());
+        append_cstring(&directory, UNPACK_NTSTRING("splitmerge_bench_"));
+        append_u32(&directory, (u32)os_get_random_u64(&random_state), 16);
+        append_char(&directory, '/');
+        null_terminate(&directory);
+    }
+    
+    //~ NOTE(Patrik): The tools are next to the benchmark unless told otherwise.
+    if(tools_name) {
+        append_bench_directory(&tools_path, tools_name);
+    } else {
+        append_string(&tools_path, executable_path);
+    }
+    
+    String merged_directory = make_string(128);
+    String chunk_directory  = make_string(128);
+    
+    append_string(&merged_directory, directory);
+    append_cstring(&merged_directory, UNPACK_NTSTRING("merged_output/"));
+    null_terminate(&merged_directory);
+    
+    append_string(&chunk_directory, directory);
+    append_cstring(&chunk_directory, UNPACK_NTSTRING("chunks/"));
+    null_terminate(&chunk_directory);
+    
+    if(!os_create_directory(directory.data) || !os_create_directory(merged_directory.data) ||
+       !os_create_directory(chunk_directory.data))
+    {
+        printf("Could not create \"%s\"\n", directory.data);
+        return 1;
+    }
+    
+    printf("Working in %s\n", directory.data);
+    
+    String input_name      = make_string(128);
+    String merged_name     = make_string(128);
+    String manifest_name   = make_string(128);
+    String first_name      = make_string(128);
+    String stats_name      = make_string(128);
+    String merge_tool      = make_string(128);
+    String merge_tool_name = make_string(128);
+    String split_tools[array_count(profiles)];
+    String file_name       = make_string(128);
+    String report          = make_string(4096);
+    
+    make_bench_file_name(&input_name,      directory,       "input",                                         -1);
+    make_bench_file_name(&stats_name,      directory,       "stats.json",                                    -1);
+    make_bench_file_name(&manifest_name,   chunk_directory, BENCH_UNIQUE_ID SPLITMERGE_MANIFEST_EXTENSION,    -1);
+    make_bench_file_name(&first_name,      chunk_directory, BENCH_UNIQUE_ID,                                 0);
+    make_bench_file_name(&merge_tool,      tools_path,      "splitmerge_merge" BENCH_EXECUTABLE_EXTENSION,   -1);
+    make_bench_file_name(&merge_tool_name, directory,       "splitmerge_merge" BENCH_EXECUTABLE_EXTENSION,   -1);
+    
+    //~ NOTE(Patrik): Merge writes next to where it thinks it is, which is
+    // merge_tool_name, with the name the input had.
+    make_bench_file_name(&merged_name, merged_directory, "input", -1);
+    
+    For(i32, profile_index, profile_count) {
+        split_tools[profile_index] = make_string(128);
+        
+        make_bench_file_name(split_tools + profile_index, tools_path, profiles[profile_index].tool_name, -1);
+    }
+    
+    if(is_json) {
+        append_char(&report, '[');
+    } else {
+        append_ntstring(&report, "backend,profile,chunk_limit,pattern,size,phase,seconds,mb_per_second,"
+                        "platform_calls,user_seconds,system_seconds,peak_memory\n");
+    }
+    
+    File_Data buffer = make_file_data(BENCH_BUFFER_SIZE);
+    
+    char *memory_options = getenv(BENCH_MEMORY_OPTIONS);
+    
+    bool is_first   = true;
+    bool has_failed = false;
+    
+    For(i32, pattern_index, Bench_Pattern__Count) {
+        if(!patterns[pattern_index]) {
+            continue;
+        }
+        
+        For(i32, size_index, size_count) {
+            i64 size = sizes[size_index];
+            
+            printf("---===##===---\n");
+            printf("Making %s input of %lld bytes\n", global_pattern_names[pattern_index], (long long)size);
+            
+            if(!make_bench_input(input_name.data, size, (Bench_Pattern)pattern_index, &buffer)) {
+                printf("Could not write \"%s\"\n", input_name.data);
+                has_failed = true;
+                break;
+            }
+            
+            Hash128 input_digest = {0};
+            
+            if(should_verify) {
+                hash_bench_file(input_name.data, &buffer, &input_digest);
+            }
+            
+            For(i32, profile_index, profile_count) {
+                Bench_Profile profile = profiles[profile_index];
+                
+                //~ NOTE(Patrik): Split only takes files that need more than one chunk.
+                if(size <= profile.chunk_limit) {
+                    printf("Skipping %s chunks, the input fits in one\n", profile.name);
+                    continue;
+                }
+                
+                printf("Splitting with %s\n", split_tools[profile_index].data);
+                
+                Bench_Args split_args = {0};
+                
+                push_bench_arg(&split_args, split_tools[profile_index].data);
+                push_bench_arg(&split_args, "--id");
+                push_bench_arg(&split_args, BENCH_UNIQUE_ID);
+                push_bench_arg(&split_args, "--output");
+                push_bench_arg(&split_args, chunk_directory.data);
+                push_bench_arg(&split_args, "--stats");
+                push_bench_arg(&split_args, stats_name.data);
+                
+                For(i32, option_index, tool_option_count) {
+                    push_bench_arg(&split_args, tool_options[option_index]);
+                }
+                
+                push_bench_arg(&split_args, input_name.data);
+                
+                Bench_Result split = make_bench_result(profile, (Bench_Pattern)pattern_index, size, "split");
+                Bench_Result merge = make_bench_result(profile, (Bench_Pattern)pattern_index, size, "merge");
+                
+                bool is_merged = run_bench_tool(&split, split_tools[profile_index].data, &split_args,
+                                                stats_name.data, &buffer);
+                bool is_memory = is_equal_to_ntstring(set_string_from_ntstring(split.backend), "memory");
+                
+                if(is_merged && is_memory) {
+                    is_merged = run_bench_tool_saved(split_tools[profile_index].data, &split_args,
+                                                     memory_options, chunk_directory);
+                }
+                
+                if(is_merged && get_bench_file_size(manifest_name.data) < 0) {
+                    printf("Could not split \"%s\"\n", input_name.data);
+                    is_merged = false;
+                }
+                
+                if(is_merged && profile.is_custom && get_bench_file_size(first_name.data) != profile.chunk_limit) {
+                    printf("%s was not built with SPLITMERGE_CUSTOM_FILE_LIMIT=%lld\n",
+                           split_tools[profile_index].data, (long long)profile.chunk_limit);
+                    is_merged = false;
+                }
+                
+                Bench_Args merge_args = {0};
+                
+                push_bench_arg(&merge_args, merge_tool_name.data);
+                push_bench_arg(&merge_args, "--stats");
+                push_bench_arg(&merge_args, stats_name.data);
+                
+                For(i32, option_index, tool_option_count) {
+                    push_bench_arg(&merge_args, tool_options[option_index]);
+                }
+                
+                push_bench_arg(&merge_args, manifest_name.data);
+                
+                if(is_merged) {
+                    printf("Merging with %s\n", merge_tool.data);
+                    
+                    is_merged = run_bench_tool(&merge, merge_tool.data, &merge_args, stats_name.data, &buffer);
+                }
+                
+                if(is_merged && should_verify) {
+                    if(is_equal_to_ntstring(set_string_from_ntstring(merge.backend), "memory")) {
+                        is_merged = run_bench_tool_saved(merge_tool.data, &merge_args, memory_options,
+                                                         merged_directory);
+                    }
+                    
+                    Hash128 merged_digest = {0};
+                    
+                    if(is_merged && (!hash_bench_file(merged_name.data, &buffer, &merged_digest) ||
+                                     !are_hashes_equal(input_digest, merged_digest)))
+                    {
+                        printf("The merged file does not match the input\n");
+                        is_merged = false;
+                    }
+                }
+                
+                if(is_merged) {
+                    append_bench_result(&report, &split, is_json, is_first);
+                    append_bench_result(&report, &merge, is_json, false);
+                    is_first = false;
+                } else {
+                    has_failed = true;
+                }
+                
+                if(!should_keep) {
+                    delete_bench_chunks(&file_name, chunk_directory);
+                    os_delete_file(merged_name.data);
+                }
+            }
+            
+            if(!should_keep) {
+                os_delete_file(input_name.data);
+            }
+        }
+    }
+    
+    if(!should_keep) {
+        os_delete_file(stats_name.data);
+        os_delete_directory(chunk_directory.data);
+        os_delete_directory(merged_directory.data);
+        os_delete_directory(directory.data);
+    }
+    
+    if(is_json) {
+        append_cstring(&report, UNPACK_NTSTRING("\n]\n"));
+    }
+    
+    printf("---===##===---\n");
+    
+    if(report_name) {
+        File_Handle report_handle = os_open_file_for_writing(report_name);
+        
+        if(os_is_handle_valid(report_handle)) {
+            os_write_file(report_handle, (u8*)report.data, report.length);
+            os_close_file(report_handle);
+            
+            printf("Wrote %s\n", report_name);
+        } else {
+            printf("Could not write \"%s\"\n", report_name);
+            has_failed = true;
+        }
+    } else {
+        printf("%.*s", report.length, report.data);
+    }
+    
+    return has_failed ? 1 : 0;
+}
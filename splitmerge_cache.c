@@ -0,0 +1,264 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SPLIT CACHE
+//
+//~ NOTE(Patrik): Include this after splitmerge_hash.c. Remembers the bundles
+// that have been split, so a file that is split again can be pointed at the
+// bundle that is already there instead of being read and written again.
+//
+// A file is known by the device and file id it has, its size and the time it
+// was last changed, which is free to look up. With a content hash it is also
+// known by what is in it (hash_content), which takes a read of the whole file but finds it
+// again after it has been copied or touched. Either way the key also has a
+// digest of the options the bundle was split with.
+//
+// The unique_id of a cached bundle is made from the key instead of being
+// random, so the same file split the same way always gets the same name.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANTS
+//
+#define SPLIT_CACHE_NAME      "split.cache"
+#define SPLIT_CACHE_READ_SIZE (1024 * 1024)
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+//~ NOTE(Patrik): content_digest is zero if the file was not hashed.
+typedef struct Split_Cache_Entry {
+    File_Identity identity;
+    Hash128       content_digest;
+    Hash128       options_digest;
+    u32           unique_id;
+    u16           chunk_count;
+    u16           reserved;
+} Split_Cache_Entry;
+
+typedef struct Split_Cache {
+    Split_Cache_Entry *entries;
+    i64                count;
+    i64                capacity;
+} Split_Cache;
+
+typedef struct Split_Cache_Key {
+    File_Identity identity;
+    Hash128       content_digest;
+    Hash128       options_digest;
+    bool          has_identity;
+    bool          has_content_digest;
+} Split_Cache_Key;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// KEY
+//
+//~ NOTE(Patrik): Reads the whole file and leaves the file pointer at the start.
+// The file is not dropped from the page cache, since it is about to be read
+// again if it is not in the cache.
+static Hash128
+hash_split_file(File_Handle handle) {
+    File_Data          buffer = make_file_data(get_slice_size(SPLIT_CACHE_READ_SIZE));
+    Content_Hash_State hash   = begin_content_hash();
+    i64                read_length;
+    
+    os_advise_sequential(handle);
+    
+    while((read_length = os_read_file(&buffer, handle, buffer.capacity)) > 0) {
+        update_content_hash(&hash, buffer.data, read_length);
+        
+        buffer.length = 0;
+    }
+    
+    os_set_file_pointer(handle, 0);
+    
+    SPLTMRG_FREE(buffer.data);
+    
+    return end_content_hash(&hash);
+}
+
+//~ NOTE(Patrik): The key can have neither an identity nor a content digest,
+// if the platform can not tell files apart and should_hash_content is false.
+// The file can not be cached then.
+static Split_Cache_Key
+make_split_cache_key(File_Handle handle, Hash128 options_digest, bool should_hash_content) {
+    Split_Cache_Key result = {0};
+    
+    result.options_digest = options_digest;
+    result.has_identity   = os_get_file_identity(handle, &result.identity);
+    
+    //~ NOTE(Patrik): The size is still needed to match on the content.
+    if(!result.has_identity) {
+        zero_memory((u8*)&result.identity, sizeof(File_Identity));
+        
+        result.identity.size = os_get_size_of_file(handle);
+    }
+    
+    if(should_hash_content) {
+        result.content_digest     = hash_split_file(handle);
+        result.has_content_digest = true;
+    }
+    
+    return result;
+}
+
+static bool
+is_split_cache_key_valid(Split_Cache_Key *key) {
+    return (key->has_identity || key->has_content_digest);
+}
+
+//~ NOTE(Patrik): Made from the content if it was hashed, so two copies of a
+// file get the same unique_id, and from the identity otherwise.
+static u32
+get_split_cache_unique_id(Split_Cache_Key *key) {
+    Hash_State hash = begin_hash(key->options_digest.lo);
+    
+    if(key->has_content_digest) {
+        update_hash(&hash, (u8*)&key->content_digest, sizeof(Hash128));
+        update_hash(&hash, (u8*)&key->identity.size, sizeof(i64));
+    } else {
+        update_hash(&hash, (u8*)&key->identity, sizeof(File_Identity));
+    }
+    
+    return (u32)end_hash(&hash).lo;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TABLE
+//
+static bool
+is_split_cache_match(Split_Cache_Entry *entry, Split_Cache_Key *key) {
+    bool result = false;
+    
+    if(are_hashes_equal(entry->options_digest, key->options_digest)) {
+        if(key->has_content_digest) {
+            result = (entry->identity.size == key->identity.size &&
+                      are_hashes_equal(entry->content_digest, key->content_digest));
+        }
+        
+        if(!result && key->has_identity) {
+            result = (entry->identity.device      == key->identity.device &&
+                      entry->identity.file_id     == key->identity.file_id &&
+                      entry->identity.size        == key->identity.size &&
+                      entry->identity.modify_time == key->identity.modify_time);
+        }
+    }
+    
+    return result;
+}
+
+static Split_Cache_Entry *
+find_split_cache_entry(Split_Cache *cache, Split_Cache_Key *key) {
+    For(i64, it_index, cache->count) {
+        if(is_split_cache_match(cache->entries + it_index, key)) {
+            return cache->entries + it_index;
+        }
+    }
+    
+    return 0;
+}
+
+//~ NOTE(Patrik): Replaces the entry the key already matches, if there is one.
+static void
+insert_split_cache_entry(Split_Cache *cache, Split_Cache_Key *key, u32 unique_id, u16 chunk_count) {
+    Split_Cache_Entry *entry = find_split_cache_entry(cache, key);
+    
+    if(!entry) {
+        if(cache->count == cache->capacity) {
+            cache->capacity = (cache->capacity > 0) ? cache->capacity * 2 : 64;
+            
+            if(cache->entries) {
+                cache->entries = SPLTMRG_REALLOC(Split_Cache_Entry, cache->entries, cache->capacity);
+            } else {
+                cache->entries = SPLTMRG_ALLOC(Split_Cache_Entry, cache->capacity);
+            }
+        }
+        
+        entry = cache->entries + cache->count;
+        cache->count += 1;
+    }
+    
+    zero_memory((u8*)entry, sizeof(Split_Cache_Entry));
+    
+    entry->identity       = key->identity;
+    entry->content_digest = key->content_digest;
+    entry->options_digest = key->options_digest;
+    entry->unique_id      = unique_id;
+    entry->chunk_count    = chunk_count;
+}
+
+//~ NOTE(Patrik): The cache is a local file like the dedup manifest, so it is
+// stored in the native byte order.
+static void
+load_split_cache(Split_Cache *cache, char *file_name) {
+    File_Handle handle = os_open_file_for_reading(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        i64 count = os_get_size_of_file(handle) / sizeof(Split_Cache_Entry);
+        
+        if(count > 0) {
+            File_Data entries = make_file_data(count * sizeof(Split_Cache_Entry));
+            
+            count = os_read_file(&entries, handle, entries.capacity) / sizeof(Split_Cache_Entry);
+            
+            cache->entries  = (Split_Cache_Entry*)entries.data;
+            cache->count    = count;
+            cache->capacity = entries.capacity / sizeof(Split_Cache_Entry);
+        }
+        
+        os_close_file(handle);
+    }
+}
+
+static bool
+save_split_cache(Split_Cache *cache, char *file_name) {
+    bool result = false;
+    
+    File_Handle handle = os_open_file_for_writing(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        i64 length = cache->count * sizeof(Split_Cache_Entry);
+        
+        if(os_write_file(handle, (u8*)cache->entries, length) == length) {
+            result = true;
+        }
+        
+        os_close_file(handle);
+    }
+    
+    return result;
+}
@@ -0,0 +1,370 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// INCLUDES
+//
+#include "splitmerge.c"
+#include "splitmerge_stream.c"
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANTS
+//
+#define CAT_BUFFER_SIZE (4 * 1024 * 1024)
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+//~ NOTE(Patrik): The chunks that were given, indexed by file_index. Only the
+// headers have been read.
+typedef struct Cat_Bundle {
+    u32 unique_id;
+    u8  flags;
+    u16 total_file_count;
+    i64 first_header_length;
+    i64 chunk_size;
+    
+    //~ NOTE(Patrik): -1 until the last chunk is found.
+    i64 payload_size;
+    
+    String *files;
+    i64    *file_sizes;
+    bool    has_first_chunk;
+    bool    has_chunk;
+} Cat_Bundle;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CHUNKS
+//
+//~ NOTE(Patrik): Everything is printed to stderr, since the range itself goes
+// to stdout unless --output is given.
+static bool
+add_cat_chunk(Cat_Bundle *bundle, String arg) {
+    File_Handle handle = os_open_file_for_reading(arg.data);
+    
+    if(!os_is_handle_valid(handle)) {
+        fprintf(stderr, "Invalid file: \"%s\"\n", arg.data);
+        return false;
+    }
+    
+    i64       file_size = os_get_size_of_file(handle);
+    File_Data header    = make_file_data(sizeof(First_Header));
+    
+    os_read_file(&header, handle, sizeof(First_Header));
+    os_close_file(handle);
+    
+    bool          result = false;
+    Shared_Header shared = *(Shared_Header*)header.data;
+    
+    if(header.length < (i64)sizeof(Shared_Header) || !is_valid_header(shared)) {
+        fprintf(stderr, "%s is not a split file\n", arg.data);
+    } else if(shared.flags & ~SPLITMERGE_KNOWN_HEADER_FLAGS) {
+        fprintf(stderr, "%s was split by a newer version of splitmerge\n", arg.data);
+    } else if(is_flag_set(shared.flags, Header_Flag__Parity)) {
+        //~ NOTE(Patrik): Parity files are skipped, so a whole folder can be given.
+        result = true;
+    } else {
+        bool should_swap = should_swap_endian(shared.flags);
+        
+        if(should_swap) {
+            shared.unique_id  = swap_endian_u32(shared.unique_id);
+            shared.file_index = swap_endian_u16(shared.file_index);
+        }
+        
+        if(bundle->has_chunk && bundle->unique_id != shared.unique_id) {
+            fprintf(stderr, "%s belongs to another file\n", arg.data);
+        } else if(shared.file_index == 0 && header.length < (i64)sizeof(First_Header)) {
+            fprintf(stderr, "%s has an invalid header\n", arg.data);
+        } else {
+            bundle->unique_id = shared.unique_id;
+            bundle->flags     = shared.flags;
+            bundle->has_chunk = true;
+            
+            if(shared.file_index == 0) {
+                First_Header first = *(First_Header*)header.data;
+                
+                if(should_swap) {
+                    first.total_file_count = swap_endian_u16(first.total_file_count);
+                    first.file_name_length = swap_endian_u16(first.file_name_length);
+                }
+                
+                bundle->total_file_count    = first.total_file_count;
+                bundle->first_header_length = sizeof(First_Header) + first.file_name_length + 1;
+                bundle->chunk_size          = file_size;
+                bundle->has_first_chunk     = true;
+            }
+            
+            bundle->files[shared.file_index]      = arg;
+            bundle->file_sizes[shared.file_index] = file_size;
+            
+            result = true;
+        }
+    }
+    
+    SPLTMRG_FREE(header.data);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The size of the payload is only known from the size of the
+// last chunk, every other chunk is as big as the first one.
+static void
+set_cat_payload_size(Cat_Bundle *bundle) {
+    u16 last_index = bundle->total_file_count - 1;
+    
+    bundle->payload_size = -1;
+    
+    if(bundle->files[last_index].data) {
+        bundle->payload_size = bundle->file_sizes[last_index] - sizeof(Shared_Header);
+        
+        if(last_index == 0) {
+            bundle->payload_size = bundle->chunk_size - bundle->first_header_length;
+        } else {
+            bundle->payload_size += bundle->chunk_size - bundle->first_header_length;
+            bundle->payload_size += (i64)(last_index - 1) * (bundle->chunk_size - sizeof(Shared_Header));
+        }
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// RANGE
+//
+//~ NOTE(Patrik): Only the chunks the range is in are opened, and only the
+// bytes of the range are read out of them.
+static bool
+write_cat_range(Cat_Bundle *bundle, i64 offset, i64 length, File_Handle dest_handle, File_Data *buffer) {
+    bool result = true;
+    
+    while(length > 0 && result) {
+        Chunk_Range range = get_chunk_range(bundle->chunk_size, bundle->first_header_length, offset, length);
+        
+        bool is_last_chunk = (range.file_index + 1 == bundle->total_file_count);
+        
+        if(range.file_index >= bundle->total_file_count) {
+            fprintf(stderr, "The range goes past the end of the file\n");
+            return false;
+        }
+        
+        String file_name = bundle->files[range.file_index];
+        
+        if(!file_name.data) {
+            fprintf(stderr, "Chunk %u of the range is missing\n", range.file_index);
+            return false;
+        }
+        
+        if(!is_last_chunk && bundle->file_sizes[range.file_index] != bundle->chunk_size) {
+            fprintf(stderr, "%s is %lld bytes, it should be %lld bytes\n", file_name.data,
+                    (long long)bundle->file_sizes[range.file_index], (long long)bundle->chunk_size);
+            return false;
+        }
+        
+        File_Handle handle = os_open_file_for_reading(file_name.data);
+        
+        if(!os_is_handle_valid(handle) || !os_set_file_pointer(handle, range.file_offset)) {
+            fprintf(stderr, "Invalid file: \"%s\"\n", file_name.data);
+            
+            if(os_is_handle_valid(handle)) {
+                os_close_file(handle);
+            }
+            
+            return false;
+        }
+        
+        i64 remaining = range.length;
+        
+        while(remaining > 0) {
+            buffer->length = 0;
+            
+            i64 read_amount = (remaining < buffer->capacity) ? remaining : buffer->capacity;
+            i64 read_length = os_read_file(buffer, handle, read_amount);
+            
+            if(read_length <= 0) {
+                fprintf(stderr, "%s ends before the range does\n", file_name.data);
+                result = false;
+                break;
+            }
+            
+            i64 written_length = 0;
+            
+            if(dest_handle) {
+                written_length = os_write_file(dest_handle, buffer->data, read_length);
+            } else {
+                written_length = os_write_standard_output(buffer->data, read_length);
+            }
+            
+            if(written_length != read_length) {
+                fprintf(stderr, "Could not write the range\n");
+                result = false;
+                break;
+            }
+            
+            remaining -= read_length;
+        }
+        
+        os_close_file(handle);
+        
+        offset += range.length;
+        length -= range.length;
+    }
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MAIN
+//
+int
+main(int arg_count, char **arg_data) {
+    //~ NOTE(Patrik): From here on the names in @lists and --files-from are
+    // part of the command line.
+    Arg_List args = {0};
+    
+    if(!expand_args(arg_count, arg_data, &args)) {
+        return 1;
+    }
+    
+    arg_count = args.count;
+    arg_data  = args.data;
+    
+    Cat_Bundle bundle = {0};
+    
+    bundle.files      = SPLTMRG_ALLOC(String, 0x10000);
+    bundle.file_sizes = SPLTMRG_ALLOC(i64, 0x10000);
+    
+    char *output_name = 0;
+    i64   offset      = 0;
+    i64   length      = -1;
+    bool  result      = true;
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if((is_equal_to_ntstring(arg, "--offset") || is_equal_to_ntstring(arg, "--length")) &&
+           arg_index + 1 < arg_count)
+        {
+            String value = set_string_from_ntstring(arg_data[arg_index + 1]);
+            u64    size  = 0;
+            
+            //~ NOTE(Patrik): A negative offset is from the end of the file.
+            bool is_negative = is_equal_to_ntstring(arg, "--offset") && begins_with_char(value, '-');
+            
+            if(is_negative) {
+                advance_string(&value, 1);
+            }
+            
+            if(!parse_size(value, &size) || size > 0x7FFFFFFFFFFFFFFF) {
+                fprintf(stderr, "Invalid value for %s: %s\n", arg.data, arg_data[arg_index + 1]);
+                return 1;
+            }
+            
+            if(is_equal_to_ntstring(arg, "--length")) {
+                length = (i64)size;
+            } else {
+                offset = is_negative ? -(i64)size : (i64)size;
+            }
+            
+            arg_index += 1;
+        } else if(is_equal_to_ntstring(arg, "--output") && arg_index + 1 < arg_count) {
+            arg_index   += 1;
+            output_name  = arg_data[arg_index];
+        } else if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            fprintf(stderr, "Unknown option: %s\n", arg.data);
+        } else if(!add_cat_chunk(&bundle, arg)) {
+            result = false;
+        }
+    }
+    
+    if(!result) {
+        return 1;
+    }
+    
+    if(!bundle.has_first_chunk) {
+        fprintf(stderr, "The first chunk is needed to find where the range is\n");
+        return 1;
+    }
+    
+    if(bundle.flags & (Header_Flag__Dedup | Header_Flag__Delta | Header_Flag__Sparse | Header_Flag__Pack)) {
+        fprintf(stderr, "Only a bundle that was split as it is can be read by range, merge this one instead\n");
+        return 1;
+    }
+    
+    set_cat_payload_size(&bundle);
+    
+    if((offset < 0 || length < 0) && bundle.payload_size < 0) {
+        fprintf(stderr, "The last chunk is needed to read up to the end of the file\n");
+        return 1;
+    }
+    
+    if(offset < 0) {
+        offset += bundle.payload_size;
+        
+        if(offset < 0) {
+            offset = 0;
+        }
+    }
+    
+    if(bundle.payload_size >= 0) {
+        if(offset > bundle.payload_size) {
+            offset = bundle.payload_size;
+        }
+        
+        if(length < 0 || length > bundle.payload_size - offset) {
+            length = bundle.payload_size - offset;
+        }
+    }
+    
+    File_Handle dest_handle = 0;
+    
+    if(output_name) {
+        dest_handle = os_open_file_for_writing(output_name);
+        
+        if(!os_is_handle_valid(dest_handle)) {
+            fprintf(stderr, "Could not write \"%s\"\n", output_name);
+            return 1;
+        }
+    }
+    
+    File_Data buffer = make_file_data(CAT_BUFFER_SIZE);
+    
+    result = write_cat_range(&bundle, offset, length, dest_handle, &buffer);
+    
+    if(dest_handle) {
+        os_close_file(dest_handle);
+    }
+    
+    return result ? 0 : 1;
+}
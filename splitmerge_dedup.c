@@ -0,0 +1,370 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANTS
+//
+//~ NOTE(Patrik): Blocks are cut where the gear hash hits a mask (FastCDC),
+// so an insert or delete in the file only changes the blocks around it.
+// The masks are harder to hit before the average size and easier after it,
+// which keeps the block sizes close to the average.
+#define DEDUP_MIN_BLOCK_SIZE     (16 * 1024)
+#define DEDUP_AVERAGE_BLOCK_SIZE (64 * 1024)
+#define DEDUP_MAX_BLOCK_SIZE     (256 * 1024)
+
+#define DEDUP_AVERAGE_BLOCK_BITS 16
+#define DEDUP_NORMALIZATION      2
+
+#define DEDUP_WINDOW_SIZE (32 * DEDUP_MAX_BLOCK_SIZE)
+
+#define DEDUP_MANIFEST_NAME "dedup.manifest"
+#define DEDUP_STORE_NAME    "dedup.store"
+#define DEDUP_INDEX_NAME    "dedup.index"
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef struct Dedup_Entry {
+    //~ NOTE(Patrik): From hash_content, the block is only ever known by its
+    // digest, so it has to be one nobody can make collide.
+    Hash128 digest;
+    
+    //~ NOTE(Patrik): offset is only used by merge, it is where the block
+    // is kept in the block store. Split only needs to know the block exists.
+    u64 offset;
+    u32 length;
+    u32 reserved;
+} Dedup_Entry;
+
+typedef struct Dedup_Table {
+    Dedup_Entry *entries;
+    i64 count;
+    i64 capacity;
+} Dedup_Table;
+
+//~ NOTE(Patrik): Walks a file one content-defined block at a time.
+typedef struct Block_Scanner {
+    File_Handle handle;
+    File_Data   window;
+    i64         window_offset;
+    i64         file_offset;
+    i64         read_offset;
+    bool        is_end_of_file;
+} Block_Scanner;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// GEAR
+//
+static u64 dedup_gear_table[256];
+static u64 dedup_mask_small;
+static u64 dedup_mask_large;
+
+static u64
+make_dedup_mask(i32 bit_count) {
+    u64 result = 0;
+    i32 step   = 48 / bit_count;
+    
+    For(i32, it_index, bit_count) {
+        result |= (u64)1 << (63 - it_index * step);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The gear table has to be identical on every run and every
+// machine, otherwise the same content would be cut at different places.
+static void
+init_dedup() {
+    u64 state = 0x53504C49544D5247;
+    
+    For(i32, it_index, 256) {
+        state += 0x9e3779b97f4a7c15;
+        
+        u64 value = state;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+        value =  value ^ (value >> 31);
+        
+        dedup_gear_table[it_index] = value;
+    }
+    
+    dedup_mask_small = make_dedup_mask(DEDUP_AVERAGE_BLOCK_BITS + DEDUP_NORMALIZATION);
+    dedup_mask_large = make_dedup_mask(DEDUP_AVERAGE_BLOCK_BITS - DEDUP_NORMALIZATION);
+}
+
+//~ NOTE(Patrik): Returns the length of the next block. The first
+// DEDUP_MIN_BLOCK_SIZE bytes are never a cut point, so they are skipped
+// without hashing.
+static i64
+find_dedup_cut(u8 *data, i64 length) {
+    if(length <= DEDUP_MIN_BLOCK_SIZE) {
+        return length;
+    }
+    
+    i64 normal_length = DEDUP_AVERAGE_BLOCK_SIZE;
+    i64 max_length    = DEDUP_MAX_BLOCK_SIZE;
+    
+    if(max_length > length) {
+        max_length = length;
+    }
+    
+    if(normal_length > max_length) {
+        normal_length = max_length;
+    }
+    
+    u64 hash  = 0;
+    i64 index = DEDUP_MIN_BLOCK_SIZE;
+    
+    while(index < normal_length) {
+        hash = (hash << 1) + dedup_gear_table[data[index]];
+        
+        if(!(hash & dedup_mask_small)) {
+            return index + 1;
+        }
+        
+        index += 1;
+    }
+    
+    while(index < max_length) {
+        hash = (hash << 1) + dedup_gear_table[data[index]];
+        
+        if(!(hash & dedup_mask_large)) {
+            return index + 1;
+        }
+        
+        index += 1;
+    }
+    
+    return max_length;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SCANNER
+//
+static Block_Scanner
+make_block_scanner(File_Handle handle) {
+    Block_Scanner result = {0};
+    
+    result.handle = handle;
+    result.window = make_file_data(DEDUP_WINDOW_SIZE);
+    
+    os_advise_sequential(handle);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Returns false when the whole file has been scanned. The block
+// points into the window and is only valid until the next call.
+static bool
+next_block(Block_Scanner *scanner, u8 **block, i64 *block_length) {
+    File_Data *window = &scanner->window;
+    
+    scanner->file_offset += *block_length;
+    
+    //~ NOTE(Patrik): Keep at least one max sized block in the window so
+    // that the cut points do not depend on where the reads happen to end.
+    if(!scanner->is_end_of_file && window->length - scanner->window_offset < DEDUP_MAX_BLOCK_SIZE) {
+        window->length -= scanner->window_offset;
+        copy_memory(window->data, window->data + scanner->window_offset, window->length);
+        scanner->window_offset = 0;
+        
+        i64 read_amount = window->capacity - window->length;
+        i64 read_length = os_read_file(window, scanner->handle, read_amount);
+        
+        drop_streamed_range(scanner->handle, scanner->read_offset, read_length);
+        
+        scanner->read_offset += read_length;
+        
+        if(read_length < read_amount) {
+            scanner->is_end_of_file = true;
+        }
+    }
+    
+    if(scanner->window_offset >= window->length) {
+        *block        = 0;
+        *block_length = 0;
+        
+        return false;
+    }
+    
+    *block        = window->data + scanner->window_offset;
+    *block_length = find_dedup_cut(*block, window->length - scanner->window_offset);
+    
+    scanner->window_offset += *block_length;
+    
+    return true;
+}
+
+static void
+free_block_scanner(Block_Scanner *scanner) {
+    SPLTMRG_FREE(scanner->window.data);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TABLE
+//
+static Dedup_Table
+make_dedup_table(i64 capacity) {
+    Dedup_Table result = {0};
+    
+    result.capacity = capacity;
+    result.entries  = SPLTMRG_ALLOC(Dedup_Entry, result.capacity);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Open addressing with linear probing, capacity is always a
+// power of two. A length of 0 marks an empty slot since blocks are never empty.
+static Dedup_Entry *
+find_dedup_slot(Dedup_Table *table, Hash128 digest) {
+    u64 mask  = (u64)table->capacity - 1;
+    u64 index = digest.lo & mask;
+    
+    while(table->entries[index].length != 0) {
+        if(are_hashes_equal(table->entries[index].digest, digest)) {
+            break;
+        }
+        
+        index = (index + 1) & mask;
+    }
+    
+    return table->entries + index;
+}
+
+static Dedup_Entry *
+find_dedup_entry(Dedup_Table *table, Hash128 digest) {
+    Dedup_Entry *result = 0;
+    
+    if(table && table->entries) {
+        Dedup_Entry *slot = find_dedup_slot(table, digest);
+        
+        if(slot->length != 0) {
+            result = slot;
+        }
+    }
+    
+    return result;
+}
+
+static void
+insert_dedup_entry(Dedup_Table *table, Dedup_Entry entry) {
+    if(table && entry.length != 0) {
+        if((table->count + 1) * 2 > table->capacity) {
+            Dedup_Table new_table = make_dedup_table(table->capacity * 2);
+            
+            For(i64, it_index, table->capacity) {
+                Dedup_Entry *it = table->entries + it_index;
+                
+                if(it->length != 0) {
+                    *find_dedup_slot(&new_table, it->digest) = *it;
+                    new_table.count += 1;
+                }
+            }
+            
+            SPLTMRG_FREE(table->entries);
+            *table = new_table;
+        }
+        
+        Dedup_Entry *slot = find_dedup_slot(table, entry.digest);
+        
+        if(slot->length == 0) {
+            table->count += 1;
+        }
+        
+        *slot = entry;
+    }
+}
+
+//~ NOTE(Patrik): The manifest and the index are local files, they are never
+// sent anywhere, so they are stored in the native byte order.
+static void
+load_dedup_table(Dedup_Table *table, char *file_name) {
+    File_Handle handle = os_open_file_for_reading(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        File_Data entries = make_file_data(4096 * sizeof(Dedup_Entry));
+        
+        while(os_read_file(&entries, handle, entries.capacity) > 0) {
+            i64 count = entries.length / sizeof(Dedup_Entry);
+            
+            For(i64, it_index, count) {
+                insert_dedup_entry(table, ((Dedup_Entry*)entries.data)[it_index]);
+            }
+            
+            entries.length = 0;
+        }
+        
+        SPLTMRG_FREE(entries.data);
+        
+        os_close_file(handle);
+    }
+}
+
+static bool
+save_dedup_table(Dedup_Table *table, char *file_name) {
+    bool result = false;
+    
+    File_Handle handle = os_open_file_for_writing(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        File_Data entries = make_file_data(4096 * sizeof(Dedup_Entry));
+        
+        result = true;
+        
+        For(i64, it_index, table->capacity) {
+            Dedup_Entry *it = table->entries + it_index;
+            
+            if(it->length != 0) {
+                ((Dedup_Entry*)entries.data)[entries.length / sizeof(Dedup_Entry)] = *it;
+                entries.length += sizeof(Dedup_Entry);
+            }
+            
+            if(entries.length == entries.capacity || it_index == table->capacity - 1) {
+                if(os_write_file(handle, entries.data, entries.length) != entries.length) {
+                    result = false;
+                    break;
+                }
+                
+                entries.length = 0;
+            }
+        }
+        
+        SPLTMRG_FREE(entries.data);
+        
+        os_close_file(handle);
+    }
+    
+    return result;
+}
@@ -0,0 +1,324 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DURABILITY
+//
+//~ NOTE(Patrik): Include this after splitmerge_throttle.c, so the flushes are
+// counted and throttled like everything else. --durability decides what is
+// done to a file that has been written when it is closed.
+//
+// none     It is closed right away and the OS writes it out when it wants to.
+//          After a crash a file can be there with the right name but be cut
+//          short or hold zeros.
+// batched  Writing it out is started when it is closed, and the handle is kept
+//          until sync_files files or sync_size bytes are waiting. Then every
+//          one of them is flushed, which has mostly been done in the background
+//          by then, while the next files were being written.
+// strict   It is written under a temporary name, flushed and then renamed, so
+//          a file only ever has its real name once all of it is on the disk.
+//
+// With batched and strict the folders are flushed at the end as well, so the
+// names of the new files are not lost either.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef enum Durability_Mode {
+    Durability_Mode__None,
+    Durability_Mode__Batched,
+    Durability_Mode__Strict,
+} Durability_Mode;
+
+typedef struct Durability {
+    Durability_Mode mode;
+    i64             sync_size;
+    i32             sync_files;
+} Durability;
+
+//~ NOTE(Patrik): The files written by one thread that are waiting to be flushed.
+typedef struct Durable_Batch {
+    File_Handle *handles;
+    i32          count;
+    i64          size;
+} Durable_Batch;
+
+#define DURABLE_TEMP_EXTENSION ".tmp"
+
+#define DURABLE_DEFAULT_SYNC_SIZE  (256 * 1024 * 1024)
+#define DURABLE_DEFAULT_SYNC_FILES 64
+#define DURABLE_MAX_SYNC_FILES     256
+
+static Durability global_durability = {
+    Durability_Mode__None, DURABLE_DEFAULT_SYNC_SIZE, DURABLE_DEFAULT_SYNC_FILES
+};
+
+
+//~~~~~~~~~~~~~~~~
+//
+// OPTIONS
+//
+static bool
+is_durability_option(String arg) {
+    if(is_equal_to_ntstring(arg, "--durability") ||
+       is_equal_to_ntstring(arg, "--sync-size")  ||
+       is_equal_to_ntstring(arg, "--sync-files"))
+    {
+        return true;
+    }
+    return false;
+}
+
+//~ NOTE(Patrik): --sync-size takes a K, M or G suffix. Setting either of the
+// batch limits turns on batched mode if no mode was given.
+static bool
+parse_durability_option(String arg, char *value) {
+    String value_string = set_string_from_ntstring(value);
+    u64    result       = 0;
+    
+    if(is_equal_to_ntstring(arg, "--durability")) {
+        if(is_equal_to_ntstring(value_string, "none")) {
+            global_durability.mode = Durability_Mode__None;
+        } else if(is_equal_to_ntstring(value_string, "batched")) {
+            global_durability.mode = Durability_Mode__Batched;
+        } else if(is_equal_to_ntstring(value_string, "strict")) {
+            global_durability.mode = Durability_Mode__Strict;
+        } else {
+            printf("Invalid value for %s: %s, it has to be none, batched or strict\n", arg.data, value);
+            return false;
+        }
+        
+        return true;
+    }
+    
+    if(is_equal_to_ntstring(arg, "--sync-size")) {
+        if(!parse_size(value_string, &result) || result == 0 || result > ((u64)1 << 40)) {
+            printf("Invalid value for %s: %s\n", arg.data, value);
+            return false;
+        }
+        
+        global_durability.sync_size = (i64)result;
+    } else {
+        if(!parse_u64(value_string, &result) || result == 0 || result > DURABLE_MAX_SYNC_FILES) {
+            printf("Invalid value for %s: %s, it has to be 1 to %d\n", arg.data, value, DURABLE_MAX_SYNC_FILES);
+            return false;
+        }
+        
+        global_durability.sync_files = (i32)result;
+    }
+    
+    if(global_durability.mode == Durability_Mode__None) {
+        global_durability.mode = Durability_Mode__Batched;
+    }
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// FILES
+//
+//~ NOTE(Patrik): Call this on the name of a file that is about to be opened for
+// writing. In strict mode the file is written under a temporary name.
+static void
+append_durable_suffix(String *file_name) {
+    if(global_durability.mode == Durability_Mode__Strict) {
+        append_cstring(file_name, UNPACK_NTSTRING(DURABLE_TEMP_EXTENSION));
+        null_terminate(file_name);
+    }
+}
+
+//~ NOTE(Patrik): Flushes and closes every file in the batch. Returns false if
+// any of them could not be flushed.
+static bool
+flush_durable_batch(Durable_Batch *batch) {
+    bool result = true;
+    
+    For(i32, it_index, batch->count) {
+        File_Handle handle = batch->handles[it_index];
+        
+        if(!os_flush_file(handle)) {
+            result = false;
+        }
+        
+        drop_streamed_file(handle);
+        os_close_file(handle);
+    }
+    
+    batch->count = 0;
+    batch->size  = 0;
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Flushes what is left in the batch and frees it.
+static bool
+end_durable_batch(Durable_Batch *batch) {
+    bool result = flush_durable_batch(batch);
+    
+    if(batch->handles) {
+        SPLTMRG_FREE(batch->handles);
+        batch->handles = 0;
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Closes a file that has been written whole, length is how much
+// was written to it. Only call this if every write went through, otherwise
+// call abandon_durable_file, so a broken file is never renamed into place.
+// In strict mode file_name is the temporary name the file was opened with, the
+// file is renamed and file_name is left as the real name. In batched mode the
+// file is only closed later on, and a false can be from an earlier file in the
+// same batch.
+static bool
+close_durable_file(Durable_Batch *batch, File_Handle handle, i64 length, String *file_name) {
+    bool result = true;
+    
+    switch(global_durability.mode) {
+        case Durability_Mode__None: {
+            drop_streamed_file(handle);
+            os_close_file(handle);
+        } break;
+        
+        case Durability_Mode__Batched: {
+            os_begin_flush_file(handle);
+            
+            if(!batch->handles) {
+                batch->handles = SPLTMRG_ALLOC(File_Handle, global_durability.sync_files);
+            }
+            
+            batch->handles[batch->count] = handle;
+            batch->count += 1;
+            batch->size  += length;
+            
+            if(batch->count >= global_durability.sync_files || batch->size >= global_durability.sync_size) {
+                result = flush_durable_batch(batch);
+            }
+        } break;
+        
+        case Durability_Mode__Strict: {
+            result = os_flush_file(handle);
+            
+            drop_streamed_file(handle);
+            os_close_file(handle);
+            
+            i32    name_length = (i32)(file_name->length - (sizeof(DURABLE_TEMP_EXTENSION) - 1));
+            String real_name   = make_string(name_length + 1);
+            
+            append_cstring(&real_name, file_name->data, name_length);
+            null_terminate(&real_name);
+            
+            if(result) {
+                result = os_move_file(file_name->data, real_name.data);
+            }
+            
+            if(!result) {
+                os_delete_file(file_name->data);
+            }
+            
+            file_name->length = name_length;
+            null_terminate(file_name);
+            
+            SPLTMRG_FREE(real_name.data);
+        } break;
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Closes a file that could not be written whole. In strict mode
+// it only has its temporary name, so it is deleted.
+static void
+abandon_durable_file(File_Handle handle, String file_name) {
+    os_close_file(handle);
+    
+    if(global_durability.mode == Durability_Mode__Strict) {
+        os_delete_file(file_name.data);
+    }
+}
+
+//~ NOTE(Patrik): For files that are written over in place. In strict mode this
+// is not as safe as a new file, a crash can leave part of the new data in it.
+static bool
+flush_durable_file(File_Handle handle) {
+    if(global_durability.mode != Durability_Mode__None) {
+        return os_flush_file(handle);
+    }
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// FOLDERS
+//
+static bool
+flush_durable_directories(Directory_Cache *cache) {
+    bool result = true;
+    
+    if(global_durability.mode != Durability_Mode__None) {
+        For(i32, it_index, cache->count) {
+            if(cache->handles[it_index] && !os_flush_directory(cache->handles[it_index])) {
+                result = false;
+            }
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): For files that were not opened relative to a cached folder.
+static bool
+flush_durable_folder(String path) {
+    bool result = true;
+    
+    if(global_durability.mode != Durability_Mode__None) {
+        String folder = make_string(path.length + 1);
+        
+        append_string(&folder, path);
+        null_terminate(&folder);
+        
+        Directory_Handle directory = os_open_directory(folder.data);
+        
+        if(directory) {
+            result = os_flush_directory(directory);
+            
+            os_close_directory(directory);
+        }
+        
+        SPLTMRG_FREE(folder.data);
+    }
+    
+    return result;
+}
@@ -0,0 +1,389 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef struct Hash128 {
+    u64 lo;
+    u64 hi;
+} Hash128;
+
+//~ NOTE(Patrik): Streaming MurmurHash3 (x64, 128-bit).
+// The input is always read as little-endian so that the same bytes hash to
+// the same value on every machine, digests are compared across hosts.
+typedef struct Hash_State {
+    u64 h1;
+    u64 h2;
+    u8  tail[16];
+    i32 tail_length;
+    u64 total_length;
+} Hash_State;
+
+#define HASH_C1 0x87c37b91114253d5
+#define HASH_C2 0x4cf5ad432745937f
+
+//~ NOTE(Patrik): SHA-256, for when a digest stands in for the content itself.
+// MurmurHash is only good for catching damage, anyone can make two blocks
+// with the same MurmurHash, and then a dedup store or the split cache would
+// hand out the wrong data without noticing. The first 128 bits of the digest
+// are kept so it still fits in a Hash128.
+typedef struct Content_Hash_State {
+    u32 state[8];
+    u8  block[64];
+    i32 block_length;
+    u64 total_length;
+} Content_Hash_State;
+
+static const u32 content_hash_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+//~~~~~~~~~~~~~~~~
+//
+// HELPERS
+//
+static u64
+rotate_left_u64(u64 value, i32 amount) {
+    return (value << amount) | (value >> (64 - amount));
+}
+
+static u64
+load_u64_le(u8 *data) {
+    u64 result = ((u64)data[0]       | (u64)data[1] <<  8 |
+                  (u64)data[2] << 16 | (u64)data[3] << 24 |
+                  (u64)data[4] << 32 | (u64)data[5] << 40 |
+                  (u64)data[6] << 48 | (u64)data[7] << 56);
+    
+    return result;
+}
+
+static u64
+hash_fmix_u64(u64 value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccd;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53;
+    value ^= value >> 33;
+    
+    return value;
+}
+
+static void
+hash_block(Hash_State *state, u8 *block) {
+    u64 k1 = load_u64_le(block);
+    u64 k2 = load_u64_le(block + 8);
+    
+    k1 *= HASH_C1;
+    k1  = rotate_left_u64(k1, 31);
+    k1 *= HASH_C2;
+    state->h1 ^= k1;
+    
+    state->h1  = rotate_left_u64(state->h1, 27);
+    state->h1 += state->h2;
+    state->h1  = state->h1 * 5 + 0x52dce729;
+    
+    k2 *= HASH_C2;
+    k2  = rotate_left_u64(k2, 33);
+    k2 *= HASH_C1;
+    state->h2 ^= k2;
+    
+    state->h2  = rotate_left_u64(state->h2, 31);
+    state->h2 += state->h1;
+    state->h2  = state->h2 * 5 + 0x38495ab5;
+}
+
+static u32
+rotate_right_u32(u32 value, i32 amount) {
+    return (value >> amount) | (value << (32 - amount));
+}
+
+static void
+content_hash_block(Content_Hash_State *state, u8 *block) {
+    u32 w[64];
+    
+    For(i32, it_index, 16) {
+        u8 *it = block + it_index * 4;
+        w[it_index] = (u32)it[0] << 24 | (u32)it[1] << 16 | (u32)it[2] << 8 | (u32)it[3];
+    }
+    
+    for_range(i32, it_index, 16, 64) {
+        u32 s0 = (rotate_right_u32(w[it_index - 15], 7) ^ rotate_right_u32(w[it_index - 15], 18) ^
+                  (w[it_index - 15] >> 3));
+        u32 s1 = (rotate_right_u32(w[it_index - 2], 17) ^ rotate_right_u32(w[it_index - 2], 19) ^
+                  (w[it_index - 2] >> 10));
+        
+        w[it_index] = w[it_index - 16] + s0 + w[it_index - 7] + s1;
+    }
+    
+    u32 a = state->state[0];
+    u32 b = state->state[1];
+    u32 c = state->state[2];
+    u32 d = state->state[3];
+    u32 e = state->state[4];
+    u32 f = state->state[5];
+    u32 g = state->state[6];
+    u32 h = state->state[7];
+    
+    For(i32, it_index, 64) {
+        u32 s1 = rotate_right_u32(e, 6) ^ rotate_right_u32(e, 11) ^ rotate_right_u32(e, 25);
+        u32 ch = (e & f) ^ (~e & g);
+        u32 t1 = h + s1 + ch + content_hash_k[it_index] + w[it_index];
+        u32 s0 = rotate_right_u32(a, 2) ^ rotate_right_u32(a, 13) ^ rotate_right_u32(a, 22);
+        u32 mj = (a & b) ^ (a & c) ^ (b & c);
+        u32 t2 = s0 + mj;
+        
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    
+    state->state[0] += a;
+    state->state[1] += b;
+    state->state[2] += c;
+    state->state[3] += d;
+    state->state[4] += e;
+    state->state[5] += f;
+    state->state[6] += g;
+    state->state[7] += h;
+}
+
+//~~~~~~~~~~~~~~~~
+//
+// HASH
+//
+static Hash_State
+begin_hash(u64 seed) {
+    Hash_State result = {0};
+    
+    result.h1 = seed;
+    result.h2 = seed;
+    
+    return result;
+}
+
+static void
+update_hash(Hash_State *state, u8 *data, i64 length) {
+    if(state && data) {
+        state->total_length += length;
+        
+        if(state->tail_length > 0) {
+            while(length > 0 && state->tail_length < 16) {
+                state->tail[state->tail_length] = *data;
+                state->tail_length += 1;
+                data               += 1;
+                length             -= 1;
+            }
+            
+            if(state->tail_length == 16) {
+                hash_block(state, state->tail);
+                state->tail_length = 0;
+            }
+        }
+        
+        while(length >= 16) {
+            hash_block(state, data);
+            data   += 16;
+            length -= 16;
+        }
+        
+        For(i64, it_index, length) {
+            state->tail[state->tail_length] = data[it_index];
+            state->tail_length += 1;
+        }
+    }
+}
+
+static Hash128
+end_hash(Hash_State *state) {
+    Hash128 result = {0};
+    
+    u64 k1 = 0;
+    u64 k2 = 0;
+    
+    rfor(i32, it_index, state->tail_length) {
+        if(it_index >= 8) {
+            k2 |= (u64)state->tail[it_index] << ((it_index - 8) * 8);
+        } else {
+            k1 |= (u64)state->tail[it_index] << (it_index * 8);
+        }
+    }
+    
+    if(state->tail_length > 8) {
+        k2 *= HASH_C2;
+        k2  = rotate_left_u64(k2, 33);
+        k2 *= HASH_C1;
+        state->h2 ^= k2;
+    }
+    
+    if(state->tail_length > 0) {
+        k1 *= HASH_C1;
+        k1  = rotate_left_u64(k1, 31);
+        k1 *= HASH_C2;
+        state->h1 ^= k1;
+    }
+    
+    u64 h1 = state->h1 ^ state->total_length;
+    u64 h2 = state->h2 ^ state->total_length;
+    
+    h1 += h2;
+    h2 += h1;
+    
+    h1 = hash_fmix_u64(h1);
+    h2 = hash_fmix_u64(h2);
+    
+    h1 += h2;
+    h2 += h1;
+    
+    result.lo = h1;
+    result.hi = h2;
+    
+    return result;
+}
+
+static Hash128
+hash_data(u8 *data, i64 length) {
+    Hash_State state = begin_hash(0);
+    
+    update_hash(&state, data, length);
+    
+    return end_hash(&state);
+}
+
+static bool
+are_hashes_equal(Hash128 a, Hash128 b) {
+    if(a.lo == b.lo && a.hi == b.hi) {
+        return true;
+    }
+    return false;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONTENT HASH
+//
+static Content_Hash_State
+begin_content_hash(void) {
+    Content_Hash_State result = {0};
+    
+    result.state[0] = 0x6a09e667;
+    result.state[1] = 0xbb67ae85;
+    result.state[2] = 0x3c6ef372;
+    result.state[3] = 0xa54ff53a;
+    result.state[4] = 0x510e527f;
+    result.state[5] = 0x9b05688c;
+    result.state[6] = 0x1f83d9ab;
+    result.state[7] = 0x5be0cd19;
+    
+    return result;
+}
+
+static void
+update_content_hash(Content_Hash_State *state, u8 *data, i64 length) {
+    if(state && data) {
+        state->total_length += length;
+        
+        if(state->block_length > 0) {
+            while(length > 0 && state->block_length < 64) {
+                state->block[state->block_length] = *data;
+                state->block_length += 1;
+                data                += 1;
+                length              -= 1;
+            }
+            
+            if(state->block_length == 64) {
+                content_hash_block(state, state->block);
+                state->block_length = 0;
+            }
+        }
+        
+        while(length >= 64) {
+            content_hash_block(state, data);
+            data   += 64;
+            length -= 64;
+        }
+        
+        For(i64, it_index, length) {
+            state->block[state->block_length] = data[it_index];
+            state->block_length += 1;
+        }
+    }
+}
+
+//~ NOTE(Patrik): lo is the first 8 bytes of the SHA-256 digest and hi the
+// next 8, both read as big-endian like the rest of SHA-256.
+static Hash128
+end_content_hash(Content_Hash_State *state) {
+    Hash128 result = {0};
+    
+    u64 bit_length = state->total_length * 8;
+    
+    state->block[state->block_length] = 0x80;
+    state->block_length += 1;
+    
+    if(state->block_length > 56) {
+        zero_memory(state->block + state->block_length, 64 - state->block_length);
+        content_hash_block(state, state->block);
+        state->block_length = 0;
+    }
+    
+    zero_memory(state->block + state->block_length, 56 - state->block_length);
+    
+    For(i32, it_index, 8) {
+        state->block[56 + it_index] = (u8)(bit_length >> (56 - it_index * 8));
+    }
+    
+    content_hash_block(state, state->block);
+    
+    result.lo = (u64)state->state[0] << 32 | state->state[1];
+    result.hi = (u64)state->state[2] << 32 | state->state[3];
+    
+    return result;
+}
+
+static Hash128
+hash_content(u8 *data, i64 length) {
+    Content_Hash_State state = begin_content_hash();
+    
+    update_content_hash(&state, data, length);
+    
+    return end_content_hash(&state);
+}
@@ -75,6 +75,179 @@ typedef struct First_Header {
 } First_Header;
 
 
+//~~~~~~~~~~~~~~~~
+//
+// DEDUP
+//
+enum Dedup_Record_Type {
+    Dedup_Record_Type__Literal   = 0,
+    Dedup_Record_Type__Reference = 1,
+};
+
+//~ NOTE(Patrik): The payload of a bundle with Header_Flag__Dedup is a list of
+// records instead of the file itself. A literal record is followed by length
+// bytes of data, a reference record points to a block that was sent in an
+// earlier bundle and is looked up by its digest when merging.
+typedef struct Dedup_Record {
+    unsigned char type;
+    
+    u32 length;
+    
+    //~ NOTE(Patrik): 128-bit hash of the block, low half first.
+    u64 digest_lo;
+    u64 digest_hi;
+} Dedup_Record;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DELTA
+//
+enum Delta_Record_Type {
+    Delta_Record_Type__Copy    = 0,
+    Delta_Record_Type__Literal = 1,
+    Delta_Record_Type__End     = 2,
+};
+
+//~ NOTE(Patrik): The payload of a bundle with Header_Flag__Delta starts with
+// a Delta_Header followed by records that rebuild the file from a base file.
+// A copy record copies length bytes from offset in the base file.
+// A literal record is followed by length bytes of data.
+// The end record has the size of the rebuilt file as length and is followed
+// by a Delta_Digest of the rebuilt file, so a wrong base file is caught.
+typedef struct Delta_Header {
+    u64 base_size;
+} Delta_Header;
+
+typedef struct Delta_Record {
+    unsigned char type;
+    
+    u64 offset;
+    u64 length;
+} Delta_Record;
+
+typedef struct Delta_Digest {
+    u64 digest_lo;
+    u64 digest_hi;
+} Delta_Digest;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PARITY
+//
+//~ NOTE(Patrik): A parity file has Header_Flag__Parity set in its shared header
+// and file_index is group_index * parity_count + parity_index.
+// The data files of a group are group_index * group_size and the data_count
+// files after it. The parity covers the whole data files, headers included,
+// as if every file was padded with zeros to stripe_length.
+typedef struct Parity_Header {
+    //~ NOTE(Patrik): Same as in the first header, so the bundle can be merged
+    // even if the first file is the one that was lost.
+    u16 total_file_count;
+    
+    u16 group_index;
+    u16 group_size;
+    u16 data_count;
+    u16 parity_count;
+    u16 parity_index;
+    
+    //~ NOTE(Patrik): Length of the parity data, which is the length of the
+    // longest data file in the group.
+    u64 stripe_length;
+    
+    //~ NOTE(Patrik): Followed by data_count Parity_Chunk_Info and then the parity data.
+} Parity_Header;
+
+typedef struct Parity_Chunk_Info {
+    u64 length;
+    u64 digest_lo;
+    u64 digest_hi;
+} Parity_Chunk_Info;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PACK
+//
+//~ NOTE(Patrik): The payload of a bundle with Header_Flag__Pack is the data of
+// every packed file one after the other, then one Pack_Entry per file, and a
+// Pack_Trailer as the very last bytes of the payload.
+// Names are relative paths that use '/' and never go above the pack.
+typedef struct Pack_Entry {
+    u64 offset;
+    u64 length;
+    u16 name_length;
+    
+    //~ NOTE(Patrik): Followed by name_length bytes of the name, no null terminator.
+} Pack_Entry;
+
+typedef struct Pack_Trailer {
+    u64 index_offset;
+    u64 entry_count;
+} Pack_Trailer;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SPARSE
+//
+enum Sparse_Record_Type {
+    Sparse_Record_Type__Data = 0,
+    Sparse_Record_Type__Hole = 1,
+    Sparse_Record_Type__End  = 2,
+};
+
+//~ NOTE(Patrik): The payload of a bundle with Header_Flag__Sparse is a list of
+// records instead of the file itself. A data record is followed by length
+// bytes of the file, a hole record stands for length zero bytes that are not
+// sent. The end record has the size of the file as length, so a hole at the
+// end of the file does not need a record of its own.
+typedef struct Sparse_Record {
+    unsigned char type;
+    
+    u64 length;
+} Sparse_Record;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MANIFEST
+//
+//~ NOTE(Patrik): A manifest is written by split next to the chunks as
+// 0x<unique_id>.manifest. It starts with a shared header that has
+// Header_Flag__Manifest set along with the flags of the bundle, and the
+// file_index is always 0.
+typedef struct Manifest_Header {
+    u16 total_file_count;
+    u16 file_name_length;
+    
+    //~ NOTE(Patrik): file_size is the size of the file that was split, which
+    // is only the same as payload_size for a plain bundle.
+    u64 file_size;
+    u64 payload_size;
+    
+    //~ NOTE(Patrik): Followed by file_name_length bytes of the name, no null
+    // terminator, and then one Manifest_Chunk per chunk in order.
+} Manifest_Header;
+
+typedef struct Manifest_Chunk {
+    //~ NOTE(Patrik): Where the payload of the chunk starts in the payload of the bundle.
+    u64 payload_offset;
+    
+    //~ NOTE(Patrik): length and the digest are of the whole chunk file, the
+    // same as the digests in Parity_Chunk_Info.
+    u64 length;
+    u64 digest_lo;
+    u64 digest_hi;
+    
+    u16 name_length;
+    
+    //~ NOTE(Patrik): Followed by name_length bytes of the name of the chunk
+    // file, relative to the manifest, no null terminator.
+} Manifest_Chunk;
+
+
 //~~~~~~~~~~~~~~~~
 //
 // PRAGMA POP
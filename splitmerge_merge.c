@@ -28,12 +28,25 @@
 // INCLUDES
 //
 #include "splitmerge.c"
+#include "splitmerge_stats.c"
+#include "splitmerge_throttle.c"
+#include "splitmerge_durability.c"
+#include "splitmerge_stream.c"
+#include "splitmerge_hash.c"
+#include "splitmerge_dedup.c"
+#include "splitmerge_parity.c"
+#include "splitmerge_sparse.c"
 
 
 //~~~~~~~~~~~~~~~~
 //
 // TYPES
 //
+typedef struct Open_Split_File {
+    File_Handle handle;
+    bool        is_open;
+} Open_Split_File;
+
 typedef struct Merge_Bundle {
     String *files;
     u32     file_count;
@@ -41,7 +54,31 @@ typedef struct Merge_Bundle {
     
     u16    total_file_count;
     u32    unique_id;
+    u8     flags;
     String out_file_name;
+    
+    //~ NOTE(Patrik): Every file but the last is as big as the first file,
+    // which is how the payload can be found without opening every file.
+    i64 first_file_size;
+    i64 first_header_length;
+    
+    //~ NOTE(Patrik): Split files that discovery left open, indexed like files.
+    // Only the first few hundred or so files get one, see get_open_file_budget.
+    Open_Split_File *open_files;
+    
+    //~ NOTE(Patrik): Only set when the bundle was added from a manifest,
+    // indexed like files.
+    Manifest_Chunk *manifest_chunks;
+    String         *manifest_names;
+    String         *manifest_folders;
+    u32             manifest_folder_count;
+    
+    //~ NOTE(Patrik): Indexed by the file_index of the parity files.
+    String *parity_files;
+    u32     parity_file_count;
+    u32     parity_file_capacity;
+    u16     parity_group_size;
+    u16     parity_count;
 } Merge_Bundle;
 
 typedef struct Merge_Bundle_Array {
@@ -50,67 +87,116 @@ typedef struct Merge_Bundle_Array {
     i32 capacity;
 } Merge_Bundle_Array;
 
+//~ NOTE(Patrik): Reads the payload of a bundle as one continuous stream,
+// opening the split files in order and skipping their headers.
+typedef struct Bundle_Reader {
+    Merge_Bundle *bundle;
+    File_Handle   handle;
+    File_Data     header_data;
+    u32           file_index;
+    i64           payload_offset;
+    bool          is_open;
+} Bundle_Reader;
 
-//~~~~~~~~~~~~~~~~
-//
-// HEADER
-//
-static bool
-is_valid_header(Shared_Header header) {
-    if(header.validation_0 == SPLITMERGE_HEADER_VALIDATION[0] &&
-       header.validation_1 == SPLITMERGE_HEADER_VALIDATION[1] &&
-       header.validation_2 == SPLITMERGE_HEADER_VALIDATION[2])
-    {
-        return true;
-    }
-    return false;
-}
-
+typedef enum Split_File_Status {
+    Split_File_Status__Ok,
+    Split_File_Status__Unreadable,
+    Split_File_Status__Invalid,
+    Split_File_Status__Newer_Version,
+} Split_File_Status;
 
-//~~~~~~~~~~~~~~~~
-//
-// ENDIAN
-//
-static u16
-swap_endian_u16(u16 value) {
-    u16 result = ((value << 8) & 0xff00 |
-                  (value >> 8) & 0x00ff);
+//~ NOTE(Patrik): Everything discovery needs from the header of a split file.
+// The header is byte swapped already.
+typedef struct Split_File_Info {
+    String            arg;
+    Split_File_Status status;
+    Shared_Header     shared;
+    u16               total_file_count;
+    String            file_name;
+    i64               file_size;
+    u16               parity_group_size;
+    u16               parity_count;
     
-    return result;
-}
+    File_Handle handle;
+    bool        should_stay_open;
+    bool        is_open;
+} Split_File_Info;
 
-static u32
-swap_endian_u32(u32 value) {
-    u32 result = ((value << 24) & 0xff000000 |
-                  (value <<  8) & 0x00ff0000 |
-                  (value >>  8) & 0x0000ff00 |
-                  (value >> 24) & 0x000000ff);
-    
-    return result;
-}
+typedef struct Bundle_Manifest {
+    File_Data       data;
+    Shared_Header   shared;
+    Manifest_Header header;
+    String          file_name;
+    Manifest_Chunk *chunks;
+    String         *chunk_names;
+} Bundle_Manifest;
 
-static u64
-swap_endian_u64(u64 value) {
-    u64 result = ((value << 32) & 0xffffffff00000000 |
-                  (value >> 32) & 0x00000000ffffffff);
-    
-    result = ((result << 16) & 0xffff0000ffff0000 |
-              (result >> 16) & 0x0000ffff0000ffff);
-    
-    result = ((result << 8) & 0xff00ff00ff00ff00 |
-              (result >> 8) & 0x00ff00ff00ff00ff);
-    
-    return result;
-}
+typedef struct Discovery_Work {
+    Split_File_Info *infos;
+    i64              count;
+    i64 volatile     next_index;
+} Discovery_Work;
 
-static bool
-should_swap_endian(u8 flags) {
-    if(is_big_endian() != (flags & Header_Flag__Big_Endian)) {
-        return true;
-    }
-    return false;
-}
+typedef enum Chunk_Status {
+    Chunk_Status__Ok,
+    Chunk_Status__Missing,
+    Chunk_Status__Unreadable,
+    Chunk_Status__Invalid_Header,
+    Chunk_Status__Wrong_Length,
+    Chunk_Status__Wrong_Digest,
+} Chunk_Status;
+
+//~ NOTE(Patrik): What a chunk should be, from the manifest or the parity files.
+typedef struct Expected_Chunk {
+    u64  length;
+    u64  digest_lo;
+    u64  digest_hi;
+    bool has_digest;
+} Expected_Chunk;
+
+typedef struct Verify_Work {
+    Merge_Bundle   *bundle;
+    Expected_Chunk *expected;
+    Chunk_Status   *statuses;
+    i64             count;
+    i64 volatile    next_index;
+} Verify_Work;
+
+//~ NOTE(Patrik): Slot n reads chunk n, n + slot_count and so on ahead of the
+// merge. is_free and is_full hand the chunk back and forth, so every slot has
+// at most one chunk waiting.
+typedef struct Read_Ahead_Slot {
+    Merge_Bundle     *bundle;
+    u32               first_index;
+    u32               slot_count;
+    File_Data         chunk;
+    Thread_Handle     thread;
+    Semaphore_Handle  is_free;
+    Semaphore_Handle  is_full;
+    bool volatile     is_stopping;
+} Read_Ahead_Slot;
 
+typedef struct Read_Ahead {
+    Merge_Bundle    *bundle;
+    Read_Ahead_Slot *slots;
+    u32              slot_count;
+} Read_Ahead;
+
+typedef struct Dedup_Store {
+    Dedup_Table table;
+    File_Handle handle;
+    i64         size;
+    String      store_path;
+    String      index_path;
+    File_Data   block;
+    bool        is_loaded;
+} Dedup_Store;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// BUNDLE
+//
 static Merge_Bundle
 make_merge_bundle(u32 unique_id) {
     Merge_Bundle result = {0};
@@ -140,14 +226,69 @@ append_bundle(Merge_Bundle_Array *array, Merge_Bundle bundle) {
     }
 }
 
+static Merge_Bundle *
+get_bundle(Merge_Bundle_Array *master_list, u32 unique_id) {
+    For(i32, it_index, master_list->count) {
+        Merge_Bundle *it = master_list->data + it_index;
+        
+        if(it->unique_id == unique_id) {
+            return it;
+        }
+    }
+    
+    Merge_Bundle new_bundle = make_merge_bundle(unique_id);
+    append_bundle(master_list, new_bundle);
+    
+    return &master_list->data[master_list->count - 1];
+}
+
+static void
+set_bundle_out_file_name(Merge_Bundle *bundle, String source_path, String file_name) {
+    bundle->out_file_name = make_string(64);
+    
+    append_string(&bundle->out_file_name, source_path);
+    
+    {
+        i32 index = find_index_of_last(bundle->out_file_name, '/');
+        
+        if(index >= 0) {
+            index = bundle->out_file_name.length - index - 1;
+            bundle->out_file_name.length -= index;
+        } else {
+            index = find_index_of_last(bundle->out_file_name, '\\');
+            
+            if(index >= 0) {
+                index = bundle->out_file_name.length - index - 1;
+                bundle->out_file_name.length -= index;
+            }
+        }
+    }
+    
+    append_cstring(&bundle->out_file_name, UNPACK_NTSTRING("merged_output/"));
+    append_string(&bundle->out_file_name, file_name);
+    null_terminate(&bundle->out_file_name);
+}
+
 static void
 append_file_name(Merge_Bundle *bundle, String file_name, u32 file_index) {
     if(bundle) {
         if(file_index >= bundle->file_capacity) {
+            u32 old_capacity = bundle->file_capacity;
+            
             while(file_index >= bundle->file_capacity) {
                 bundle->file_capacity += 128;
             }
             bundle->files = SPLTMRG_REALLOC(String, bundle->files, bundle->file_capacity);
+            
+            zero_memory((u8*)(bundle->files + old_capacity),
+                        (bundle->file_capacity - old_capacity) * sizeof(String));
+            
+            if(bundle->open_files) {
+                bundle->open_files = SPLTMRG_REALLOC(Open_Split_File, bundle->open_files, bundle->file_capacity);
+                
+                zero_memory((u8*)(bundle->open_files + old_capacity),
+                            (bundle->file_capacity - old_capacity) * sizeof(Open_Split_File));
+            }
         }
         
         bundle->files[file_index] = file_name;
@@ -155,198 +296,3285 @@ append_file_name(Merge_Bundle *bundle, String file_name, u32 file_index) {
     }
 }
 
+static void
+append_parity_file_name(Merge_Bundle *bundle, String file_name, u32 file_index) {
+    if(bundle) {
+        if(file_index >= bundle->parity_file_capacity) {
+            u32 old_capacity = bundle->parity_file_capacity;
+            
+            while(file_index >= bundle->parity_file_capacity) {
+                bundle->parity_file_capacity += 128;
+            }
+            
+            if(bundle->parity_files) {
+                bundle->parity_files = SPLTMRG_REALLOC(String, bundle->parity_files,
+                                                       bundle->parity_file_capacity);
+            } else {
+                bundle->parity_files = SPLTMRG_ALLOC(String, bundle->parity_file_capacity);
+            }
+            
+            zero_memory((u8*)(bundle->parity_files + old_capacity),
+                        (bundle->parity_file_capacity - old_capacity) * sizeof(String));
+        }
+        
+        bundle->parity_files[file_index] = file_name;
+        bundle->parity_file_count += 1;
+    }
+}
+
+static bool
+has_file_name(String *files, u32 capacity, u32 file_index) {
+    if(file_index < capacity && files[file_index].data) {
+        return true;
+    }
+    return false;
+}
 
-//~~~~~~~~~~~~~~~~
-//
-// MAIN
-//
-int
-main(int arg_count, char **arg_data) {
-    Merge_Bundle_Array master_list = {0};
-    master_list.capacity = 4;
-    master_list.data     = SPLTMRG_ALLOC(Merge_Bundle, master_list.capacity);
+static void
+set_bundle_file_handle(Merge_Bundle *bundle, u32 file_index, File_Handle handle) {
+    if(!bundle->open_files) {
+        bundle->open_files = SPLTMRG_ALLOC(Open_Split_File, bundle->file_capacity);
+    }
     
-    printf("SPLITMERGE <merge>\n");
-    printf("%d potential split files.\n", arg_count - 1);
+    Open_Split_File *open_file = bundle->open_files + file_index;
     
-    String source_path = set_string_from_ntstring(arg_data[0]);
+    if(open_file->is_open) {
+        os_close_file(open_file->handle);
+    }
     
-    for_range(int, arg_index, 1, arg_count) {
-        String arg = set_string_from_ntstring(arg_data[arg_index]);
+    open_file->handle  = handle;
+    open_file->is_open = true;
+}
+
+//~ NOTE(Patrik): Hands over the handle discovery left open if there is one,
+// otherwise the file is opened again. Either way it starts at the header and
+// the caller closes it.
+static File_Handle
+open_bundle_file(Merge_Bundle *bundle, u32 file_index) {
+    if(bundle->open_files && bundle->open_files[file_index].is_open) {
+        Open_Split_File *open_file = bundle->open_files + file_index;
         
-        if(ends_with_cstring(arg, SPLITMERGE_FILE_EXTENSION_CSTRING)) {
-            File_Handle file_handle = os_open_file_for_reading(arg.data);
+        open_file->is_open = false;
+        
+        if(os_set_file_pointer(open_file->handle, 0)) {
+            return open_file->handle;
+        }
+        
+        os_close_file(open_file->handle);
+    }
+    
+    return os_open_file_for_reading(bundle->files[file_index].data);
+}
+
+static void
+close_bundle_file(Merge_Bundle *bundle, u32 file_index) {
+    if(bundle->open_files && bundle->open_files[file_index].is_open) {
+        os_close_file(bundle->open_files[file_index].handle);
+        bundle->open_files[file_index].is_open = false;
+    }
+}
+
+static void
+close_bundle_files(Merge_Bundle *bundle) {
+    For(u32, it_index, bundle->file_capacity) {
+        close_bundle_file(bundle, it_index);
+    }
+}
+
+#define OPEN_FILE_MEMORY (8 * 1024)
+
+//~ NOTE(Patrik): How many split files discovery may leave open. Some are kept
+// back for the output file, the dedup store, parity and the like.
+static i64
+get_open_file_budget(void) {
+    i64 result = os_get_max_open_files() - 64;
+    
+    if(result > 4096) {
+        result = 4096;
+    }
+    
+    //~ NOTE(Patrik): An open file has a buffer of its own in the C runtime,
+    // so with --max-memory the open files get a quarter of it.
+    if(global_max_memory && result > global_max_memory / 4 / OPEN_FILE_MEMORY) {
+        result = global_max_memory / 4 / OPEN_FILE_MEMORY;
+    }
+    
+    if(result < 0) {
+        result = 0;
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Moves the file pointer of a split file past its header.
+// header_data needs to be able to hold a First_Header.
+static bool
+skip_chunk_header(File_Handle source_handle, u32 file_index, File_Data *header_data) {
+    bool result = false;
+    
+    header_data->length = 0;
+    
+    if(file_index == 0) {
+        if(os_read_file(header_data, source_handle, sizeof(First_Header)) == sizeof(First_Header)) {
+            First_Header *header = (First_Header*)header_data->data;
             
-            if(os_is_handle_valid(file_handle)) {
-                File_Data file = make_file_data(SPLITMERGE_MAX_FILE_NAME_AND_HEADER_SIZE);
-                
-                if(os_read_file(&file, file_handle, sizeof(First_Header)) > 0) {
-                    Shared_Header *shared_header = (Shared_Header*)file.data;
-                    
-                    if(is_valid_header(*shared_header)) {
-                        Merge_Bundle *bundle = 0;
-                        
-                        if(should_swap_endian(shared_header->flags)) {
-                            shared_header->version    = swap_endian_u16(shared_header->version);
-                            shared_header->unique_id  = swap_endian_u32(shared_header->unique_id);
-                            shared_header->file_index = swap_endian_u16(shared_header->file_index);
-                        }
-                        
-                        For(i32, it_index, master_list.count) {
-                            Merge_Bundle *it = master_list.data + it_index;
-                            
-                            if(it->unique_id == shared_header->unique_id) {
-                                bundle = it;
-                                break;
-                            }
-                        }
-                        
-                        if(!bundle) {
-                            Merge_Bundle new_bundle = make_merge_bundle(shared_header->unique_id);
-                            append_bundle(&master_list, new_bundle);
-                            bundle = &master_list.data[master_list.count - 1];
-                        }
-                        
-                        if(shared_header->file_index == 0) {
-                            First_Header *header = (First_Header*)file.data;
-                            
-                            if(should_swap_endian(shared_header->flags)) {
-                                header->file_name_length = swap_endian_u16(header->file_name_length);
-                                header->total_file_count = swap_endian_u16(header->total_file_count);
-                            }
-                            
-                            bundle->total_file_count = header->total_file_count;
-                            bundle->out_file_name    = make_string(64);
-                            
-                            char *file_name_pos = (char*)file.data + file.length;
-                            
-                            append_string(&bundle->out_file_name, source_path);
-                            
-                            {
-                                i32 index = find_index_of_last(bundle->out_file_name, '/');
-                                
-                                if(index >= 0) {
-                                    index = bundle->out_file_name.length - index - 1;
-                                    bundle->out_file_name.length -= index;
-                                } else {
-                                    index = find_index_of_last(bundle->out_file_name, '\\');
-                                    
-                                    if(index >= 0) {
-                                        index = bundle->out_file_name.length - index - 1;
-                                        bundle->out_file_name.length -= index;
-                                    }
-                                }
-                            }
-                            
-                            append_cstring(&bundle->out_file_name, UNPACK_NTSTRING("merged_output/"));
-                            
-                            if(os_read_file(&file, file_handle, header->file_name_length) > 0) {
-                                append_cstring(&bundle->out_file_name,
-                                               file_name_pos, header->file_name_length);
-                                
-                                null_terminate(&bundle->out_file_name);
-                            }
-                        }
-                        
-                        append_file_name(bundle, arg, shared_header->file_index);
-                    } else {
-                        printf("%s has an invalid header\n", arg.data);
-                    }
-                }
-                
-                SPLTMRG_FREE(file.data);
+            u16 file_name_length = header->file_name_length;
+            if(should_swap_endian(header->shared.flags)) {
+                file_name_length = swap_endian_u16(file_name_length);
             }
             
-            os_close_file(file_handle);
-        } else {
-            printf("%s is not a split file\n", arg.data);
+            result = os_move_file_pointer(source_handle, file_name_length + 1);
         }
-	}
+    } else {
+        result = os_move_file_pointer(source_handle, sizeof(Shared_Header));
+    }
     
-    if(master_list.count > 0) {
-        File_Data file_buffer = make_file_data(SPLITMERGE_NITRO_FILE_LIMIT);
-        File_Data header_data = make_file_data(sizeof(First_Header));
-        File_Data read_data   = {0};
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DISCOVERY
+//
+//~ NOTE(Patrik): Reading the headers is split from sorting the files into
+// bundles so that the reading can be done on many threads. Nothing in
+// read_split_file_info touches shared state or prints.
+static void
+read_split_file_info(Split_File_Info *info) {
+    i64 start_time = begin_stats_timer();
+    
+    info->handle = os_open_file_for_reading(info->arg.data);
+    
+    if(!os_is_handle_valid(info->handle)) {
+        info->status = Split_File_Status__Unreadable;
+        end_stats_timer(Stats_Phase__Header, start_time, 0);
+        return;
+    }
+    
+    info->status    = Split_File_Status__Invalid;
+    info->file_size = os_get_size_of_file(info->handle);
+    
+    First_Header header = {0};
+    File_Data    data   = {0};
+    data.data     = (u8*)&header;
+    data.capacity = sizeof(First_Header);
+    
+    if(os_read_file(&data, info->handle, sizeof(First_Header)) > 0) {
+        Shared_Header *shared_header = &header.shared;
         
-        For(i32, bundle_index, master_list.count) {
-            printf("---===##===---\n");
+        SPLITMERGE_PROBE2(header_discover, info->arg.data, is_valid_header(*shared_header));
+        
+        if(is_valid_header(*shared_header) && (shared_header->flags & ~SPLITMERGE_KNOWN_HEADER_FLAGS)) {
+            info->status = Split_File_Status__Newer_Version;
+        } else if(is_valid_header(*shared_header)) {
+            bool should_swap = should_swap_endian(shared_header->flags);
             
-            Merge_Bundle *bundle = master_list.data + bundle_index;
+            if(should_swap) {
+                shared_header->version    = swap_endian_u16(shared_header->version);
+                shared_header->unique_id  = swap_endian_u32(shared_header->unique_id);
+                shared_header->file_index = swap_endian_u16(shared_header->file_index);
+            }
+            
+            info->shared = *shared_header;
             
-            if(bundle->file_count == bundle->total_file_count) {
-                File_Handle dest_handle = os_open_file_for_writing(bundle->out_file_name.data);
+            if(is_flag_set(shared_header->flags, Header_Flag__Parity)) {
+                Parity_Header parity_header = {0};
                 
-                if(os_is_handle_valid(dest_handle)) {
-                    For(u32, file_index, bundle->file_count) {
-                        File_Handle source_handle = os_open_file_for_reading(bundle->files[file_index].data);
-                        
-                        header_data.length = 0;
-                        
-                        if(os_is_handle_valid(source_handle)) {
-                            if(file_index == 0) {
-                                if(os_read_file(&header_data, source_handle, sizeof(First_Header)) > 0)
-                                {
-                                    First_Header *header = (First_Header*)header_data.data;
-                                    
-                                    u16 file_name_length = header->file_name_length;
-                                    if(should_swap_endian(header->shared.flags)) {
-                                        file_name_length = swap_endian_u16(file_name_length);
-                                    }
-                                    
-                                    os_move_file_pointer(source_handle, file_name_length + 1);
-                                }
-                            } else {
-                                os_move_file_pointer(source_handle, sizeof(Shared_Header));
-                            }
-                            
-                            i64 remaining_length = os_get_remaining_size_of_file(source_handle);
-                            while(remaining_length > 0) {
-                                read_data.length   = 0;
-                                read_data.data     = file_buffer.data     + file_buffer.length;
-                                read_data.capacity = file_buffer.capacity - file_buffer.length;
-                                
-                                if(os_read_file(&read_data, source_handle, read_data.capacity)) {
-                                    file_buffer.length += read_data.length;
-                                    
-                                    if(file_buffer.length == file_buffer.capacity) {
-                                        printf("Merging file %d/%d - chunk %u/%u\n",
-                                               bundle_index + 1, master_list.count,
-                                               file_index, bundle->file_count);
-                                        
-                                        os_write_file(dest_handle, file_buffer.data, file_buffer.length);
-                                        
-                                        file_buffer.length = 0;
-                                    }
-                                }
-                                
-                                remaining_length = os_get_remaining_size_of_file(source_handle);
-                            }
-                        }
-                        
-                        os_close_file(source_handle);
+                os_set_file_pointer(info->handle, sizeof(Shared_Header));
+                
+                data.data     = (u8*)&parity_header;
+                data.length   = 0;
+                data.capacity = sizeof(Parity_Header);
+                
+                if(os_read_file(&data, info->handle, sizeof(Parity_Header)) == sizeof(Parity_Header)) {
+                    if(should_swap) {
+                        parity_header.total_file_count = swap_endian_u16(parity_header.total_file_count);
+                        parity_header.group_size       = swap_endian_u16(parity_header.group_size);
+                        parity_header.parity_count     = swap_endian_u16(parity_header.parity_count);
                     }
                     
-                    if(file_buffer.length > 0) {
-                        printf("Merging file %d/%d - chunk %u/%u\n",
-                               bundle_index + 1, master_list.count,
-                               bundle->file_count, bundle->file_count);
-                        
-                        os_write_file(dest_handle, file_buffer.data, file_buffer.length);
-                        
-                        file_buffer.length = 0;
-                    }
+                    info->total_file_count  = parity_header.total_file_count;
+                    info->parity_group_size = parity_header.group_size;
+                    info->parity_count      = parity_header.parity_count;
+                    info->status            = Split_File_Status__Ok;
+                }
+            } else if(shared_header->file_index == 0) {
+                if(should_swap) {
+                    header.file_name_length = swap_endian_u16(header.file_name_length);
+                    header.total_file_count = swap_endian_u16(header.total_file_count);
                 }
                 
-                os_close_file(dest_handle);
+                info->total_file_count = header.total_file_count;
+                info->file_name        = make_string(header.file_name_length + 1);
+                
+                File_Data name_data = {0};
+                name_data.data     = (u8*)info->file_name.data;
+                name_data.capacity = header.file_name_length;
+                
+                if(os_read_file(&name_data, info->handle, header.file_name_length) == header.file_name_length) {
+                    info->file_name.length = header.file_name_length;
+                    info->status           = Split_File_Status__Ok;
+                }
             } else {
-                printf("There should be %d total files, but found %d\n",
-                       bundle->total_file_count, bundle->file_count);
+                info->status = Split_File_Status__Ok;
             }
         }
+    }
+    
+    if(info->status != Split_File_Status__Ok || !info->should_stay_open) {
+        os_close_file(info->handle);
+        info->handle = 0;
+    } else {
+        info->is_open = true;
+    }
+    
+    end_stats_timer(Stats_Phase__Header, start_time, 0);
+}
+
+static void
+add_split_file_info(Merge_Bundle_Array *master_list, Split_File_Info *info, String source_path) {
+    if(info->status == Split_File_Status__Newer_Version) {
+        printf("%s was split by a newer version of splitmerge\n", info->arg.data);
+    } else if(info->status == Split_File_Status__Invalid) {
+        printf("%s has an invalid header\n", info->arg.data);
+    }
+    
+    if(info->status != Split_File_Status__Ok) {
+        return;
+    }
+    
+    Shared_Header *shared_header = &info->shared;
+    Merge_Bundle  *bundle        = get_bundle(master_list, shared_header->unique_id);
+    
+    if(is_flag_set(shared_header->flags, Header_Flag__Parity)) {
+        //~ NOTE(Patrik): The first file might be the one that is missing.
+        if(bundle->total_file_count == 0) {
+            bundle->total_file_count = info->total_file_count;
+        }
         
-        SPLTMRG_FREE(file_buffer.data);
-        SPLTMRG_FREE(header_data.data);
+        bundle->parity_group_size = info->parity_group_size;
+        bundle->parity_count      = info->parity_count;
+        
+        append_parity_file_name(bundle, info->arg, shared_header->file_index);
+    } else if(!has_file_name(bundle->files, bundle->file_capacity, shared_header->file_index)) {
+        //~ NOTE(Patrik): A chunk that a manifest added already is skipped.
+        if(shared_header->file_index == 0) {
+            bundle->total_file_count    = info->total_file_count;
+            bundle->first_file_size     = info->file_size;
+            bundle->first_header_length = sizeof(First_Header) + info->file_name.length + 1;
+            
+            set_bundle_out_file_name(bundle, source_path, info->file_name);
+        }
+        
+        bundle->flags = shared_header->flags;
+        
+        append_file_name(bundle, info->arg, shared_header->file_index);
+        
+        if(info->is_open) {
+            set_bundle_file_handle(bundle, shared_header->file_index, info->handle);
+            info->is_open = false;
+        }
+    }
+    
+    if(info->is_open) {
+        os_close_file(info->handle);
+        info->is_open = false;
+    }
+}
+
+static void
+free_split_file_info(Split_File_Info *info) {
+    if(info->file_name.data) {
+        SPLTMRG_FREE(info->file_name.data);
+    }
+}
+
+static void
+add_split_file(Merge_Bundle_Array *master_list, String arg, String source_path) {
+    Split_File_Info info = {0};
+    info.arg = arg;
+    
+    read_split_file_info(&info);
+    add_split_file_info(master_list, &info, source_path);
+    free_split_file_info(&info);
+}
+
+static
+PLATFORM_THREAD_PROC(discovery_thread_proc) {
+    Discovery_Work *work = (Discovery_Work*)data;
+    
+    for(;;) {
+        i64 index = os_atomic_add(&work->next_index, 1);
+        
+        if(index >= work->count) {
+            break;
+        }
+        
+        read_split_file_info(work->infos + index);
+    }
+}
+
+//~ NOTE(Patrik): Reads every header on thread_count threads, then sorts the
+// files into bundles in the order they were given. The first open_file_count
+// files are left open for the merge to use.
+static void
+discover_split_files(Merge_Bundle_Array *master_list, String *args, i32 arg_count, String source_path,
+                     i32 thread_count, i64 open_file_count)
+{
+    Discovery_Work work = {0};
+    work.infos = SPLTMRG_ALLOC(Split_File_Info, arg_count);
+    work.count = arg_count;
+    
+    For(i32, it_index, arg_count) {
+        work.infos[it_index].arg              = args[it_index];
+        work.infos[it_index].should_stay_open = (it_index < open_file_count);
+    }
+    
+    if(thread_count > arg_count) {
+        thread_count = arg_count;
+    }
+    
+    run_on_threads(discovery_thread_proc, &work, thread_count);
+    
+    For(i32, it_index, arg_count) {
+        add_split_file_info(master_list, work.infos + it_index, source_path);
+        free_split_file_info(work.infos + it_index);
+    }
+    
+    SPLTMRG_FREE(work.infos);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MANIFEST
+//
+//~ NOTE(Patrik): Reads a whole manifest and checks that it is well formed.
+// The manifest is byte swapped already, the names point into data and are
+// not null terminated.
+static bool
+read_manifest(String file_name, Bundle_Manifest *manifest) {
+    bool result = false;
+    
+    File_Handle handle = os_open_file_for_reading(file_name.data);
+    
+    if(!os_is_handle_valid(handle)) {
+        printf("Invalid file: \"%s\"\n", file_name.data);
+        return false;
+    }
+    
+    i64 file_size = os_get_size_of_file(handle);
+    
+    File_Data *data = &manifest->data;
+    
+    *data = make_file_data(file_size + 1);
+    
+    if(file_size < (i64)(sizeof(Shared_Header) + sizeof(Manifest_Header)) ||
+       os_read_file(data, handle, file_size) != file_size)
+    {
+        printf("%s is not a manifest\n", file_name.data);
+        os_close_file(handle);
+        return false;
+    }
+    
+    os_close_file(handle);
+    
+    Shared_Header   *shared = (Shared_Header*)data->data;
+    Manifest_Header *header = (Manifest_Header*)(shared + 1);
+    
+    if(!is_valid_header(*shared) || !is_flag_set(shared->flags, Header_Flag__Manifest)) {
+        printf("%s is not a manifest\n", file_name.data);
+        return false;
+    }
+    
+    if(shared->flags & ~(SPLITMERGE_KNOWN_HEADER_FLAGS | Header_Flag__Manifest)) {
+        printf("%s was split by a newer version of splitmerge\n", file_name.data);
+        return false;
+    }
+    
+    bool should_swap = should_swap_endian(shared->flags);
+    
+    if(should_swap) {
+        shared->version          = swap_endian_u16(shared->version);
+        shared->unique_id        = swap_endian_u32(shared->unique_id);
+        header->total_file_count = swap_endian_u16(header->total_file_count);
+        header->file_name_length = swap_endian_u16(header->file_name_length);
+        header->file_size        = swap_endian_u64(header->file_size);
+        header->payload_size     = swap_endian_u64(header->payload_size);
+    }
+    
+    manifest->shared = *shared;
+    manifest->header = *header;
+    
+    i64 offset = sizeof(Shared_Header) + sizeof(Manifest_Header);
+    
+    if(header->total_file_count > 0 && offset + header->file_name_length <= data->length) {
+        manifest->file_name.data   = (char*)data->data + offset;
+        manifest->file_name.length = header->file_name_length;
+        
+        offset += header->file_name_length;
+        
+        //~ NOTE(Patrik): The names make the chunks different lengths, so they
+        // are copied out to be indexed by file_index.
+        manifest->chunks      = SPLTMRG_ALLOC(Manifest_Chunk, header->total_file_count);
+        manifest->chunk_names = SPLTMRG_ALLOC(String, header->total_file_count);
+        
+        result = true;
+        
+        For(u16, it_index, header->total_file_count) {
+            Manifest_Chunk *chunk = manifest->chunks + it_index;
+            
+            if(offset + (i64)sizeof(Manifest_Chunk) > data->length) {
+                result = false;
+                break;
+            }
+            
+            copy_memory((u8*)chunk, data->data + offset, sizeof(Manifest_Chunk));
+            
+            if(should_swap) {
+                chunk->payload_offset = swap_endian_u64(chunk->payload_offset);
+                chunk->length         = swap_endian_u64(chunk->length);
+                chunk->digest_lo      = swap_endian_u64(chunk->digest_lo);
+                chunk->digest_hi      = swap_endian_u64(chunk->digest_hi);
+                chunk->name_length    = swap_endian_u16(chunk->name_length);
+            }
+            
+            offset += sizeof(Manifest_Chunk);
+            
+            if(chunk->name_length == 0 || offset + chunk->name_length > data->length) {
+                result = false;
+                break;
+            }
+            
+            manifest->chunk_names[it_index].data   = (char*)data->data + offset;
+            manifest->chunk_names[it_index].length = chunk->name_length;
+            
+            offset += chunk->name_length;
+        }
+    }
+    
+    if(!result || offset != data->length) {
+        printf("%s is damaged\n", file_name.data);
+        result = false;
+    }
+    
+    return result;
+}
+
+static void
+free_manifest(Bundle_Manifest *manifest) {
+    if(manifest->data.data) {
+        SPLTMRG_FREE(manifest->data.data);
+    }
+    
+    if(manifest->chunks) {
+        SPLTMRG_FREE(manifest->chunks);
+        SPLTMRG_FREE(manifest->chunk_names);
+    }
+}
+
+//~ NOTE(Patrik): Adds the bundle a manifest describes without reading the
+// header of any chunk. The chunks are looked for next to every manifest of
+// the bundle that was given, since split writes one to every --output folder,
+// see open_manifest_chunks.
+static void
+add_bundle_manifest(Merge_Bundle_Array *master_list, String arg, String source_path) {
+    Bundle_Manifest manifest = {0};
+    
+    if(read_manifest(arg, &manifest)) {
+        Merge_Bundle    *bundle = get_bundle(master_list, manifest.shared.unique_id);
+        Manifest_Header *header = &manifest.header;
+        
+        if(bundle->manifest_chunks) {
+            if(bundle->total_file_count != header->total_file_count) {
+                printf("%s does not match the other manifest of the bundle\n", arg.data);
+                free_manifest(&manifest);
+                return;
+            }
+        } else {
+            bundle->total_file_count    = header->total_file_count;
+            bundle->flags               = manifest.shared.flags & ~Header_Flag__Manifest;
+            bundle->first_file_size     = manifest.chunks[0].length;
+            bundle->first_header_length = sizeof(First_Header) + header->file_name_length + 1;
+            
+            set_bundle_out_file_name(bundle, source_path, manifest.file_name);
+            
+            bundle->manifest_chunks = SPLTMRG_ALLOC(Manifest_Chunk, header->total_file_count);
+            bundle->manifest_names  = SPLTMRG_ALLOC(String, header->total_file_count);
+            
+            copy_memory((u8*)bundle->manifest_chunks, (u8*)manifest.chunks,
+                        header->total_file_count * sizeof(Manifest_Chunk));
+            
+            For(u16, it_index, header->total_file_count) {
+                bundle->manifest_names[it_index] = make_string(manifest.chunk_names[it_index].length + 1);
+                
+                append_string(bundle->manifest_names + it_index, manifest.chunk_names[it_index]);
+            }
+        }
+        
+        //~ NOTE(Patrik): The chunk names are relative to the manifest.
+        i32 folder_length = find_index_of_last(arg, '/');
+        
+        if(folder_length < 0) {
+            folder_length = find_index_of_last(arg, '\\');
+        }
+        
+        folder_length += 1;
+        
+        String folder = make_string(folder_length + 1);
+        
+        append_cstring(&folder, arg.data, folder_length);
+        
+        if(bundle->manifest_folders) {
+            bundle->manifest_folders = SPLTMRG_REALLOC(String, bundle->manifest_folders,
+                                                       (bundle->manifest_folder_count + 1));
+        } else {
+            bundle->manifest_folders = SPLTMRG_ALLOC(String, 1);
+        }
+        
+        bundle->manifest_folders[bundle->manifest_folder_count] = folder;
+        bundle->manifest_folder_count += 1;
+    }
+    
+    free_manifest(&manifest);
+}
+
+//~ NOTE(Patrik): Opens every chunk of a bundle that was added from manifests
+// to find the ones that are missing or have the wrong length, and keeps up to
+// open_file_budget of the handles for the merge. Chunk n is looked for in the
+// folder of manifest n % folder_count first, which is where split put it if
+// the manifests are given in the same order as the --output folders.
+// The names can have a fan-out subfolder in them, the chunks are opened
+// relative to their folder so the folders are only looked up once.
+static void
+open_manifest_chunks(Merge_Bundle *bundle, i64 *open_file_budget) {
+    u32             missing_count   = 0;
+    String          chunk_file_name = make_string(128);
+    Directory_Cache directories     = {0};
+    
+    For(u16, it_index, bundle->total_file_count) {
+        Manifest_Chunk *chunk = bundle->manifest_chunks + it_index;
+        
+        if(has_file_name(bundle->files, bundle->file_capacity, it_index)) {
+            continue;
+        }
+        
+        File_Handle handle = 0;
+        
+        For(u32, folder_offset, bundle->manifest_folder_count) {
+            u32 folder_index = (it_index + folder_offset) % bundle->manifest_folder_count;
+            
+            chunk_file_name.length = 0;
+            
+            append_string(&chunk_file_name, bundle->manifest_folders[folder_index]);
+            append_string(&chunk_file_name, bundle->manifest_names[it_index]);
+            null_terminate(&chunk_file_name);
+            
+            String folder = chunk_file_name;
+            
+            folder.length = get_folder_length(chunk_file_name);
+            
+            Directory_Handle directory = get_cached_directory(&directories, folder, false);
+            
+            if(directory) {
+                handle = os_open_file_in_directory_for_reading(directory, chunk_file_name.data + folder.length);
+            } else {
+                handle = os_open_file_for_reading(chunk_file_name.data);
+            }
+            
+            if(os_is_handle_valid(handle)) {
+                break;
+            }
+        }
+        
+        if(!os_is_handle_valid(handle)) {
+            printf("%s is missing\n", bundle->manifest_names[it_index].data);
+            
+            missing_count += 1;
+            continue;
+        }
+        
+        //~ NOTE(Patrik): The chunk is still added, so that verify can list it
+        // and parity can rebuild it. The merge stops at its digest.
+        i64 file_size = os_get_size_of_file(handle);
+        
+        if(file_size != (i64)chunk->length) {
+            printf("%s is %lld bytes, it should be %llu bytes\n", chunk_file_name.data,
+                   (long long)file_size, (unsigned long long)chunk->length);
+        }
+        
+        String file_name = make_string(chunk_file_name.length + 1);
+        
+        append_string(&file_name, chunk_file_name);
+        null_terminate(&file_name);
+        
+        append_file_name(bundle, file_name, it_index);
+        
+        if(*open_file_budget > 0) {
+            set_bundle_file_handle(bundle, it_index, handle);
+            *open_file_budget -= 1;
+        } else {
+            os_close_file(handle);
+        }
+    }
+    
+    printf("%s has %u of %u chunks\n", bundle->out_file_name.data, bundle->total_file_count - missing_count,
+           bundle->total_file_count);
+    
+    free_directory_cache(&directories);
+    SPLTMRG_FREE(chunk_file_name.data);
+}
+
+//~ NOTE(Patrik): The manifest does not list the parity files, so they are
+// looked for next to the manifests under the names split gives them, in the
+// same folders as the chunks. Until one is found it is not known how many
+// there are, but the parity of the first two groups starts below
+// PARITY_MAX_CHUNKS, so one is found if any of them is left.
+static void
+find_manifest_parity_files(Merge_Bundle_Array *master_list, i32 bundle_index, String source_path) {
+    Merge_Bundle *bundle = master_list->data + bundle_index;
+    
+    if(bundle->manifest_folder_count == 0) {
+        return;
+    }
+    
+    bool has_fan_out = (count_instance_of_char(bundle->manifest_names[0], '/') > 0);
+    u32  unique_id   = bundle->unique_id;
+    u32  found_count = 0;
+    u32  file_count  = PARITY_MAX_CHUNKS;
+    
+    for(u32 parity_index = 0; parity_index < file_count && parity_index < 0xFFFF; parity_index += 1) {
+        if(has_file_name(bundle->parity_files, bundle->parity_file_capacity, parity_index)) {
+            continue;
+        }
+        
+        For(u32, folder_offset, bundle->manifest_folder_count) {
+            u32 folder_index = (parity_index + folder_offset) % bundle->manifest_folder_count;
+            
+            Split_File_Info info = {0};
+            info.arg = make_string(bundle->manifest_folders[folder_index].length + 64);
+            
+            append_string(&info.arg, bundle->manifest_folders[folder_index]);
+            
+            if(has_fan_out) {
+                append_fan_out_folder(&info.arg, unique_id, (u16)parity_index);
+            }
+            
+            append_cstring(&info.arg, UNPACK_NTSTRING("0x"));
+            append_u32(&info.arg, unique_id, 16);
+            append_cstring(&info.arg, UNPACK_NTSTRING("_parity_"));
+            append_u32(&info.arg, parity_index, 10);
+            append_cstring(&info.arg, SPLITMERGE_FILE_EXTENSION_CSTRING);
+            null_terminate(&info.arg);
+            
+            read_split_file_info(&info);
+            
+            bool is_found = (info.status == Split_File_Status__Ok && info.shared.unique_id == unique_id &&
+                             is_flag_set(info.shared.flags, Header_Flag__Parity));
+            
+            if(is_found) {
+                add_split_file_info(master_list, &info, source_path);
+                
+                bundle = master_list->data + bundle_index;
+                
+                if(found_count == 0 && bundle->parity_group_size > 0) {
+                    u32 group_count = ((bundle->total_file_count + bundle->parity_group_size - 1) /
+                                       bundle->parity_group_size);
+                    
+                    file_count = group_count * bundle->parity_count;
+                }
+                
+                found_count += 1;
+            } else {
+                SPLTMRG_FREE(info.arg.data);
+            }
+            
+            free_split_file_info(&info);
+            
+            if(is_found) {
+                break;
+            }
+        }
+    }
+    
+    if(found_count > 0) {
+        printf("%s has %u parity files\n", bundle->out_file_name.data, found_count);
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// BUNDLE READER
+//
+static Bundle_Reader
+make_bundle_reader(Merge_Bundle *bundle) {
+    Bundle_Reader result = {0};
+    
+    result.bundle      = bundle;
+    result.header_data = make_file_data(sizeof(First_Header));
+    
+    return result;
+}
+
+static void
+free_bundle_reader(Bundle_Reader *reader) {
+    if(reader->is_open) {
+        os_close_file(reader->handle);
+        reader->is_open = false;
+    }
+    
+    SPLTMRG_FREE(reader->header_data.data);
+}
+
+static bool
+open_next_bundle_file(Bundle_Reader *reader) {
+    if(reader->file_index >= reader->bundle->file_count) {
+        return false;
+    }
+    
+    reader->handle = open_bundle_file(reader->bundle, reader->file_index);
+    
+    if(!os_is_handle_valid(reader->handle)) {
+        return false;
+    }
+    
+    reader->is_open = true;
+    
+    os_advise_sequential(reader->handle);
+    
+    if(!skip_chunk_header(reader->handle, reader->file_index, &reader->header_data)) {
+        return false;
+    }
+    
+    reader->file_index += 1;
+    
+    return true;
+}
+
+//~ NOTE(Patrik): Reads up to read_amount bytes of payload into dest.
+// Returns less than read_amount only when the bundle has run out.
+static i64
+read_bundle_payload(Bundle_Reader *reader, File_Data *dest, i64 read_amount) {
+    i64 result = 0;
+    
+    if(read_amount > dest->capacity - dest->length) {
+        read_amount = dest->capacity - dest->length;
+    }
+    
+    while(read_amount > 0) {
+        if(!reader->is_open && !open_next_bundle_file(reader)) {
+            break;
+        }
+        
+        i64 read_length = os_read_file(dest, reader->handle, read_amount);
+        
+        result      += read_length;
+        read_amount -= read_length;
+        
+        if(read_length == 0) {
+            drop_streamed_file(reader->handle);
+            os_close_file(reader->handle);
+            reader->is_open = false;
+        }
+    }
+    
+    reader->payload_offset += result;
+    
+    return result;
+}
+
+static i64
+get_bundle_file_payload_length(Merge_Bundle *bundle, u32 file_index) {
+    if(file_index == 0) {
+        return bundle->first_file_size - bundle->first_header_length;
+    }
+    return bundle->first_file_size - sizeof(Shared_Header);
+}
+
+static i64
+get_bundle_payload_size(Merge_Bundle *bundle) {
+    i64 result = get_bundle_file_payload_length(bundle, 0);
+    
+    if(bundle->manifest_chunks && bundle->total_file_count > 1) {
+        Manifest_Chunk *last = bundle->manifest_chunks + bundle->total_file_count - 1;
+        
+        result = last->payload_offset + last->length - sizeof(Shared_Header);
+    } else if(bundle->file_count > 1) {
+        result += (bundle->file_count - 2) * get_bundle_file_payload_length(bundle, 1);
+        
+        File_Handle handle = os_open_file_for_reading(bundle->files[bundle->file_count - 1].data);
+        
+        if(os_is_handle_valid(handle)) {
+            result += os_get_size_of_file(handle) - sizeof(Shared_Header);
+            
+            os_close_file(handle);
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Every chunk but the last is as big as the first one, and the
+// last one is never bigger. The first chunk sets the length, so there is
+// nothing to check it against while its length is not known.
+static bool
+is_bundle_chunk_length_valid(Merge_Bundle *bundle, u32 file_index, i64 length) {
+    i64 header_length = (file_index == 0) ? bundle->first_header_length : (i64)sizeof(Shared_Header);
+    
+    if(length < header_length) {
+        return false;
+    }
+    
+    if(bundle->first_file_size > 0) {
+        if(file_index + 1 < bundle->total_file_count) {
+            return length == bundle->first_file_size;
+        }
+        
+        return length <= bundle->first_file_size;
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): A chunk that is too long is not always read to the end, so
+// only the length it was cut off at is known.
+static void
+print_bundle_chunk_length_error(Merge_Bundle *bundle, u32 file_index, i64 length) {
+    if(bundle->first_file_size > 0 && length > bundle->first_file_size) {
+        printf("%s is longer than %lld bytes, the length of the first chunk\n", bundle->files[file_index].data,
+               (long long)bundle->first_file_size);
+    } else {
+        printf("%s is only %lld bytes\n", bundle->files[file_index].data, (long long)length);
+    }
+}
+
+//~ NOTE(Patrik): Moves the reader to an offset in the payload. Files that are
+// skipped over entirely are never opened.
+static bool
+seek_bundle_payload(Bundle_Reader *reader, i64 payload_offset) {
+    if(payload_offset < reader->payload_offset) {
+        if(reader->is_open) {
+            os_close_file(reader->handle);
+            reader->is_open = false;
+        }
+        
+        reader->file_index     = 0;
+        reader->payload_offset = 0;
+    }
+    
+    i64 amount = payload_offset - reader->payload_offset;
+    
+    while(amount > 0) {
+        if(reader->is_open) {
+            i64 remaining_length = os_get_remaining_size_of_file(reader->handle);
+            
+            if(amount < remaining_length) {
+                os_move_file_pointer(reader->handle, amount);
+                remaining_length = amount;
+            } else {
+                os_close_file(reader->handle);
+                reader->is_open = false;
+            }
+            
+            reader->payload_offset += remaining_length;
+            amount                 -= remaining_length;
+        } else {
+            i64 file_length = get_bundle_file_payload_length(reader->bundle, reader->file_index);
+            
+            if(reader->file_index + 1 < reader->bundle->file_count && amount >= file_length) {
+                reader->file_index     += 1;
+                reader->payload_offset += file_length;
+                amount                 -= file_length;
+            } else if(!open_next_bundle_file(reader)) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DEDUP
+//
+//~ NOTE(Patrik): The block store keeps every block merged from a dedup bundle
+// so that later bundles can refer to them instead of sending them again.
+static bool
+load_dedup_store(Dedup_Store *store, String output_path) {
+    if(!store->is_loaded) {
+        init_dedup();
+        
+        store->table      = make_dedup_table(4096);
+        store->block      = make_file_data(DEDUP_MAX_BLOCK_SIZE);
+        store->store_path = make_string(128);
+        store->index_path = make_string(128);
+        
+        append_string(&store->store_path, output_path);
+        append_cstring(&store->store_path, UNPACK_NTSTRING(DEDUP_STORE_NAME));
+        null_terminate(&store->store_path);
+        
+        append_string(&store->index_path, output_path);
+        append_cstring(&store->index_path, UNPACK_NTSTRING(DEDUP_INDEX_NAME));
+        null_terminate(&store->index_path);
+        
+        load_dedup_table(&store->table, store->index_path.data);
+        
+        store->handle = os_open_file_for_updating(store->store_path.data);
+        
+        if(os_is_handle_valid(store->handle)) {
+            store->size      = os_get_size_of_file(store->handle);
+            store->is_loaded = true;
+        } else {
+            printf("Could not open \"%s\"\n", store->store_path.data);
+        }
+    }
+    
+    return store->is_loaded;
+}
+
+static void
+save_dedup_store(Dedup_Store *store) {
+    if(store->is_loaded) {
+        if(!save_dedup_table(&store->table, store->index_path.data)) {
+            printf("Could not write \"%s\"\n", store->index_path.data);
+        }
+        
+        os_close_file(store->handle);
+        
+        SPLTMRG_FREE(store->table.entries);
+        SPLTMRG_FREE(store->block.data);
+        SPLTMRG_FREE(store->store_path.data);
+        SPLTMRG_FREE(store->index_path.data);
+        
+        store->is_loaded = false;
+    }
+}
+
+static bool
+merge_dedup_bundle(Merge_Bundle *bundle, File_Handle dest_handle, Dedup_Store *store) {
+    bool result = true;
+    
+    Bundle_Reader reader      = make_bundle_reader(bundle);
+    File_Data     record_data = make_file_data(sizeof(Dedup_Record));
+    File_Data    *block       = &store->block;
+    
+    bool should_swap = should_swap_endian(bundle->flags);
+    
+    while(result) {
+        record_data.length = 0;
+        
+        i64 read_length = read_bundle_payload(&reader, &record_data, sizeof(Dedup_Record));
+        
+        if(read_length == 0) {
+            break;
+        }
+        
+        Dedup_Record *record = (Dedup_Record*)record_data.data;
+        
+        if(should_swap) {
+            record->length    = swap_endian_u32(record->length);
+            record->digest_lo = swap_endian_u64(record->digest_lo);
+            record->digest_hi = swap_endian_u64(record->digest_hi);
+        }
+        
+        if(read_length != sizeof(Dedup_Record) ||
+           record->length == 0 || record->length > DEDUP_MAX_BLOCK_SIZE)
+        {
+            printf("The bundle has an invalid dedup record\n");
+            result = false;
+            break;
+        }
+        
+        Hash128 digest = {0};
+        digest.lo = record->digest_lo;
+        digest.hi = record->digest_hi;
+        
+        Dedup_Entry *entry = find_dedup_entry(&store->table, digest);
+        
+        block->length = 0;
+        
+        if(record->type == Dedup_Record_Type__Literal) {
+            //~ NOTE(Patrik): A block that goes into the store is trusted by every
+            // later bundle that refers to it, so it has to be hashed first.
+            if(read_bundle_payload(&reader, block, record->length) != record->length) {
+                printf("The bundle ended in the middle of a block\n");
+                result = false;
+            } else if(!are_hashes_equal(hash_content(block->data, block->length), digest)) {
+                printf("Dedup block %016llx%016llx does not match its digest\n",
+                       (unsigned long long)digest.hi, (unsigned long long)digest.lo);
+                result = false;
+            } else if(!entry) {
+                os_set_file_pointer(store->handle, store->size);
+                
+                if(os_write_file(store->handle, block->data, block->length) == block->length) {
+                    Dedup_Entry new_entry = {0};
+                    new_entry.digest = digest;
+                    new_entry.offset = store->size;
+                    new_entry.length = record->length;
+                    
+                    insert_dedup_entry(&store->table, new_entry);
+                    
+                    store->size += block->length;
+                } else {
+                    //~ NOTE(Patrik): store->size is not moved, so whatever part of
+                    // the block made it is written over by the next block.
+                    printf("Could not write \"%s\"\n", store->store_path.data);
+                    result = false;
+                }
+            }
+        } else if(record->type == Dedup_Record_Type__Reference) {
+            if(entry && entry->length == record->length) {
+                os_set_file_pointer(store->handle, entry->offset);
+                
+                if(os_read_file(block, store->handle, entry->length) != entry->length) {
+                    printf("Could not read a block from \"%s\"\n", store->store_path.data);
+                    result = false;
+                }
+            } else {
+                printf("Missing dedup block %016llx%016llx, merge the bundles in the order they were split\n",
+                       (unsigned long long)digest.hi, (unsigned long long)digest.lo);
+                result = false;
+            }
+        } else {
+            printf("The bundle has an invalid dedup record\n");
+            result = false;
+        }
+        
+        if(result && os_write_file(dest_handle, block->data, block->length) != block->length) {
+            printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+            result = false;
+        }
+    }
+    
+    free_bundle_reader(&reader);
+    SPLTMRG_FREE(record_data.data);
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DELTA
+//
+static bool
+merge_delta_bundle(Merge_Bundle *bundle, File_Handle dest_handle, File_Handle base_handle,
+                   File_Data *file_buffer)
+{
+    bool result = false;
+    
+    Bundle_Reader reader      = make_bundle_reader(bundle);
+    File_Data     record_data = make_file_data(sizeof(Delta_Record) + sizeof(Delta_Digest));
+    Hash_State    target      = begin_hash(0);
+    i64           target_size = 0;
+    
+    bool should_swap = should_swap_endian(bundle->flags);
+    
+    if(read_bundle_payload(&reader, &record_data, sizeof(Delta_Header)) == sizeof(Delta_Header)) {
+        Delta_Header *header = (Delta_Header*)record_data.data;
+        
+        if(should_swap) {
+            header->base_size = swap_endian_u64(header->base_size);
+        }
+        
+        if(header->base_size != (u64)os_get_size_of_file(base_handle)) {
+            printf("The base file should be %llu bytes, but it is %lld bytes\n",
+                   (unsigned long long)header->base_size, (long long)os_get_size_of_file(base_handle));
+        } else {
+            bool is_done = false;
+            
+            while(!is_done) {
+                record_data.length = 0;
+                
+                if(read_bundle_payload(&reader, &record_data, sizeof(Delta_Record)) != sizeof(Delta_Record)) {
+                    printf("The bundle ended without an end record\n");
+                    break;
+                }
+                
+                Delta_Record *record = (Delta_Record*)record_data.data;
+                
+                if(should_swap) {
+                    record->offset = swap_endian_u64(record->offset);
+                    record->length = swap_endian_u64(record->length);
+                }
+                
+                if(record->type == Delta_Record_Type__End) {
+                    is_done = true;
+                    
+                    Delta_Digest *digest = (Delta_Digest*)(record_data.data + record_data.length);
+                    
+                    if(read_bundle_payload(&reader, &record_data, sizeof(Delta_Digest)) == sizeof(Delta_Digest)) {
+                        if(should_swap) {
+                            digest->digest_lo = swap_endian_u64(digest->digest_lo);
+                            digest->digest_hi = swap_endian_u64(digest->digest_hi);
+                        }
+                        
+                        Hash128 target_digest = end_hash(&target);
+                        
+                        if(record->length == (u64)target_size &&
+                           digest->digest_lo == target_digest.lo && digest->digest_hi == target_digest.hi)
+                        {
+                            result = true;
+                        } else {
+                            printf("The merged file does not match, the base file is not the one it was split against\n");
+                        }
+                    }
+                } else if(record->type == Delta_Record_Type__Copy ||
+                          record->type == Delta_Record_Type__Literal)
+                {
+                    u64 remaining_length = record->length;
+                    
+                    if(record->type == Delta_Record_Type__Copy) {
+                        if(record->offset + record->length > (u64)os_get_size_of_file(base_handle)) {
+                            printf("The bundle copies past the end of the base file\n");
+                            break;
+                        }
+                        
+                        os_set_file_pointer(base_handle, record->offset);
+                    }
+                    
+                    bool has_write_failed = false;
+                    
+                    while(remaining_length > 0) {
+                        i64 read_amount = file_buffer->capacity;
+                        
+                        if((u64)read_amount > remaining_length) {
+                            read_amount = remaining_length;
+                        }
+                        
+                        file_buffer->length = 0;
+                        
+                        i64 read_length = 0;
+                        
+                        if(record->type == Delta_Record_Type__Copy) {
+                            read_length = os_read_file(file_buffer, base_handle, read_amount);
+                        } else {
+                            read_length = read_bundle_payload(&reader, file_buffer, read_amount);
+                        }
+                        
+                        if(read_length != read_amount) {
+                            break;
+                        }
+                        
+                        update_hash(&target, file_buffer->data, file_buffer->length);
+                        
+                        if(os_write_file(dest_handle, file_buffer->data, file_buffer->length) != file_buffer->length) {
+                            has_write_failed = true;
+                            break;
+                        }
+                        
+                        target_size      += file_buffer->length;
+                        remaining_length -= file_buffer->length;
+                    }
+                    
+                    file_buffer->length = 0;
+                    
+                    if(has_write_failed) {
+                        printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+                        break;
+                    }
+                    
+                    if(remaining_length > 0) {
+                        printf("The bundle ended in the middle of a record\n");
+                        break;
+                    }
+                } else {
+                    printf("The bundle has an invalid delta record\n");
+                    break;
+                }
+            }
+        }
+    }
+    
+    free_bundle_reader(&reader);
+    SPLTMRG_FREE(record_data.data);
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SPARSE
+//
+//~ NOTE(Patrik): The merged file is always a new file, so skipping over a hole
+// with the file pointer is enough to leave it unwritten, there is nothing to
+// punch out.
+static bool
+merge_sparse_bundle(Merge_Bundle *bundle, File_Handle dest_handle, File_Data *file_buffer) {
+    bool result = false;
+    
+    Bundle_Reader reader      = make_bundle_reader(bundle);
+    File_Data     record_data = make_file_data(sizeof(Sparse_Record));
+    i64           merged_size = 0;
+    
+    bool should_swap = should_swap_endian(bundle->flags);
+    
+    if(!os_set_sparse(dest_handle)) {
+        printf("%s can not have holes, they are written as zeros\n", bundle->out_file_name.data);
+    }
+    
+    bool is_done = false;
+    
+    while(!is_done) {
+        record_data.length = 0;
+        
+        if(read_bundle_payload(&reader, &record_data, sizeof(Sparse_Record)) != sizeof(Sparse_Record)) {
+            printf("The bundle ended without an end record\n");
+            break;
+        }
+        
+        Sparse_Record *record = (Sparse_Record*)record_data.data;
+        
+        if(should_swap) {
+            record->length = swap_endian_u64(record->length);
+        }
+        
+        if(record->type == Sparse_Record_Type__End) {
+            is_done = true;
+            
+            if(record->length < (u64)merged_size) {
+                printf("The bundle has more data than the size of the file\n");
+            } else if(!os_set_size_of_file(dest_handle, record->length)) {
+                printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+            } else {
+                result = true;
+            }
+        } else if(record->type == Sparse_Record_Type__Hole) {
+            if(!os_move_file_pointer(dest_handle, record->length)) {
+                printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+                break;
+            }
+            
+            merged_size += record->length;
+        } else if(record->type == Sparse_Record_Type__Data) {
+            u64 remaining_length = record->length;
+            
+            while(remaining_length > 0) {
+                i64 read_amount = file_buffer->capacity;
+                
+                if((u64)read_amount > remaining_length) {
+                    read_amount = remaining_length;
+                }
+                
+                file_buffer->length = 0;
+                
+                if(read_bundle_payload(&reader, file_buffer, read_amount) != read_amount) {
+                    break;
+                }
+                
+                if(os_write_file(dest_handle, file_buffer->data, file_buffer->length) != file_buffer->length) {
+                    break;
+                }
+                
+                merged_size      += file_buffer->length;
+                remaining_length -= file_buffer->length;
+            }
+            
+            file_buffer->length = 0;
+            
+            if(remaining_length > 0) {
+                printf("The bundle ended in the middle of a record\n");
+                break;
+            }
+        } else {
+            printf("The bundle has an invalid sparse record\n");
+            break;
+        }
+    }
+    
+    free_bundle_reader(&reader);
+    SPLTMRG_FREE(record_data.data);
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PARITY
+//
+static Hash128
+hash_file(File_Handle handle, File_Data *buffer) {
+    Hash_State state = begin_hash(0);
+    
+    buffer->length = 0;
+    
+    while(os_read_file(buffer, handle, buffer->capacity) > 0) {
+        update_hash(&state, buffer->data, buffer->length);
+        buffer->length = 0;
+    }
+    
+    return end_hash(&state);
+}
+
+//~ NOTE(Patrik): Reads the parity header and the chunk infos of a parity file.
+// Returns the length of the whole header, or 0 if the file is not usable.
+static i64
+read_parity_header(String file_name, File_Data *header_data) {
+    i64 result = 0;
+    
+    File_Handle handle = os_open_file_for_reading(file_name.data);
+    
+    if(os_is_handle_valid(handle)) {
+        header_data->length = 0;
+        
+        i64 read_amount = sizeof(Shared_Header) + sizeof(Parity_Header);
+        
+        if(os_read_file(header_data, handle, read_amount) == read_amount) {
+            Shared_Header *shared = (Shared_Header*)header_data->data;
+            Parity_Header *header = (Parity_Header*)(shared + 1);
+            
+            bool should_swap = should_swap_endian(shared->flags);
+            
+            if(should_swap) {
+                header->total_file_count = swap_endian_u16(header->total_file_count);
+                header->group_index      = swap_endian_u16(header->group_index);
+                header->group_size       = swap_endian_u16(header->group_size);
+                header->data_count       = swap_endian_u16(header->data_count);
+                header->parity_count     = swap_endian_u16(header->parity_count);
+                header->parity_index     = swap_endian_u16(header->parity_index);
+                header->stripe_length    = swap_endian_u64(header->stripe_length);
+            }
+            
+            read_amount = header->data_count * sizeof(Parity_Chunk_Info);
+            
+            if(header->data_count <= header->group_size &&
+               os_read_file(header_data, handle, read_amount) == read_amount)
+            {
+                Parity_Chunk_Info *infos = (Parity_Chunk_Info*)(header + 1);
+                
+                if(should_swap) {
+                    For(i32, it_index, header->data_count) {
+                        infos[it_index].length    = swap_endian_u64(infos[it_index].length);
+                        infos[it_index].digest_lo = swap_endian_u64(infos[it_index].digest_lo);
+                        infos[it_index].digest_hi = swap_endian_u64(infos[it_index].digest_hi);
+                    }
+                }
+                
+                result = header_data->length;
+                
+                if(os_get_size_of_file(handle) != result + (i64)header->stripe_length) {
+                    result = 0;
+                }
+            }
+        }
+        
+        os_close_file(handle);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Checks every group that has parity files and rebuilds the
+// data files that are missing or do not match their digest. The rebuilt
+// files are written to merged_output and added to the bundle.
+static void
+repair_bundle(Merge_Bundle_Array *master_list, Merge_Bundle *bundle, String source_path, String output_path) {
+    i32 group_size   = bundle->parity_group_size;
+    i32 parity_count = bundle->parity_count;
+    
+    if(group_size == 0 || parity_count == 0 || group_size + parity_count > PARITY_MAX_CHUNKS) {
+        return;
+    }
+    
+    init_parity();
+    
+    i32 group_count = (bundle->total_file_count + group_size - 1) / group_size;
+    
+    i64 max_header_length = (sizeof(Shared_Header) + sizeof(Parity_Header) +
+                             group_size * sizeof(Parity_Chunk_Info));
+    
+    File_Data          header_data  = make_file_data(max_header_length);
+    File_Data          stripe       = make_file_data(PARITY_STRIPE_SIZE);
+    bool              *is_bad       = SPLTMRG_ALLOC(bool, group_size);
+    i32               *sources      = SPLTMRG_ALLOC(i32, group_size);
+    File_Handle       *handles      = SPLTMRG_ALLOC(File_Handle, group_size);
+    File_Handle       *out_handles  = SPLTMRG_ALLOC(File_Handle, group_size);
+    u8                *matrix       = SPLTMRG_ALLOC(u8, group_size * group_size);
+    u8                *out_stripes  = SPLTMRG_ALLOC(u8, group_size * PARITY_STRIPE_SIZE);
+    Parity_Chunk_Info *infos        = SPLTMRG_ALLOC(Parity_Chunk_Info, group_size);
+    
+    For(i32, group_index, group_count) {
+        i32 first_index = group_index * group_size;
+        i64 header_length = 0;
+        
+        For(i32, it_index, parity_count) {
+            u32 parity_file_index = group_index * parity_count + it_index;
+            
+            if(has_file_name(bundle->parity_files, bundle->parity_file_capacity, parity_file_index)) {
+                header_length = read_parity_header(bundle->parity_files[parity_file_index], &header_data);
+                
+                if(header_length > 0) {
+                    break;
+                }
+            }
+        }
+        
+        if(header_length == 0) {
+            continue;
+        }
+        
+        Parity_Header *header     = (Parity_Header*)(header_data.data + sizeof(Shared_Header));
+        i32            data_count = header->data_count;
+        i64            stripe_length = header->stripe_length;
+        
+        copy_memory((u8*)infos, (u8*)(header + 1), data_count * sizeof(Parity_Chunk_Info));
+        
+        i32 bad_count = 0;
+        
+        For(i32, it_index, data_count) {
+            is_bad[it_index] = true;
+            
+            if(has_file_name(bundle->files, bundle->file_capacity, first_index + it_index)) {
+                File_Handle handle = os_open_file_for_reading(bundle->files[first_index + it_index].data);
+                
+                if(os_is_handle_valid(handle)) {
+                    if(os_get_size_of_file(handle) == (i64)infos[it_index].length) {
+                        Hash128 digest = hash_file(handle, &stripe);
+                        
+                        if(digest.lo == infos[it_index].digest_lo && digest.hi == infos[it_index].digest_hi) {
+                            is_bad[it_index] = false;
+                        }
+                    }
+                    
+                    os_close_file(handle);
+                }
+            }
+            
+            if(is_bad[it_index]) {
+                bad_count += 1;
+            }
+        }
+        
+        if(bad_count == 0) {
+            continue;
+        }
+        
+        //~ NOTE(Patrik): Pick data_count good files, the good data files first
+        // and then parity files in place of the bad ones.
+        i32 source_count = 0;
+        
+        For(i32, it_index, data_count) {
+            if(!is_bad[it_index]) {
+                sources[source_count] = it_index;
+                source_count += 1;
+            }
+        }
+        
+        For(i32, it_index, parity_count) {
+            u32 parity_file_index = group_index * parity_count + it_index;
+            
+            if(source_count < data_count &&
+               has_file_name(bundle->parity_files, bundle->parity_file_capacity, parity_file_index))
+            {
+                File_Data check_data = make_file_data(max_header_length);
+                
+                if(read_parity_header(bundle->parity_files[parity_file_index], &check_data) == header_length) {
+                    sources[source_count] = data_count + it_index;
+                    source_count += 1;
+                }
+                
+                SPLTMRG_FREE(check_data.data);
+            }
+        }
+        
+        if(source_count < data_count) {
+            printf("Group %d has %d missing or damaged files, but only %d parity files to rebuild them from\n",
+                   group_index + 1, bad_count, source_count - (data_count - bad_count));
+            continue;
+        }
+        
+        zero_memory(matrix, group_size * group_size);
+        
+        For(i32, row, data_count) {
+            if(sources[row] < data_count) {
+                matrix[row * data_count + sources[row]] = 1;
+            } else {
+                For(i32, column, data_count) {
+                    matrix[row * data_count + column] =
+                        get_parity_coefficient(group_size, sources[row] - data_count, column);
+                }
+            }
+        }
+        
+        if(!invert_gf_matrix(matrix, data_count)) {
+            printf("Group %d can not be rebuilt\n", group_index + 1);
+            continue;
+        }
+        
+        bool has_failed = false;
+        i32  open_count = 0;
+        
+        For(i32, row, data_count) {
+            String file_name = {0};
+            
+            if(sources[row] < data_count) {
+                file_name = bundle->files[first_index + sources[row]];
+            } else {
+                file_name = bundle->parity_files[group_index * parity_count + sources[row] - data_count];
+            }
+            
+            handles[row] = os_open_file_for_reading(file_name.data);
+            
+            if(!os_is_handle_valid(handles[row])) {
+                has_failed = true;
+                break;
+            }
+            
+            open_count += 1;
+            
+            if(sources[row] >= data_count) {
+                os_set_file_pointer(handles[row], header_length);
+            }
+        }
+        
+        String *rebuilt_names = SPLTMRG_ALLOC(String, data_count);
+        
+        For(i32, it_index, data_count) {
+            if(is_bad[it_index] && !has_failed) {
+                rebuilt_names[it_index] = make_string(128);
+                
+                append_string(&rebuilt_names[it_index], output_path);
+                append_cstring(&rebuilt_names[it_index], UNPACK_NTSTRING("0x"));
+                append_u32(&rebuilt_names[it_index], bundle->unique_id, 16);
+                append_char(&rebuilt_names[it_index], '_');
+                append_u32(&rebuilt_names[it_index], first_index + it_index, 10);
+                append_cstring(&rebuilt_names[it_index], SPLITMERGE_FILE_EXTENSION_CSTRING);
+                null_terminate(&rebuilt_names[it_index]);
+                
+                out_handles[it_index] = os_open_file_for_writing(rebuilt_names[it_index].data);
+                
+                if(!os_is_handle_valid(out_handles[it_index])) {
+                    printf("Could not write \"%s\"\n", rebuilt_names[it_index].data);
+                    is_bad[it_index] = false;
+                    has_failed       = true;
+                }
+            }
+        }
+        
+        printf("Rebuilding %d files in group %d/%d\n", bad_count, group_index + 1, group_count);
+        
+        for(i64 offset = 0; offset < stripe_length && !has_failed; offset += PARITY_STRIPE_SIZE) {
+            i64 length = stripe_length - offset;
+            
+            if(length > PARITY_STRIPE_SIZE) {
+                length = PARITY_STRIPE_SIZE;
+            }
+            
+            zero_memory(out_stripes, group_size * PARITY_STRIPE_SIZE);
+            
+            For(i32, row, data_count) {
+                stripe.length = 0;
+                
+                os_read_file(&stripe, handles[row], length);
+                zero_memory(stripe.data + stripe.length, length - stripe.length);
+                
+                For(i32, it_index, data_count) {
+                    if(is_bad[it_index]) {
+                        gf_mul_add_region(out_stripes + it_index * PARITY_STRIPE_SIZE, stripe.data,
+                                          matrix[it_index * data_count + row], length);
+                    }
+                }
+            }
+            
+            For(i32, it_index, data_count) {
+                i64 write_length = (i64)infos[it_index].length - offset;
+                
+                if(write_length > length) {
+                    write_length = length;
+                }
+                
+                if(is_bad[it_index] && write_length > 0) {
+                    os_write_file(out_handles[it_index], out_stripes + it_index * PARITY_STRIPE_SIZE, write_length);
+                }
+            }
+        }
+        
+        For(i32, it_index, open_count) {
+            os_close_file(handles[it_index]);
+        }
+        
+        For(i32, it_index, data_count) {
+            if(is_bad[it_index] && rebuilt_names[it_index].data) {
+                os_close_file(out_handles[it_index]);
+                
+                if(!has_failed) {
+                    printf("Rebuilt %s\n", rebuilt_names[it_index].data);
+                    
+                    //~ NOTE(Patrik): A damaged file is replaced, so it should not be counted twice.
+                    if(has_file_name(bundle->files, bundle->file_capacity, first_index + it_index)) {
+                        close_bundle_file(bundle, first_index + it_index);
+                        
+                        bundle->files[first_index + it_index].data = 0;
+                        bundle->file_count -= 1;
+                    }
+                    
+                    add_split_file(master_list, rebuilt_names[it_index], source_path);
+                }
+            }
+        }
+        
+        SPLTMRG_FREE(rebuilt_names);
+    }
+    
+    SPLTMRG_FREE(header_data.data);
+    SPLTMRG_FREE(stripe.data);
+    SPLTMRG_FREE(is_bad);
+    SPLTMRG_FREE(sources);
+    SPLTMRG_FREE(handles);
+    SPLTMRG_FREE(out_handles);
+    SPLTMRG_FREE(matrix);
+    SPLTMRG_FREE(out_stripes);
+    SPLTMRG_FREE(infos);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// VERIFY
+//
+#define VERIFY_READ_SIZE (1024 * 1024)
+
+static char *
+get_chunk_status_message(Chunk_Status status) {
+    switch(status) {
+        case Chunk_Status__Ok:             return "is good";
+        case Chunk_Status__Missing:        return "is missing";
+        case Chunk_Status__Unreadable:     return "could not be read";
+        case Chunk_Status__Invalid_Header: return "has an invalid header";
+        case Chunk_Status__Wrong_Length:   return "has the wrong length";
+        case Chunk_Status__Wrong_Digest:   return "does not match its digest";
+    }
+    return "";
+}
+
+//~ NOTE(Patrik): Fills in what every chunk should be from the manifest, or
+// from the chunk infos of the parity files when there is no manifest.
+static void
+get_expected_chunks(Merge_Bundle *bundle, Expected_Chunk *expected) {
+    if(bundle->manifest_chunks) {
+        For(u32, it_index, bundle->total_file_count) {
+            Manifest_Chunk *chunk = bundle->manifest_chunks + it_index;
+            
+            expected[it_index].length     = chunk->length;
+            expected[it_index].digest_lo  = chunk->digest_lo;
+            expected[it_index].digest_hi  = chunk->digest_hi;
+            expected[it_index].has_digest = true;
+        }
+    } else if(bundle->parity_group_size > 0 && bundle->parity_count > 0) {
+        i32 group_size   = bundle->parity_group_size;
+        i32 parity_count = bundle->parity_count;
+        i32 group_count  = (bundle->total_file_count + group_size - 1) / group_size;
+        
+        File_Data header_data = make_file_data(sizeof(Shared_Header) + sizeof(Parity_Header) +
+                                               group_size * sizeof(Parity_Chunk_Info));
+        
+        For(i32, group_index, group_count) {
+            For(i32, it_index, parity_count) {
+                u32 parity_file_index = group_index * parity_count + it_index;
+                
+                if(has_file_name(bundle->parity_files, bundle->parity_file_capacity, parity_file_index) &&
+                   read_parity_header(bundle->parity_files[parity_file_index], &header_data) > 0)
+                {
+                    Parity_Header     *header = (Parity_Header*)(header_data.data + sizeof(Shared_Header));
+                    Parity_Chunk_Info *infos  = (Parity_Chunk_Info*)(header + 1);
+                    
+                    For(i32, data_index, header->data_count) {
+                        u32 file_index = group_index * group_size + data_index;
+                        
+                        if(file_index < bundle->total_file_count) {
+                            expected[file_index].length     = infos[data_index].length;
+                            expected[file_index].digest_lo  = infos[data_index].digest_lo;
+                            expected[file_index].digest_hi  = infos[data_index].digest_hi;
+                            expected[file_index].has_digest = true;
+                        }
+                    }
+                    
+                    break;
+                }
+            }
+        }
+        
+        SPLTMRG_FREE(header_data.data);
+    }
+}
+
+//~ NOTE(Patrik): Checks the header at the start of a chunk against the
+// bundle it was sorted into.
+static bool
+is_chunk_header_valid(Merge_Bundle *bundle, u32 file_index, u8 *data, i64 length) {
+    if(length < (i64)sizeof(Shared_Header)) {
+        return false;
+    }
+    
+    Shared_Header shared = *(Shared_Header*)data;
+    
+    if(!is_valid_header(shared) || (shared.flags & ~SPLITMERGE_KNOWN_HEADER_FLAGS) ||
+       is_flag_set(shared.flags, Header_Flag__Parity) || shared.flags != bundle->flags)
+    {
+        return false;
+    }
+    
+    bool should_swap = should_swap_endian(shared.flags);
+    
+    if(should_swap) {
+        shared.unique_id  = swap_endian_u32(shared.unique_id);
+        shared.file_index = swap_endian_u16(shared.file_index);
+    }
+    
+    if(shared.unique_id != bundle->unique_id || shared.file_index != file_index) {
+        return false;
+    }
+    
+    if(file_index == 0) {
+        if(length < (i64)sizeof(First_Header)) {
+            return false;
+        }
+        
+        First_Header header = *(First_Header*)data;
+        
+        if(should_swap) {
+            header.total_file_count = swap_endian_u16(header.total_file_count);
+            header.file_name_length = swap_endian_u16(header.file_name_length);
+        }
+        
+        if(header.total_file_count != bundle->total_file_count ||
+           (i64)(sizeof(First_Header) + header.file_name_length + 1) != bundle->first_header_length)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): Without a manifest or parity every chunk but the last has to
+// be as big as the first one, which is the same rule the merge relies on.
+static bool
+is_chunk_length_valid(Merge_Bundle *bundle, Expected_Chunk *expected, u32 file_index, i64 length) {
+    if(expected->has_digest) {
+        return length == (i64)expected->length;
+    }
+    
+    return is_bundle_chunk_length_valid(bundle, file_index, length);
+}
+
+static Chunk_Status
+verify_chunk(Merge_Bundle *bundle, Expected_Chunk *expected, u32 file_index, File_Data *buffer) {
+    if(!has_file_name(bundle->files, bundle->file_capacity, file_index)) {
+        return Chunk_Status__Missing;
+    }
+    
+    File_Handle handle = open_bundle_file(bundle, file_index);
+    
+    if(!os_is_handle_valid(handle)) {
+        return Chunk_Status__Unreadable;
+    }
+    
+    Chunk_Status result = Chunk_Status__Ok;
+    i64          length = os_get_size_of_file(handle);
+    
+    buffer->length = 0;
+    
+    if(!is_chunk_length_valid(bundle, expected, file_index, length)) {
+        result = Chunk_Status__Wrong_Length;
+    } else if(os_read_file(buffer, handle, buffer->capacity) <= 0) {
+        result = Chunk_Status__Unreadable;
+    } else if(!is_chunk_header_valid(bundle, file_index, buffer->data, buffer->length)) {
+        result = Chunk_Status__Invalid_Header;
+    } else if(expected->has_digest) {
+        Hash_State state      = begin_hash(0);
+        i64        read_total = 0;
+        
+        do {
+            update_hash(&state, buffer->data, buffer->length);
+            
+            read_total     += buffer->length;
+            buffer->length  = 0;
+        } while(os_read_file(buffer, handle, buffer->capacity) > 0);
+        
+        Hash128 digest = end_hash(&state);
+        
+        if(read_total != length) {
+            result = Chunk_Status__Unreadable;
+        } else if(digest.lo != expected->digest_lo || digest.hi != expected->digest_hi) {
+            result = Chunk_Status__Wrong_Digest;
+        }
+    }
+    
+    drop_streamed_file(handle);
+    os_close_file(handle);
+    
+    return result;
+}
+
+static
+PLATFORM_THREAD_PROC(verify_thread_proc) {
+    Verify_Work *work   = (Verify_Work*)data;
+    File_Data    buffer = make_file_data(get_slice_size(VERIFY_READ_SIZE));
+    
+    for(;;) {
+        i64 index = os_atomic_add(&work->next_index, 1);
+        
+        if(index >= work->count) {
+            break;
+        }
+        
+        work->statuses[index] = verify_chunk(work->bundle, work->expected + index, (u32)index, &buffer);
+    }
+    
+    SPLTMRG_FREE(buffer.data);
+}
+
+//~ NOTE(Patrik): Checks every chunk of a bundle on thread_count threads
+// without writing anything, and lists the ones that are bad.
+// Returns true if the whole bundle is good.
+static bool
+verify_bundle(Merge_Bundle *bundle, i32 thread_count) {
+    if(bundle->total_file_count == 0) {
+        printf("Bundle 0x%08X has no first chunk, so the amount of chunks is not known\n", bundle->unique_id);
+        return false;
+    }
+    
+    printf("Verifying %s - %u chunks\n", bundle->out_file_name.data, bundle->total_file_count);
+    
+    Verify_Work work = {0};
+    work.bundle   = bundle;
+    work.count    = bundle->total_file_count;
+    work.expected = SPLTMRG_ALLOC(Expected_Chunk, work.count);
+    work.statuses = SPLTMRG_ALLOC(Chunk_Status, work.count);
+    
+    get_expected_chunks(bundle, work.expected);
+    
+    //~ NOTE(Patrik): Every thread has a read buffer of its own, with
+    // --max-memory there are only as many threads as there are buffers that fit.
+    if(global_max_memory && thread_count > global_max_memory / 4 / get_slice_size(VERIFY_READ_SIZE)) {
+        thread_count = (i32)(global_max_memory / 4 / get_slice_size(VERIFY_READ_SIZE));
+    }
+    
+    if(thread_count > work.count) {
+        thread_count = (i32)work.count;
+    }
+    
+    run_on_threads(verify_thread_proc, &work, thread_count);
+    
+    u32 bad_count = 0;
+    
+    For(u32, it_index, bundle->total_file_count) {
+        if(work.statuses[it_index] != Chunk_Status__Ok) {
+            printf("Chunk %u %s\n", it_index, get_chunk_status_message(work.statuses[it_index]));
+            bad_count += 1;
+        }
+    }
+    
+    if(bad_count > 0) {
+        printf("%u of %u chunks are bad\n", bad_count, bundle->total_file_count);
+    } else if(work.expected[0].has_digest) {
+        printf("All %u chunks are good\n", bundle->total_file_count);
+    } else {
+        printf("All %u chunks are good, there was no manifest or parity to check the digests against\n",
+               bundle->total_file_count);
+    }
+    
+    SPLTMRG_FREE(work.expected);
+    SPLTMRG_FREE(work.statuses);
+    
+    return bad_count == 0;
+}
+
+static i64
+get_bundle_file_size(Merge_Bundle *bundle, u32 file_index) {
+    if(bundle->open_files && bundle->open_files[file_index].is_open) {
+        return os_get_size_of_file(bundle->open_files[file_index].handle);
+    }
+    
+    i64         result = -1;
+    File_Handle handle = os_open_file_for_reading(bundle->files[file_index].data);
+    
+    if(os_is_handle_valid(handle)) {
+        result = os_get_size_of_file(handle);
+        os_close_file(handle);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Runs before the merged file is opened, so a bundle from a
+// manifest that can not be merged whole leaves nothing behind. Every chunk has
+// to be as long as the manifest says. A plain merge checks the digests as the
+// chunks are read, the other kinds take their chunks apart in pieces, so their
+// digests are checked here, the same way --verify does.
+static bool
+check_manifest_bundle(Merge_Bundle *bundle, File_Data *buffer) {
+    if(!bundle->manifest_chunks) {
+        return true;
+    }
+    
+    bool should_check_digests = (bundle->flags & (Header_Flag__Dedup | Header_Flag__Delta |
+                                                  Header_Flag__Sparse | Header_Flag__Pack)) != 0;
+    u32  bad_count            = 0;
+    
+    For(u32, file_index, bundle->total_file_count) {
+        Manifest_Chunk *chunk  = bundle->manifest_chunks + file_index;
+        Chunk_Status    status = Chunk_Status__Ok;
+        
+        if(should_check_digests) {
+            Expected_Chunk expected = {0};
+            expected.length     = chunk->length;
+            expected.digest_lo  = chunk->digest_lo;
+            expected.digest_hi  = chunk->digest_hi;
+            expected.has_digest = true;
+            
+            status = verify_chunk(bundle, &expected, file_index, buffer);
+        } else {
+            i64 file_size = get_bundle_file_size(bundle, file_index);
+            
+            if(file_size < 0) {
+                status = Chunk_Status__Unreadable;
+            } else if(file_size != (i64)chunk->length) {
+                status = Chunk_Status__Wrong_Length;
+            }
+        }
+        
+        if(status != Chunk_Status__Ok) {
+            printf("%s %s\n", bundle->files[file_index].data, get_chunk_status_message(status));
+            bad_count += 1;
+        }
+    }
+    
+    if(bad_count > 0) {
+        printf("Nothing was merged, %u of %u chunks are bad and there is no parity to rebuild them\n",
+               bad_count, bundle->total_file_count);
+    }
+    
+    return bad_count == 0;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PACK
+//
+static bool
+is_pack_entry_selected(String name, String *only_names, i32 only_count) {
+    if(only_count == 0) {
+        return true;
+    }
+    
+    For(i32, it_index, only_count) {
+        if(are_strings_equal(name, only_names[it_index])) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+//~ NOTE(Patrik): Split only writes relative names that use '/', so anything
+// else comes from a damaged or crafted pack and could write outside of the
+// folder of the pack: absolute names, drive letters, '\\', and empty, "."
+// or ".." parts.
+static bool
+is_pack_entry_name_safe(String name) {
+    if(name.length == 0 || name.data[0] == '/' || name.data[name.length - 1] == '/') {
+        return false;
+    }
+    
+    i32 part_start = 0;
+    
+    For(i32, it_index, name.length + 1) {
+        if(it_index < name.length) {
+            char c = name.data[it_index];
+            
+            if(c == 0 || c == '\\' || c == ':') {
+                return false;
+            }
+            
+            if(c != '/') {
+                continue;
+            }
+        }
+        
+        i32 part_length = it_index - part_start;
+        
+        if(part_length == 0 ||
+           (part_length == 1 && name.data[part_start] == '.') ||
+           (part_length == 2 && name.data[part_start] == '.' && name.data[part_start + 1] == '.'))
+        {
+            return false;
+        }
+        
+        part_start = it_index + 1;
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): Creates every folder in path up to the last '/'.
+static void
+create_parent_directories(String path) {
+    For(i32, it_index, path.length) {
+        if(path.data[it_index] == '/' && it_index > 0) {
+            path.data[it_index] = 0;
+            os_create_directory(path.data);
+            path.data[it_index] = '/';
+        }
+    }
+}
+
+static bool
+merge_pack_bundle(Merge_Bundle *bundle, File_Data *file_buffer, String *only_names, i32 only_count) {
+    bool result = false;
+    
+    Bundle_Reader reader       = make_bundle_reader(bundle);
+    File_Data     index        = {0};
+    String        out_path     = make_string(128);
+    i64           payload_size = get_bundle_payload_size(bundle);
+    Durable_Batch batch        = {0};
+    
+    Pack_Trailer trailer = {0};
+    File_Data    trailer_data = {0};
+    trailer_data.data     = (u8*)&trailer;
+    trailer_data.capacity = sizeof(Pack_Trailer);
+    
+    bool should_swap = should_swap_endian(bundle->flags);
+    
+    if(payload_size >= (i64)sizeof(Pack_Trailer) &&
+       seek_bundle_payload(&reader, payload_size - sizeof(Pack_Trailer)) &&
+       read_bundle_payload(&reader, &trailer_data, sizeof(Pack_Trailer)) == sizeof(Pack_Trailer))
+    {
+        if(should_swap) {
+            trailer.index_offset = swap_endian_u64(trailer.index_offset);
+            trailer.entry_count  = swap_endian_u64(trailer.entry_count);
+        }
+        
+        i64 index_length = payload_size - sizeof(Pack_Trailer) - trailer.index_offset;
+        
+        if(trailer.index_offset <= (u64)payload_size && index_length >= 0) {
+            index = make_file_data(index_length + 1);
+            
+            if(seek_bundle_payload(&reader, trailer.index_offset) &&
+               read_bundle_payload(&reader, &index, index_length) == index_length)
+            {
+                result = true;
+            }
+        }
+    }
+    
+    if(!result) {
+        printf("The pack index is missing or damaged\n");
+    }
+    
+    u64 restored_count = 0;
+    i64 index_offset   = 0;
+    
+    For(u64, entry_index, trailer.entry_count) {
+        if(!result) {
+            break;
+        }
+        
+        if(index_offset + (i64)sizeof(Pack_Entry) > index.length) {
+            printf("The pack index is damaged\n");
+            result = false;
+            break;
+        }
+        
+        Pack_Entry entry = *(Pack_Entry*)(index.data + index_offset);
+        
+        if(should_swap) {
+            entry.offset      = swap_endian_u64(entry.offset);
+            entry.length      = swap_endian_u64(entry.length);
+            entry.name_length = swap_endian_u16(entry.name_length);
+        }
+        
+        index_offset += sizeof(Pack_Entry);
+        
+        String name = {0};
+        name.data   = (char*)(index.data + index_offset);
+        name.length = entry.name_length;
+        
+        index_offset += entry.name_length;
+        
+        if(index_offset > index.length || entry.offset + entry.length > trailer.index_offset) {
+            printf("The pack index is damaged\n");
+            result = false;
+            break;
+        }
+        
+        if(!is_pack_entry_name_safe(name)) {
+            printf("The pack index has an unsafe name: \"%.*s\"\n", (int)name.length, name.data);
+            result = false;
+            break;
+        }
+        
+        if(!is_pack_entry_selected(name, only_names, only_count)) {
+            continue;
+        }
+        
+        out_path.length = 0;
+        
+        append_string(&out_path, bundle->out_file_name);
+        append_char(&out_path, '/');
+        append_string(&out_path, name);
+        null_terminate(&out_path);
+        
+        create_parent_directories(out_path);
+        append_durable_suffix(&out_path);
+        
+        File_Handle dest_handle = os_open_file_for_writing(out_path.data);
+        
+        if(os_is_handle_valid(dest_handle)) {
+            u64  remaining_length = entry.length;
+            bool has_write_failed = false;
+            
+            seek_bundle_payload(&reader, entry.offset);
+            
+            while(remaining_length > 0) {
+                i64 read_amount = file_buffer->capacity;
+                
+                if((u64)read_amount > remaining_length) {
+                    read_amount = remaining_length;
+                }
+                
+                file_buffer->length = 0;
+                
+                if(read_bundle_payload(&reader, file_buffer, read_amount) != read_amount) {
+                    break;
+                }
+                
+                if(os_write_file(dest_handle, file_buffer->data, file_buffer->length) != file_buffer->length) {
+                    has_write_failed = true;
+                    break;
+                }
+                
+                remaining_length -= read_amount;
+            }
+            
+            file_buffer->length = 0;
+            
+            if(has_write_failed) {
+                abandon_durable_file(dest_handle, out_path);
+                
+                printf("Could not write \"%s\"\n", out_path.data);
+                result = false;
+            } else if(remaining_length > 0) {
+                abandon_durable_file(dest_handle, out_path);
+                
+                printf("The pack ended in the middle of %s\n", out_path.data);
+                result = false;
+            } else if(!close_durable_file(&batch, dest_handle, entry.length, &out_path)) {
+                printf("Could not flush \"%s\"\n", out_path.data);
+                result = false;
+            } else {
+                restored_count += 1;
+            }
+        } else {
+            printf("Could not write \"%s\"\n", out_path.data);
+            result = false;
+        }
+    }
+    
+    if(!end_durable_batch(&batch) || !flush_durable_folder(bundle->out_file_name)) {
+        printf("Could not flush the files in %s\n", bundle->out_file_name.data);
+        result = false;
+    }
+    
+    if(result) {
+        printf("Restored %llu of %llu files to %s\n", (unsigned long long)restored_count,
+               (unsigned long long)trailer.entry_count, bundle->out_file_name.data);
+    }
+    
+    free_bundle_reader(&reader);
+    SPLTMRG_FREE(out_path.data);
+    
+    if(index.data) {
+        SPLTMRG_FREE(index.data);
+    }
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// READ AHEAD
+//
+//~ NOTE(Patrik): Only used for plain bundles. Up to this much memory is spent
+// on chunks that are read but not merged yet, which is what lets chunks that
+// are striped over several disks be read from all of them at once.
+#define READ_AHEAD_MEMORY (256 * 1024 * 1024)
+#define READ_AHEAD_MAX_SLOTS 8
+
+static void
+read_bundle_chunk(Merge_Bundle *bundle, u32 file_index, File_Data *chunk) {
+    File_Handle handle = open_bundle_file(bundle, file_index);
+    
+    chunk->length = 0;
+    
+    if(os_is_handle_valid(handle)) {
+        os_advise_sequential(handle);
+        os_read_file(chunk, handle, chunk->capacity);
+        
+        drop_streamed_file(handle);
+        os_close_file(handle);
+    }
+}
+
+static
+PLATFORM_THREAD_PROC(read_ahead_thread_proc) {
+    Read_Ahead_Slot *slot = (Read_Ahead_Slot*)data;
+    
+    for(u32 file_index = slot->first_index; file_index < slot->bundle->file_count; file_index += slot->slot_count) {
+        os_wait_semaphore(slot->is_free);
+        
+        if(slot->is_stopping) {
+            break;
+        }
+        
+        read_bundle_chunk(slot->bundle, file_index, &slot->chunk);
+        
+        os_signal_semaphore(slot->is_full);
+    }
+}
+
+static Read_Ahead
+begin_read_ahead(Merge_Bundle *bundle, i32 thread_count) {
+    Read_Ahead result = {0};
+    
+    //~ NOTE(Patrik): One more byte than a chunk should be, so a chunk that is
+    // too long is caught instead of cut off.
+    i64 chunk_capacity = bundle->first_file_size + 1;
+    
+    if(bundle->first_file_size <= 0) {
+        chunk_capacity = SPLITMERGE_NITRO_FILE_LIMIT;
+    }
+    
+    i64 slot_count = READ_AHEAD_MEMORY / chunk_capacity;
+    
+    if(slot_count > READ_AHEAD_MAX_SLOTS) {
+        slot_count = READ_AHEAD_MAX_SLOTS;
+    }
+    
+    if(slot_count > thread_count) {
+        slot_count = thread_count;
+    }
+    
+    if(slot_count > bundle->file_count) {
+        slot_count = bundle->file_count;
+    }
+    
+    if(slot_count < 1) {
+        slot_count = 1;
+    }
+    
+    result.bundle     = bundle;
+    result.slot_count = (u32)slot_count;
+    result.slots      = SPLTMRG_ALLOC(Read_Ahead_Slot, result.slot_count);
+    
+    For(u32, it_index, result.slot_count) {
+        Read_Ahead_Slot *slot = result.slots + it_index;
+        
+        slot->bundle      = bundle;
+        slot->first_index = it_index;
+        slot->slot_count  = result.slot_count;
+        slot->chunk       = make_file_data(chunk_capacity);
+        
+        //~ NOTE(Patrik): With a single slot there is nothing to overlap, and
+        // a slot without a thread reads its chunks when they are asked for.
+        if(result.slot_count > 1) {
+            slot->is_free = os_create_semaphore(1);
+            slot->is_full = os_create_semaphore(0);
+            slot->thread  = os_create_thread(read_ahead_thread_proc, slot);
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Chunks have to be asked for in order, and each has to be
+// given back with release_read_ahead_chunk before the next one.
+static File_Data *
+get_read_ahead_chunk(Read_Ahead *read_ahead, u32 file_index) {
+    Read_Ahead_Slot *slot = read_ahead->slots + (file_index % read_ahead->slot_count);
+    
+    if(slot->thread) {
+        os_wait_semaphore(slot->is_full);
+    } else {
+        read_bundle_chunk(read_ahead->bundle, file_index, &slot->chunk);
+    }
+    
+    return &slot->chunk;
+}
+
+static void
+release_read_ahead_chunk(Read_Ahead *read_ahead, u32 file_index) {
+    Read_Ahead_Slot *slot = read_ahead->slots + (file_index % read_ahead->slot_count);
+    
+    if(slot->thread) {
+        os_signal_semaphore(slot->is_free);
+    }
+}
+
+//~ NOTE(Patrik): Also stops a merge that ended early, a thread that is in the
+// middle of a read finishes it and then sees is_stopping.
+static void
+end_read_ahead(Read_Ahead *read_ahead) {
+    For(u32, it_index, read_ahead->slot_count) {
+        Read_Ahead_Slot *slot = read_ahead->slots + it_index;
+        
+        if(slot->thread) {
+            slot->is_stopping = true;
+            
+            os_signal_semaphore(slot->is_free);
+            os_join_thread(slot->thread);
+        }
+        
+        if(slot->is_free) {
+            os_free_semaphore(slot->is_free);
+            os_free_semaphore(slot->is_full);
+        }
+        
+        SPLTMRG_FREE(slot->chunk.data);
+    }
+    
+    SPLTMRG_FREE(read_ahead->slots);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SLICED MERGE
+//
+//~ NOTE(Patrik): Merges a plain bundle one slice of file_buffer at a time
+// instead of whole chunks, for --max-memory. The first slice of a chunk has
+// all of its header, so the merge stream checks it as usual and the rest of
+// the chunk is payload. A chunk that does not match the manifest is only
+// found once it has been written.
+static bool
+merge_plain_bundle_sliced(Merge_Bundle *bundle, File_Handle dest_handle, File_Data *file_buffer) {
+    bool result = true;
+    
+    Merge_Stream stream         = make_merge_stream();
+    i64          written_offset = 0;
+    
+    For(u32, file_index, bundle->file_count) {
+        SPLITMERGE_PROBE2(merge_chunk_begin, bundle->unique_id, file_index);
+        
+        File_Handle handle = open_bundle_file(bundle, file_index);
+        
+        if(!os_is_handle_valid(handle)) {
+            printf("Invalid file: \"%s\"\n", bundle->files[file_index].data);
+            result = false;
+            break;
+        }
+        
+        os_advise_sequential(handle);
+        
+        Hash_State hash         = begin_hash(0);
+        i64        chunk_length = 0;
+        
+        for(;;) {
+            file_buffer->length = 0;
+            
+            i64 read_length = os_read_file(file_buffer, handle, file_buffer->capacity);
+            
+            if(read_length <= 0 && chunk_length > 0) {
+                break;
+            }
+            
+            //~ NOTE(Patrik): A chunk that is too long is caught before any of
+            // what is past the end of it is written.
+            if(bundle->first_file_size > 0 && chunk_length + read_length > bundle->first_file_size) {
+                print_bundle_chunk_length_error(bundle, file_index, chunk_length + read_length);
+                result = false;
+                break;
+            }
+            
+            update_hash(&hash, file_buffer->data, read_length);
+            drop_streamed_range(handle, chunk_length, read_length);
+            
+            u8 *payload        = file_buffer->data;
+            i64 payload_length = read_length;
+            
+            if(chunk_length == 0) {
+                Merge_Stream_Status status = push_merge_chunk(&stream, file_buffer->data, read_length);
+                
+                if(status != Merge_Stream_Status__Ok) {
+                    printf("%s %s\n", bundle->files[file_index].data, get_merge_stream_status_message(status));
+                    result = false;
+                    break;
+                }
+                
+                payload_length = pull_merge_payload(&stream, &payload);
+            }
+            
+            chunk_length += read_length;
+            
+            SPLITMERGE_PROBE1(merge_flush_begin, payload_length);
+            
+            i64 written_length = os_write_file(dest_handle, payload, payload_length);
+            
+            SPLITMERGE_PROBE1(merge_flush_end, written_length);
+            
+            if(written_length != payload_length) {
+                printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+                result = false;
+                break;
+            }
+            
+            drop_streamed_range(dest_handle, written_offset, written_length);
+            
+            written_offset += written_length;
+        }
+        
+        os_close_file(handle);
+        
+        SPLITMERGE_PROBE2(merge_chunk_end, bundle->unique_id, file_index);
+        
+        if(!result) {
+            break;
+        }
+        
+        if(!is_bundle_chunk_length_valid(bundle, file_index, chunk_length)) {
+            print_bundle_chunk_length_error(bundle, file_index, chunk_length);
+            result = false;
+            break;
+        }
+        
+        if(bundle->manifest_chunks) {
+            Manifest_Chunk *chunk  = bundle->manifest_chunks + file_index;
+            Hash128         digest = end_hash(&hash);
+            
+            if(digest.lo != chunk->digest_lo || digest.hi != chunk->digest_hi) {
+                printf("%s does not match the manifest\n", bundle->files[file_index].data);
+                result = false;
+                break;
+            }
+        }
+    }
+    
+    free_merge_stream(&stream);
+    
+    return result;
+}
+
+//~~~~~~~~~~~~~~~~
+//
+// IN-PLACE MERGE
+//
+//~ NOTE(Patrik): With --in-place a plain bundle never takes up much more
+// than its own size on the disk. The first chunk is renamed to the merged file
+// and its header is cut off the front, then every other chunk is appended to
+// it and deleted once what was appended is flushed, sync_size bytes at a time.
+// The chunks are used up as it goes, so a merge that stops half way leaves
+// the merged file up to the last whole chunk and the chunks after it.
+static bool
+does_chunk_match_manifest(Merge_Bundle *bundle, u32 file_index, Hash_State *hash) {
+    if(bundle->manifest_chunks) {
+        Manifest_Chunk *chunk  = bundle->manifest_chunks + file_index;
+        Hash128         digest = end_hash(hash);
+        
+        if(digest.lo != chunk->digest_lo || digest.hi != chunk->digest_hi) {
+            printf("%s does not match the manifest\n", bundle->files[file_index].data);
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): The first chunk is read whole before it is renamed, since
+// nothing can be undone after that.
+static bool
+check_in_place_first_chunk(Merge_Bundle *bundle, Merge_Stream *stream, File_Data *file_buffer, i64 *header_length) {
+    File_Handle handle = open_bundle_file(bundle, 0);
+    
+    if(!os_is_handle_valid(handle)) {
+        printf("Invalid file: \"%s\"\n", bundle->files[0].data);
+        return false;
+    }
+    
+    os_advise_sequential(handle);
+    
+    bool       result       = true;
+    Hash_State hash         = begin_hash(0);
+    i64        chunk_length = 0;
+    
+    for(;;) {
+        file_buffer->length = 0;
+        
+        i64 read_length = os_read_file(file_buffer, handle, file_buffer->capacity);
+        
+        if(read_length <= 0 && chunk_length > 0) {
+            break;
+        }
+        
+        update_hash(&hash, file_buffer->data, read_length);
+        
+        if(chunk_length == 0) {
+            Merge_Stream_Status status = push_merge_chunk(stream, file_buffer->data, read_length);
+            
+            if(status != Merge_Stream_Status__Ok) {
+                printf("%s %s\n", bundle->files[0].data, get_merge_stream_status_message(status));
+                result = false;
+                break;
+            }
+            
+            u8 *payload = 0;
+            
+            *header_length = read_length - pull_merge_payload(stream, &payload);
+        }
+        
+        chunk_length += read_length;
+    }
+    
+    os_close_file(handle);
+    
+    if(result && !is_bundle_chunk_length_valid(bundle, 0, chunk_length)) {
+        print_bundle_chunk_length_error(bundle, 0, chunk_length);
+        result = false;
+    }
+    
+    return result && does_chunk_match_manifest(bundle, 0, &hash);
+}
+
+//~ NOTE(Patrik): Every other chunk is checked before the first one is renamed
+// as well, its length always and its digest when there is a manifest, so a
+// chunk that is bad from the start does not leave a half merged file behind.
+static bool
+check_in_place_chunks(Merge_Bundle *bundle, File_Data *file_buffer) {
+    for_range(u32, file_index, 1, bundle->file_count) {
+        File_Handle handle = open_bundle_file(bundle, file_index);
+        
+        if(!os_is_handle_valid(handle)) {
+            printf("Invalid file: \"%s\"\n", bundle->files[file_index].data);
+            return false;
+        }
+        
+        i64  chunk_length = os_get_size_of_file(handle);
+        bool result       = is_bundle_chunk_length_valid(bundle, file_index, chunk_length);
+        
+        if(!result) {
+            print_bundle_chunk_length_error(bundle, file_index, chunk_length);
+        } else if(bundle->manifest_chunks) {
+            Hash_State hash = begin_hash(0);
+            
+            os_advise_sequential(handle);
+            
+            for(;;) {
+                file_buffer->length = 0;
+                
+                i64 read_length = os_read_file(file_buffer, handle, file_buffer->capacity);
+                
+                if(read_length <= 0) {
+                    break;
+                }
+                
+                update_hash(&hash, file_buffer->data, read_length);
+            }
+            
+            result = does_chunk_match_manifest(bundle, file_index, &hash);
+        }
+        
+        os_close_file(handle);
+        
+        if(!result) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): Cuts the header off the front of the file, by moving the
+// payload down a buffer at a time where the file system can not collapse it.
+// It is only the first chunk, so the copy is at most a chunk long.
+static bool
+strip_first_chunk_header(File_Handle handle, i64 header_length, File_Data *file_buffer) {
+    i64 size = os_get_size_of_file(handle);
+    
+    if(!os_collapse_file_range(handle, 0, header_length)) {
+        i64 offset = header_length;
+        
+        while(offset < size) {
+            file_buffer->length = 0;
+            
+            if(!os_set_file_pointer(handle, offset)) {
+                return false;
+            }
+            
+            i64 read_length = os_read_file(file_buffer, handle, file_buffer->capacity);
+            
+            if(read_length <= 0 || !os_set_file_pointer(handle, offset - header_length) ||
+               os_write_file(handle, file_buffer->data, read_length) != read_length)
+            {
+                return false;
+            }
+            
+            offset += read_length;
+        }
+        
+        if(!os_set_size_of_file(handle, size - header_length)) {
+            return false;
+        }
+    }
+    
+    return os_set_file_pointer(handle, size - header_length);
+}
+
+//~ NOTE(Patrik): A chunk that can not be appended whole is cut off again, so
+// the merged file always ends on a whole chunk.
+static bool
+append_in_place_chunk(Merge_Bundle *bundle, u32 file_index, Merge_Stream *stream, File_Handle dest_handle,
+                      File_Data *file_buffer, i64 *written_offset)
+{
+    File_Handle handle = open_bundle_file(bundle, file_index);
+    
+    if(!os_is_handle_valid(handle)) {
+        printf("Invalid file: \"%s\"\n", bundle->files[file_index].data);
+        return false;
+    }
+    
+    os_advise_sequential(handle);
+    
+    bool       result       = true;
+    Hash_State hash         = begin_hash(0);
+    i64        chunk_length = 0;
+    i64        start_offset = *written_offset;
+    
+    for(;;) {
+        file_buffer->length = 0;
+        
+        i64 read_length = os_read_file(file_buffer, handle, file_buffer->capacity);
+        
+        if(read_length <= 0 && chunk_length > 0) {
+            break;
+        }
+        
+        update_hash(&hash, file_buffer->data, read_length);
+        drop_streamed_range(handle, chunk_length, read_length);
+        
+        u8 *payload        = file_buffer->data;
+        i64 payload_length = read_length;
+        
+        if(chunk_length == 0) {
+            Merge_Stream_Status status = push_merge_chunk(stream, file_buffer->data, read_length);
+            
+            if(status != Merge_Stream_Status__Ok) {
+                printf("%s %s\n", bundle->files[file_index].data, get_merge_stream_status_message(status));
+                result = false;
+                break;
+            }
+            
+            payload_length = pull_merge_payload(stream, &payload);
+        }
+        
+        chunk_length += read_length;
+        
+        if(os_write_file(dest_handle, payload, payload_length) != payload_length) {
+            printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+            result = false;
+            break;
+        }
+        
+        *written_offset += payload_length;
+    }
+    
+    os_close_file(handle);
+    
+    if(result && !does_chunk_match_manifest(bundle, file_index, &hash)) {
+        result = false;
+    }
+    
+    if(!result) {
+        os_set_size_of_file(dest_handle, start_offset);
+        
+        *written_offset = start_offset;
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): The merged file is left open in dest_handle when it worked,
+// otherwise it is closed and kept with what could be merged.
+static bool
+merge_plain_bundle_in_place(Merge_Bundle *bundle, String dest_name, File_Data *file_buffer, File_Handle *dest_handle) {
+    Merge_Stream stream        = make_merge_stream();
+    i64          header_length = 0;
+    
+    if(!check_in_place_first_chunk(bundle, &stream, file_buffer, &header_length) ||
+       !check_in_place_chunks(bundle, file_buffer))
+    {
+        printf("Nothing was merged, the chunks are left as they were\n");
+        
+        free_merge_stream(&stream);
+        return false;
+    }
+    
+    if(!os_move_file(bundle->files[0].data, dest_name.data)) {
+        printf("Could not move \"%s\" to \"%s\", it has to be on the same volume to merge in place\n",
+               bundle->files[0].data, dest_name.data);
+        
+        free_merge_stream(&stream);
+        return false;
+    }
+    
+    *dest_handle = os_open_file_for_updating(dest_name.data);
+    
+    bool result = (os_is_handle_valid(*dest_handle) &&
+                   strip_first_chunk_header(*dest_handle, header_length, file_buffer));
+    
+    if(!result) {
+        printf("Could not write \"%s\", it is what was %s but the header may only be partly cut off\n",
+               dest_name.data, bundle->files[0].data);
+    }
+    
+    i64 written_offset = 0;
+    
+    if(result) {
+        written_offset = os_get_size_of_file(*dest_handle);
+    }
+    
+    //~ NOTE(Patrik): merged_count is the amount of chunks in the merged file.
+    // Chunks from first_unflushed on are appended but can not be deleted until
+    // the merged file is flushed.
+    i64 flushed_offset  = written_offset;
+    u32 merged_count    = (result ? 1 : 0);
+    u32 first_unflushed = 1;
+    
+    for_range(u32, file_index, 1, bundle->file_count) {
+        if(!result) {
+            break;
+        }
+        
+        SPLITMERGE_PROBE2(merge_chunk_begin, bundle->unique_id, file_index);
+        
+        result = append_in_place_chunk(bundle, file_index, &stream, *dest_handle, file_buffer, &written_offset);
+        
+        SPLITMERGE_PROBE2(merge_chunk_end, bundle->unique_id, file_index);
+        
+        if(!result) {
+            break;
+        }
+        
+        merged_count = file_index + 1;
+        
+        if(written_offset - flushed_offset >= global_durability.sync_size || merged_count == bundle->file_count) {
+            if(!os_flush_file(*dest_handle)) {
+                printf("Could not flush \"%s\"\n", dest_name.data);
+                result = false;
+                break;
+            }
+            
+            for_range(u32, delete_index, first_unflushed, merged_count) {
+                os_delete_file(bundle->files[delete_index].data);
+            }
+            
+            first_unflushed = merged_count;
+            flushed_offset  = written_offset;
+        }
+    }
+    
+    free_merge_stream(&stream);
+    
+    //~ NOTE(Patrik): The chunks that made it into the merged file are deleted
+    // once it is flushed, so what is left is the merged file with the first
+    // merged_count chunks and the chunks after them, which is what it takes
+    // to finish the merge by hand.
+    if(!result) {
+        if(os_is_handle_valid(*dest_handle)) {
+            if(first_unflushed < merged_count && os_flush_file(*dest_handle)) {
+                for_range(u32, delete_index, first_unflushed, merged_count) {
+                    os_delete_file(bundle->files[delete_index].data);
+                }
+                
+                first_unflushed = merged_count;
+            }
+            
+            os_close_file(*dest_handle);
+        }
+        
+        printf("%s has the first %u of %u chunks merged into it, the chunks after them are left as they were\n",
+               dest_name.data, merged_count, bundle->file_count);
+        
+        for_range(u32, kept_index, first_unflushed, merged_count) {
+            printf("%s is merged too but could not be deleted\n", bundle->files[kept_index].data);
+        }
+    }
+    
+    return result;
+}
+
+//~~~~~~~~~~~~~~~~
+//
+// MAIN
+//
+static bool
+is_option_with_value(String arg) {
+    if(is_equal_to_ntstring(arg, "--base")       ||
+       is_equal_to_ntstring(arg, "--only")       ||
+       is_equal_to_ntstring(arg, "--threads")    ||
+       is_equal_to_ntstring(arg, "--max-memory") ||
+       is_equal_to_ntstring(arg, "--stats")      ||
+       is_throttle_option(arg) ||
+       is_durability_option(arg))
+    {
+        return true;
+    }
+    return false;
+}
+
+int
+main(int arg_count, char **arg_data) {
+    Merge_Bundle_Array master_list = {0};
+    master_list.capacity = 4;
+    master_list.data     = SPLTMRG_ALLOC(Merge_Bundle, master_list.capacity);
+    
+    printf("SPLITMERGE <merge>\n");
+    
+    begin_stats();
+    
+    //~ NOTE(Patrik): From here on the names in @lists and --files-from are
+    // part of the command line.
+    Arg_List args = {0};
+    
+    if(!expand_args(arg_count, arg_data, &args)) {
+        return 1;
+    }
+    
+    arg_count = args.count;
+    arg_data  = args.data;
+    
+    bool    is_verify_mode  = false;
+    bool    is_in_place     = false;
+    char   *base_file_name  = 0;
+    char   *stats_file_name = 0;
+    String *only_names      = SPLTMRG_ALLOC(String, arg_count);
+    i32     only_count      = 0;
+    i32     option_count    = 0;
+    
+    Throttle_Options throttle_options = {0};
+    
+    //~ NOTE(Patrik): Reading headers mostly waits on the disk or the network,
+    // so there are more threads than processors.
+    i32 thread_count = os_get_processor_count() * 2;
+    
+    if(thread_count < 4) {
+        thread_count = 4;
+    } else if(thread_count > 32) {
+        thread_count = 32;
+    }
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(is_equal_to_ntstring(arg, "--verify")) {
+                is_verify_mode = true;
+            } else if(is_equal_to_ntstring(arg, "--in-place")) {
+                is_in_place = true;
+            } else if(is_equal_to_ntstring(arg, "--base") && arg_index + 1 < arg_count) {
+                arg_index      += 1;
+                option_count   += 1;
+                base_file_name  = arg_data[arg_index];
+            } else if(is_equal_to_ntstring(arg, "--only") && arg_index + 1 < arg_count) {
+                arg_index    += 1;
+                option_count += 1;
+                
+                only_names[only_count] = set_string_from_ntstring(arg_data[arg_index]);
+                only_count += 1;
+            } else if(is_equal_to_ntstring(arg, "--stats") && arg_index + 1 < arg_count) {
+                arg_index       += 1;
+                option_count    += 1;
+                stats_file_name  = arg_data[arg_index];
+            } else if(begins_with_ntstring(arg, "--stats=")) {
+                stats_file_name = arg.data + get_length_of_ntstring("--stats=");
+            } else if(is_equal_to_ntstring(arg, "--threads") && arg_index + 1 < arg_count) {
+                u64 value = 0;
+                
+                if(!parse_u64(set_string_from_ntstring(arg_data[arg_index + 1]), &value) ||
+                   value == 0 || value > 256)
+                {
+                    printf("Invalid value for %s: %s\n", arg.data, arg_data[arg_index + 1]);
+                    return 1;
+                }
+                
+                thread_count  = (i32)value;
+                arg_index    += 1;
+                option_count += 1;
+            } else if(is_equal_to_ntstring(arg, "--max-memory") && arg_index + 1 < arg_count) {
+                u64 value = 0;
+                
+                if(!parse_size(set_string_from_ntstring(arg_data[arg_index + 1]), &value) || value < MIN_MAX_MEMORY) {
+                    printf("Invalid value for %s: %s, it has to be at least 1M\n", arg.data, arg_data[arg_index + 1]);
+                    return 1;
+                }
+                
+                global_max_memory  = (i64)value;
+                arg_index         += 1;
+                option_count      += 1;
+            } else if(is_throttle_option(arg) && arg_index + 1 < arg_count) {
+                if(!parse_throttle_option(&throttle_options, arg, arg_data[arg_index + 1])) {
+                    return 1;
+                }
+                
+                arg_index    += 1;
+                option_count += 1;
+            } else if(is_durability_option(arg) && arg_index + 1 < arg_count) {
+                if(!parse_durability_option(arg, arg_data[arg_index + 1])) {
+                    return 1;
+                }
+                
+                arg_index    += 1;
+                option_count += 1;
+            } else if(is_equal_to_ntstring(arg, "--background")) {
+                throttle_options.is_background_mode = true;
+            } else if(is_equal_to_ntstring(arg, "--keep-cache")) {
+                global_should_drop_cache = false;
+            } else {
+                printf("Unknown option: %s\n", arg.data);
+            }
+            
+            option_count += 1;
+        }
+    }
+    
+    printf("%d potential split files.\n", arg_count - 1 - option_count);
+    
+    apply_throttle_options(&throttle_options);
+    
+    String source_path = set_string_from_ntstring(arg_data[0]);
+    String output_path = make_string(64);
+    
+    {
+        append_string(&output_path, source_path);
+        
+        i32 index = find_index_of_last(output_path, '/');
+        
+        if(index < 0) {
+            index = find_index_of_last(output_path, '\\');
+        }
+        
+        output_path.length = index + 1;
+        
+        append_cstring(&output_path, UNPACK_NTSTRING("merged_output/"));
+    }
+    
+    Dedup_Store   dedup_store = {0};
+    Durable_Batch dest_batch  = {0};
+    
+    String *split_file_names = SPLTMRG_ALLOC(String, arg_count);
+    i32     split_file_count = 0;
+    i64     open_file_budget = get_open_file_budget();
+    
+    //~ NOTE(Patrik): Manifests go first, so that chunks that are also given
+    // on their own do not have their headers read.
+    for_range(int, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(is_option_with_value(arg)) {
+                arg_index += 1;
+            }
+        } else if(ends_with_cstring(arg, SPLITMERGE_MANIFEST_EXTENSION_CSTRING)) {
+            add_bundle_manifest(&master_list, arg, source_path);
+        }
+    }
+    
+    For(i32, bundle_index, master_list.count) {
+        open_manifest_chunks(master_list.data + bundle_index, &open_file_budget);
+        find_manifest_parity_files(&master_list, bundle_index, source_path);
+    }
+    
+    for_range(int, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(is_option_with_value(arg)) {
+                arg_index += 1;
+            }
+        } else if(ends_with_cstring(arg, SPLITMERGE_FILE_EXTENSION_CSTRING)) {
+            split_file_names[split_file_count] = arg;
+            split_file_count += 1;
+        } else if(!ends_with_cstring(arg, SPLITMERGE_MANIFEST_EXTENSION_CSTRING)) {
+            printf("%s is not a split file\n", arg.data);
+        }
+	}
+    
+    discover_split_files(&master_list, split_file_names, split_file_count, source_path,
+                         thread_count, open_file_budget);
+    
+    SPLTMRG_FREE(split_file_names);
+    
+    //~ NOTE(Patrik): Nothing is written in verify mode, not even merged_output.
+    if(is_verify_mode) {
+        i32 bad_bundle_count = 0;
+        
+        For(i32, bundle_index, master_list.count) {
+            printf("---===##===---\n");
+            
+            Merge_Bundle *bundle = master_list.data + bundle_index;
+            
+            if(!verify_bundle(bundle, thread_count)) {
+                bad_bundle_count += 1;
+            }
+            
+            close_bundle_files(bundle);
+        }
+        
+        if(stats_file_name && !write_stats_file(stats_file_name, "verify")) {
+            printf("Could not write \"%s\"\n", stats_file_name);
+        }
+        
+        return (bad_bundle_count > 0) ? 1 : 0;
+    }
+    
+    i32 failed_bundle_count = 0;
+    
+    if(master_list.count > 0) {
+        File_Data file_buffer = make_file_data(get_slice_size(SPLITMERGE_NITRO_FILE_LIMIT));
+        
+        For(i32, bundle_index, master_list.count) {
+            printf("---===##===---\n");
+            
+            Merge_Bundle *bundle = master_list.data + bundle_index;
+            
+            if(bundle->parity_file_count > 0) {
+                repair_bundle(&master_list, bundle, source_path, output_path);
+            }
+            
+            //~ NOTE(Patrik): After the repair, so only chunks parity could not
+            // rebuild are left to stop the merge.
+            if(bundle->file_count == bundle->total_file_count && !check_manifest_bundle(bundle, &file_buffer)) {
+                failed_bundle_count += 1;
+            } else if(bundle->file_count == bundle->total_file_count && is_flag_set(bundle->flags, Header_Flag__Pack)) {
+                printf("Merging file %d/%d - pack of %u chunks\n",
+                       bundle_index + 1, master_list.count, bundle->file_count);
+                
+                if(!os_create_directory(bundle->out_file_name.data)) {
+                    printf("Could not create \"%s\"\n", bundle->out_file_name.data);
+                    failed_bundle_count += 1;
+                } else if(!merge_pack_bundle(bundle, &file_buffer, only_names, only_count)) {
+                    failed_bundle_count += 1;
+                }
+            } else if(bundle->file_count == bundle->total_file_count && is_in_place &&
+                      !(bundle->flags & (Header_Flag__Dedup | Header_Flag__Delta | Header_Flag__Sparse)))
+            {
+                printf("Merging file %d/%d - %u chunks in place\n",
+                       bundle_index + 1, master_list.count, bundle->file_count);
+                
+                String dest_name = make_string(bundle->out_file_name.length + 8);
+                
+                append_string(&dest_name, bundle->out_file_name);
+                null_terminate(&dest_name);
+                append_durable_suffix(&dest_name);
+                
+                begin_stats_progress("Merging", Stats_Phase__Read, get_bundle_payload_size(bundle));
+                
+                File_Handle dest_handle = 0;
+                bool        is_merged   = merge_plain_bundle_in_place(bundle, dest_name, &file_buffer, &dest_handle);
+                
+                if(!is_merged) {
+                    stop_stats_progress();
+                    failed_bundle_count += 1;
+                } else {
+                    end_stats_progress();
+                    
+                    if(!close_durable_file(&dest_batch, dest_handle, os_get_size_of_file(dest_handle), &dest_name)) {
+                        printf("Could not flush \"%s\"\n", dest_name.data);
+                        failed_bundle_count += 1;
+                    }
+                }
+                
+                SPLTMRG_FREE(dest_name.data);
+            } else if(bundle->file_count == bundle->total_file_count) {
+                String dest_name = make_string(bundle->out_file_name.length + 8);
+                
+                append_string(&dest_name, bundle->out_file_name);
+                null_terminate(&dest_name);
+                append_durable_suffix(&dest_name);
+                
+                File_Handle dest_handle = os_open_file_for_writing(dest_name.data);
+                bool        is_merged   = false;
+                
+                if(os_is_handle_valid(dest_handle) && is_flag_set(bundle->flags, Header_Flag__Dedup)) {
+                    printf("Merging file %d/%d - dedup bundle of %u chunks\n",
+                           bundle_index + 1, master_list.count, bundle->file_count);
+                    
+                    if(load_dedup_store(&dedup_store, output_path)) {
+                        if(!merge_dedup_bundle(bundle, dest_handle, &dedup_store)) {
+                            printf("Could not merge %s\n", bundle->out_file_name.data);
+                        } else {
+                            is_merged = true;
+                        }
+                    }
+                } else if(os_is_handle_valid(dest_handle) && is_flag_set(bundle->flags, Header_Flag__Delta)) {
+                    printf("Merging file %d/%d - delta bundle of %u chunks\n",
+                           bundle_index + 1, master_list.count, bundle->file_count);
+                    
+                    File_Handle base_handle = 0;
+                    
+                    if(base_file_name) {
+                        base_handle = os_open_file_for_reading(base_file_name);
+                    }
+                    
+                    if(!base_file_name) {
+                        printf("%s is a delta bundle, the base file has to be given with --base\n",
+                               bundle->out_file_name.data);
+                    } else if(!os_is_handle_valid(base_handle)) {
+                        printf("Invalid base file: \"%s\"\n", base_file_name);
+                    } else {
+                        if(!merge_delta_bundle(bundle, dest_handle, base_handle, &file_buffer)) {
+                            printf("Could not merge %s\n", bundle->out_file_name.data);
+                        } else {
+                            is_merged = true;
+                        }
+                        
+                        os_close_file(base_handle);
+                    }
+                } else if(os_is_handle_valid(dest_handle) && is_flag_set(bundle->flags, Header_Flag__Sparse)) {
+                    printf("Merging file %d/%d - sparse bundle of %u chunks\n",
+                           bundle_index + 1, master_list.count, bundle->file_count);
+                    
+                    if(!merge_sparse_bundle(bundle, dest_handle, &file_buffer)) {
+                        printf("Could not merge %s\n", bundle->out_file_name.data);
+                    } else {
+                        is_merged = true;
+                    }
+                } else if(os_is_handle_valid(dest_handle) && global_max_memory) {
+                    printf("Merging file %d/%d - %u chunks\n",
+                           bundle_index + 1, master_list.count, bundle->file_count);
+                    
+                    begin_stats_progress("Merging", Stats_Phase__Read, get_bundle_payload_size(bundle));
+                    
+                    is_merged = merge_plain_bundle_sliced(bundle, dest_handle, &file_buffer);
+                    
+                    end_stats_progress();
+                } else if(os_is_handle_valid(dest_handle)) {
+                    printf("Merging file %d/%d - %u chunks\n",
+                           bundle_index + 1, master_list.count, bundle->file_count);
+                    
+                    begin_stats_progress("Merging", Stats_Phase__Read, get_bundle_payload_size(bundle));
+                    
+                    Merge_Stream stream         = make_merge_stream();
+                    Read_Ahead   read_ahead     = begin_read_ahead(bundle, thread_count);
+                    i64          written_offset = 0;
+                    
+                    is_merged = true;
+                    
+                    For(u32, file_index, bundle->file_count) {
+                        SPLITMERGE_PROBE2(merge_chunk_begin, bundle->unique_id, file_index);
+                        
+                        File_Data *chunk_data = get_read_ahead_chunk(&read_ahead, file_index);
+                        
+                        if(!is_bundle_chunk_length_valid(bundle, file_index, chunk_data->length)) {
+                            end_stats_progress();
+                            
+                            print_bundle_chunk_length_error(bundle, file_index, chunk_data->length);
+                            is_merged = false;
+                            break;
+                        }
+                        
+                        if(bundle->manifest_chunks) {
+                            Manifest_Chunk *chunk  = bundle->manifest_chunks + file_index;
+                            Hash128         digest = hash_data(chunk_data->data, chunk_data->length);
+                            
+                            if(digest.lo != chunk->digest_lo || digest.hi != chunk->digest_hi) {
+                                end_stats_progress();
+                                
+                                printf("%s does not match the manifest\n", bundle->files[file_index].data);
+                                is_merged = false;
+                                break;
+                            }
+                        }
+                        
+                        Merge_Stream_Status status = push_merge_chunk(&stream, chunk_data->data, chunk_data->length);
+                        
+                        if(status != Merge_Stream_Status__Ok) {
+                            end_stats_progress();
+                            
+                            printf("%s %s\n", bundle->files[file_index].data,
+                                   get_merge_stream_status_message(status));
+                            is_merged = false;
+                            break;
+                        }
+                        
+                        u8 *payload        = 0;
+                        i64 payload_length = pull_merge_payload(&stream, &payload);
+                        
+                        SPLITMERGE_PROBE1(merge_flush_begin, payload_length);
+                        
+                        i64 written_length = os_write_file(dest_handle, payload, payload_length);
+                        
+                        SPLITMERGE_PROBE1(merge_flush_end, written_length);
+                        SPLITMERGE_PROBE2(merge_chunk_end, bundle->unique_id, file_index);
+                        
+                        release_read_ahead_chunk(&read_ahead, file_index);
+                        
+                        if(written_length != payload_length) {
+                            end_stats_progress();
+                            printf("Could not write \"%s\"\n", bundle->out_file_name.data);
+                            is_merged = false;
+                            break;
+                        }
+                        
+                        drop_streamed_range(dest_handle, written_offset, written_length);
+                        
+                        written_offset += written_length;
+                    }
+                    
+                    end_stats_progress();
+                    end_read_ahead(&read_ahead);
+                    
+                    free_merge_stream(&stream);
+                }
+                
+                //~ NOTE(Patrik): In strict mode a file that was not merged whole
+                // is deleted instead of left with the real name.
+                if(!os_is_handle_valid(dest_handle)) {
+                    printf("Could not write \"%s\"\n", dest_name.data);
+                    failed_bundle_count += 1;
+                } else if(!is_merged) {
+                    drop_streamed_file(dest_handle);
+                    abandon_durable_file(dest_handle, dest_name);
+                    failed_bundle_count += 1;
+                } else if(!close_durable_file(&dest_batch, dest_handle, os_get_size_of_file(dest_handle),
+                                              &dest_name))
+                {
+                    printf("Could not flush \"%s\"\n", dest_name.data);
+                    failed_bundle_count += 1;
+                }
+                
+                SPLTMRG_FREE(dest_name.data);
+            } else {
+                printf("There should be %d total files, but found %d\n",
+                       bundle->total_file_count, bundle->file_count);
+                failed_bundle_count += 1;
+            }
+            
+            close_bundle_files(bundle);
+        }
+        
+        SPLTMRG_FREE(file_buffer.data);
+    }
+    
+    if(!end_durable_batch(&dest_batch) || !flush_durable_folder(output_path)) {
+        printf("Could not flush the merged files\n");
+        failed_bundle_count += 1;
+    }
+    
+    save_dedup_store(&dedup_store);
+    
+    SPLTMRG_FREE(only_names);
+    
+    if(stats_file_name && !write_stats_file(stats_file_name, "merge")) {
+        printf("Could not write \"%s\"\n", stats_file_name);
     }
     
-	return 0;
+	return (failed_bundle_count > 0) ? 1 : 0;
 }
@@ -0,0 +1,226 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// INCLUDES
+//
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSSE3__)
+#  include <tmmintrin.h>
+#endif
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANTS
+//
+//~ NOTE(Patrik): Reed-Solomon over GF(2^8) with the polynomial 0x11D.
+// Parity chunk i of a group is the sum of every data chunk j multiplied by
+// 1 / (x_i + y_j) where x_i = group_size + i and y_j = j (a Cauchy matrix),
+// so any group_size of the data and parity chunks can rebuild the rest.
+#define PARITY_POLYNOMIAL  0x11D
+#define PARITY_MAX_CHUNKS  256
+#define PARITY_STRIPE_SIZE (1024 * 1024)
+
+#define PARITY_DEFAULT_GROUP_SIZE 16
+
+
+//~~~~~~~~~~~~~~~~
+//
+// GALOIS FIELD
+//
+static u8 gf_exp_table[512];
+static u8 gf_log_table[256];
+
+static void
+init_parity() {
+    u32 value = 1;
+    
+    For(i32, it_index, 255) {
+        gf_exp_table[it_index] = (u8)value;
+        gf_log_table[value]    = (u8)it_index;
+        
+        value <<= 1;
+        
+        if(value & 0x100) {
+            value ^= PARITY_POLYNOMIAL;
+        }
+    }
+    
+    for_range(i32, it_index, 255, 512) {
+        gf_exp_table[it_index] = gf_exp_table[it_index - 255];
+    }
+}
+
+static u8
+gf_mul(u8 a, u8 b) {
+    if(a == 0 || b == 0) {
+        return 0;
+    }
+    return gf_exp_table[gf_log_table[a] + gf_log_table[b]];
+}
+
+static u8
+gf_inv(u8 a) {
+    return gf_exp_table[255 - gf_log_table[a]];
+}
+
+static u8
+get_parity_coefficient(i32 group_size, i32 parity_index, i32 data_index) {
+    return gf_inv((u8)((group_size + parity_index) ^ data_index));
+}
+
+//~ NOTE(Patrik): dest ^= source * c. Every product is looked up as the sum of
+// the products of the low and the high nibble, which is 2 table lookups that
+// pshufb does 16 or 32 at a time.
+static void
+gf_mul_add_region(u8 *dest, u8 *source, u8 c, i64 length) {
+    if(c == 0) {
+        return;
+    }
+    
+    u8 low_table[16];
+    u8 high_table[16];
+    
+    For(i32, it_index, 16) {
+        low_table[it_index]  = gf_mul(c, (u8)it_index);
+        high_table[it_index] = gf_mul(c, (u8)(it_index << 4));
+    }
+    
+    i64 index = 0;
+    
+#if defined(__AVX2__)
+    __m256i low  = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i*)low_table));
+    __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i*)high_table));
+    __m256i mask = _mm256_set1_epi8(0x0F);
+    
+    while(index + 32 <= length) {
+        __m256i x = _mm256_loadu_si256((__m256i*)(source + index));
+        __m256i d = _mm256_loadu_si256((__m256i*)(dest   + index));
+        
+        __m256i l = _mm256_shuffle_epi8(low,  _mm256_and_si256(x, mask));
+        __m256i h = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+        
+        d = _mm256_xor_si256(d, _mm256_xor_si256(l, h));
+        _mm256_storeu_si256((__m256i*)(dest + index), d);
+        
+        index += 32;
+    }
+#elif defined(__SSSE3__)
+    __m128i low  = _mm_loadu_si128((__m128i*)low_table);
+    __m128i high = _mm_loadu_si128((__m128i*)high_table);
+    __m128i mask = _mm_set1_epi8(0x0F);
+    
+    while(index + 16 <= length) {
+        __m128i x = _mm_loadu_si128((__m128i*)(source + index));
+        __m128i d = _mm_loadu_si128((__m128i*)(dest   + index));
+        
+        __m128i l = _mm_shuffle_epi8(low,  _mm_and_si128(x, mask));
+        __m128i h = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        
+        d = _mm_xor_si128(d, _mm_xor_si128(l, h));
+        _mm_storeu_si128((__m128i*)(dest + index), d);
+        
+        index += 16;
+    }
+#endif
+    
+    while(index < length) {
+        dest[index] ^= low_table[source[index] & 0x0F] ^ high_table[source[index] >> 4];
+        index += 1;
+    }
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MATRIX
+//
+//~ NOTE(Patrik): Inverts a count x count matrix in place with Gauss-Jordan.
+// Returns false if the matrix is singular, which can not happen for rows
+// taken from the identity and the Cauchy matrix.
+static bool
+invert_gf_matrix(u8 *matrix, i32 count) {
+    u8 *inverse = SPLTMRG_ALLOC(u8, count * count);
+    bool result = true;
+    
+    For(i32, it_index, count) {
+        inverse[it_index * count + it_index] = 1;
+    }
+    
+    For(i32, column, count) {
+        i32 pivot = column;
+        
+        while(pivot < count && matrix[pivot * count + column] == 0) {
+            pivot += 1;
+        }
+        
+        if(pivot == count) {
+            result = false;
+            break;
+        }
+        
+        if(pivot != column) {
+            For(i32, it_index, count) {
+                u8 tmp = matrix[pivot * count + it_index];
+                matrix[pivot * count + it_index]  = matrix[column * count + it_index];
+                matrix[column * count + it_index] = tmp;
+                
+                tmp = inverse[pivot * count + it_index];
+                inverse[pivot * count + it_index]  = inverse[column * count + it_index];
+                inverse[column * count + it_index] = tmp;
+            }
+        }
+        
+        u8 scale = gf_inv(matrix[column * count + column]);
+        
+        For(i32, it_index, count) {
+            matrix[column * count + it_index]  = gf_mul(matrix[column * count + it_index], scale);
+            inverse[column * count + it_index] = gf_mul(inverse[column * count + it_index], scale);
+        }
+        
+        For(i32, row, count) {
+            u8 factor = matrix[row * count + column];
+            
+            if(row != column && factor != 0) {
+                For(i32, it_index, count) {
+                    matrix[row * count + it_index]  ^= gf_mul(factor, matrix[column * count + it_index]);
+                    inverse[row * count + it_index] ^= gf_mul(factor, inverse[column * count + it_index]);
+                }
+            }
+        }
+    }
+    
+    For(i32, it_index, count * count) {
+        matrix[it_index] = inverse[it_index];
+    }
+    
+    SPLTMRG_FREE(inverse);
+    
+    return result;
+}
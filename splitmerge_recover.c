@@ -0,0 +1,1045 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// INCLUDES
+//
+#include "splitmerge.c"
+#include "splitmerge_stats.c"
+#include "splitmerge_stream.c"
+#include "splitmerge_hash.c"
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANTS
+//
+#define RECOVER_BLOCK_SIZE (16 * 1024 * 1024)
+#define RECOVER_COPY_SIZE  (4 * 1024 * 1024)
+
+//~ NOTE(Patrik): The most a header can take up past where it starts, which is
+// the first header with the longest name. This much of the end of a block is
+// scanned again at the start of the next one so no header is cut in half.
+#define RECOVER_HEADER_SPAN (SPLITMERGE_MAX_FILE_NAME_AND_HEADER_SIZE + 1)
+
+//~ NOTE(Patrik): Same as PARITY_MAX_CHUNKS, a parity group is never bigger.
+#define RECOVER_MAX_GROUP_SIZE 256
+
+//~ NOTE(Patrik): A manifest is only read this far, which fits the names of
+// far more chunks than a split ever makes.
+#define RECOVER_MAX_MANIFEST_SIZE (64 * 1024 * 1024)
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef struct Recover_Chunk {
+    i32 image_index;
+    i32 bundle_index;
+    
+    //~ NOTE(Patrik): Where the header is in the image, and how far it is to
+    // the next header or the end of the image.
+    i64 offset;
+    i64 extent;
+    
+    //~ NOTE(Patrik): Only parity chunks tell how long they are, 0 otherwise.
+    i64 length;
+    
+    //~ NOTE(Patrik): In the byte order of this machine.
+    Shared_Header shared;
+} Recover_Chunk;
+
+typedef struct Recover_Bundle {
+    u32 unique_id;
+    
+    //~ NOTE(Patrik): 0 until the first chunk or a parity chunk is found.
+    u16 total_file_count;
+    
+    //~ NOTE(Patrik): Empty until the first chunk is found.
+    String file_name;
+    
+    //~ NOTE(Patrik): Every data chunk but the last is chunk_limit bytes. It is
+    // exact once a parity chunk has told the length of one of them, otherwise
+    // it is the biggest limit that one of the chunks reaches in the image.
+    i64  chunk_limit;
+    bool has_exact_chunk_limit;
+    
+    //~ NOTE(Patrik): The lengths and digests of the data chunks taken from a
+    // manifest or the parity chunks, total_file_count of them, a length of 0
+    // is unknown.
+    Parity_Chunk_Info *infos;
+    
+    //~ NOTE(Patrik): One bit per data chunk and then one per parity chunk.
+    u64 *recovered_bits;
+    
+    i32 data_count;
+    i32 parity_count;
+    i32 damaged_count;
+} Recover_Bundle;
+
+typedef struct Recover_State {
+    Recover_Chunk *chunks;
+    i32            chunk_count;
+    i32            chunk_capacity;
+    
+    Recover_Bundle *bundles;
+    i32             bundle_count;
+    i32             bundle_capacity;
+    
+    File_Handle *images;
+    i32          image_count;
+} Recover_State;
+
+typedef enum Recover_Copy_Status {
+    Recover_Copy_Status__Ok,
+    Recover_Copy_Status__Damaged,
+    Recover_Copy_Status__Failed,
+} Recover_Copy_Status;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SEARCH
+//
+static i32
+find_lowest_set_bit(u32 value) {
+#if defined(_MSC_VER)
+    unsigned long result = 0;
+    _BitScanForward(&result, value);
+    return (i32)result;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+//~ NOTE(Patrik): Returns the first index from start up to end where a shared
+// header could start, which is where the validation bytes are one byte in, or
+// -1 if there is none. data has to be readable up to end + 3.
+// The three bytes are compared 32 or 16 positions at a time and a position is
+// only looked at on its own when all three match, so random data and zeros go
+// through at the speed the memory can be read.
+static i64
+find_header_magic(u8 *data, i64 start, i64 end) {
+    u8 *magic = (u8*)SPLITMERGE_HEADER_VALIDATION;
+    i64 index = start;
+    
+#if defined(__AVX2__)
+    __m256i magic_0 = _mm256_set1_epi8((char)magic[0]);
+    __m256i magic_1 = _mm256_set1_epi8((char)magic[1]);
+    __m256i magic_2 = _mm256_set1_epi8((char)magic[2]);
+    
+    while(index + 32 <= end) {
+        u8 *at = data + index + 1;
+        
+        __m256i match = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(at + 0)), magic_0);
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(at + 1)), magic_1));
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*)(at + 2)), magic_2));
+        
+        u32 mask = (u32)_mm256_movemask_epi8(match);
+        
+        if(mask) {
+            return index + find_lowest_set_bit(mask);
+        }
+        
+        index += 32;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128i magic_0 = _mm_set1_epi8((char)magic[0]);
+    __m128i magic_1 = _mm_set1_epi8((char)magic[1]);
+    __m128i magic_2 = _mm_set1_epi8((char)magic[2]);
+    
+    while(index + 16 <= end) {
+        u8 *at = data + index + 1;
+        
+        __m128i match = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(at + 0)), magic_0);
+        match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(at + 1)), magic_1));
+        match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*)(at + 2)), magic_2));
+        
+        u32 mask = (u32)_mm_movemask_epi8(match);
+        
+        if(mask) {
+            return index + find_lowest_set_bit(mask);
+        }
+        
+        index += 16;
+    }
+#endif
+    
+    while(index < end) {
+        if(data[index + 1] == magic[0] && data[index + 2] == magic[1] && data[index + 3] == magic[2]) {
+            return index;
+        }
+        
+        index += 1;
+    }
+    
+    return -1;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// BUNDLES
+//
+static Recover_Bundle *
+get_recover_bundle(Recover_State *state, u32 unique_id, i32 *bundle_index) {
+    //~ NOTE(Patrik): The chunks of a bundle are mostly found one after the
+    // other, so the last bundle is tried first.
+    rfor(i32, it_index, state->bundle_count) {
+        if(state->bundles[it_index].unique_id == unique_id) {
+            *bundle_index = it_index;
+            return state->bundles + it_index;
+        }
+    }
+    
+    if(state->bundle_count == state->bundle_capacity) {
+        state->bundle_capacity *= 2;
+        state->bundles = SPLTMRG_REALLOC(Recover_Bundle, state->bundles, state->bundle_capacity);
+    }
+    
+    *bundle_index = state->bundle_count;
+    state->bundle_count += 1;
+    
+    Recover_Bundle *result = state->bundles + *bundle_index;
+    *result = (Recover_Bundle){0};
+    
+    result->unique_id      = unique_id;
+    result->chunk_limit    = SPLITMERGE_FILE_LIMIT;
+    result->recovered_bits = SPLTMRG_ALLOC(u64, 2 * 0x10000 / 64);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): A bundle only has one amount of chunks, a header that says
+// something else is not part of it.
+static bool
+set_recover_total_file_count(Recover_Bundle *bundle, u16 total_file_count) {
+    if(total_file_count == 0) {
+        return false;
+    }
+    
+    if(bundle->total_file_count == 0) {
+        bundle->total_file_count = total_file_count;
+        bundle->infos = SPLTMRG_ALLOC(Parity_Chunk_Info, total_file_count);
+    }
+    
+    return bundle->total_file_count == total_file_count;
+}
+
+static bool
+test_and_set_recovered(Recover_Bundle *bundle, Shared_Header shared) {
+    u32 bit = shared.file_index;
+    
+    if(is_flag_set(shared.flags, Header_Flag__Parity)) {
+        bit += 0x10000;
+    }
+    
+    u64 mask = (u64)1 << (bit % 64);
+    
+    if(bundle->recovered_bits[bit / 64] & mask) {
+        return true;
+    }
+    
+    bundle->recovered_bits[bit / 64] |= mask;
+    
+    return false;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// HEADERS
+//
+//~ NOTE(Patrik): Checks everything the header at data says about itself
+// against what a split would have written. available is how much of the image
+// there is from data on. A header that passes is added to its bundle.
+static bool
+read_recover_header(Recover_State *state, u8 *data, i64 available, Recover_Chunk *chunk) {
+    if(available < (i64)sizeof(Shared_Header)) {
+        return false;
+    }
+    
+    Shared_Header shared = *(Shared_Header*)data;
+    
+    if(!is_valid_header(shared) || (shared.flags & ~(SPLITMERGE_KNOWN_HEADER_FLAGS | Header_Flag__Manifest))) {
+        return false;
+    }
+    
+    bool should_swap = should_swap_endian(shared.flags);
+    
+    if(should_swap) {
+        shared.version    = swap_endian_u16(shared.version);
+        shared.unique_id  = swap_endian_u32(shared.unique_id);
+        shared.file_index = swap_endian_u16(shared.file_index);
+    }
+    
+    if(shared.version != SPLITMERGE_FILE_VERSION) {
+        return false;
+    }
+    
+    i32 bundle_index = 0;
+    
+    if(is_flag_set(shared.flags, Header_Flag__Manifest)) {
+        //~ NOTE(Patrik): The rest of the manifest is read once the scan is
+        // done, since it can be longer than a header.
+        if(shared.file_index != 0 || available < (i64)(sizeof(Shared_Header) + sizeof(Manifest_Header))) {
+            return false;
+        }
+        
+        Manifest_Header header = *(Manifest_Header*)(data + sizeof(Shared_Header));
+        
+        if(should_swap) {
+            header.total_file_count = swap_endian_u16(header.total_file_count);
+            header.file_name_length = swap_endian_u16(header.file_name_length);
+        }
+        
+        if(header.file_name_length == 0) {
+            return false;
+        }
+        
+        Recover_Bundle *bundle = get_recover_bundle(state, shared.unique_id, &bundle_index);
+        
+        if(!set_recover_total_file_count(bundle, header.total_file_count)) {
+            return false;
+        }
+    } else if(is_flag_set(shared.flags, Header_Flag__Parity)) {
+        i64 header_length = sizeof(Shared_Header) + sizeof(Parity_Header);
+        
+        if(available < header_length) {
+            return false;
+        }
+        
+        Parity_Header header = *(Parity_Header*)(data + sizeof(Shared_Header));
+        
+        if(should_swap) {
+            header.total_file_count = swap_endian_u16(header.total_file_count);
+            header.group_index      = swap_endian_u16(header.group_index);
+            header.group_size       = swap_endian_u16(header.group_size);
+            header.data_count       = swap_endian_u16(header.data_count);
+            header.parity_count     = swap_endian_u16(header.parity_count);
+            header.parity_index     = swap_endian_u16(header.parity_index);
+            header.stripe_length    = swap_endian_u64(header.stripe_length);
+        }
+        
+        i64 first_index = (i64)header.group_index * header.group_size;
+        
+        if(header.group_size == 0 || header.group_size > RECOVER_MAX_GROUP_SIZE ||
+           header.data_count == 0 || header.data_count > header.group_size ||
+           header.parity_count == 0 || header.parity_index >= header.parity_count ||
+           shared.file_index != header.group_index * header.parity_count + header.parity_index ||
+           first_index + header.data_count > header.total_file_count ||
+           header.stripe_length > SPLITMERGE_NITRO_FILE_LIMIT)
+        {
+            return false;
+        }
+        
+        header_length += header.data_count * sizeof(Parity_Chunk_Info);
+        
+        if(available < header_length) {
+            return false;
+        }
+        
+        Recover_Bundle *bundle = get_recover_bundle(state, shared.unique_id, &bundle_index);
+        
+        if(!set_recover_total_file_count(bundle, header.total_file_count)) {
+            return false;
+        }
+        
+        Parity_Chunk_Info *infos = (Parity_Chunk_Info*)(data + sizeof(Shared_Header) + sizeof(Parity_Header));
+        
+        For(i32, it_index, header.data_count) {
+            Parity_Chunk_Info info = infos[it_index];
+            
+            if(should_swap) {
+                info.length    = swap_endian_u64(info.length);
+                info.digest_lo = swap_endian_u64(info.digest_lo);
+                info.digest_hi = swap_endian_u64(info.digest_hi);
+            }
+            
+            i64 file_index = first_index + it_index;
+            
+            bundle->infos[file_index] = info;
+            
+            if(file_index + 1 < bundle->total_file_count && !bundle->has_exact_chunk_limit) {
+                bundle->chunk_limit           = info.length;
+                bundle->has_exact_chunk_limit = true;
+            }
+        }
+        
+        chunk->length = header_length + header.stripe_length;
+    } else if(shared.file_index == 0) {
+        if(available < (i64)sizeof(First_Header)) {
+            return false;
+        }
+        
+        First_Header header = *(First_Header*)data;
+        
+        if(should_swap) {
+            header.total_file_count = swap_endian_u16(header.total_file_count);
+            header.file_name_length = swap_endian_u16(header.file_name_length);
+        }
+        
+        i64 header_length = sizeof(First_Header) + header.file_name_length + 1;
+        
+        if(header.file_name_length == 0 || available < header_length || data[header_length - 1] != 0) {
+            return false;
+        }
+        
+        char *name = (char*)data + sizeof(First_Header);
+        
+        For(u16, it_index, header.file_name_length) {
+            if(name[it_index] == 0) {
+                return false;
+            }
+        }
+        
+        Recover_Bundle *bundle = get_recover_bundle(state, shared.unique_id, &bundle_index);
+        
+        if(!set_recover_total_file_count(bundle, header.total_file_count)) {
+            return false;
+        }
+        
+        if(bundle->file_name.length == 0) {
+            bundle->file_name = make_string(header.file_name_length + 1);
+            
+            append_cstring(&bundle->file_name, name, header.file_name_length);
+            null_terminate(&bundle->file_name);
+        }
+    } else {
+        get_recover_bundle(state, shared.unique_id, &bundle_index);
+    }
+    
+    chunk->bundle_index = bundle_index;
+    chunk->shared       = shared;
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SCAN
+//
+static void
+push_recover_chunk(Recover_State *state, Recover_Chunk chunk) {
+    if(state->chunk_count == state->chunk_capacity) {
+        state->chunk_capacity *= 2;
+        state->chunks = SPLTMRG_REALLOC(Recover_Chunk, state->chunks, state->chunk_capacity);
+    }
+    
+    state->chunks[state->chunk_count] = chunk;
+    state->chunk_count += 1;
+}
+
+//~ NOTE(Patrik): Reads the image from start to end a block at a time and
+// adds every header that is found in it. A chunk goes on until the next
+// header or the end of the image.
+static bool
+scan_image(Recover_State *state, char *image_name) {
+    File_Handle handle = os_open_file_for_reading(image_name);
+    
+    if(!os_is_handle_valid(handle)) {
+        printf("Invalid file: \"%s\"\n", image_name);
+        return false;
+    }
+    
+    i32 image_index = state->image_count;
+    
+    state->images[image_index] = handle;
+    state->image_count += 1;
+    
+    os_advise_sequential(handle);
+    
+    i64 image_size  = os_get_size_of_file(handle);
+    i32 first_chunk = state->chunk_count;
+    
+    File_Data block = make_file_data(RECOVER_BLOCK_SIZE + RECOVER_HEADER_SPAN);
+    
+    //~ NOTE(Patrik): Where the start of the block is in the image.
+    i64 block_offset = 0;
+    i64 read_offset  = 0;
+    bool result      = true;
+    
+    begin_stats_progress("Scanning", Stats_Phase__Read, image_size);
+    
+    while(true) {
+        i64 read_amount = block.capacity - block.length;
+        
+        if(read_amount > image_size - read_offset) {
+            read_amount = image_size - read_offset;
+        }
+        
+        while(read_amount > 0) {
+            i64 read_length = os_read_file(&block, handle, read_amount);
+            
+            if(read_length <= 0) {
+                printf("Could not read \"%s\" at %lld\n", image_name, (long long)read_offset);
+                result = false;
+                break;
+            }
+            
+            drop_streamed_range(handle, read_offset, read_length);
+            
+            read_offset += read_length;
+            read_amount -= read_length;
+        }
+        
+        if(!result) {
+            break;
+        }
+        
+        bool is_last_block = (read_offset == image_size);
+        
+        i64 scan_end = block.length - RECOVER_HEADER_SPAN;
+        
+        if(is_last_block) {
+            scan_end = block.length - 3;
+        }
+        
+        i64 index = 0;
+        
+        while(scan_end > 0 && (index = find_header_magic(block.data, index, scan_end)) >= 0) {
+            Recover_Chunk chunk = {0};
+            
+            chunk.image_index = image_index;
+            chunk.offset      = block_offset + index;
+            
+            if(read_recover_header(state, block.data + index, block.length - index, &chunk)) {
+                push_recover_chunk(state, chunk);
+            }
+            
+            index += 1;
+        }
+        
+        if(is_last_block) {
+            break;
+        }
+        
+        //~ NOTE(Patrik): The end of the block that could still hold the start
+        // of a header is scanned again with the next block.
+        copy_memory(block.data, block.data + scan_end, block.length - scan_end);
+        
+        block.length -= scan_end;
+        block_offset += scan_end;
+    }
+    
+    end_stats_progress();
+    
+    SPLTMRG_FREE(block.data);
+    
+    for_range(i32, it_index, first_chunk, state->chunk_count) {
+        Recover_Chunk *chunk = state->chunks + it_index;
+        
+        i64 next_offset = image_size;
+        
+        if(it_index + 1 < state->chunk_count) {
+            next_offset = chunk[1].offset;
+        }
+        
+        chunk->extent = next_offset - chunk->offset;
+    }
+    
+    printf("%s: %d headers in %lld bytes\n", image_name, state->chunk_count - first_chunk,
+           (long long)image_size);
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// EXTRACT
+//
+//~ NOTE(Patrik): A manifest has the length and the digest of every chunk in
+// the bundle, which is the only way to tell exactly where the last chunk ends
+// when there is no parity. A manifest that was cut off or written over is
+// left out as a whole.
+static void
+read_recover_manifest(Recover_State *state, Recover_Chunk *chunk) {
+    Recover_Bundle *bundle = state->bundles + chunk->bundle_index;
+    File_Handle     image  = state->images[chunk->image_index];
+    
+    i64 length = chunk->extent;
+    
+    if(length > RECOVER_MAX_MANIFEST_SIZE) {
+        length = RECOVER_MAX_MANIFEST_SIZE;
+    }
+    
+    File_Data data = make_file_data(length);
+    
+    if(os_set_file_pointer(image, chunk->offset)) {
+        while(data.length < length) {
+            if(os_read_file(&data, image, length - data.length) <= 0) {
+                break;
+            }
+        }
+    }
+    
+    bool should_swap = should_swap_endian(chunk->shared.flags);
+    i64  offset      = sizeof(Shared_Header) + sizeof(Manifest_Header);
+    
+    Manifest_Header header = {0};
+    
+    if(data.length >= offset) {
+        header = *(Manifest_Header*)(data.data + sizeof(Shared_Header));
+        
+        if(should_swap) {
+            header.total_file_count = swap_endian_u16(header.total_file_count);
+            header.file_name_length = swap_endian_u16(header.file_name_length);
+        }
+    }
+    
+    char *name = (char*)data.data + offset;
+    
+    offset += header.file_name_length;
+    
+    Parity_Chunk_Info *infos    = SPLTMRG_ALLOC(Parity_Chunk_Info, bundle->total_file_count);
+    bool               is_whole = (header.total_file_count > 0 && offset <= data.length);
+    
+    For(u16, it_index, header.total_file_count) {
+        Manifest_Chunk manifest_chunk = {0};
+        
+        if(!is_whole || offset + (i64)sizeof(Manifest_Chunk) > data.length) {
+            is_whole = false;
+            break;
+        }
+        
+        copy_memory((u8*)&manifest_chunk, data.data + offset, sizeof(Manifest_Chunk));
+        
+        if(should_swap) {
+            manifest_chunk.length      = swap_endian_u64(manifest_chunk.length);
+            manifest_chunk.digest_lo   = swap_endian_u64(manifest_chunk.digest_lo);
+            manifest_chunk.digest_hi   = swap_endian_u64(manifest_chunk.digest_hi);
+            manifest_chunk.name_length = swap_endian_u16(manifest_chunk.name_length);
+        }
+        
+        offset += sizeof(Manifest_Chunk) + manifest_chunk.name_length;
+        
+        if(offset > data.length) {
+            is_whole = false;
+            break;
+        }
+        
+        infos[it_index].length    = manifest_chunk.length;
+        infos[it_index].digest_lo = manifest_chunk.digest_lo;
+        infos[it_index].digest_hi = manifest_chunk.digest_hi;
+    }
+    
+    if(is_whole) {
+        For(u16, it_index, bundle->total_file_count) {
+            if(bundle->infos[it_index].length == 0) {
+                bundle->infos[it_index] = infos[it_index];
+            }
+        }
+        
+        if(bundle->total_file_count > 1 && !bundle->has_exact_chunk_limit) {
+            bundle->chunk_limit           = infos[0].length;
+            bundle->has_exact_chunk_limit = true;
+        }
+        
+        if(bundle->file_name.length == 0) {
+            bundle->file_name = make_string(header.file_name_length + 1);
+            
+            append_cstring(&bundle->file_name, name, header.file_name_length);
+            null_terminate(&bundle->file_name);
+        }
+    }
+    
+    SPLTMRG_FREE(infos);
+    SPLTMRG_FREE(data.data);
+}
+
+//~ NOTE(Patrik): How long the chunk should be, or 0 if it can not be
+// recovered. Data chunks that are not the last one are always chunk_limit
+// bytes, the last one can only be told apart from what comes after it by the
+// length a parity chunk has for it, otherwise it goes on for as long as it
+// can.
+static i64
+get_recover_length(Recover_Bundle *bundle, Recover_Chunk *chunk) {
+    u16 file_index = chunk->shared.file_index;
+    
+    if(is_flag_set(chunk->shared.flags, Header_Flag__Manifest)) {
+        return 0;
+    }
+    
+    if(is_flag_set(chunk->shared.flags, Header_Flag__Parity)) {
+        return chunk->length;
+    }
+    
+    if(bundle->total_file_count > 0) {
+        if(file_index >= bundle->total_file_count) {
+            return 0;
+        }
+        
+        if(bundle->infos[file_index].length > 0) {
+            return bundle->infos[file_index].length;
+        }
+        
+        if(file_index + 1 < bundle->total_file_count) {
+            return bundle->chunk_limit;
+        }
+    }
+    
+    i64 result = chunk->extent;
+    
+    if(result > bundle->chunk_limit) {
+        result = bundle->chunk_limit;
+    }
+    
+    return result;
+}
+
+static void
+make_recover_file_name(String *out_file_name, String output_path, Shared_Header shared) {
+    out_file_name->length = 0;
+    
+    append_string(out_file_name, output_path);
+    append_cstring(out_file_name, UNPACK_NTSTRING("0x"));
+    append_u32(out_file_name, shared.unique_id, 16);
+    append_char(out_file_name, '_');
+    
+    if(is_flag_set(shared.flags, Header_Flag__Parity)) {
+        append_cstring(out_file_name, UNPACK_NTSTRING("parity_"));
+    }
+    
+    append_u32(out_file_name, shared.file_index, 10);
+    append_cstring(out_file_name, SPLITMERGE_FILE_EXTENSION_CSTRING);
+    null_terminate(out_file_name);
+}
+
+//~ NOTE(Patrik): Copies length bytes of the image from the header on. If the
+// digest of the chunk is known from a parity chunk, a chunk that was partly
+// written over is caught here and its file is deleted again.
+static Recover_Copy_Status
+copy_recover_chunk(File_Handle image, Recover_Chunk *chunk, i64 length, Parity_Chunk_Info *info,
+                   File_Data *buffer, char *out_file_name)
+{
+    if(!os_set_file_pointer(image, chunk->offset)) {
+        return Recover_Copy_Status__Failed;
+    }
+    
+    File_Handle handle = os_open_file_for_writing(out_file_name);
+    
+    if(!os_is_handle_valid(handle)) {
+        return Recover_Copy_Status__Failed;
+    }
+    
+    Recover_Copy_Status result = Recover_Copy_Status__Ok;
+    Hash_State          hash   = begin_hash(0);
+    
+    i64 remaining = length;
+    
+    while(remaining > 0) {
+        buffer->length = 0;
+        
+        i64 read_amount = buffer->capacity;
+        
+        if(read_amount > remaining) {
+            read_amount = remaining;
+        }
+        
+        i64 read_length = os_read_file(buffer, image, read_amount);
+        
+        if(read_length <= 0 || os_write_file(handle, buffer->data, read_length) != read_length) {
+            result = Recover_Copy_Status__Failed;
+            break;
+        }
+        
+        update_hash(&hash, buffer->data, read_length);
+        
+        remaining -= read_length;
+    }
+    
+    os_close_file(handle);
+    
+    if(result == Recover_Copy_Status__Ok && info && info->length > 0) {
+        Hash128 digest = end_hash(&hash);
+        
+        if(digest.lo != info->digest_lo || digest.hi != info->digest_hi) {
+            result = Recover_Copy_Status__Damaged;
+        }
+    }
+    
+    if(result != Recover_Copy_Status__Ok) {
+        os_delete_file(out_file_name);
+    }
+    
+    return result;
+}
+
+static bool
+extract_chunks(Recover_State *state, String output_path, bool is_list_mode) {
+    String    out_file_name = make_string(output_path.length + 64);
+    File_Data buffer        = make_file_data(RECOVER_COPY_SIZE);
+    bool      result        = true;
+    
+    For(i32, it_index, state->chunk_count) {
+        Recover_Chunk *chunk = state->chunks + it_index;
+        
+        if(is_flag_set(chunk->shared.flags, Header_Flag__Manifest)) {
+            read_recover_manifest(state, chunk);
+        }
+    }
+    
+    //~ NOTE(Patrik): Without a parity chunk to tell, a chunk that goes on
+    // past the normal limit is from splitmerge_split_nitro.
+    For(i32, it_index, state->chunk_count) {
+        Recover_Chunk  *chunk  = state->chunks + it_index;
+        Recover_Bundle *bundle = state->bundles + chunk->bundle_index;
+        
+        if(!bundle->has_exact_chunk_limit && !is_flag_set(chunk->shared.flags, Header_Flag__Parity) &&
+           chunk->extent >= SPLITMERGE_NITRO_FILE_LIMIT)
+        {
+            bundle->chunk_limit = SPLITMERGE_NITRO_FILE_LIMIT;
+        }
+    }
+    
+    For(i32, it_index, state->chunk_count) {
+        Recover_Chunk  *chunk  = state->chunks + it_index;
+        Recover_Bundle *bundle = state->bundles + chunk->bundle_index;
+        
+        bool is_parity = is_flag_set(chunk->shared.flags, Header_Flag__Parity);
+        i64  length    = get_recover_length(bundle, chunk);
+        
+        make_recover_file_name(&out_file_name, output_path, chunk->shared);
+        
+        char *short_name = out_file_name.data + output_path.length;
+        
+        if(length == 0) {
+            continue;
+        }
+        
+        if(chunk->extent < length) {
+            printf("%s at %lld is cut off after %lld of %lld bytes\n", short_name, (long long)chunk->offset,
+                   (long long)chunk->extent, (long long)length);
+            
+            bundle->damaged_count += 1;
+            continue;
+        }
+        
+        if(test_and_set_recovered(bundle, chunk->shared)) {
+            continue;
+        }
+        
+        if(!is_list_mode) {
+            Parity_Chunk_Info *info = 0;
+            
+            if(!is_parity && bundle->total_file_count > 0) {
+                info = bundle->infos + chunk->shared.file_index;
+            }
+            
+            Recover_Copy_Status status = copy_recover_chunk(state->images[chunk->image_index], chunk, length,
+                                                            info, &buffer, out_file_name.data);
+            
+            if(status == Recover_Copy_Status__Damaged) {
+                printf("%s at %lld does not match its digest\n", short_name, (long long)chunk->offset);
+                
+                //~ NOTE(Patrik): A copy of it later on in the image may still be whole.
+                u32 bit = chunk->shared.file_index;
+                bundle->recovered_bits[bit / 64] &= ~((u64)1 << (bit % 64));
+                
+                bundle->damaged_count += 1;
+                continue;
+            }
+            
+            if(status == Recover_Copy_Status__Failed) {
+                printf("Could not write \"%s\"\n", out_file_name.data);
+                result = false;
+                break;
+            }
+        }
+        
+        if(is_parity) {
+            bundle->parity_count += 1;
+        } else {
+            bundle->data_count += 1;
+        }
+    }
+    
+    SPLTMRG_FREE(buffer.data);
+    SPLTMRG_FREE(out_file_name.data);
+    
+    return result;
+}
+
+static void
+print_recover_report(Recover_State *state) {
+    i32 complete_count = 0;
+    
+    For(i32, bundle_index, state->bundle_count) {
+        Recover_Bundle *bundle = state->bundles + bundle_index;
+        
+        printf("---===##===---\n");
+        
+        if(bundle->file_name.length > 0) {
+            printf("0x%X \"%s\"\n", bundle->unique_id, bundle->file_name.data);
+        } else {
+            printf("0x%X, the name of the file was not found\n", bundle->unique_id);
+        }
+        
+        if(bundle->total_file_count > 0) {
+            printf("%d of %d chunks", bundle->data_count, bundle->total_file_count);
+        } else {
+            printf("%d chunks", bundle->data_count);
+        }
+        
+        printf(", %d parity chunks, %d damaged\n", bundle->parity_count, bundle->damaged_count);
+        
+        if(bundle->total_file_count > 0 && bundle->data_count == bundle->total_file_count) {
+            complete_count += 1;
+        } else if(bundle->parity_count > 0) {
+            printf("Some chunks are missing, the parity chunks may be able to rebuild them when merging\n");
+        }
+    }
+    
+    printf("---===##===---\n");
+    printf("%d of %d bundles are complete\n", complete_count, state->bundle_count);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MAIN
+//
+int
+main(int arg_count, char **arg_data) {
+    printf("%s <recover>\n", SPLITMERGE_WELCOME_MSG);
+    
+    begin_stats();
+    
+    //~ NOTE(Patrik): From here on the names in @lists and --files-from are
+    // part of the command line.
+    Arg_List args = {0};
+    
+    if(!expand_args(arg_count, arg_data, &args)) {
+        return 1;
+    }
+    
+    arg_count = args.count;
+    arg_data  = args.data;
+    
+    char *output_name     = 0;
+    char *stats_file_name = 0;
+    bool  is_list_mode    = false;
+    
+    Recover_State state = {0};
+    
+    state.chunk_capacity  = 64;
+    state.chunks          = SPLTMRG_ALLOC(Recover_Chunk, state.chunk_capacity);
+    state.bundle_capacity = 4;
+    state.bundles         = SPLTMRG_ALLOC(Recover_Bundle, state.bundle_capacity);
+    state.images          = SPLTMRG_ALLOC(File_Handle, arg_count);
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(is_equal_to_ntstring(arg, "--output") && arg_index + 1 < arg_count) {
+            arg_index   += 1;
+            output_name  = arg_data[arg_index];
+        } else if(is_equal_to_ntstring(arg, "--list")) {
+            is_list_mode = true;
+        } else if(is_equal_to_ntstring(arg, "--stats") && arg_index + 1 < arg_count) {
+            arg_index       += 1;
+            stats_file_name  = arg_data[arg_index];
+        } else if(begins_with_ntstring(arg, "--stats=")) {
+            stats_file_name = arg.data + get_length_of_ntstring("--stats=");
+        } else if(is_equal_to_ntstring(arg, "--keep-cache")) {
+            global_should_drop_cache = false;
+        } else if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            printf("Unknown option: %s\n", arg.data);
+        }
+    }
+    
+    bool result = true;
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(is_equal_to_ntstring(arg, "--output") || is_equal_to_ntstring(arg, "--stats")) {
+            arg_index += 1;
+        } else if(!begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(!scan_image(&state, arg.data)) {
+                result = false;
+            }
+        }
+    }
+    
+    String output_path = make_string(64);
+    
+    if(output_name) {
+        append_ntstring(&output_path, output_name);
+        
+        if(!ends_with_char(output_path, '/') && !ends_with_char(output_path, '\\')) {
+            append_char(&output_path, '/');
+        }
+    } else {
+        append_ntstring(&output_path, arg_data[0]);
+        
+        i32 index = find_index_of_last(output_path, '/');
+        
+        if(index < 0) {
+            index = find_index_of_last(output_path, '\\');
+        }
+        
+        output_path.length = index + 1;
+        
+        append_cstring(&output_path, UNPACK_NTSTRING("recovered_output/"));
+    }
+    
+    null_terminate(&output_path);
+    
+    if(!is_list_mode && state.chunk_count > 0) {
+        os_create_directory(output_path.data);
+    }
+    
+    if(!extract_chunks(&state, output_path, is_list_mode)) {
+        result = false;
+    }
+    
+    print_recover_report(&state);
+    
+    if(stats_file_name && !write_stats_file(stats_file_name, "recover")) {
+        printf("Could not write \"%s\"\n", stats_file_name);
+    }
+    
+    For(i32, it_index, state.image_count) {
+        os_close_file(state.images[it_index]);
+    }
+    
+    return result ? 0 : 1;
+}
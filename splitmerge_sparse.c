@@ -0,0 +1,158 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SPARSE
+//
+//~ NOTE(Patrik): Finding the holes of a file for sparse bundles. Holes that
+// the file system knows about are skipped without being read, and blocks of
+// zeros inside of the data are found with SIMD and sent as holes too, which
+// covers images that were copied without keeping their holes.
+//
+// Include splitmerge.c before this file.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// INCLUDES
+//
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#endif
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CONSTANTS
+//
+//~ NOTE(Patrik): Zeros are only turned into holes a whole block at a time,
+// which is the page size and the block size of most file systems.
+#define SPARSE_BLOCK_SIZE 4096
+#define SPARSE_READ_SIZE  (1024 * 1024)
+
+
+//~~~~~~~~~~~~~~~~
+//
+// ZEROS
+//
+static bool
+is_zero_block(u8 *data, i64 length) {
+    i64 index = 0;
+    
+#if defined(__AVX2__)
+    while(index + 128 <= length) {
+        __m256i x = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256((__m256i*)(data + index)),
+                                                    _mm256_loadu_si256((__m256i*)(data + index + 32))),
+                                    _mm256_or_si256(_mm256_loadu_si256((__m256i*)(data + index + 64)),
+                                                    _mm256_loadu_si256((__m256i*)(data + index + 96))));
+        
+        if(!_mm256_testz_si256(x, x)) {
+            return false;
+        }
+        
+        index += 128;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128i zero = _mm_setzero_si128();
+    
+    while(index + 64 <= length) {
+        __m128i x = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((__m128i*)(data + index)),
+                                              _mm_loadu_si128((__m128i*)(data + index + 16))),
+                                 _mm_or_si128(_mm_loadu_si128((__m128i*)(data + index + 32)),
+                                              _mm_loadu_si128((__m128i*)(data + index + 48))));
+        
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xFFFF) {
+            return false;
+        }
+        
+        index += 64;
+    }
+#endif
+    
+    while(index < length) {
+        if(data[index] != 0) {
+            return false;
+        }
+        
+        index += 1;
+    }
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DATA RANGES
+//
+//~ NOTE(Patrik): Same as os_get_next_data, but when the file system can not
+// tell, the rest of the file is data.
+static void
+get_next_data_range(File_Handle handle, i64 offset, i64 file_size, i64 *data_start, i64 *data_end) {
+    if(!os_get_next_data(handle, offset, data_start, data_end)) {
+        *data_start = offset;
+        *data_end   = file_size;
+    }
+    
+    if(*data_start < offset) {
+        *data_start = offset;
+    }
+    
+    if(*data_end > file_size) {
+        *data_end = file_size;
+    }
+    
+    if(*data_start > *data_end) {
+        *data_start = *data_end;
+    }
+}
+
+//~ NOTE(Patrik): How much of the file is not a hole, which is what is read.
+static i64
+get_sparse_data_size(File_Handle handle, i64 file_size) {
+    i64 result = 0;
+    i64 offset = 0;
+    
+    while(offset < file_size) {
+        i64 data_start = 0;
+        i64 data_end   = 0;
+        
+        get_next_data_range(handle, offset, file_size, &data_start, &data_end);
+        
+        if(data_start >= data_end) {
+            break;
+        }
+        
+        result += data_end - data_start;
+        offset  = data_end;
+    }
+    
+    return result;
+}
@@ -28,6 +28,15 @@
 // INCLUDES
 //
 #include "splitmerge.c"
+#include "splitmerge_stats.c"
+#include "splitmerge_throttle.c"
+#include "splitmerge_durability.c"
+#include "splitmerge_stream.c"
+#include "splitmerge_hash.c"
+#include "splitmerge_cache.c"
+#include "splitmerge_dedup.c"
+#include "splitmerge_parity.c"
+#include "splitmerge_sparse.c"
 
 
 //~~~~~~~~~~~~~~~~
@@ -40,6 +49,19 @@
 #define FILE_LIMIT          SPLITMERGE_FILE_LIMIT
 #define MAX_FIRST_FILE_SIZE SPLITMERGE_MAX_FIRST_FILE_SIZE
 
+//~ NOTE(Patrik): For a split with other chunk sizes than the two there are,
+// like the custom profile of splitmerge_bench. Merge takes any size up to the
+// nitro one.
+#if defined(SPLITMERGE_CUSTOM_FILE_LIMIT)
+#  if SPLITMERGE_CUSTOM_FILE_LIMIT < 0x100000 || SPLITMERGE_CUSTOM_FILE_LIMIT > SPLITMERGE_NITRO_FILE_LIMIT
+#    error "SPLITMERGE_CUSTOM_FILE_LIMIT has to be from 1 MB up to SPLITMERGE_NITRO_FILE_LIMIT"
+#  endif
+#  undef  FILE_LIMIT
+#  undef  MAX_FIRST_FILE_SIZE
+#  define FILE_LIMIT          SPLITMERGE_CUSTOM_FILE_LIMIT
+#  define MAX_FIRST_FILE_SIZE (SPLITMERGE_CUSTOM_FILE_LIMIT - sizeof(First_Header))
+#endif
+
 #endif
 
 
@@ -59,33 +81,1445 @@
 //~~~~~~~~~~~~~~~~
 //
 //
-//
-static i32
-get_split_count(i64 file_size) {
-    i32 result = 0;
+//
+static i32
+get_split_count(i64 file_size) {
+    i32 result = 0;
+    
+    if(file_size >= MAX_FIRST_FILE_SIZE) {
+        while(file_size > 0) {
+            file_size -= FILE_LIMIT;
+            result    += 1;
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): folder ends with a separator, or is empty for a name that is
+// relative to the output folder like the ones in the manifest.
+static void
+make_chunk_file_name(String *out_file_name, String folder, Shared_Header shared_header, bool has_fan_out) {
+    out_file_name->length = 0;
+    
+    append_cstring(out_file_name, folder.data, folder.length);
+    
+    if(has_fan_out) {
+        append_fan_out_folder(out_file_name, shared_header.unique_id, shared_header.file_index);
+    }
+    
+    append_cstring(out_file_name, UNPACK_NTSTRING("0x"));
+    append_u32(out_file_name, shared_header.unique_id, 16);
+    append_char(out_file_name, '_');
+    
+    if(is_flag_set(shared_header.flags, Header_Flag__Parity)) {
+        append_cstring(out_file_name, UNPACK_NTSTRING("parity_"));
+    }
+    
+    append_u32(out_file_name, shared_header.file_index, 10);
+    append_cstring(out_file_name, SPLITMERGE_FILE_EXTENSION_CSTRING);
+    null_terminate(out_file_name);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CHUNK OUTPUT
+//
+//~ NOTE(Patrik): The folders the chunks are written to. Every path ends with
+// a separator. Chunk n goes to root n % count, and so does parity file n.
+// With has_fan_out it goes to a subfolder of the root, see get_fan_out_folder.
+typedef struct Output_Roots {
+    String *paths;
+    i32     count;
+    bool    has_fan_out;
+} Output_Roots;
+
+//~ NOTE(Patrik): Writes the chunks of one root on its own thread when the
+// chunks are striped, so every disk is busy while the next chunk is being made.
+// There is one chunk in flight per root, is_free and is_full hand it back and
+// forth.
+typedef struct Chunk_Writer {
+    Output_Roots    *roots;
+    Directory_Cache  directories;
+    Durable_Batch    batch;
+    String           out_file_name;
+    File_Data        chunk;
+    Shared_Header    shared_header;
+    Thread_Handle    thread;
+    Semaphore_Handle is_free;
+    Semaphore_Handle is_full;
+    bool             is_stopping;
+    bool             has_failed;
+} Chunk_Writer;
+
+//~ NOTE(Patrik): Writes the chunks of a split stream to the output roots, and
+// the manifest of the bundle to every root once every chunk has been written.
+typedef struct Chunk_Output {
+    Output_Roots *roots;
+    Chunk_Writer *writers;
+    String        out_file_name;
+    
+    //~ NOTE(Patrik): The chunks are indexed by file_index since chunk 0 can be
+    // the last one to be written.
+    Shared_Header   shared;
+    String          file_name;
+    i64             file_size;
+    Manifest_Chunk *chunks;
+    i64            *payload_lengths;
+    u32             chunk_capacity;
+    
+    //~ NOTE(Patrik): With --max-memory or --follow the chunks come in slices and are
+    // written straight from the stream one at a time, without the writers.
+    File_Handle slice_handle;
+    Hash_State  slice_hash;
+    i64         slice_header_length;
+    bool        has_first_chunk;
+} Chunk_Output;
+
+static String
+get_chunk_output_path(Output_Roots *roots, Shared_Header shared_header) {
+    return roots->paths[shared_header.file_index % roots->count];
+}
+
+//~ NOTE(Patrik): The chunk is opened relative to its folder, which is kept
+// open in directories, so a split into a huge amount of chunks does not look
+// up the whole path for every one of them. Fan-out folders are made the first
+// time a chunk is written to them.
+static File_Handle
+open_chunk_file(Directory_Cache *directories, Output_Roots *roots, Shared_Header shared_header,
+                String *out_file_name, bool is_writing)
+{
+    make_chunk_file_name(out_file_name, get_chunk_output_path(roots, shared_header), shared_header,
+                         roots->has_fan_out);
+    
+    if(is_writing) {
+        append_durable_suffix(out_file_name);
+    }
+    
+    i32    folder_length = get_folder_length(*out_file_name);
+    String folder        = *out_file_name;
+    
+    folder.length = folder_length;
+    
+    Directory_Handle directory = get_cached_directory(directories, folder, is_writing && roots->has_fan_out);
+    
+    File_Handle result;
+    
+    if(directory) {
+        if(is_writing) {
+            result = os_open_file_in_directory_for_writing(directory, out_file_name->data + folder_length);
+        } else {
+            result = os_open_file_in_directory_for_reading(directory, out_file_name->data + folder_length);
+        }
+    } else if(is_writing) {
+        result = os_open_file_for_writing(out_file_name->data);
+    } else {
+        result = os_open_file_for_reading(out_file_name->data);
+    }
+    
+    return result;
+}
+
+static bool
+write_chunk_file(Directory_Cache *directories, Durable_Batch *batch, Output_Roots *roots,
+                 Shared_Header shared_header, String *out_file_name, File_Data *file)
+{
+    bool result = false;
+    
+    File_Handle out_file_handle = open_chunk_file(directories, roots, shared_header, out_file_name, true);
+    
+    if(os_is_handle_valid(out_file_handle)) {
+        if(os_write_file(out_file_handle, file->data, file->length) == file->length) {
+            result = close_durable_file(batch, out_file_handle, file->length, out_file_name);
+        } else {
+            abandon_durable_file(out_file_handle, *out_file_name);
+        }
+    }
+    
+    if(!result) {
+        printf("Could not write \"%s\"\n", out_file_name->data);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_THREAD_PROC(chunk_writer_thread_proc) {
+    Chunk_Writer *writer = (Chunk_Writer*)data;
+    
+    for(;;) {
+        os_wait_semaphore(writer->is_full);
+        
+        if(writer->is_stopping) {
+            break;
+        }
+        
+        if(!write_chunk_file(&writer->directories, &writer->batch, writer->roots, writer->shared_header,
+                             &writer->out_file_name, &writer->chunk))
+        {
+            writer->has_failed = true;
+        }
+        
+        os_signal_semaphore(writer->is_free);
+    }
+}
+
+//~ NOTE(Patrik): With --follow every chunk is written the moment it is full,
+// chunk 0 too, so the chunks always come from the stream one at a time.
+static bool global_is_following = false;
+
+static Chunk_Output
+make_chunk_output(Output_Roots *roots, i64 file_size) {
+    Chunk_Output result = {0};
+    
+    result.roots         = roots;
+    result.writers       = SPLTMRG_ALLOC(Chunk_Writer, roots->count);
+    result.out_file_name = make_string(128);
+    result.file_name     = make_string(128);
+    result.file_size     = file_size;
+    
+    For(i32, it_index, roots->count) {
+        Chunk_Writer *writer = result.writers + it_index;
+        
+        writer->roots         = roots;
+        writer->out_file_name = make_string(128);
+        writer->is_free       = os_create_semaphore(1);
+        writer->is_full       = os_create_semaphore(0);
+        
+        //~ NOTE(Patrik): Without a thread the chunks of this root are written
+        // straight from the callback instead. A writer holds a whole chunk, so
+        // there are none with --max-memory or --follow, and with a single root
+        // there would be nothing to write at the same time.
+        if(roots->count > 1 && !global_max_memory && !global_is_following) {
+            writer->thread = os_create_thread(chunk_writer_thread_proc, writer);
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Waits for every writer to finish its last chunk and stops it,
+// and flushes what is still waiting to be flushed. Returns false if any chunk
+// could not be written.
+static bool
+stop_chunk_writers(Chunk_Output *output) {
+    bool result = true;
+    
+    For(i32, it_index, output->roots->count) {
+        Chunk_Writer *writer = output->writers + it_index;
+        
+        if(writer->thread) {
+            os_wait_semaphore(writer->is_free);
+            
+            writer->is_stopping = true;
+            
+            os_signal_semaphore(writer->is_full);
+            os_join_thread(writer->thread);
+        }
+        
+        if(!end_durable_batch(&writer->batch) || !flush_durable_directories(&writer->directories)) {
+            printf("Could not flush the chunks in \"%.*s\"\n", (int)writer->roots->paths[it_index].length,
+                   writer->roots->paths[it_index].data);
+            result = false;
+        }
+        
+        if(writer->has_failed) {
+            result = false;
+        }
+        
+        os_free_semaphore(writer->is_free);
+        os_free_semaphore(writer->is_full);
+        
+        free_directory_cache(&writer->directories);
+        SPLTMRG_FREE(writer->out_file_name.data);
+        
+        if(writer->chunk.data) {
+            SPLTMRG_FREE(writer->chunk.data);
+        }
+    }
+    
+    SPLTMRG_FREE(output->writers);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): chunk has to hold at least the whole header of the chunk.
+// Returns the length of the header.
+static i64
+add_manifest_chunk_header(Chunk_Output *output, Shared_Header shared_header, u8 *chunk) {
+    u32 file_index = shared_header.file_index;
+    
+    if(file_index >= output->chunk_capacity) {
+        u32 old_capacity = output->chunk_capacity;
+        
+        while(file_index >= output->chunk_capacity) {
+            output->chunk_capacity += 128;
+        }
+        
+        if(output->chunks) {
+            output->chunks          = SPLTMRG_REALLOC(Manifest_Chunk, output->chunks, output->chunk_capacity);
+            output->payload_lengths = SPLTMRG_REALLOC(i64, output->payload_lengths, output->chunk_capacity);
+        } else {
+            output->chunks          = SPLTMRG_ALLOC(Manifest_Chunk, output->chunk_capacity);
+            output->payload_lengths = SPLTMRG_ALLOC(i64, output->chunk_capacity);
+        }
+        
+        zero_memory((u8*)(output->chunks + old_capacity),
+                    (output->chunk_capacity - old_capacity) * sizeof(Manifest_Chunk));
+        zero_memory((u8*)(output->payload_lengths + old_capacity),
+                    (output->chunk_capacity - old_capacity) * sizeof(i64));
+    }
+    
+    i64 result = sizeof(Shared_Header);
+    
+    if(file_index == 0) {
+        First_Header *header = (First_Header*)chunk;
+        
+        result = sizeof(First_Header) + header->file_name_length + 1;
+        
+        output->shared = shared_header;
+        output->file_name.length = 0;
+        
+        append_cstring(&output->file_name, (char*)(header + 1), header->file_name_length);
+    }
+    
+    return result;
+}
+
+static void
+set_manifest_chunk_digest(Chunk_Output *output, u16 file_index, i64 header_length, i64 chunk_length,
+                          Hash128 digest)
+{
+    output->chunks[file_index].length    = chunk_length;
+    output->chunks[file_index].digest_lo = digest.lo;
+    output->chunks[file_index].digest_hi = digest.hi;
+    
+    output->payload_lengths[file_index] = chunk_length - header_length;
+}
+
+static void
+add_manifest_chunk(Chunk_Output *output, Shared_Header shared_header, u8 *chunk, i64 chunk_length) {
+    i64 header_length = add_manifest_chunk_header(output, shared_header, chunk);
+    
+    set_manifest_chunk_digest(output, shared_header.file_index, header_length, chunk_length,
+                              hash_data(chunk, chunk_length));
+}
+
+//~ NOTE(Patrik): The same manifest is written to every root, so merge can be
+// given any of them, or all of them to find the chunks in every root.
+static bool
+write_manifest(Chunk_Output *output, u16 total_file_count) {
+    bool result = true;
+    
+    File_Data data = make_file_data(sizeof(Shared_Header) + sizeof(Manifest_Header) + output->file_name.length +
+                                    total_file_count * (sizeof(Manifest_Chunk) + 32));
+    
+    Shared_Header shared_header = output->shared;
+    shared_header.flags      |= Header_Flag__Manifest;
+    shared_header.file_index  = 0;
+    
+    Manifest_Header header = {0};
+    header.total_file_count = total_file_count;
+    header.file_name_length = (u16)output->file_name.length;
+    header.file_size        = output->file_size;
+    
+    For(u16, it_index, total_file_count) {
+        header.payload_size += output->payload_lengths[it_index];
+    }
+    
+    append_file_data(&data, (u8*)&shared_header, sizeof(Shared_Header));
+    append_file_data(&data, (u8*)&header, sizeof(Manifest_Header));
+    append_file_data(&data, (u8*)output->file_name.data, output->file_name.length);
+    
+    //~ NOTE(Patrik): The chunk names are relative to the manifest, so they
+    // are made without a folder, only the fan-out subfolder.
+    String        no_folder      = {0};
+    u64           payload_offset = 0;
+    Durable_Batch batch          = {0};
+    
+    For(u16, it_index, total_file_count) {
+        Manifest_Chunk *chunk = output->chunks + it_index;
+        
+        shared_header.flags      = output->shared.flags;
+        shared_header.file_index = it_index;
+        
+        make_chunk_file_name(&output->out_file_name, no_folder, shared_header, output->roots->has_fan_out);
+        
+        chunk->payload_offset = payload_offset;
+        chunk->name_length    = (u16)output->out_file_name.length;
+        
+        payload_offset += output->payload_lengths[it_index];
+        
+        append_file_data(&data, (u8*)chunk, sizeof(Manifest_Chunk));
+        append_file_data(&data, (u8*)output->out_file_name.data, chunk->name_length);
+    }
+    
+    For(i32, root_index, output->roots->count) {
+        output->out_file_name.length = 0;
+        
+        append_string(&output->out_file_name, output->roots->paths[root_index]);
+        append_cstring(&output->out_file_name, UNPACK_NTSTRING("0x"));
+        append_u32(&output->out_file_name, output->shared.unique_id, 16);
+        append_cstring(&output->out_file_name, SPLITMERGE_MANIFEST_EXTENSION_CSTRING);
+        null_terminate(&output->out_file_name);
+        append_durable_suffix(&output->out_file_name);
+        
+        File_Handle handle = os_open_file_for_writing(output->out_file_name.data);
+        bool        is_ok  = false;
+        
+        if(os_is_handle_valid(handle)) {
+            if(os_write_file(handle, data.data, data.length) == data.length) {
+                is_ok = close_durable_file(&batch, handle, data.length, &output->out_file_name);
+            } else {
+                abandon_durable_file(handle, output->out_file_name);
+            }
+        }
+        
+        //~ NOTE(Patrik): The manifest is the last thing written to the root, so
+        // the root is flushed after it, along with the fan-out folders made in it.
+        if(is_ok && (!end_durable_batch(&batch) || !flush_durable_folder(output->roots->paths[root_index]))) {
+            is_ok = false;
+        }
+        
+        if(!is_ok) {
+            printf("Could not write \"%s\"\n", output->out_file_name.data);
+            result = false;
+        }
+    }
+    
+    SPLTMRG_FREE(data.data);
+    
+    return result;
+}
+
+static
+SPLITMERGE_CHUNK_CALLBACK(write_chunk_callback) {
+    Chunk_Output *output = (Chunk_Output*)user_data;
+    Chunk_Writer *writer = output->writers + (shared_header.file_index % output->roots->count);
+    
+    add_manifest_chunk(output, shared_header, chunk->data, chunk->length);
+    
+    if(!writer->thread) {
+        return write_chunk_file(&writer->directories, &writer->batch, output->roots, shared_header,
+                                &writer->out_file_name, chunk);
+    }
+    
+    //~ NOTE(Patrik): The writer takes the buffer of the chunk and the stream
+    // goes on with the one the writer is done with, so nothing is copied.
+    os_wait_semaphore(writer->is_free);
+    
+    if(writer->has_failed) {
+        os_signal_semaphore(writer->is_free);
+        return false;
+    }
+    
+    if(writer->chunk.capacity < chunk->capacity) {
+        if(writer->chunk.data) {
+            SPLTMRG_FREE(writer->chunk.data);
+        }
+        
+        writer->chunk = make_file_data(chunk->capacity);
+    }
+    
+    File_Data free_chunk = writer->chunk;
+    
+    writer->chunk         = *chunk;
+    writer->shared_header = shared_header;
+    
+    *chunk        = free_chunk;
+    chunk->length = 0;
+    
+    os_signal_semaphore(writer->is_full);
+    
+    return true;
+}
+
+#define REHASH_READ_SIZE (64 * 1024)
+
+//~ NOTE(Patrik): Writes the new first header of chunk 0 over the one it was
+// written with, and hashes the chunk again for the manifest.
+static bool
+rewrite_first_header(Chunk_Output *output, Chunk_Writer *writer, Shared_Header shared_header,
+                     u8 *header, i64 header_length)
+{
+    bool result = false;
+    
+    make_chunk_file_name(&writer->out_file_name, get_chunk_output_path(output->roots, shared_header),
+                         shared_header, output->roots->has_fan_out);
+    
+    File_Handle handle = os_open_file_for_updating(writer->out_file_name.data);
+    
+    if(os_is_handle_valid(handle)) {
+        if(os_write_file(handle, header, header_length) == header_length && os_set_file_pointer(handle, 0)) {
+            File_Data  buffer    = make_file_data(REHASH_READ_SIZE);
+            Hash_State hash      = begin_hash(0);
+            i64        file_size = 0;
+            i64        read_length;
+            
+            while((read_length = os_read_file(&buffer, handle, buffer.capacity)) > 0) {
+                update_hash(&hash, buffer.data, read_length);
+                
+                file_size    += read_length;
+                buffer.length = 0;
+            }
+            
+            Hash128 digest = end_hash(&hash);
+            
+            output->chunks[0].length    = file_size;
+            output->chunks[0].digest_lo = digest.lo;
+            output->chunks[0].digest_hi = digest.hi;
+            
+            result = flush_durable_file(handle);
+            
+            SPLTMRG_FREE(buffer.data);
+        }
+        
+        drop_streamed_file(handle);
+        os_close_file(handle);
+    }
+    
+    if(!result) {
+        printf("Could not write \"%s\"\n", writer->out_file_name.data);
+    }
+    
+    return result;
+}
+
+static
+SPLITMERGE_CHUNK_SLICE_CALLBACK(write_chunk_slice_callback) {
+    Chunk_Output *output = (Chunk_Output*)user_data;
+    Chunk_Writer *writer = output->writers + (shared_header.file_index % output->roots->count);
+    
+    if(shared_header.file_index == 0 && output->has_first_chunk) {
+        return rewrite_first_header(output, writer, shared_header, slice, length);
+    }
+    
+    if(offset == 0) {
+        output->slice_header_length = add_manifest_chunk_header(output, shared_header, slice);
+        output->slice_hash          = begin_hash(0);
+        output->slice_handle        = open_chunk_file(&writer->directories, output->roots, shared_header,
+                                                      &writer->out_file_name, true);
+        
+        if(!os_is_handle_valid(output->slice_handle)) {
+            printf("Could not write \"%s\"\n", writer->out_file_name.data);
+            return false;
+        }
+    }
+    
+    update_hash(&output->slice_hash, slice, length);
+    
+    if(os_write_file(output->slice_handle, slice, length) != length) {
+        printf("Could not write \"%s\"\n", writer->out_file_name.data);
+        
+        abandon_durable_file(output->slice_handle, writer->out_file_name);
+        return false;
+    }
+    
+    drop_streamed_range(output->slice_handle, offset, length);
+    
+    if(is_chunk_end) {
+        set_manifest_chunk_digest(output, shared_header.file_index, output->slice_header_length,
+                                  offset + length, end_hash(&output->slice_hash));
+        
+        if(!close_durable_file(&writer->batch, output->slice_handle, offset + length, &writer->out_file_name)) {
+            printf("Could not write \"%s\"\n", writer->out_file_name.data);
+            return false;
+        }
+        
+        if(shared_header.file_index == 0) {
+            output->has_first_chunk = true;
+        }
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): payload_size is -1 when the payload is not the file itself,
+// so the amount of chunks is not known up front. With --max-memory the stream
+// is sliced. With --follow it is too, but a slice is the whole chunk unless
+// there is a memory limit, so chunk 0 goes out first and only its header is
+// written again at the end.
+static Split_Stream
+begin_chunk_output_stream(Chunk_Output *output, Shared_Header shared_header, String file_name, i64 payload_size) {
+    if(global_max_memory || global_is_following) {
+        i64 slice_limit = (global_max_memory ? get_slice_size(FILE_LIMIT) : FILE_LIMIT);
+        
+        return begin_sliced_split_stream(shared_header, file_name, payload_size, FILE_LIMIT,
+                                         slice_limit, write_chunk_slice_callback, output);
+    }
+    
+    return begin_split_stream(shared_header, file_name, payload_size, FILE_LIMIT, write_chunk_callback, output);
+}
+
+//~ NOTE(Patrik): Returns the total amount of chunk files, or 0 on failure.
+static u16
+end_chunk_output_stream(Chunk_Output *output, Split_Stream *stream) {
+    u16 result = end_split_stream(stream);
+    
+    if(!stop_chunk_writers(output)) {
+        result = 0;
+    }
+    
+    end_stats_progress();
+    
+    if(stream->error) {
+        printf("%s\n", stream->error);
+    }
+    
+    //~ NOTE(Patrik): A bundle without its manifest can still be merged from
+    // the chunks, but it is not what was asked for, so it counts as failed.
+    if(result > 0 && !write_manifest(output, result)) {
+        result = 0;
+    }
+    
+    SPLTMRG_FREE(output->out_file_name.data);
+    SPLTMRG_FREE(output->file_name.data);
+    
+    if(output->chunks) {
+        SPLTMRG_FREE(output->chunks);
+        SPLTMRG_FREE(output->payload_lengths);
+    }
+    
+    return result;
+}
+//~~~~~~~~~~~~~~~~
+//
+// DEDUP
+//
+static u16
+split_file_dedup(Dedup_Table *table, File_Handle file_handle, Shared_Header shared_header,
+                 String file_name, Output_Roots *roots)
+{
+    shared_header.flags |= Header_Flag__Dedup;
+    
+    Chunk_Output  output  = make_chunk_output(roots, os_get_size_of_file(file_handle));
+    Split_Stream  stream  = begin_chunk_output_stream(&output, shared_header, file_name, -1);
+    Block_Scanner scanner = make_block_scanner(file_handle);
+    
+    i64 block_count     = 0;
+    i64 new_block_count = 0;
+    i64 new_byte_count  = 0;
+    
+    u8 *block        = 0;
+    i64 block_length = 0;
+    
+    while(!stream.has_failed && next_block(&scanner, &block, &block_length)) {
+        Hash128 digest = hash_content(block, block_length);
+        
+        Dedup_Record record = {0};
+        record.length    = (u32)block_length;
+        record.digest_lo = digest.lo;
+        record.digest_hi = digest.hi;
+        
+        if(find_dedup_entry(table, digest)) {
+            record.type = Dedup_Record_Type__Reference;
+            
+            push_split_stream(&stream, (u8*)&record, sizeof(Dedup_Record));
+        } else {
+            record.type = Dedup_Record_Type__Literal;
+            
+            push_split_stream(&stream, (u8*)&record, sizeof(Dedup_Record));
+            push_split_stream(&stream, block, block_length);
+            
+            Dedup_Entry entry = {0};
+            entry.digest = digest;
+            entry.length = (u32)block_length;
+            
+            insert_dedup_entry(table, entry);
+            
+            new_block_count += 1;
+            new_byte_count  += block_length;
+        }
+        
+        block_count += 1;
+    }
+    
+    u16 chunk_count = end_chunk_output_stream(&output, &stream);
+    
+    if(chunk_count > 0) {
+        printf("%lld blocks, %lld new blocks (%lld bytes) in %u files\n",
+               (long long)block_count, (long long)new_block_count,
+               (long long)new_byte_count, chunk_count);
+    }
+    
+    free_block_scanner(&scanner);
+    
+    return chunk_count;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// DELTA
+//
+//~ NOTE(Patrik): The base file is cut into the same content-defined blocks as
+// the new file, so any block that is unchanged can be found by its digest.
+static i64
+index_delta_base(Dedup_Table *table, File_Handle base_handle) {
+    Block_Scanner scanner = make_block_scanner(base_handle);
+    
+    u8 *block        = 0;
+    i64 block_length = 0;
+    
+    while(next_block(&scanner, &block, &block_length)) {
+        Dedup_Entry entry = {0};
+        entry.digest = hash_content(block, block_length);
+        entry.offset = scanner.file_offset;
+        entry.length = (u32)block_length;
+        
+        if(!find_dedup_entry(table, entry.digest)) {
+            insert_dedup_entry(table, entry);
+        }
+    }
+    
+    i64 result = scanner.file_offset;
+    
+    free_block_scanner(&scanner);
+    
+    return result;
+}
+
+static void
+write_delta_copy(Split_Stream *stream, Delta_Record *copy) {
+    if(copy->length > 0) {
+        push_split_stream(stream, (u8*)copy, sizeof(Delta_Record));
+        copy->length = 0;
+    }
+}
+
+static u16
+split_file_delta(Dedup_Table *base_table, i64 base_size, File_Handle file_handle,
+                 Shared_Header shared_header, String file_name, Output_Roots *roots)
+{
+    shared_header.flags |= Header_Flag__Delta;
+    
+    Chunk_Output  output  = make_chunk_output(roots, os_get_size_of_file(file_handle));
+    Split_Stream  stream  = begin_chunk_output_stream(&output, shared_header, file_name, -1);
+    Block_Scanner scanner = make_block_scanner(file_handle);
+    Hash_State    target  = begin_hash(0);
+    
+    Delta_Header header = {0};
+    header.base_size = base_size;
+    
+    push_split_stream(&stream, (u8*)&header, sizeof(Delta_Header));
+    
+    //~ NOTE(Patrik): Copies of blocks that follow each other in the base file
+    // are merged into one record, so an unchanged file is a single copy.
+    Delta_Record copy = {0};
+    copy.type = Delta_Record_Type__Copy;
+    
+    i64 copy_byte_count    = 0;
+    i64 literal_byte_count = 0;
+    
+    u8 *block        = 0;
+    i64 block_length = 0;
+    
+    while(!stream.has_failed && next_block(&scanner, &block, &block_length)) {
+        update_hash(&target, block, block_length);
+        
+        Dedup_Entry *entry = find_dedup_entry(base_table, hash_content(block, block_length));
+        
+        if(entry) {
+            if(copy.length > 0 && copy.offset + copy.length != entry->offset) {
+                write_delta_copy(&stream, &copy);
+            }
+            
+            if(copy.length == 0) {
+                copy.offset = entry->offset;
+            }
+            
+            copy.length     += entry->length;
+            copy_byte_count += entry->length;
+        } else {
+            write_delta_copy(&stream, &copy);
+            
+            Delta_Record literal = {0};
+            literal.type   = Delta_Record_Type__Literal;
+            literal.length = block_length;
+            
+            push_split_stream(&stream, (u8*)&literal, sizeof(Delta_Record));
+            push_split_stream(&stream, block, block_length);
+            
+            literal_byte_count += block_length;
+        }
+    }
+    
+    write_delta_copy(&stream, &copy);
+    
+    Hash128 target_digest = end_hash(&target);
+    
+    Delta_Record end = {0};
+    end.type   = Delta_Record_Type__End;
+    end.length = scanner.file_offset;
+    
+    Delta_Digest digest = {0};
+    digest.digest_lo = target_digest.lo;
+    digest.digest_hi = target_digest.hi;
+    
+    push_split_stream(&stream, (u8*)&end, sizeof(Delta_Record));
+    push_split_stream(&stream, (u8*)&digest, sizeof(Delta_Digest));
+    
+    u16 chunk_count = end_chunk_output_stream(&output, &stream);
+    
+    if(chunk_count > 0) {
+        printf("%lld bytes copied from the base, %lld new bytes in %u files\n",
+               (long long)copy_byte_count, (long long)literal_byte_count, chunk_count);
+    }
+    
+    free_block_scanner(&scanner);
+    
+    return chunk_count;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SPARSE
+//
+static void
+write_sparse_hole(Split_Stream *stream, i64 *hole_length) {
+    if(*hole_length > 0) {
+        Sparse_Record hole = {0};
+        hole.type   = Sparse_Record_Type__Hole;
+        hole.length = *hole_length;
+        
+        push_split_stream(stream, (u8*)&hole, sizeof(Sparse_Record));
+        
+        *hole_length = 0;
+    }
+}
+
+static void
+write_sparse_data(Split_Stream *stream, u8 *data, i64 length) {
+    if(length > 0) {
+        Sparse_Record record = {0};
+        record.type   = Sparse_Record_Type__Data;
+        record.length = length;
+        
+        push_split_stream(stream, (u8*)&record, sizeof(Sparse_Record));
+        push_split_stream(stream, data, length);
+    }
+}
+
+//~ NOTE(Patrik): Holes are held back until the next data, so holes from the
+// file system and blocks of zeros next to each other end up in one record.
+static u16
+split_file_sparse(File_Handle file_handle, Shared_Header shared_header, String file_name, Output_Roots *roots) {
+    shared_header.flags |= Header_Flag__Sparse;
+    
+    i64 file_size = os_get_size_of_file(file_handle);
+    
+    Chunk_Output output = make_chunk_output(roots, file_size);
+    Split_Stream stream = begin_chunk_output_stream(&output, shared_header, file_name, -1);
+    File_Data    buffer = make_file_data(get_slice_size(SPARSE_READ_SIZE));
+    
+    i64 offset          = 0;
+    i64 hole_length     = 0;
+    i64 hole_byte_count = 0;
+    
+    os_advise_sequential(file_handle);
+    
+    while(!stream.has_failed && offset < file_size) {
+        i64 data_start = 0;
+        i64 data_end   = 0;
+        
+        get_next_data_range(file_handle, offset, file_size, &data_start, &data_end);
+        
+        if(data_start >= data_end) {
+            hole_byte_count += file_size - offset;
+            break;
+        }
+        
+        hole_length     += data_start - offset;
+        hole_byte_count += data_start - offset;
+        offset           = data_start;
+        
+        os_set_file_pointer(file_handle, offset);
+        
+        while(!stream.has_failed && offset < data_end) {
+            i64 read_amount = data_end - offset;
+            
+            if(read_amount > buffer.capacity) {
+                read_amount = buffer.capacity;
+            }
+            
+            buffer.length = 0;
+            
+            if(os_read_file(&buffer, file_handle, read_amount) != read_amount) {
+                stream.has_failed = true;
+                stream.error      = "The file changed while it was being split";
+                break;
+            }
+            
+            drop_streamed_range(file_handle, offset, read_amount);
+            
+            i64 data_run_start = -1;
+            
+            for(i64 block_offset = 0; block_offset < read_amount; block_offset += SPARSE_BLOCK_SIZE) {
+                i64 block_length = read_amount - block_offset;
+                
+                if(block_length > SPARSE_BLOCK_SIZE) {
+                    block_length = SPARSE_BLOCK_SIZE;
+                }
+                
+                if(is_zero_block(buffer.data + block_offset, block_length)) {
+                    if(data_run_start >= 0) {
+                        write_sparse_data(&stream, buffer.data + data_run_start, block_offset - data_run_start);
+                        data_run_start = -1;
+                    }
+                    
+                    hole_length     += block_length;
+                    hole_byte_count += block_length;
+                } else if(data_run_start < 0) {
+                    write_sparse_hole(&stream, &hole_length);
+                    data_run_start = block_offset;
+                }
+            }
+            
+            if(data_run_start >= 0) {
+                write_sparse_data(&stream, buffer.data + data_run_start, read_amount - data_run_start);
+            }
+            
+            offset += read_amount;
+        }
+    }
+    
+    //~ NOTE(Patrik): A hole at the end is left to the end record.
+    Sparse_Record end = {0};
+    end.type   = Sparse_Record_Type__End;
+    end.length = file_size;
+    
+    push_split_stream(&stream, (u8*)&end, sizeof(Sparse_Record));
+    
+    u16 chunk_count = end_chunk_output_stream(&output, &stream);
+    
+    if(chunk_count > 0) {
+        printf("%lld bytes of holes and %lld bytes of data in %u files\n",
+               (long long)hole_byte_count, (long long)(file_size - hole_byte_count), chunk_count);
+    }
+    
+    SPLTMRG_FREE(buffer.data);
+    
+    return chunk_count;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// FOLLOW
+//
+#define FOLLOW_DEFAULT_TIMEOUT 60
+#define FOLLOW_POLL_INTERVAL   (250 * 1000000LL)
+
+//~ NOTE(Patrik): Splits a file that is still being written, like a log or a
+// recording. Every chunk is written as soon as there are enough new bytes to
+// fill it, and the bundle is done once the file has not grown for timeout
+// nanoseconds. The amount of chunks is only known then, so chunk 0 is written
+// with a total of 0 and gets its real first header at the end.
+static u16
+split_file_follow(File_Handle file_handle, Shared_Header shared_header, String file_name,
+                  Output_Roots *roots, i64 timeout)
+{
+    Chunk_Output output = make_chunk_output(roots, 0);
+    Split_Stream stream = begin_chunk_output_stream(&output, shared_header, file_name, -1);
+    
+    os_advise_sequential(file_handle);
+    
+    i64 read_offset = 0;
+    i64 idle_time   = 0;
+    
+    while(!stream.has_failed) {
+        File_Data space = get_split_stream_space(&stream);
+        
+        if(os_read_file(&space, file_handle, space.capacity) > 0) {
+            drop_streamed_range(file_handle, read_offset, space.length);
+            
+            read_offset += space.length;
+            idle_time    = 0;
+            
+            commit_split_stream(&stream, space.length);
+            set_stats_progress_total(read_offset);
+            continue;
+        }
+        
+        //~ NOTE(Patrik): A file that got smaller was truncated or replaced, as
+        // when a log is rotated, so what was read so far is the bundle.
+        i64 file_size = os_get_size_of_file(file_handle);
+        
+        if(file_size < read_offset) {
+            printf("\n%.*s got smaller while following it, the bundle ends at %lld bytes\n",
+                   (int)file_name.length, file_name.data, (long long)read_offset);
+            break;
+        }
+        
+        if(file_size == read_offset && idle_time >= timeout) {
+            break;
+        }
+        
+        os_sleep(FOLLOW_POLL_INTERVAL);
+        
+        idle_time += FOLLOW_POLL_INTERVAL;
+    }
+    
+    output.file_size = read_offset;
+    
+    u16 chunk_count = end_chunk_output_stream(&output, &stream);
+    
+    if(chunk_count > 0) {
+        printf("Followed %lld bytes into %u files\n", (long long)read_offset, chunk_count);
+    }
+    
+    return chunk_count;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PACK
+//
+#define PACK_READ_SIZE (1024 * 1024)
+
+static bool
+is_option_with_value(String arg) {
+    if(is_equal_to_ntstring(arg, "--base")   ||
+       is_equal_to_ntstring(arg, "--parity") ||
+       is_equal_to_ntstring(arg, "--parity-group") ||
+       is_equal_to_ntstring(arg, "--pack")   ||
+       is_equal_to_ntstring(arg, "--output") ||
+       is_equal_to_ntstring(arg, "--max-memory") ||
+       is_equal_to_ntstring(arg, "--follow-timeout") ||
+       is_equal_to_ntstring(arg, "--stats") ||
+       is_equal_to_ntstring(arg, "--id") ||
+       is_throttle_option(arg) ||
+       is_durability_option(arg))
+    {
+        return true;
+    }
+    return false;
+}
+
+//~ NOTE(Patrik): Turns a path from the command line into a relative path that
+// uses '/', drops drive letters, "." and "..", so the names never point
+// outside of the folder of the pack. Merge rejects any name that does, see
+// is_pack_entry_name_safe, since a pack can come from anywhere.
+static void
+make_pack_entry_name(String *dest, String path) {
+    dest->length = 0;
+    
+    while(path.length > 0) {
+        String part = path;
+        
+        For(i32, it_index, path.length) {
+            if(path.data[it_index] == '/' || path.data[it_index] == '\\') {
+                part.length = it_index;
+                break;
+            }
+        }
+        
+        bool is_drive = (dest->length == 0 && part.length > 0 && part.data[part.length - 1] == ':');
+        
+        if(part.length > 0 && !is_drive &&
+           !is_equal_to_ntstring(part, ".") && !is_equal_to_ntstring(part, ".."))
+        {
+            if(dest->length > 0) {
+                append_char(dest, '/');
+            }
+            
+            append_string(dest, part);
+        }
+        
+        advance_string(&path, part.length);
+        
+        if(path.length > 0) {
+            advance_string(&path, 1);
+        }
+    }
+    
+    null_terminate(dest);
+}
+
+static u16
+split_files_pack(i32 arg_count, char **arg_data, Shared_Header shared_header,
+                 String pack_name, Output_Roots *roots)
+{
+    shared_header.flags |= Header_Flag__Pack;
+    
+    Chunk_Output output     = make_chunk_output(roots, 0);
+    Split_Stream stream     = begin_chunk_output_stream(&output, shared_header, pack_name, -1);
+    File_Data    buffer     = make_file_data(get_slice_size(PACK_READ_SIZE));
+    File_Data    index      = make_file_data(64 * 1024);
+    String       entry_name = make_string(128);
+    
+    Pack_Trailer trailer = {0};
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(is_option_with_value(arg)) {
+                arg_index += 1;
+            }
+            
+            continue;
+        }
+        
+        if(stream.has_failed) {
+            break;
+        }
+        
+        make_pack_entry_name(&entry_name, arg);
+        
+        if(entry_name.length == 0 || entry_name.length > SPLITMERGE_MAX_FILE_NAME_LENGTH) {
+            printf("Invalid file name: \"%s\"\n", arg.data);
+            continue;
+        }
+        
+        File_Handle file_handle = os_open_file_for_reading(arg.data);
+        
+        if(os_is_handle_valid(file_handle)) {
+            Pack_Entry entry = {0};
+            entry.offset      = trailer.index_offset;
+            entry.name_length = (u16)entry_name.length;
+            
+            buffer.length = 0;
+            
+            os_advise_sequential(file_handle);
+            
+            while(!stream.has_failed && os_read_file(&buffer, file_handle, buffer.capacity) > 0) {
+                push_split_stream(&stream, buffer.data, buffer.length);
+                drop_streamed_range(file_handle, entry.length, buffer.length);
+                
+                entry.length  += buffer.length;
+                buffer.length  = 0;
+            }
+            
+            os_close_file(file_handle);
+            
+            maybe_grow_file_data(&index, index.length + sizeof(Pack_Entry) + entry_name.length);
+            
+            append_file_data(&index, (u8*)&entry, sizeof(Pack_Entry));
+            append_file_data(&index, (u8*)entry_name.data, entry_name.length);
+            
+            trailer.index_offset += entry.length;
+            trailer.entry_count  += 1;
+            
+            printf("Packing %s (%lld bytes)\n", entry_name.data, (long long)entry.length);
+        } else {
+            printf("Invalid file: \"%s\"\n", arg.data);
+        }
+    }
+    
+    push_split_stream(&stream, index.data, index.length);
+    push_split_stream(&stream, (u8*)&trailer, sizeof(Pack_Trailer));
+    
+    output.file_size = trailer.index_offset;
+    
+    u16 chunk_count = end_chunk_output_stream(&output, &stream);
+    
+    if(chunk_count > 0) {
+        printf("Packed %llu files in %u files\n", (unsigned long long)trailer.entry_count, chunk_count);
+    }
+    
+    SPLTMRG_FREE(buffer.data);
+    SPLTMRG_FREE(index.data);
+    SPLTMRG_FREE(entry_name.data);
+    
+    return chunk_count;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PARITY
+//
+//~ NOTE(Patrik): The parity files are made from the data files after the whole
+// bundle has been written, one group at a time and one stripe at a time, so
+// it works the same for every kind of bundle and only needs a few stripes of memory.
+static bool
+write_parity_chunks(Shared_Header shared_header, u16 total_file_count, i32 group_size, i32 parity_count,
+                    Output_Roots *roots)
+{
+    bool result = true;
+    
+    i32 group_count = (total_file_count + group_size - 1) / group_size;
+    
+    if(group_count * parity_count > 0xFFFF) {
+        printf("Too many parity files, use a bigger --parity-group\n");
+        return false;
+    }
+    
+    i64 max_header_length = (sizeof(Shared_Header) + sizeof(Parity_Header) +
+                             group_size * sizeof(Parity_Chunk_Info));
+    
+    Directory_Cache    directories    = {0};
+    Durable_Batch      batch          = {0};
+    String             out_file_name  = make_string(128);
+    File_Handle       *data_handles   = SPLTMRG_ALLOC(File_Handle, group_size);
+    File_Handle       *parity_handles = SPLTMRG_ALLOC(File_Handle, parity_count);
+    Hash_State        *hashes         = SPLTMRG_ALLOC(Hash_State, group_size);
+    u8                *parity_stripes = SPLTMRG_ALLOC(u8, parity_count * PARITY_STRIPE_SIZE);
+    File_Data          stripe         = make_file_data(PARITY_STRIPE_SIZE);
+    File_Data          header_data    = make_file_data(max_header_length);
+    
+    Shared_Header      *parity_shared = (Shared_Header*)header_data.data;
+    Parity_Header      *parity_header = (Parity_Header*)(parity_shared + 1);
+    Parity_Chunk_Info  *infos         = (Parity_Chunk_Info*)(parity_header + 1);
+    
+    *parity_shared = shared_header;
+    parity_shared->flags |= Header_Flag__Parity;
+    
+    For(i32, group_index, group_count) {
+        i32 first_index = group_index * group_size;
+        i32 data_count  = group_size;
+        
+        if(data_count > total_file_count - first_index) {
+            data_count = total_file_count - first_index;
+        }
+        
+        printf("Writing parity %d/%d\n", group_index + 1, group_count);
+        
+        i64 stripe_length = 0;
+        i32 open_count    = 0;
+        
+        For(i32, it_index, data_count) {
+            shared_header.file_index = (u16)(first_index + it_index);
+            data_handles[it_index] = open_chunk_file(&directories, roots, shared_header, &out_file_name, false);
+            
+            if(!os_is_handle_valid(data_handles[it_index])) {
+                printf("Invalid file: \"%s\"\n", out_file_name.data);
+                result = false;
+                break;
+            }
+            
+            open_count += 1;
+            
+            infos[it_index].length = os_get_size_of_file(data_handles[it_index]);
+            hashes[it_index]       = begin_hash(0);
+            
+            if(stripe_length < (i64)infos[it_index].length) {
+                stripe_length = infos[it_index].length;
+            }
+        }
+        
+        i64 header_length = (sizeof(Shared_Header) + sizeof(Parity_Header) +
+                             data_count * sizeof(Parity_Chunk_Info));
+        
+        parity_header->total_file_count = total_file_count;
+        parity_header->group_index      = (u16)group_index;
+        parity_header->group_size       = (u16)group_size;
+        parity_header->data_count       = (u16)data_count;
+        parity_header->parity_count     = (u16)parity_count;
+        parity_header->stripe_length    = stripe_length;
+        
+        if(result) {
+            For(i32, it_index, parity_count) {
+                parity_shared->file_index    = (u16)(group_index * parity_count + it_index);
+                parity_header->parity_index  = (u16)it_index;
+                
+                parity_handles[it_index] = open_chunk_file(&directories, roots, *parity_shared, &out_file_name, true);
+                
+                if(!os_is_handle_valid(parity_handles[it_index]) ||
+                   os_write_file(parity_handles[it_index], header_data.data, header_length) != header_length)
+                {
+                    printf("Could not write \"%s\"\n", out_file_name.data);
+                    
+                    if(os_is_handle_valid(parity_handles[it_index])) {
+                        os_close_file(parity_handles[it_index]);
+                    }
+                    
+                    rfor(i32, close_index, it_index) {
+                        os_close_file(parity_handles[close_index]);
+                    }
+                    
+                    result = false;
+                    break;
+                }
+            }
+        }
+        
+        if(result) {
+            for(i64 offset = 0; offset < stripe_length; offset += PARITY_STRIPE_SIZE) {
+                i64 length = stripe_length - offset;
+                
+                if(length > PARITY_STRIPE_SIZE) {
+                    length = PARITY_STRIPE_SIZE;
+                }
+                
+                zero_memory(parity_stripes, parity_count * PARITY_STRIPE_SIZE);
+                
+                For(i32, data_index, data_count) {
+                    stripe.length = 0;
+                    
+                    os_read_file(&stripe, data_handles[data_index], length);
+                    update_hash(&hashes[data_index], stripe.data, stripe.length);
+                    zero_memory(stripe.data + stripe.length, length - stripe.length);
+                    
+                    For(i32, parity_index, parity_count) {
+                        u8 c = get_parity_coefficient(group_size, parity_index, data_index);
+                        
+                        gf_mul_add_region(parity_stripes + parity_index * PARITY_STRIPE_SIZE,
+                                          stripe.data, c, length);
+                    }
+                }
+                
+                For(i32, parity_index, parity_count) {
+                    os_write_file(parity_handles[parity_index],
+                                  parity_stripes + parity_index * PARITY_STRIPE_SIZE, length);
+                }
+            }
+            
+            For(i32, data_index, data_count) {
+                Hash128 digest = end_hash(&hashes[data_index]);
+                
+                infos[data_index].digest_lo = digest.lo;
+                infos[data_index].digest_hi = digest.hi;
+            }
+            
+            //~ NOTE(Patrik): The digests are only known at the end, so the
+            // headers are written again now that they are filled in.
+            For(i32, parity_index, parity_count) {
+                parity_shared->file_index   = (u16)(group_index * parity_count + parity_index);
+                parity_header->parity_index = (u16)parity_index;
+                
+                os_set_file_pointer(parity_handles[parity_index], 0);
+                
+                if(os_write_file(parity_handles[parity_index], header_data.data, header_length) != header_length) {
+                    result = false;
+                }
+                
+                //~ NOTE(Patrik): The name is made again since in strict mode
+                // every parity file of the group has a temporary name to
+                // be renamed from.
+                make_chunk_file_name(&out_file_name, get_chunk_output_path(roots, *parity_shared), *parity_shared,
+                                     roots->has_fan_out);
+                append_durable_suffix(&out_file_name);
+                
+                if(!result) {
+                    abandon_durable_file(parity_handles[parity_index], out_file_name);
+                } else if(!close_durable_file(&batch, parity_handles[parity_index], header_length + stripe_length,
+                                              &out_file_name))
+                {
+                    printf("Could not write \"%s\"\n", out_file_name.data);
+                    result = false;
+                }
+            }
+        }
+        
+        For(i32, it_index, open_count) {
+            os_close_file(data_handles[it_index]);
+        }
+        
+        if(!result) {
+            break;
+        }
+    }
+    
+    if(!end_durable_batch(&batch) || !flush_durable_directories(&directories)) {
+        printf("Could not flush the parity files\n");
+        result = false;
+    }
+    
+    free_directory_cache(&directories);
+    SPLTMRG_FREE(out_file_name.data);
+    SPLTMRG_FREE(data_handles);
+    SPLTMRG_FREE(parity_handles);
+    SPLTMRG_FREE(hashes);
+    SPLTMRG_FREE(parity_stripes);
+    SPLTMRG_FREE(stripe.data);
+    SPLTMRG_FREE(header_data.data);
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// CACHE
+//
+//~ NOTE(Patrik): Everything that changes what the bundle of a file looks like,
+// so a file split with other options or to other folders is split again.
+static Hash128
+get_split_options_digest(Output_Roots *roots, String file_name, bool is_sparse_mode, i32 parity_count,
+                         i32 parity_group_size)
+{
+    Hash_State hash = begin_hash(0);
     
-    if(file_size >= MAX_FIRST_FILE_SIZE) {
-        while(file_size > 0) {
-            file_size -= FILE_LIMIT;
-            result    += 1;
-        }
+    u64 options[] = {
+        SPLITMERGE_FILE_VERSION, FILE_LIMIT, is_sparse_mode, roots->has_fan_out,
+        parity_count, (parity_count > 0) ? parity_group_size : 0, file_name.length,
+    };
+    
+    update_hash(&hash, (u8*)options, sizeof(options));
+    update_hash(&hash, (u8*)file_name.data, file_name.length);
+    
+    For(i32, it_index, roots->count) {
+        update_hash(&hash, (u8*)roots->paths[it_index].data, roots->paths[it_index].length);
     }
     
-    return result;
+    return end_hash(&hash);
 }
 
-static void
-append_file_data(File_Data *file, u8 *data, i64 length) {
-    if(file) {
-        if(length >= file->capacity - file->length) {
-            length = file->capacity - file->length;
+//~ NOTE(Patrik): A cached bundle is only used if every chunk, parity file and
+// manifest of it is still there. They are not read, only opened.
+static bool
+is_bundle_on_disk(Output_Roots *roots, u32 unique_id, u16 chunk_count, i32 parity_count, i32 parity_group_size) {
+    bool result = true;
+    
+    Directory_Cache directories   = {0};
+    String          out_file_name = make_string(128);
+    Shared_Header   shared_header = make_shared_header(unique_id);
+    i32             file_count    = chunk_count;
+    
+    if(parity_count > 0) {
+        file_count += ((chunk_count + parity_group_size - 1) / parity_group_size) * parity_count;
+    }
+    
+    For(i32, it_index, file_count) {
+        shared_header.file_index = (u16)it_index;
+        
+        if(it_index >= chunk_count) {
+            shared_header.flags      |= Header_Flag__Parity;
+            shared_header.file_index  = (u16)(it_index - chunk_count);
+        }
+        
+        File_Handle handle = open_chunk_file(&directories, roots, shared_header, &out_file_name, false);
+        
+        if(!os_is_handle_valid(handle)) {
+            result = false;
+            break;
+        }
+        
+        os_close_file(handle);
+    }
+    
+    For(i32, root_index, roots->count) {
+        if(!result) {
+            break;
         }
         
-        For(i64, it_index, length) {
-            file->data[file->length] = data[it_index];
-            file->length += 1;
+        out_file_name.length = 0;
+        
+        append_string(&out_file_name, roots->paths[root_index]);
+        append_cstring(&out_file_name, UNPACK_NTSTRING("0x"));
+        append_u32(&out_file_name, unique_id, 16);
+        append_cstring(&out_file_name, SPLITMERGE_MANIFEST_EXTENSION_CSTRING);
+        null_terminate(&out_file_name);
+        
+        File_Handle handle = os_open_file_for_reading(out_file_name.data);
+        
+        if(!os_is_handle_valid(handle)) {
+            result = false;
+            break;
         }
+        
+        os_close_file(handle);
     }
+    
+    free_directory_cache(&directories);
+    SPLTMRG_FREE(out_file_name.data);
+    
+    return result;
 }
 
 
@@ -93,10 +1527,254 @@ append_file_data(File_Data *file, u8 *data, i64 length) {
 //
 // MAIN
 //
+//~ NOTE(Patrik): The id in the chunk names, with or without 0x in front.
+static bool
+parse_unique_id(String str, u32 *value) {
+    if(begins_with_cstring(str, UNPACK_NTSTRING("0x")) || begins_with_cstring(str, UNPACK_NTSTRING("0X"))) {
+        advance_string(&str, 2);
+    }
+    
+    if(str.length <= 0 || str.length > 8) {
+        return false;
+    }
+    
+    *value = 0;
+    
+    For(i32, it_index, str.length) {
+        char c = str.data[it_index];
+        u32  digit;
+        
+        if(c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if(c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else if(c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        
+        *value = (*value << 4) | digit;
+    }
+    
+    return true;
+}
+
+//~ NOTE(Patrik): With --id the bundles are numbered up from the given id, so
+// that a script knows the chunk names before the split is done.
+static u32
+get_next_unique_id(u64 *random_seed, u32 *next_unique_id, bool has_unique_id) {
+    u32 result = (u32)os_get_random_u64(random_seed);
+    
+    if(has_unique_id) {
+        result           = *next_unique_id;
+        *next_unique_id += 1;
+    }
+    
+    return result;
+}
+
 int
 main(int arg_count, char **arg_data) {
     printf("%s <split>\n", WELCOME_MSG);
-    printf("%d potential files to split.\n", arg_count - 1);
+    
+    begin_stats();
+    
+    //~ NOTE(Patrik): From here on the names in @lists and --files-from are
+    // part of the command line.
+    Arg_List args = {0};
+    
+    if(!expand_args(arg_count, arg_data, &args)) {
+        return 1;
+    }
+    
+    arg_count = args.count;
+    arg_data  = args.data;
+    
+    bool  is_dedup_mode     = false;
+    bool  is_sparse_mode    = false;
+    bool  is_cache_mode     = false;
+    bool  should_hash_cache = false;
+    char *base_file_name    = 0;
+    char *pack_name         = 0;
+    char *stats_file_name   = 0;
+    i32   parity_count      = 0;
+    i32   parity_group_size = PARITY_DEFAULT_GROUP_SIZE;
+    i32   option_count      = 0;
+    i64   follow_timeout    = FOLLOW_DEFAULT_TIMEOUT;
+    u32   next_unique_id    = 0;
+    bool  has_unique_id     = false;
+    
+    Output_Roots roots = {0};
+    roots.paths = SPLTMRG_ALLOC(String, arg_count);
+    
+    Throttle_Options throttle_options = {0};
+    
+    for_range(i32, arg_index, 1, arg_count) {
+        String arg = set_string_from_ntstring(arg_data[arg_index]);
+        
+        if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(is_equal_to_ntstring(arg, "--dedup")) {
+                is_dedup_mode = true;
+            } else if(is_equal_to_ntstring(arg, "--sparse")) {
+                is_sparse_mode = true;
+            } else if(is_equal_to_ntstring(arg, "--fan-out")) {
+                roots.has_fan_out = true;
+            } else if(is_equal_to_ntstring(arg, "--cache")) {
+                is_cache_mode = true;
+            } else if(is_equal_to_ntstring(arg, "--cache-hash")) {
+                is_cache_mode     = true;
+                should_hash_cache = true;
+            } else if(is_equal_to_ntstring(arg, "--base") && arg_index + 1 < arg_count) {
+                arg_index      += 1;
+                option_count   += 1;
+                base_file_name  = arg_data[arg_index];
+            } else if(is_equal_to_ntstring(arg, "--pack") && arg_index + 1 < arg_count) {
+                arg_index    += 1;
+                option_count += 1;
+                pack_name     = arg_data[arg_index];
+            } else if(is_equal_to_ntstring(arg, "--output") && arg_index + 1 < arg_count) {
+                arg_index    += 1;
+                option_count += 1;
+                
+                String path = make_string(128);
+                
+                append_ntstring(&path, arg_data[arg_index]);
+                null_terminate(&path);
+                
+                if(!os_create_directory(path.data)) {
+                    printf("Invalid output folder: \"%s\"\n", path.data);
+                    return 1;
+                }
+                
+                if(path.length > 0 && path.data[path.length - 1] != '/' && path.data[path.length - 1] != '\\') {
+                    append_cstring(&path, UNPACK_NTSTRING("/"));
+                }
+                
+                roots.paths[roots.count] = path;
+                roots.count += 1;
+            } else if((is_equal_to_ntstring(arg, "--parity") ||
+                       is_equal_to_ntstring(arg, "--parity-group")) && arg_index + 1 < arg_count)
+            {
+                u64 value = 0;
+                
+                if(!parse_u64(set_string_from_ntstring(arg_data[arg_index + 1]), &value) ||
+                   value == 0 || value >= PARITY_MAX_CHUNKS)
+                {
+                    printf("Invalid value for %s: %s\n", arg.data, arg_data[arg_index + 1]);
+                    return 1;
+                }
+                
+                if(is_equal_to_ntstring(arg, "--parity")) {
+                    parity_count = (i32)value;
+                } else {
+                    parity_group_size = (i32)value;
+                }
+                
+                arg_index    += 1;
+                option_count += 1;
+            } else if(is_equal_to_ntstring(arg, "--max-memory") && arg_index + 1 < arg_count) {
+                u64 value = 0;
+                
+                if(!parse_size(set_string_from_ntstring(arg_data[arg_index + 1]), &value) || value < MIN_MAX_MEMORY) {
+                    printf("Invalid value for %s: %s, it has to be at least 1M\n", arg.data, arg_data[arg_index + 1]);
+                    return 1;
+                }
+                
+                global_max_memory  = (i64)value;
+                arg_index         += 1;
+                option_count      += 1;
+            } else if(is_equal_to_ntstring(arg, "--id") && arg_index + 1 < arg_count) {
+                if(!parse_unique_id(set_string_from_ntstring(arg_data[arg_index + 1]), &next_unique_id)) {
+                    printf("Invalid value for %s: %s, it is a hex id like 0x7AF001C3\n", arg.data, arg_data[arg_index + 1]);
+                    return 1;
+                }
+                
+                has_unique_id  = true;
+                arg_index     += 1;
+                option_count  += 1;
+            } else if(is_equal_to_ntstring(arg, "--follow")) {
+                global_is_following = true;
+            } else if(is_equal_to_ntstring(arg, "--follow-timeout") && arg_index + 1 < arg_count) {
+                u64 value = 0;
+                
+                if(!parse_u64(set_string_from_ntstring(arg_data[arg_index + 1]), &value) || value > 86400) {
+                    printf("Invalid value for %s: %s, it is in seconds\n", arg.data, arg_data[arg_index + 1]);
+                    return 1;
+                }
+                
+                global_is_following  = true;
+                follow_timeout       = (i64)value;
+                arg_index           += 1;
+                option_count        += 1;
+            } else if(is_throttle_option(arg) && arg_index + 1 < arg_count) {
+                if(!parse_throttle_option(&throttle_options, arg, arg_data[arg_index + 1])) {
+                    return 1;
+                }
+                
+                arg_index    += 1;
+                option_count += 1;
+            } else if(is_durability_option(arg) && arg_index + 1 < arg_count) {
+                if(!parse_durability_option(arg, arg_data[arg_index + 1])) {
+                    return 1;
+                }
+                
+                arg_index    += 1;
+                option_count += 1;
+            } else if(is_equal_to_ntstring(arg, "--background")) {
+                throttle_options.is_background_mode = true;
+            } else if(is_equal_to_ntstring(arg, "--keep-cache")) {
+                global_should_drop_cache = false;
+            } else if(is_equal_to_ntstring(arg, "--stats") && arg_index + 1 < arg_count) {
+                arg_index       += 1;
+                option_count    += 1;
+                stats_file_name  = arg_data[arg_index];
+            } else if(begins_with_ntstring(arg, "--stats=")) {
+                stats_file_name = arg.data + get_length_of_ntstring("--stats=");
+            } else {
+                printf("Unknown option: %s\n", arg.data);
+            }
+            
+            option_count += 1;
+        }
+    }
+    
+    if((is_dedup_mode + is_sparse_mode + (base_file_name != 0) + (pack_name != 0)) > 1) {
+        printf("Only one of --dedup, --sparse, --base and --pack can be used at a time\n");
+        return 1;
+    }
+    
+    //~ NOTE(Patrik): A dedup or delta bundle depends on more than the file, and
+    // a pack on more than one file.
+    if(is_cache_mode && (is_dedup_mode || base_file_name || pack_name)) {
+        printf("--cache can not be used with --dedup, --base or --pack\n");
+        return 1;
+    }
+    
+    //~ NOTE(Patrik): The other modes need the whole file up front.
+    if(global_is_following && (is_dedup_mode || is_sparse_mode || is_cache_mode || base_file_name || pack_name)) {
+        printf("--follow can not be used with --dedup, --sparse, --cache, --base or --pack\n");
+        return 1;
+    }
+    
+    //~ NOTE(Patrik): The cache picks the id from the file.
+    if(is_cache_mode && has_unique_id) {
+        printf("--cache can not be used with --id\n");
+        return 1;
+    }
+    
+    if(parity_count > 0 && parity_group_size + parity_count > PARITY_MAX_CHUNKS) {
+        printf("--parity-group and --parity can not add up to more than %d\n", PARITY_MAX_CHUNKS);
+        return 1;
+    }
+    
+    if(parity_count > 0) {
+        init_parity();
+    }
+    
+    printf("%d potential files to split.\n", arg_count - 1 - option_count);
+    
+    apply_throttle_options(&throttle_options);
     
     u64 random_seed = os_set_random_seed();
     
@@ -121,16 +1799,121 @@ main(int arg_count, char **arg_data) {
         
         source_path = output_path;
         
-        append_cstring(&output_path, UNPACK_NTSTRING("split_output/0x"));
+        append_cstring(&output_path, UNPACK_NTSTRING("split_output/"));
     }
     
-    for_range(i32, arg_index, 1, arg_count) {
+    //~ NOTE(Patrik): Without --output everything goes to split_output.
+    if(roots.count == 0) {
+        roots.paths[0] = output_path;
+        roots.count    = 1;
+    }
+    
+    if(roots.count > 1) {
+        printf("Striping the chunks over %d folders\n", roots.count);
+    }
+    
+    if(pack_name) {
+        String pack_file_name = set_string_from_ntstring(pack_name);
+        
+        if(pack_file_name.length == 0 || pack_file_name.length > SPLITMERGE_MAX_FILE_NAME_LENGTH ||
+           count_instance_of_char(pack_file_name, '/') || count_instance_of_char(pack_file_name, '\\'))
+        {
+            printf("Invalid pack name: \"%s\"\n", pack_name);
+            return 1;
+        }
+        
         printf("---===##===---\n");
         
-        file_name.length = 0;
+        Shared_Header shared_header = make_shared_header(get_next_unique_id(&random_seed, &next_unique_id, has_unique_id));
+        u16           chunk_count   = split_files_pack(arg_count, arg_data, shared_header,
+                                                       pack_file_name, &roots);
         
+        bool is_written = (chunk_count > 0);
+        
+        if(is_written && parity_count > 0) {
+            is_written = write_parity_chunks(shared_header, chunk_count, parity_group_size, parity_count, &roots);
+        }
+        
+        if(stats_file_name && !write_stats_file(stats_file_name, "split")) {
+            printf("Could not write \"%s\"\n", stats_file_name);
+        }
+        
+        return is_written ? 0 : 1;
+    }
+    
+    i32 failed_file_count = 0;
+    
+    Dedup_Table dedup_table         = {0};
+    String      dedup_manifest_path = {0};
+    bool        should_save_dedup   = true;
+    
+    if(is_dedup_mode) {
+        init_dedup();
+        
+        dedup_table         = make_dedup_table(4096);
+        dedup_manifest_path = make_string(128);
+        
+        append_string(&dedup_manifest_path, source_path);
+        append_cstring(&dedup_manifest_path, UNPACK_NTSTRING("split_output/" DEDUP_MANIFEST_NAME));
+        null_terminate(&dedup_manifest_path);
+        
+        load_dedup_table(&dedup_table, dedup_manifest_path.data);
+        
+        printf("%lld known blocks in %s\n", (long long)dedup_table.count, dedup_manifest_path.data);
+    }
+    
+    Split_Cache split_cache       = {0};
+    String      split_cache_path  = {0};
+    bool        should_save_cache = false;
+    
+    if(is_cache_mode) {
+        split_cache_path = make_string(128);
+        
+        append_string(&split_cache_path, source_path);
+        append_cstring(&split_cache_path, UNPACK_NTSTRING("split_output/" SPLIT_CACHE_NAME));
+        null_terminate(&split_cache_path);
+        
+        load_split_cache(&split_cache, split_cache_path.data);
+        
+        printf("%lld split files in %s\n", (long long)split_cache.count, split_cache_path.data);
+    }
+    
+    Dedup_Table base_table = {0};
+    i64         base_size  = 0;
+    
+    if(base_file_name) {
+        File_Handle base_handle = os_open_file_for_reading(base_file_name);
+        
+        if(!os_is_handle_valid(base_handle)) {
+            printf("Invalid base file: \"%s\"\n", base_file_name);
+            return 1;
+        }
+        
+        init_dedup();
+        
+        base_table = make_dedup_table(4096);
+        base_size  = index_delta_base(&base_table, base_handle);
+        
+        printf("%lld blocks in the base file %s\n", (long long)base_table.count, base_file_name);
+        
+        os_close_file(base_handle);
+    }
+    
+    for_range(i32, arg_index, 1, arg_count) {
         String arg = set_string_from_ntstring(arg_data[arg_index]);
         
+        if(begins_with_cstring(arg, UNPACK_NTSTRING("--"))) {
+            if(is_option_with_value(arg)) {
+                arg_index += 1;
+            }
+            
+            continue;
+        }
+        
+        printf("---===##===---\n");
+        
+        file_name.length = 0;
+        
         if(begins_with_cstring(arg, UNPACK_NTSTRING("..\\")) ||
            begins_with_cstring(arg, UNPACK_NTSTRING("../")))
         {
@@ -168,81 +1951,161 @@ main(int arg_count, char **arg_data) {
         
         File_Handle file_handle = os_open_file_for_reading(arg.data);
         
-        if(os_is_handle_valid(file_handle)) {
+        Shared_Header   shared_header = make_shared_header(get_next_unique_id(&random_seed, &next_unique_id, has_unique_id));
+        u16             chunk_count   = 0;
+        Split_Cache_Key cache_key     = {0};
+        bool            is_cached     = false;
+        
+        if(os_is_handle_valid(file_handle) && is_cache_mode) {
+            Hash128 options_digest = get_split_options_digest(&roots, file_name, is_sparse_mode, parity_count,
+                                                              parity_group_size);
+            
+            cache_key = make_split_cache_key(file_handle, options_digest, should_hash_cache);
+            
+            if(is_split_cache_key_valid(&cache_key)) {
+                Split_Cache_Entry *entry = find_split_cache_entry(&split_cache, &cache_key);
+                
+                if(entry && is_bundle_on_disk(&roots, entry->unique_id, entry->chunk_count, parity_count,
+                                              parity_group_size))
+                {
+                    printf("%s is already split as 0x%X, %u chunks\n", arg.data, entry->unique_id,
+                           entry->chunk_count);
+                    
+                    is_cached = true;
+                } else {
+                    shared_header = make_shared_header(get_split_cache_unique_id(&cache_key));
+                }
+            } else {
+                printf("Can not tell files apart on this platform, use --cache-hash\n");
+            }
+        }
+        
+        if(is_cached) {
+            if(cache_key.has_content_digest) {
+                drop_streamed_file(file_handle);
+            }
+        } else if(os_is_handle_valid(file_handle) && is_dedup_mode) {
+            begin_stats_progress("Splitting", Stats_Phase__Read, os_get_size_of_file(file_handle));
+            
+            chunk_count = split_file_dedup(&dedup_table, file_handle, shared_header, file_name, &roots);
+            
+            if(chunk_count == 0) {
+                should_save_dedup = false;
+            }
+        } else if(os_is_handle_valid(file_handle) && base_file_name) {
+            begin_stats_progress("Splitting", Stats_Phase__Read, os_get_size_of_file(file_handle));
+            
+            chunk_count = split_file_delta(&base_table, base_size, file_handle, shared_header,
+                                           file_name, &roots);
+        } else if(os_is_handle_valid(file_handle) && global_is_following) {
+            printf("Following %s until it has not grown for %lld seconds\n", arg.data, (long long)follow_timeout);
+            
+            begin_stats_progress("Following", Stats_Phase__Read, os_get_size_of_file(file_handle));
+            
+            chunk_count = split_file_follow(file_handle, shared_header, file_name, &roots,
+                                            follow_timeout * 1000000000LL);
+        } else if(os_is_handle_valid(file_handle) && is_sparse_mode) {
+            i64 file_size = os_get_size_of_file(file_handle);
+            
+            begin_stats_progress("Splitting", Stats_Phase__Read, get_sparse_data_size(file_handle, file_size));
+            
+            chunk_count = split_file_sparse(file_handle, shared_header, file_name, &roots);
+        } else if(os_is_handle_valid(file_handle)) {
             i64 file_size       = os_get_size_of_file(file_handle);
             i64 total_file_size = file_size;
             
             i32 split_count = get_split_count(total_file_size + file_name.length);
             
             if(split_count > 0) {
-                File_Data file = make_file_data(FILE_LIMIT);
-                
-                String out_file_name = make_string(128);
+                begin_stats_progress("Splitting", Stats_Phase__Read, file_size);
                 
-                Shared_Header shared_header = {0};
+                Chunk_Output output = make_chunk_output(&roots, file_size);
+                Split_Stream stream = begin_chunk_output_stream(&output, shared_header, file_name, file_size);
                 
-                shared_header.validation_0 = SPLITMERGE_HEADER_VALIDATION[0];
-                shared_header.validation_1 = SPLITMERGE_HEADER_VALIDATION[1];
-                shared_header.validation_2 = SPLITMERGE_HEADER_VALIDATION[2];
-                shared_header.version      = SPLITMERGE_FILE_VERSION;
-                shared_header.unique_id    = (u32)os_get_random_u64(&random_seed);
+                os_advise_sequential(file_handle);
                 
-                if(is_big_endian()) {
-                    shared_header.flags |= Header_Flag__Big_Endian;
-                }
+                //~ NOTE(Patrik): The file is read straight into the chunk.
+                i64 read_offset = 0;
                 
-                For(i32, it_index, split_count) {
-                    file.length = 0;
+                while(!stream.has_failed) {
+                    File_Data space = get_split_stream_space(&stream);
                     
-                    if(shared_header.file_index == 0) {
-                        First_Header header = {0};
-                        header.shared           = shared_header;
-                        header.file_name_length = (u16)file_name.length;
-                        header.total_file_count = (u16)split_count;
-                        
-                        u8 null_byte = 0;
-                        
-                        append_file_data(&file, (u8*)&header, sizeof(First_Header));
-                        append_file_data(&file, (u8*)file_name.data, file_name.length);
-                        append_file_data(&file, &null_byte, 1);
-                    } else {
-                        append_file_data(&file, (u8*)&shared_header, sizeof(Shared_Header));
+                    if(os_read_file(&space, file_handle, space.capacity) <= 0) {
+                        break;
                     }
                     
-                    printf("Splitting file %d/%d\n", it_index + 1, split_count);
+                    drop_streamed_range(file_handle, read_offset, space.length);
                     
-                    if(os_read_file(&file, file_handle, file.capacity - file.length) > 0) {
-                        out_file_name.length = 0;
-                        
-                        append_cstring(&out_file_name, output_path.data, output_path.length);
-                        append_u32(&out_file_name, shared_header.unique_id, 16);
-                        append_char(&out_file_name, '_');
-                        append_u32(&out_file_name, shared_header.file_index, 10);
-                        append_cstring(&out_file_name, SPLITMERGE_FILE_EXTENSION_CSTRING);
-                        null_terminate(&out_file_name);
-                        
-                        File_Handle out_file_handle = os_open_file_for_writing(out_file_name.data);
-                        
-                        os_write_file(out_file_handle, file.data, file.length);
-                        
-                        os_close_file(out_file_handle);
-                        
-                        shared_header.file_index += 1;
-                    }
+                    read_offset += space.length;
+                    
+                    commit_split_stream(&stream, space.length);
                 }
                 
-                SPLTMRG_FREE(file.data);
-                SPLTMRG_FREE(out_file_name.data);
+                chunk_count = end_chunk_output_stream(&output, &stream);
             } else {
                 printf("%s is too small, minimum file size is %lld bytes\n",
-                       arg.data, (MAX_FIRST_FILE_SIZE + 1));
+                       arg.data, (long long)(MAX_FIRST_FILE_SIZE + 1));
             }
         } else {
             printf("Invalid file: \"%s\"\n", arg.data);
         }
         
-        os_close_file(file_handle);
+        end_stats_progress();
+        
+        bool is_written = (chunk_count > 0);
+        
+        if(is_written && parity_count > 0) {
+            is_written = write_parity_chunks(shared_header, chunk_count, parity_group_size, parity_count, &roots);
+        }
+        
+        if(!is_written && !is_cached) {
+            failed_file_count += 1;
+        }
+        
+        if(is_written && is_split_cache_key_valid(&cache_key)) {
+            insert_split_cache_entry(&split_cache, &cache_key, shared_header.unique_id, chunk_count);
+            
+            should_save_cache = true;
+        }
+        
+        if(os_is_handle_valid(file_handle)) {
+            os_close_file(file_handle);
+        }
+    }
+    
+    if(is_cache_mode) {
+        if(should_save_cache && !save_split_cache(&split_cache, split_cache_path.data)) {
+            printf("Could not write \"%s\"\n", split_cache_path.data);
+        }
+        
+        if(split_cache.entries) {
+            SPLTMRG_FREE(split_cache.entries);
+        }
+        
+        SPLTMRG_FREE(split_cache_path.data);
+    }
+    
+    if(is_dedup_mode) {
+        //~ NOTE(Patrik): If a bundle failed to write, its blocks are in the table
+        // but were never produced, so the manifest is left as it was.
+        if(should_save_dedup) {
+            if(!save_dedup_table(&dedup_table, dedup_manifest_path.data)) {
+                printf("Could not write \"%s\"\n", dedup_manifest_path.data);
+            }
+        }
+        
+        SPLTMRG_FREE(dedup_table.entries);
+        SPLTMRG_FREE(dedup_manifest_path.data);
+    }
+    
+    if(base_file_name) {
+        SPLTMRG_FREE(base_table.entries);
+    }
+    
+    if(stats_file_name && !write_stats_file(stats_file_name, "split")) {
+        printf("Could not write \"%s\"\n", stats_file_name);
     }
     
-    return 0;
+    //~ NOTE(Patrik): Like merge, so a script can tell that a file was not split.
+    return failed_file_count > 0 ? 1 : 0;
 }
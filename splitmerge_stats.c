@@ -0,0 +1,493 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// STATS
+//
+//~ NOTE(Patrik): Include this right after splitmerge.c. It puts timers and
+// counters around the platform file calls and copy_memory by redefining
+// them, so everything included after it is counted without knowing about it.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+typedef enum Stats_Phase {
+    Stats_Phase__Open,
+    Stats_Phase__Header,
+    Stats_Phase__Read,
+    Stats_Phase__Write,
+    Stats_Phase__Seek,
+    Stats_Phase__Close,
+    Stats_Phase__Flush,
+    
+    Stats_Phase__Count,
+} Stats_Phase;
+
+static char *global_stats_phase_names[Stats_Phase__Count] = {
+    "open",
+    "header",
+    "read",
+    "write",
+    "seek",
+    "close",
+    "flush",
+};
+
+typedef struct Stats_Timer {
+    i64 time;
+    i64 calls;
+    i64 bytes;
+} Stats_Timer;
+
+//~ NOTE(Patrik): The progress follows the bytes of one phase, reads for split
+// and merge alike, since that is what the total is known for up front.
+typedef struct Stats_Progress {
+    char       *label;
+    Stats_Phase phase;
+    i64         total;
+    i64         start_bytes;
+    i64         start_time;
+    i64         last_print_time;
+    bool        is_active;
+} Stats_Progress;
+
+typedef struct Stats {
+    i64            start_time;
+    Stats_Timer    phases[Stats_Phase__Count];
+    i64            copied_bytes;
+    Stats_Progress progress;
+} Stats;
+
+#define STATS_PROGRESS_INTERVAL 250000000
+
+static Stats global_stats;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// PROGRESS
+//
+static void
+append_stats_size(String *str, i64 bytes) {
+    u64 tenths = (u64)bytes * 10 / (1024 * 1024);
+    
+    append_u64(str, tenths / 10, 10);
+    append_char(str, '.');
+    append_u64(str, tenths % 10, 10);
+    append_cstring(str, UNPACK_NTSTRING(" MB"));
+}
+
+static void
+append_stats_duration(String *str, i64 seconds) {
+    append_u64(str, seconds / 60, 10);
+    append_char(str, ':');
+    
+    if(seconds % 60 < 10) {
+        append_char(str, '0');
+    }
+    
+    append_u64(str, seconds % 60, 10);
+}
+
+static void
+print_stats_progress(i64 now) {
+    Stats_Progress *progress = &global_stats.progress;
+    
+    i64 done    = global_stats.phases[progress->phase].bytes - progress->start_bytes;
+    i64 elapsed = now - progress->start_time;
+    
+    if(done > progress->total) {
+        done = progress->total;
+    }
+    
+    static String line = {0};
+    
+    if(!line.data) {
+        line = make_string(128);
+    }
+    
+    line.length = 0;
+    
+    append_ntstring(&line, progress->label);
+    append_char(&line, ' ');
+    append_stats_size(&line, done);
+    append_cstring(&line, UNPACK_NTSTRING(" / "));
+    append_stats_size(&line, progress->total);
+    
+    if(elapsed > 0 && done > 0) {
+        i64 rate = (i64)((double)done * 1e9 / (double)elapsed);
+        
+        append_cstring(&line, UNPACK_NTSTRING("  "));
+        append_stats_size(&line, rate);
+        append_cstring(&line, UNPACK_NTSTRING("/s  ETA "));
+        append_stats_duration(&line, (progress->total - done) / (rate > 0 ? rate : 1));
+    }
+    
+    //~ NOTE(Patrik): Padded so that a shorter line covers the last one.
+    while(line.length < 72) {
+        append_char(&line, ' ');
+    }
+    
+    printf("\r%.*s", line.length, line.data);
+    fflush(stdout);
+    
+    progress->last_print_time = now;
+}
+
+static void
+begin_stats_progress(char *label, Stats_Phase phase, i64 total) {
+    Stats_Progress *progress = &global_stats.progress;
+    
+    progress->label           = label;
+    progress->phase           = phase;
+    progress->total           = total;
+    progress->start_bytes     = global_stats.phases[phase].bytes;
+    progress->start_time      = os_get_time();
+    progress->last_print_time = progress->start_time;
+    progress->is_active       = true;
+}
+
+//~ NOTE(Patrik): For a total that is only known as it goes, like a file that
+// is still being written.
+static void
+set_stats_progress_total(i64 total) {
+    if(total > global_stats.progress.total) {
+        global_stats.progress.total = total;
+    }
+}
+
+static void
+update_stats_progress(i64 now) {
+    if(global_stats.progress.is_active && now - global_stats.progress.last_print_time >= STATS_PROGRESS_INTERVAL) {
+        print_stats_progress(now);
+    }
+}
+
+static void
+end_stats_progress(void) {
+    if(global_stats.progress.is_active) {
+        print_stats_progress(os_get_time());
+        printf("\n");
+        
+        global_stats.progress.is_active = false;
+    }
+}
+
+//~ NOTE(Patrik): For when it failed, the error is the last thing that should be
+// on the screen and not a line that looks like it finished.
+static void
+stop_stats_progress(void) {
+    global_stats.progress.is_active = false;
+}
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TIMERS
+//
+static i64
+begin_stats_timer(void) {
+    return os_get_time();
+}
+
+static void
+end_stats_timer(Stats_Phase phase, i64 start_time, i64 bytes) {
+    i64 now = os_get_time();
+    
+    Stats_Timer *timer = global_stats.phases + phase;
+    
+    //~ NOTE(Patrik): Atomic since merge discovery reads headers on many threads.
+    os_atomic_add(&timer->time, now - start_time);
+    os_atomic_add(&timer->calls, 1);
+    os_atomic_add(&timer->bytes, bytes);
+    
+    update_stats_progress(now);
+}
+
+static void
+begin_stats(void) {
+    global_stats.start_time = os_get_time();
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// COUNTED PLATFORM API
+//
+static
+PLATFORM_OPEN_FILE_FOR_READING(stats_open_file_for_reading) {
+    i64 start_time = begin_stats_timer();
+    File_Handle result = os_open_file_for_reading(file_name);
+    end_stats_timer(Stats_Phase__Open, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_FOR_WRITING(stats_open_file_for_writing) {
+    i64 start_time = begin_stats_timer();
+    File_Handle result = os_open_file_for_writing(file_name);
+    end_stats_timer(Stats_Phase__Open, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_FOR_UPDATING(stats_open_file_for_updating) {
+    i64 start_time = begin_stats_timer();
+    File_Handle result = os_open_file_for_updating(file_name);
+    end_stats_timer(Stats_Phase__Open, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_READING(stats_open_file_in_directory_for_reading) {
+    i64 start_time = begin_stats_timer();
+    File_Handle result = os_open_file_in_directory_for_reading(directory, file_name);
+    end_stats_timer(Stats_Phase__Open, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_WRITING(stats_open_file_in_directory_for_writing) {
+    i64 start_time = begin_stats_timer();
+    File_Handle result = os_open_file_in_directory_for_writing(directory, file_name);
+    end_stats_timer(Stats_Phase__Open, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_CLOSE_FILE(stats_close_file) {
+    i64 start_time = begin_stats_timer();
+    os_close_file(handle);
+    end_stats_timer(Stats_Phase__Close, start_time, 0);
+}
+
+static
+PLATFORM_READ_FILE(stats_read_file) {
+    i64 start_time = begin_stats_timer();
+    i64 result = os_read_file(file, handle, read_amount);
+    end_stats_timer(Stats_Phase__Read, start_time, result);
+    
+    return result;
+}
+
+static
+PLATFORM_WRITE_FILE(stats_write_file) {
+    i64 start_time = begin_stats_timer();
+    i64 result = os_write_file(handle, data, length);
+    end_stats_timer(Stats_Phase__Write, start_time, result);
+    
+    return result;
+}
+
+static
+PLATFORM_FLUSH_FILE(stats_flush_file) {
+    i64 start_time = begin_stats_timer();
+    bool result = os_flush_file(handle);
+    end_stats_timer(Stats_Phase__Flush, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_BEGIN_FLUSH_FILE(stats_begin_flush_file) {
+    i64 start_time = begin_stats_timer();
+    os_begin_flush_file(handle);
+    end_stats_timer(Stats_Phase__Flush, start_time, 0);
+}
+
+static
+PLATFORM_MOVE_FILE_POINTER(stats_move_file_pointer) {
+    i64 start_time = begin_stats_timer();
+    bool result = os_move_file_pointer(handle, desired_offset);
+    end_stats_timer(Stats_Phase__Seek, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_SET_FILE_POINTER(stats_set_file_pointer) {
+    i64 start_time = begin_stats_timer();
+    bool result = os_set_file_pointer(handle, desired_offset);
+    end_stats_timer(Stats_Phase__Seek, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_GET_SIZE_OF_FILE(stats_get_size_of_file) {
+    i64 start_time = begin_stats_timer();
+    i64 result = os_get_size_of_file(handle);
+    end_stats_timer(Stats_Phase__Seek, start_time, 0);
+    
+    return result;
+}
+
+static
+PLATFORM_GET_REMAINING_SIZE_OF_FILE(stats_get_remaining_size_of_file) {
+    i64 start_time = begin_stats_timer();
+    i64 result = os_get_remaining_size_of_file(handle);
+    end_stats_timer(Stats_Phase__Seek, start_time, 0);
+    
+    return result;
+}
+
+static void
+stats_copy_memory(u8 *dest, u8 *source, i64 length) {
+    os_atomic_add(&global_stats.copied_bytes, length);
+    copy_memory(dest, source, length);
+}
+
+#undef os_open_file_for_reading
+#undef os_open_file_for_writing
+#undef os_open_file_for_updating
+#undef os_open_file_in_directory_for_reading
+#undef os_open_file_in_directory_for_writing
+#undef os_close_file
+#undef os_read_file
+#undef os_write_file
+#undef os_flush_file
+#undef os_begin_flush_file
+#undef os_move_file_pointer
+#undef os_set_file_pointer
+#undef os_get_size_of_file
+#undef os_get_remaining_size_of_file
+
+#define os_open_file_for_reading stats_open_file_for_reading
+#define os_open_file_for_writing stats_open_file_for_writing
+#define os_open_file_for_updating stats_open_file_for_updating
+#define os_open_file_in_directory_for_reading stats_open_file_in_directory_for_reading
+#define os_open_file_in_directory_for_writing stats_open_file_in_directory_for_writing
+#define os_close_file stats_close_file
+#define os_read_file stats_read_file
+#define os_write_file stats_write_file
+#define os_flush_file stats_flush_file
+#define os_begin_flush_file stats_begin_flush_file
+#define os_move_file_pointer stats_move_file_pointer
+#define os_set_file_pointer stats_set_file_pointer
+#define os_get_size_of_file stats_get_size_of_file
+#define os_get_remaining_size_of_file stats_get_remaining_size_of_file
+
+#define copy_memory stats_copy_memory
+
+
+//~~~~~~~~~~~~~~~~
+//
+// REPORT
+//
+static void
+append_stats_seconds(String *str, i64 time) {
+    u64 microseconds = (u64)time / 1000;
+    
+    append_u64(str, microseconds / 1000000, 10);
+    append_char(str, '.');
+    
+    u64 fraction = microseconds % 1000000;
+    
+    for(u64 scale = 100000; scale > 0; scale /= 10) {
+        append_char(str, digit_value_to_char((i32)((fraction / scale) % 10)));
+    }
+}
+
+//~ NOTE(Patrik): A backend that keeps its files somewhere other than the disk
+// defines write_stats_report, so the report still ends up where it can be read.
+#if !defined(write_stats_report)
+static bool
+write_stats_report(char *file_name, u8 *data, i64 length) {
+    bool result = false;
+    
+    File_Handle handle = os_open_file_for_writing(file_name);
+    
+    if(os_is_handle_valid(handle)) {
+        result = (os_write_file(handle, data, length) == length);
+        
+        os_close_file(handle);
+    }
+    
+    return result;
+}
+#endif
+
+//~ NOTE(Patrik): "bytes_read" and "bytes_written" count every file, not just
+// the payload. "bytes_copied" is what went through copy_memory on top of that.
+static bool
+write_stats_file(char *file_name, char *tool_name) {
+    i64 wall_time = os_get_time() - global_stats.start_time;
+    
+    String report = make_string(2048);
+    
+    i64 platform_calls = 0;
+    
+    For(i32, phase_index, Stats_Phase__Count) {
+        if(phase_index != Stats_Phase__Header) {
+            platform_calls += global_stats.phases[phase_index].calls;
+        }
+    }
+    
+    append_cstring(&report, UNPACK_NTSTRING("{\n  \"tool\": \""));
+    append_ntstring(&report, tool_name);
+    append_cstring(&report, UNPACK_NTSTRING("\",\n  \"backend\": \"" SPLITMERGE_BACKEND_NAME "\",\n  \"wall_seconds\": "));
+    append_stats_seconds(&report, wall_time);
+    append_cstring(&report, UNPACK_NTSTRING(",\n  \"bytes_read\": "));
+    append_u64(&report, global_stats.phases[Stats_Phase__Read].bytes, 10);
+    append_cstring(&report, UNPACK_NTSTRING(",\n  \"bytes_written\": "));
+    append_u64(&report, global_stats.phases[Stats_Phase__Write].bytes, 10);
+    append_cstring(&report, UNPACK_NTSTRING(",\n  \"bytes_copied\": "));
+    append_u64(&report, global_stats.copied_bytes, 10);
+    append_cstring(&report, UNPACK_NTSTRING(",\n  \"platform_calls\": "));
+    append_u64(&report, platform_calls, 10);
+    append_cstring(&report, UNPACK_NTSTRING(",\n  \"phases\": {"));
+    
+    For(i32, phase_index, Stats_Phase__Count) {
+        Stats_Timer *timer = global_stats.phases + phase_index;
+        
+        append_ntstring(&report, phase_index ? ",\n    \"" : "\n    \"");
+        append_ntstring(&report, global_stats_phase_names[phase_index]);
+        append_cstring(&report, UNPACK_NTSTRING("\": {\"seconds\": "));
+        append_stats_seconds(&report, timer->time);
+        append_cstring(&report, UNPACK_NTSTRING(", \"calls\": "));
+        append_u64(&report, timer->calls, 10);
+        append_cstring(&report, UNPACK_NTSTRING(", \"bytes\": "));
+        append_u64(&report, timer->bytes, 10);
+        append_char(&report, '}');
+    }
+    
+    append_cstring(&report, UNPACK_NTSTRING("\n  }\n}\n"));
+    
+    bool result = write_stats_report(file_name, (u8*)report.data, report.length);
+    
+    SPLTMRG_FREE(report.data);
+    
+    return result;
+}
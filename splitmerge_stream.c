@@ -0,0 +1,683 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// STREAM
+//
+//~ NOTE(Patrik): The split and merge streams are the core of splitmerge with
+// no files involved. Split takes payload bytes and hands finished chunks to a
+// callback, merge takes chunks and hands back the payload inside of them.
+// Neither of them does any I/O or printing, so they can be used to send
+// chunks straight over a network instead of through split_output.
+//
+// Include splitmerge.c before this file.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+//~ NOTE(Patrik): chunk holds the whole chunk, header and payload, and is only
+// valid during the call. To keep it without a copy, swap *chunk for an empty
+// buffer with at least the same capacity, which the stream then goes on with.
+// total_file_count is 0 when it is not known yet. Returning false stops the
+// stream.
+#define SPLITMERGE_CHUNK_CALLBACK(name) bool name(void *user_data, Shared_Header shared_header, \
+                                                  u16 total_file_count, File_Data *chunk)
+typedef SPLITMERGE_CHUNK_CALLBACK(Chunk_Callback);
+
+//~ NOTE(Patrik): Used by a sliced split stream instead. A slice is length bytes
+// at offset in the chunk, the slices of a chunk come in order and is_chunk_end
+// is set on the last one. When the payload size is not known, chunk 0 goes out
+// with a total_file_count of 0, and at the end of the stream its First_Header
+// is handed out once more on its own at offset 0, to be written over the old one.
+#define SPLITMERGE_CHUNK_SLICE_CALLBACK(name) bool name(void *user_data, Shared_Header shared_header, \
+                                                        u16 total_file_count, u8 *slice, i64 offset, \
+                                                        i64 length, bool is_chunk_end)
+typedef SPLITMERGE_CHUNK_SLICE_CALLBACK(Chunk_Slice_Callback);
+
+typedef struct Split_Stream {
+    Shared_Header shared;
+    i64           chunk_limit;
+    
+    //~ NOTE(Patrik): When the payload size is not given up front the amount
+    // of chunks is not known, so chunk 0 is held in first_file and is the last
+    // chunk to be handed out, once total_file_count can be filled in.
+    u16       total_file_count;
+    File_Data first_file;
+    File_Data file;
+    
+    Chunk_Callback *emit_chunk;
+    void           *user_data;
+    
+    //~ NOTE(Patrik): A sliced stream only has a slice of the current chunk in
+    // file, chunk_offset is where it starts in the chunk.
+    Chunk_Slice_Callback *emit_slice;
+    i64                   chunk_offset;
+    First_Header          first_header;
+    
+    char *error;
+    bool  has_failed;
+} Split_Stream;
+
+typedef enum Merge_Stream_Status {
+    Merge_Stream_Status__Ok,
+    Merge_Stream_Status__Invalid_Chunk,
+    Merge_Stream_Status__Newer_Version,
+    Merge_Stream_Status__Parity_Chunk,
+    Merge_Stream_Status__Wrong_Bundle,
+    Merge_Stream_Status__Out_Of_Order,
+    Merge_Stream_Status__Done,
+} Merge_Stream_Status;
+
+//~ NOTE(Patrik): Where a range of the payload of a plain bundle is, as
+// length bytes at file_offset in the chunk with file_index.
+typedef struct Chunk_Range {
+    u32 file_index;
+    i64 file_offset;
+    i64 length;
+} Chunk_Range;
+
+//~ NOTE(Patrik): Chunks have to be pushed in order, starting with chunk 0.
+// The payload handed back points into the pushed chunk, nothing is copied.
+typedef struct Merge_Stream {
+    u32    unique_id;
+    u8     flags;
+    u16    total_file_count;
+    u16    next_file_index;
+    String file_name;
+    
+    u8 *payload;
+    i64 payload_length;
+} Merge_Stream;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// HEADER
+//
+static Shared_Header
+make_shared_header(u32 unique_id) {
+    Shared_Header result = {0};
+    
+    result.validation_0 = SPLITMERGE_HEADER_VALIDATION[0];
+    result.validation_1 = SPLITMERGE_HEADER_VALIDATION[1];
+    result.validation_2 = SPLITMERGE_HEADER_VALIDATION[2];
+    result.version      = SPLITMERGE_FILE_VERSION;
+    result.unique_id    = unique_id;
+    
+    if(is_big_endian()) {
+        result.flags |= Header_Flag__Big_Endian;
+    }
+    
+    return result;
+}
+
+static bool
+is_valid_header(Shared_Header header) {
+    if(header.validation_0 == SPLITMERGE_HEADER_VALIDATION[0] &&
+       header.validation_1 == SPLITMERGE_HEADER_VALIDATION[1] &&
+       header.validation_2 == SPLITMERGE_HEADER_VALIDATION[2])
+    {
+        return true;
+    }
+    return false;
+}
+
+//~ NOTE(Patrik): The exact amount of chunks a payload of payload_size bytes is
+// split into, or 0 if it does not fit in 0xFFFF chunks.
+static u16
+get_chunk_count(i64 payload_size, i64 file_name_length, i64 chunk_limit) {
+    i64 first_payload_length = chunk_limit - (sizeof(First_Header) + file_name_length + 1);
+    i64 payload_length       = chunk_limit - sizeof(Shared_Header);
+    i64 result               = 1;
+    
+    if(payload_size > first_payload_length) {
+        result += (payload_size - first_payload_length + payload_length - 1) / payload_length;
+    }
+    
+    if(result > 0xFFFF) {
+        result = 0;
+    }
+    
+    return (u16)result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// ENDIAN
+//
+static u16
+swap_endian_u16(u16 value) {
+    u16 result = ((value << 8) & 0xff00 |
+                  (value >> 8) & 0x00ff);
+    
+    return result;
+}
+
+static u32
+swap_endian_u32(u32 value) {
+    u32 result = ((value << 24) & 0xff000000 |
+                  (value <<  8) & 0x00ff0000 |
+                  (value >>  8) & 0x0000ff00 |
+                  (value >> 24) & 0x000000ff);
+    
+    return result;
+}
+
+static u64
+swap_endian_u64(u64 value) {
+    u64 result = ((value << 32) & 0xffffffff00000000 |
+                  (value >> 32) & 0x00000000ffffffff);
+    
+    result = ((result << 16) & 0xffff0000ffff0000 |
+              (result >> 16) & 0x0000ffff0000ffff);
+    
+    result = ((result << 8) & 0xff00ff00ff00ff00 |
+              (result >> 8) & 0x00ff00ff00ff00ff);
+    
+    return result;
+}
+
+static bool
+should_swap_endian(u8 flags) {
+    if(is_big_endian() != (flags & Header_Flag__Big_Endian)) {
+        return true;
+    }
+    return false;
+}
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// SPLIT STREAM
+//
+static void
+start_split_stream(Split_Stream *stream, String file_name, i64 payload_size) {
+    if(payload_size >= 0) {
+        stream->total_file_count = get_chunk_count(payload_size, file_name.length, stream->chunk_limit);
+        
+        if(stream->total_file_count == 0) {
+            stream->error      = "The payload does not fit in 65535 files";
+            stream->has_failed = true;
+        }
+    }
+    
+    File_Data *file = &stream->file;
+    
+    if(stream->first_file.data) {
+        file = &stream->first_file;
+    }
+    
+    First_Header *header = &stream->first_header;
+    header->shared           = stream->shared;
+    header->file_name_length = (u16)file_name.length;
+    header->total_file_count = stream->total_file_count;
+    
+    u8 null_byte = 0;
+    
+    append_file_data(file, (u8*)header, sizeof(First_Header));
+    append_file_data(file, (u8*)file_name.data, file_name.length);
+    append_file_data(file, &null_byte, 1);
+}
+
+//~ NOTE(Patrik): payload_size is the total size of the payload if it is known,
+// or -1 if it is not. Chunks are handed out in order when it is known,
+// otherwise chunk 0 is handed out last.
+static Split_Stream
+begin_split_stream(Shared_Header shared_header, String file_name, i64 payload_size, i64 chunk_limit,
+                   Chunk_Callback *emit_chunk, void *user_data)
+{
+    Split_Stream result = {0};
+    
+    result.shared      = shared_header;
+    result.chunk_limit = chunk_limit;
+    result.emit_chunk  = emit_chunk;
+    result.user_data   = user_data;
+    result.file        = make_file_data(chunk_limit);
+    
+    if(payload_size < 0) {
+        result.first_file = make_file_data(chunk_limit);
+    }
+    
+    start_split_stream(&result, file_name, payload_size);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Same as begin_split_stream, but only slice_limit bytes of a
+// chunk are held at a time and handed to emit_slice, so memory does not grow
+// with the chunk size. The first header has to fit in slice_limit.
+static Split_Stream
+begin_sliced_split_stream(Shared_Header shared_header, String file_name, i64 payload_size, i64 chunk_limit,
+                          i64 slice_limit, Chunk_Slice_Callback *emit_slice, void *user_data)
+{
+    Split_Stream result = {0};
+    
+    if(slice_limit > chunk_limit) {
+        slice_limit = chunk_limit;
+    }
+    
+    result.shared      = shared_header;
+    result.chunk_limit = chunk_limit;
+    result.emit_slice  = emit_slice;
+    result.user_data   = user_data;
+    result.file        = make_file_data(slice_limit);
+    
+    start_split_stream(&result, file_name, payload_size);
+    
+    return result;
+}
+
+static File_Data*
+get_split_stream_chunk(Split_Stream *stream) {
+    if(stream->shared.file_index == 0 && stream->first_file.data) {
+        return &stream->first_file;
+    }
+    return &stream->file;
+}
+
+static i64
+get_split_stream_chunk_length(Split_Stream *stream) {
+    return stream->chunk_offset + get_split_stream_chunk(stream)->length;
+}
+
+//~ NOTE(Patrik): Hands out the slice in file when it is full but the chunk is not.
+static bool
+emit_split_stream_slice(Split_Stream *stream) {
+    File_Data *file = &stream->file;
+    
+    if(!stream->emit_slice(stream->user_data, stream->shared, stream->total_file_count,
+                           file->data, stream->chunk_offset, file->length, false))
+    {
+        stream->error      = "Could not write a chunk";
+        stream->has_failed = true;
+    }
+    
+    stream->chunk_offset += file->length;
+    file->length          = 0;
+    
+    return !stream->has_failed;
+}
+
+static bool
+emit_split_stream_chunk(Split_Stream *stream, File_Data *file) {
+    Shared_Header shared_header = stream->shared;
+    
+    if(!stream->emit_slice) {
+        shared_header = *(Shared_Header*)file->data;
+    }
+    
+    SPLITMERGE_PROBE3(split_chunk_begin, shared_header.unique_id, shared_header.file_index,
+                      stream->chunk_offset + file->length);
+    
+    bool is_ok;
+    
+    if(stream->emit_slice) {
+        is_ok = stream->emit_slice(stream->user_data, shared_header, stream->total_file_count,
+                                   file->data, stream->chunk_offset, file->length, true);
+    } else {
+        is_ok = stream->emit_chunk(stream->user_data, shared_header, stream->total_file_count, file);
+    }
+    
+    if(!is_ok) {
+        stream->error      = "Could not write a chunk";
+        stream->has_failed = true;
+    }
+    
+    stream->chunk_offset = 0;
+    
+    SPLITMERGE_PROBE3(split_chunk_end, shared_header.unique_id, shared_header.file_index, !stream->has_failed);
+    
+    return !stream->has_failed;
+}
+
+//~ NOTE(Patrik): Hands out the current chunk and starts the next one.
+static void
+next_split_stream_chunk(Split_Stream *stream) {
+    File_Data *file = get_split_stream_chunk(stream);
+    
+    if(file == &stream->file && !emit_split_stream_chunk(stream, file)) {
+        return;
+    }
+    
+    if(stream->shared.file_index + 1 >= 0xFFFF) {
+        stream->error      = "The payload does not fit in 65535 files";
+        stream->has_failed = true;
+        return;
+    }
+    
+    stream->shared.file_index += 1;
+    stream->file.length        = 0;
+    
+    append_file_data(&stream->file, (u8*)&stream->shared, sizeof(Shared_Header));
+}
+
+static bool
+is_last_split_stream_chunk(Split_Stream *stream) {
+    return (stream->total_file_count && stream->shared.file_index + 1 >= stream->total_file_count);
+}
+
+//~ NOTE(Patrik): Gives the free space at the end of the current chunk, so the
+// payload can be read straight into it. Call commit_split_stream with the
+// amount that was written. The space is empty when the last chunk is full.
+static File_Data
+get_split_stream_space(Split_Stream *stream) {
+    File_Data result = {0};
+    
+    if(!stream->has_failed && get_split_stream_chunk_length(stream) == stream->chunk_limit) {
+        if(is_last_split_stream_chunk(stream)) {
+            return result;
+        }
+        
+        next_split_stream_chunk(stream);
+    }
+    
+    if(!stream->has_failed && stream->emit_slice && stream->file.length == stream->file.capacity) {
+        emit_split_stream_slice(stream);
+    }
+    
+    if(!stream->has_failed) {
+        File_Data *file        = get_split_stream_chunk(stream);
+        i64        chunk_space = stream->chunk_limit - get_split_stream_chunk_length(stream);
+        
+        result.data     = file->data     + file->length;
+        result.capacity = file->capacity - file->length;
+        
+        if(result.capacity > chunk_space) {
+            result.capacity = chunk_space;
+        }
+    }
+    
+    return result;
+}
+
+static void
+commit_split_stream(Split_Stream *stream, i64 length) {
+    get_split_stream_chunk(stream)->length += length;
+}
+
+static void
+push_split_stream(Split_Stream *stream, u8 *data, i64 length) {
+    while(length > 0 && !stream->has_failed) {
+        File_Data space = get_split_stream_space(stream);
+        
+        if(!stream->has_failed && space.capacity == 0) {
+            stream->error      = "The payload is bigger than the size it was started with";
+            stream->has_failed = true;
+            break;
+        }
+        
+        i64 amount = space.capacity;
+        
+        if(amount > length) {
+            amount = length;
+        }
+        
+        copy_memory(space.data, data, amount);
+        commit_split_stream(stream, amount);
+        
+        data   += amount;
+        length -= amount;
+    }
+}
+
+//~ NOTE(Patrik): Returns the total amount of chunks, or 0 on failure.
+static u16
+end_split_stream(Split_Stream *stream) {
+    u16 result = 0;
+    
+    File_Data *file = get_split_stream_chunk(stream);
+    
+    //~ NOTE(Patrik): get_split_stream_space starts a new chunk as soon as the
+    // last one is full, which leaves an empty chunk if the payload ended there.
+    if(!stream->has_failed && file == &stream->file) {
+        if(stream->shared.file_index > 0 && stream->chunk_offset == 0 && file->length == sizeof(Shared_Header)) {
+            stream->shared.file_index -= 1;
+        } else {
+            emit_split_stream_chunk(stream, file);
+        }
+    }
+    
+    if(!stream->has_failed) {
+        if(stream->first_file.data) {
+            First_Header *header = (First_Header*)stream->first_file.data;
+            
+            stream->total_file_count = stream->shared.file_index + 1;
+            header->total_file_count = stream->total_file_count;
+            
+            emit_split_stream_chunk(stream, &stream->first_file);
+        } else if(stream->emit_slice && stream->first_header.total_file_count == 0) {
+            stream->total_file_count              = stream->shared.file_index + 1;
+            stream->first_header.total_file_count = stream->total_file_count;
+            
+            if(!stream->emit_slice(stream->user_data, stream->first_header.shared, stream->total_file_count,
+                                   (u8*)&stream->first_header, 0, sizeof(First_Header), true))
+            {
+                stream->error      = "Could not write a chunk";
+                stream->has_failed = true;
+            }
+        } else if(stream->shared.file_index + 1 != stream->total_file_count) {
+            stream->error      = "The payload is smaller than the size it was started with";
+            stream->has_failed = true;
+        }
+    }
+    
+    if(!stream->has_failed) {
+        result = stream->total_file_count;
+    }
+    
+    if(stream->first_file.data) {
+        SPLTMRG_FREE(stream->first_file.data);
+    }
+    
+    SPLTMRG_FREE(stream->file.data);
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// MERGE STREAM
+//
+static Merge_Stream
+make_merge_stream(void) {
+    Merge_Stream result = {0};
+    
+    result.file_name = make_string(SPLITMERGE_MAX_FILE_NAME_LENGTH + 1);
+    
+    return result;
+}
+
+static void
+free_merge_stream(Merge_Stream *stream) {
+    SPLTMRG_FREE(stream->file_name.data);
+}
+
+static bool
+is_merge_stream_done(Merge_Stream *stream) {
+    return (stream->total_file_count > 0 && stream->next_file_index == stream->total_file_count);
+}
+
+static Merge_Stream_Status
+read_merge_chunk(Merge_Stream *stream, u8 *chunk, i64 chunk_length) {
+    if(chunk_length < (i64)sizeof(Shared_Header)) {
+        return Merge_Stream_Status__Invalid_Chunk;
+    }
+    
+    Shared_Header shared_header = *(Shared_Header*)chunk;
+    
+    if(!is_valid_header(shared_header)) {
+        return Merge_Stream_Status__Invalid_Chunk;
+    }
+    
+    if(shared_header.flags & ~SPLITMERGE_KNOWN_HEADER_FLAGS) {
+        return Merge_Stream_Status__Newer_Version;
+    }
+    
+    if(is_flag_set(shared_header.flags, Header_Flag__Parity)) {
+        return Merge_Stream_Status__Parity_Chunk;
+    }
+    
+    bool should_swap = should_swap_endian(shared_header.flags);
+    
+    if(should_swap) {
+        shared_header.unique_id  = swap_endian_u32(shared_header.unique_id);
+        shared_header.file_index = swap_endian_u16(shared_header.file_index);
+    }
+    
+    if(stream->next_file_index > 0 && shared_header.unique_id != stream->unique_id) {
+        return Merge_Stream_Status__Wrong_Bundle;
+    }
+    
+    if(is_merge_stream_done(stream)) {
+        return Merge_Stream_Status__Done;
+    }
+    
+    if(shared_header.file_index != stream->next_file_index) {
+        return Merge_Stream_Status__Out_Of_Order;
+    }
+    
+    i64 header_length = sizeof(Shared_Header);
+    
+    if(shared_header.file_index == 0) {
+        if(chunk_length < (i64)sizeof(First_Header)) {
+            return Merge_Stream_Status__Invalid_Chunk;
+        }
+        
+        First_Header header = *(First_Header*)chunk;
+        
+        if(should_swap) {
+            header.file_name_length = swap_endian_u16(header.file_name_length);
+            header.total_file_count = swap_endian_u16(header.total_file_count);
+        }
+        
+        header_length = sizeof(First_Header) + header.file_name_length + 1;
+        
+        if(chunk_length < header_length || header.total_file_count == 0) {
+            return Merge_Stream_Status__Invalid_Chunk;
+        }
+        
+        stream->unique_id        = shared_header.unique_id;
+        stream->flags            = shared_header.flags;
+        stream->total_file_count = header.total_file_count;
+        
+        stream->file_name.length = 0;
+        append_cstring(&stream->file_name, (char*)chunk + sizeof(First_Header), header.file_name_length);
+        null_terminate(&stream->file_name);
+    }
+    
+    stream->next_file_index += 1;
+    stream->payload          = chunk        + header_length;
+    stream->payload_length   = chunk_length - header_length;
+    
+    return Merge_Stream_Status__Ok;
+}
+
+static Merge_Stream_Status
+push_merge_chunk(Merge_Stream *stream, u8 *chunk, i64 chunk_length) {
+    Merge_Stream_Status result = read_merge_chunk(stream, chunk, chunk_length);
+    
+    SPLITMERGE_PROBE3(header_validate, stream->unique_id, stream->next_file_index, result);
+    
+    return result;
+}
+
+//~ NOTE(Patrik): Hands back the payload of the last pushed chunk, once.
+// It points into that chunk so it is only valid as long as the chunk is.
+static i64
+pull_merge_payload(Merge_Stream *stream, u8 **payload) {
+    i64 result = stream->payload_length;
+    
+    *payload = stream->payload;
+    
+    stream->payload        = 0;
+    stream->payload_length = 0;
+    
+    return result;
+}
+
+static char*
+get_merge_stream_status_message(Merge_Stream_Status status) {
+    switch(status) {
+        case Merge_Stream_Status__Ok:            return "Ok";
+        case Merge_Stream_Status__Invalid_Chunk: return "has an invalid header";
+        case Merge_Stream_Status__Newer_Version: return "was split by a newer version of splitmerge";
+        case Merge_Stream_Status__Parity_Chunk:  return "is a parity file";
+        case Merge_Stream_Status__Wrong_Bundle:  return "belongs to another file";
+        case Merge_Stream_Status__Out_Of_Order:  return "is out of order";
+        case Merge_Stream_Status__Done:          return "is past the last file";
+    }
+    return "";
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// RANGE
+//
+//~ NOTE(Patrik): Every chunk of a bundle but the last is chunk_size bytes, so
+// where a byte of the payload is can be worked out from the size of chunk 0
+// and the length of its header, without reading any other chunk.
+// Hands back the part of the range that is in the chunk payload_offset is in,
+// a range that goes on into the next chunk needs another call for the rest.
+static Chunk_Range
+get_chunk_range(i64 chunk_size, i64 first_header_length, i64 payload_offset, i64 length) {
+    Chunk_Range result = {0};
+    
+    i64 first_payload_length = chunk_size - first_header_length;
+    i64 payload_length       = chunk_size - sizeof(Shared_Header);
+    i64 available            = 0;
+    
+    if(payload_offset < first_payload_length) {
+        result.file_index  = 0;
+        result.file_offset = first_header_length + payload_offset;
+        
+        available = first_payload_length - payload_offset;
+    } else {
+        i64 offset = payload_offset - first_payload_length;
+        i64 index  = 1 + offset / payload_length;
+        
+        //~ NOTE(Patrik): An offset that is past what any bundle can hold
+        // still ends up past the last chunk.
+        if(index > 0x10000) {
+            index = 0x10000;
+        }
+        
+        result.file_index  = (u32)index;
+        result.file_offset = sizeof(Shared_Header) + offset % payload_length;
+        
+        available = payload_length - offset % payload_length;
+    }
+    
+    result.length = (length < available) ? length : available;
+    
+    return result;
+}
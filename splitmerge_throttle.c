@@ -0,0 +1,286 @@
+//~~~~~~~~~~~~~~~~
+// MIT License
+//
+// Copyright (c) 2021 Patrik Johansson
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+
+
+//~~~~~~~~~~~~~~~~
+//
+// THROTTLE
+//
+//~ NOTE(Patrik): Include this right after splitmerge_stats.c. It limits the
+// bandwidth and the amount of operations of the platform file calls with
+// token buckets by redefining them, the same way stats counts them. Since it
+// wraps the counted calls, time spent waiting is not counted as reading or
+// writing.
+//
+// Big reads and writes are cut into slices that are throttled one at a time,
+// so a 100MB chunk is spread out instead of going out in one burst.
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TYPES
+//
+//~ NOTE(Patrik): tokens can go below zero, the call that took them then
+// sleeps until the bucket is back at zero. Calls from other threads queue up
+// behind it since they take from the same debt. tokens is a double so that
+// frequent small calls do not lose the fraction of a token they added.
+typedef struct Token_Bucket {
+    i64    rate;
+    double burst;
+    double tokens;
+    i64    last_time;
+} Token_Bucket;
+
+typedef struct Throttle {
+    Token_Bucket     read;
+    Token_Bucket     write;
+    Token_Bucket     operations;
+    i64              slice_size;
+    Semaphore_Handle lock;
+    bool             is_active;
+} Throttle;
+
+#define THROTTLE_MIN_SLICE_SIZE (64 * 1024)
+#define THROTTLE_MAX_SLICE_SIZE (4 * 1024 * 1024)
+
+static Throttle global_throttle;
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TOKEN BUCKET
+//
+static void
+init_token_bucket(Token_Bucket *bucket, i64 rate) {
+    bucket->rate      = rate;
+    bucket->burst     = (double)rate / 10.0;
+    bucket->last_time = os_get_time();
+    
+    if(bucket->burst < 1.0) {
+        bucket->burst = 1.0;
+    }
+    
+    bucket->tokens = bucket->burst;
+}
+
+static void
+take_tokens(Token_Bucket *bucket, i64 amount) {
+    if(bucket->rate == 0 || amount <= 0) {
+        return;
+    }
+    
+    os_wait_semaphore(global_throttle.lock);
+    
+    i64 now = os_get_time();
+    
+    bucket->tokens    += (double)(now - bucket->last_time) * (double)bucket->rate / 1e9;
+    bucket->last_time  = now;
+    
+    if(bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
+    }
+    
+    bucket->tokens -= (double)amount;
+    
+    i64 wait_time = 0;
+    
+    if(bucket->tokens < 0.0) {
+        wait_time = (i64)(-bucket->tokens * 1e9 / (double)bucket->rate);
+    }
+    
+    os_signal_semaphore(global_throttle.lock);
+    
+    os_sleep(wait_time);
+}
+
+//~ NOTE(Patrik): A rate of 0 is no limit. Returns false if nothing is limited.
+static bool
+init_throttle(i64 read_rate, i64 write_rate, i64 operation_rate) {
+    if(read_rate == 0 && write_rate == 0 && operation_rate == 0) {
+        return false;
+    }
+    
+    init_token_bucket(&global_throttle.read, read_rate);
+    init_token_bucket(&global_throttle.write, write_rate);
+    init_token_bucket(&global_throttle.operations, operation_rate);
+    
+    //~ NOTE(Patrik): About 16 slices a second at the lowest rate.
+    i64 lowest_rate = read_rate;
+    
+    if(lowest_rate == 0 || (write_rate != 0 && write_rate < lowest_rate)) {
+        lowest_rate = write_rate;
+    }
+    
+    global_throttle.slice_size = THROTTLE_MAX_SLICE_SIZE;
+    
+    if(lowest_rate != 0 && lowest_rate / 16 < global_throttle.slice_size) {
+        global_throttle.slice_size = lowest_rate / 16;
+    }
+    
+    if(global_throttle.slice_size < THROTTLE_MIN_SLICE_SIZE) {
+        global_throttle.slice_size = THROTTLE_MIN_SLICE_SIZE;
+    }
+    
+    global_throttle.lock      = os_create_semaphore(1);
+    global_throttle.is_active = true;
+    
+    return true;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// OPTIONS
+//
+//~ NOTE(Patrik): Shared by split and merge, the options that take a value.
+static bool
+is_throttle_option(String arg) {
+    if(is_equal_to_ntstring(arg, "--max-read-rate")  ||
+       is_equal_to_ntstring(arg, "--max-write-rate") ||
+       is_equal_to_ntstring(arg, "--max-iops"))
+    {
+        return true;
+    }
+    return false;
+}
+
+typedef struct Throttle_Options {
+    u64  read_rate;
+    u64  write_rate;
+    u64  operation_rate;
+    bool is_background_mode;
+} Throttle_Options;
+
+//~ NOTE(Patrik): Rates take a K, M or G suffix and are per second.
+static bool
+parse_throttle_option(Throttle_Options *options, String arg, char *value) {
+    String value_string = set_string_from_ntstring(value);
+    u64    result       = 0;
+    
+    if(!parse_size(value_string, &result) || result == 0 || result > ((u64)1 << 40)) {
+        printf("Invalid value for %s: %s\n", arg.data, value);
+        return false;
+    }
+    
+    if(is_equal_to_ntstring(arg, "--max-read-rate")) {
+        options->read_rate = result;
+    } else if(is_equal_to_ntstring(arg, "--max-write-rate")) {
+        options->write_rate = result;
+    } else {
+        options->operation_rate = result;
+    }
+    
+    return true;
+}
+
+static void
+apply_throttle_options(Throttle_Options *options) {
+    if(options->is_background_mode && !os_enter_background_mode()) {
+        printf("Could not lower the priority of the process\n");
+    }
+    
+    init_throttle(options->read_rate, options->write_rate, options->operation_rate);
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// THROTTLED PLATFORM API
+//
+static
+PLATFORM_READ_FILE(throttle_read_file) {
+    if(!global_throttle.is_active) {
+        return os_read_file(file, handle, read_amount);
+    }
+    
+    i64 result = 0;
+    
+    while(result < read_amount) {
+        i64 slice_size = read_amount - result;
+        
+        if(slice_size > global_throttle.slice_size) {
+            slice_size = global_throttle.slice_size;
+        }
+        
+        take_tokens(&global_throttle.operations, 1);
+        
+        i64 read_size = os_read_file(file, handle, slice_size);
+        
+        if(read_size <= 0) {
+            break;
+        }
+        
+        take_tokens(&global_throttle.read, read_size);
+        
+        result += read_size;
+        
+        if(read_size < slice_size) {
+            break;
+        }
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_WRITE_FILE(throttle_write_file) {
+    if(!global_throttle.is_active) {
+        return os_write_file(handle, data, length);
+    }
+    
+    i64 result = 0;
+    
+    while(result < length) {
+        i64 slice_size = length - result;
+        
+        if(slice_size > global_throttle.slice_size) {
+            slice_size = global_throttle.slice_size;
+        }
+        
+        take_tokens(&global_throttle.operations, 1);
+        take_tokens(&global_throttle.write, slice_size);
+        
+        i64 written_size = os_write_file(handle, data + result, slice_size);
+        
+        if(written_size <= 0) {
+            break;
+        }
+        
+        result += written_size;
+        
+        if(written_size < slice_size) {
+            break;
+        }
+    }
+    
+    return result;
+}
+
+#undef os_read_file
+#undef os_write_file
+
+#define os_read_file throttle_read_file
+#define os_write_file throttle_write_file
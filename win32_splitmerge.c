@@ -28,6 +28,9 @@
 // INCLUDES
 //
 #include <windows.h>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
 
 
 //~~~~~~~~~~~~~~~~
@@ -42,22 +45,84 @@
 #define os_close_file win32_close_file
 #define os_open_file_for_reading win32_open_file_for_reading
 #define os_open_file_for_writing win32_open_file_for_writing
+#define os_open_file_for_updating win32_open_file_for_updating
 #define os_move_file_pointer win32_move_file_pointer
+#define os_set_file_pointer win32_set_file_pointer
 #define os_read_file win32_read_file
+#define os_read_standard_input win32_read_standard_input
+#define os_write_standard_output win32_write_standard_output
 #define os_write_file win32_write_file
 
+#define os_create_directory win32_create_directory
+#define os_delete_file win32_delete_file
+#define os_delete_directory win32_delete_directory
+#define os_move_file win32_move_file
+
+#define os_open_directory win32_open_directory
+#define os_close_directory win32_close_directory
+#define os_open_file_in_directory_for_reading win32_open_file_in_directory_for_reading
+#define os_open_file_in_directory_for_writing win32_open_file_in_directory_for_writing
+
+#define os_flush_file win32_flush_file
+#define os_begin_flush_file win32_begin_flush_file
+#define os_flush_directory win32_flush_directory
+
+#define os_advise_sequential win32_advise_sequential
+#define os_drop_cache win32_drop_cache
+
 #define os_get_size_of_file win32_get_size_of_file
 #define os_get_remaining_size_of_file win32_get_remaining_size_of_file
+#define os_get_file_identity win32_get_file_identity
+#define os_set_size_of_file win32_set_size_of_file
+#define os_collapse_file_range win32_collapse_file_range
+
+#define os_get_next_data win32_get_next_data
+#define os_set_sparse win32_set_sparse
 
 #define os_get_random_u64 win32_get_random_u64
 #define os_set_random_seed win32_set_random_seed
 
+#define os_get_time win32_get_time
+#define os_get_process_usage win32_get_process_usage
+#define os_sleep win32_sleep
+#define os_enter_background_mode win32_enter_background_mode
+#define os_run_process win32_run_process
+
+#define os_create_thread win32_create_thread
+#define os_join_thread win32_join_thread
+#define os_create_semaphore win32_create_semaphore
+#define os_wait_semaphore win32_wait_semaphore
+#define os_signal_semaphore win32_signal_semaphore
+#define os_free_semaphore win32_free_semaphore
+#define os_atomic_add win32_atomic_add
+#define os_get_processor_count win32_get_processor_count
+#define os_get_max_open_files win32_get_max_open_files
+
+#define SPLITMERGE_BACKEND_NAME "win32"
+
 
 //~~~~~~~~~~~~~~~~
 //
 // TYPES
 //
 typedef HANDLE File_Handle;
+typedef HANDLE Thread_Handle;
+typedef HANDLE Semaphore_Handle;
+
+//~ NOTE(Patrik): The Win32 API has no openat, NtCreateFile takes a root
+// directory but is not part of it, so the files are opened by joining path
+// and the name. path ends with a separator.
+typedef struct Win32_Directory {
+    i32  path_length;
+    char path[1];
+} Win32_Directory;
+
+typedef Win32_Directory * Directory_Handle;
+
+typedef struct Win32_Thread_Start {
+    Thread_Proc *proc;
+    void        *data;
+} Win32_Thread_Start;
 
 
 //~~~~~~~~~~~~~~~~
@@ -97,7 +162,9 @@ PLATFORM_IS_HANDLE_VALID(win32_is_handle_valid) {
 
 static
 PLATFORM_CLOSE_FILE(win32_close_file) {
-    CloseHandle(handle);
+    if(handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle);
+    }
 }
 
 static
@@ -124,6 +191,18 @@ PLATFORM_OPEN_FILE_FOR_WRITING(win32_open_file_for_writing) {
     return result;
 }
 
+static
+PLATFORM_OPEN_FILE_FOR_UPDATING(win32_open_file_for_updating) {
+    File_Handle result = INVALID_HANDLE_VALUE;
+    
+    if(file_name) {
+        result = CreateFileA(file_name, GENERIC_READ | GENERIC_WRITE, 0, 0,
+							 OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    }
+    
+    return result;
+}
+
 static
 PLATFORM_MOVE_FILE_POINTER(win32_move_file_pointer) {
     LARGE_INTEGER distance_to_move = {0};
@@ -135,6 +214,73 @@ PLATFORM_MOVE_FILE_POINTER(win32_move_file_pointer) {
     return false;
 }
 
+static
+PLATFORM_SET_FILE_POINTER(win32_set_file_pointer) {
+    LARGE_INTEGER distance_to_move = {0};
+    distance_to_move.QuadPart = desired_offset;
+    
+    if(SetFilePointerEx(handle, distance_to_move, 0, FILE_BEGIN)) {
+        return true;
+    }
+    return false;
+}
+
+//~ NOTE(Patrik): A pipe gives back what is in it so far, and ReadFile fails
+// with ERROR_BROKEN_PIPE once the other end is closed.
+static
+PLATFORM_READ_STANDARD_INPUT(win32_read_standard_input) {
+    i64 result = 0;
+    
+    if(file && file->data) {
+        if(read_amount > file->capacity - file->length) {
+            read_amount = file->capacity - file->length;
+        }
+        
+        if(read_amount > 0xFFFFFFFF) {
+            read_amount = 0xFFFFFFFF;
+        }
+        
+        DWORD bytes_read = 0;
+        
+        if(ReadFile(GetStdHandle(STD_INPUT_HANDLE), file->data + file->length, (DWORD)read_amount, &bytes_read, 0)) {
+            result        = bytes_read;
+            file->length += bytes_read;
+        }
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): stdout is flushed first, in case printf has something in it.
+static
+PLATFORM_WRITE_STANDARD_OUTPUT(win32_write_standard_output) {
+    i64 result = 0;
+    
+    if(data) {
+        fflush(stdout);
+        
+        HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+        
+        while(result < length) {
+            i64 write_amount = length - result;
+            
+            if(write_amount > 0xFFFFFFFF) {
+                write_amount = 0xFFFFFFFF;
+            }
+            
+            DWORD bytes_written = 0;
+            
+            if(!WriteFile(handle, data + result, (DWORD)write_amount, &bytes_written, 0) || bytes_written == 0) {
+                break;
+            }
+            
+            result += bytes_written;
+        }
+    }
+    
+    return result;
+}
+
 static
 PLATFORM_READ_FILE(win32_read_file) {
     i64 result = 0;
@@ -193,6 +339,144 @@ PLATFORM_WRITE_FILE(win32_write_file) {
     return result;
 }
 
+static
+PLATFORM_CREATE_DIRECTORY(win32_create_directory) {
+    if(directory_name) {
+        if(CreateDirectoryA(directory_name, 0) || GetLastError() == ERROR_ALREADY_EXISTS) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_DELETE_FILE(win32_delete_file) {
+    if(file_name && DeleteFileA(file_name)) {
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_DELETE_DIRECTORY(win32_delete_directory) {
+    if(directory_name && RemoveDirectoryA(directory_name)) {
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_MOVE_FILE(win32_move_file) {
+    if(old_name && new_name && MoveFileExA(old_name, new_name, MOVEFILE_REPLACE_EXISTING)) {
+        return true;
+    }
+    
+    return false;
+}
+
+static
+PLATFORM_FLUSH_FILE(win32_flush_file) {
+    if(FlushFileBuffers(handle)) {
+        return true;
+    }
+    
+    return false;
+}
+
+//~ NOTE(Patrik): The cache manager starts writing dirty pages out on its own.
+static
+PLATFORM_BEGIN_FLUSH_FILE(win32_begin_flush_file) {
+}
+
+static
+PLATFORM_OPEN_DIRECTORY(win32_open_directory) {
+    Win32_Directory *result = 0;
+    
+    if(directory_name) {
+        DWORD attributes = GetFileAttributesA(directory_name);
+        
+        if(attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            return 0;
+        }
+        
+        i32 path_length = (i32)lstrlenA(directory_name);
+        
+        result = (Win32_Directory*)win32_alloc(sizeof(Win32_Directory) + path_length + 1);
+        
+        CopyMemory(result->path, directory_name, path_length);
+        
+        if(path_length > 0 && directory_name[path_length - 1] != '/' && directory_name[path_length - 1] != '\\') {
+            result->path[path_length] = '\\';
+            path_length += 1;
+        }
+        
+        result->path_length = path_length;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_CLOSE_DIRECTORY(win32_close_directory) {
+    if(directory) {
+        win32_free(directory);
+    }
+}
+
+//~ NOTE(Patrik): NTFS logs changes to directories itself, and a directory can
+// not be flushed without opening it with backup semantics.
+static
+PLATFORM_FLUSH_DIRECTORY(win32_flush_directory) {
+    return true;
+}
+
+static File_Handle
+win32_open_file_in_directory(Win32_Directory *directory, char *file_name, bool is_writing) {
+    File_Handle result = INVALID_HANDLE_VALUE;
+    
+    if(directory && file_name) {
+        i32   name_length = (i32)lstrlenA(file_name);
+        char *path        = (char*)win32_alloc(directory->path_length + name_length + 1);
+        
+        CopyMemory(path, directory->path, directory->path_length);
+        CopyMemory(path + directory->path_length, file_name, name_length);
+        
+        if(is_writing) {
+            result = win32_open_file_for_writing(path);
+        } else {
+            result = win32_open_file_for_reading(path);
+        }
+        
+        win32_free(path);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_READING(win32_open_file_in_directory_for_reading) {
+    return win32_open_file_in_directory(directory, file_name, false);
+}
+
+static
+PLATFORM_OPEN_FILE_IN_DIRECTORY_FOR_WRITING(win32_open_file_in_directory_for_writing) {
+    return win32_open_file_in_directory(directory, file_name, true);
+}
+
+//~ NOTE(Patrik): Windows only takes these hints as flags when the file is
+// opened, FILE_FLAG_SEQUENTIAL_SCAN and FILE_FLAG_NO_BUFFERING, and the last
+// one needs aligned reads and writes. Both are left to the cache manager.
+static
+PLATFORM_ADVISE_SEQUENTIAL(win32_advise_sequential) {
+}
+
+static
+PLATFORM_DROP_CACHE(win32_drop_cache) {
+}
+
 static
 PLATFORM_GET_SIZE_OF_FILE(win32_get_size_of_file) {
     i64 result = 0;
@@ -206,6 +490,26 @@ PLATFORM_GET_SIZE_OF_FILE(win32_get_size_of_file) {
     return result;
 }
 
+//~ NOTE(Patrik): The last write time is in 100 nanosecond ticks.
+static
+PLATFORM_GET_FILE_IDENTITY(win32_get_file_identity) {
+    bool result = false;
+    
+    BY_HANDLE_FILE_INFORMATION info;
+    
+    if(GetFileInformationByHandle(handle, &info)) {
+        identity->device      = info.dwVolumeSerialNumber;
+        identity->file_id     = ((u64)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+        identity->size        = (i64)(((u64)info.nFileSizeHigh << 32) | info.nFileSizeLow);
+        identity->modify_time = (i64)((((u64)info.ftLastWriteTime.dwHighDateTime << 32) |
+                                       info.ftLastWriteTime.dwLowDateTime) * 100);
+        
+        result = true;
+    }
+    
+    return result;
+}
+
 static
 PLATFORM_GET_REMAINING_SIZE_OF_FILE(win32_get_remaining_size_of_file) {
     i64 result = 0;
@@ -225,6 +529,84 @@ PLATFORM_GET_REMAINING_SIZE_OF_FILE(win32_get_remaining_size_of_file) {
     return result;
 }
 
+static
+PLATFORM_SET_SIZE_OF_FILE(win32_set_size_of_file) {
+    bool result = false;
+    
+    LARGE_INTEGER zero     = {0};
+    LARGE_INTEGER position = {0};
+    LARGE_INTEGER end      = {0};
+    end.QuadPart = size;
+    
+    if(SetFilePointerEx(handle, zero, &position, FILE_CURRENT) &&
+       SetFilePointerEx(handle, end, 0, FILE_BEGIN))
+    {
+        result = (SetEndOfFile(handle) != 0);
+        
+        SetFilePointerEx(handle, position, 0, FILE_BEGIN);
+    }
+    
+    return result;
+}
+
+//~ NOTE(Patrik): There is no way to do it on Windows.
+static
+PLATFORM_COLLAPSE_FILE_RANGE(win32_collapse_file_range) {
+    return false;
+}
+
+//~ NOTE(Patrik): NTFS hands out allocated ranges in 64KB steps, and a file
+// that is not sparse is one range.
+static
+PLATFORM_GET_NEXT_DATA(win32_get_next_data) {
+    LARGE_INTEGER size = {0};
+    
+    if(!GetFileSizeEx(handle, &size)) {
+        return false;
+    }
+    
+    *data_start = size.QuadPart;
+    *data_end   = size.QuadPart;
+    
+    if(offset >= size.QuadPart) {
+        return true;
+    }
+    
+    FILE_ALLOCATED_RANGE_BUFFER query = {0};
+    query.FileOffset.QuadPart = offset;
+    query.Length.QuadPart     = size.QuadPart - offset;
+    
+    FILE_ALLOCATED_RANGE_BUFFER range = {0};
+    DWORD returned_size = 0;
+    
+    //~ NOTE(Patrik): ERROR_MORE_DATA only means there are more ranges after
+    // the first one.
+    if(!DeviceIoControl(handle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query),
+                        &range, sizeof(range), &returned_size, 0) &&
+       GetLastError() != ERROR_MORE_DATA)
+    {
+        return false;
+    }
+    
+    if(returned_size >= sizeof(range)) {
+        *data_start = range.FileOffset.QuadPart;
+        *data_end   = range.FileOffset.QuadPart + range.Length.QuadPart;
+        
+        if(*data_start < offset) {
+            *data_start = offset;
+        }
+    }
+    
+    return true;
+}
+
+static
+PLATFORM_SET_SPARSE(win32_set_sparse) {
+    DWORD returned_size = 0;
+    
+    return DeviceIoControl(handle, FSCTL_SET_SPARSE, 0, 0, 0, 0, &returned_size, 0) != 0;
+}
+
 static
 PLATFORM_GET_RANDOM_U64(win32_get_random_u64) {
     u64 result = 0;
@@ -258,3 +640,213 @@ PLATFORM_SET_RANDOM_SEED(win32_set_random_seed) {
     
     return result;
 }
+
+
+//~~~~~~~~~~~~~~~~
+//
+// TIME
+//
+static
+PLATFORM_GET_TIME(win32_get_time) {
+    static LARGE_INTEGER frequency = {0};
+    
+    if(frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    
+    LARGE_INTEGER counter = {0};
+    QueryPerformanceCounter(&counter);
+    
+    i64 seconds   = counter.QuadPart / frequency.QuadPart;
+    i64 remainder = counter.QuadPart % frequency.QuadPart;
+    
+    return seconds * 1000000000 + (remainder * 1000000000) / frequency.QuadPart;
+}
+
+static
+PLATFORM_GET_PROCESS_USAGE(win32_get_process_usage) {
+    Process_Usage result = {0};
+    
+    FILETIME creation_time = {0};
+    FILETIME exit_time     = {0};
+    FILETIME kernel_time   = {0};
+    FILETIME user_time     = {0};
+    
+    //~ NOTE(Patrik): FILETIME is in 100 nanosecond steps.
+    if(GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+        result.user_time   = (((i64)user_time.dwHighDateTime   << 32) | user_time.dwLowDateTime)   * 100;
+        result.system_time = (((i64)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime) * 100;
+    }
+    
+    PROCESS_MEMORY_COUNTERS counters = {0};
+    
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        result.peak_memory = counters.PeakWorkingSetSize;
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_SLEEP(win32_sleep) {
+    if(nanoseconds > 0) {
+        Sleep((DWORD)((nanoseconds + 999999) / 1000000));
+    }
+}
+
+//~ NOTE(Patrik): Background mode lowers both the CPU and the I/O priority.
+static
+PLATFORM_ENTER_BACKGROUND_MODE(win32_enter_background_mode) {
+    return SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN) != 0;
+}
+
+//~ NOTE(Patrik): CreateProcess takes one command line, every argument is put
+// in quotes so names with spaces stay whole.
+static
+PLATFORM_RUN_PROCESS(win32_run_process) {
+    i64 command_length = 1;
+    
+    for(char **arg = args; *arg; arg += 1) {
+        command_length += lstrlenA(*arg) + 3;
+    }
+    
+    char *command_line = (char*)win32_alloc(command_length);
+    char *at           = command_line;
+    
+    for(char **arg = args; *arg; arg += 1) {
+        i32 length = lstrlenA(*arg);
+        
+        *at++ = '"';
+        CopyMemory(at, *arg, length);
+        at += length;
+        *at++ = '"';
+        *at++ = ' ';
+    }
+    
+    *at = 0;
+    
+    fflush(stdout);
+    
+    STARTUPINFOA        startup_info = {0};
+    PROCESS_INFORMATION process_info = {0};
+    
+    startup_info.cb = sizeof(startup_info);
+    
+    bool result = CreateProcessA(program, command_line, 0, 0, FALSE, 0, 0, 0, &startup_info, &process_info) != 0;
+    
+    win32_free(command_line);
+    
+    if(result) {
+        WaitForSingleObject(process_info.hProcess, INFINITE);
+        
+        DWORD code = 0;
+        GetExitCodeProcess(process_info.hProcess, &code);
+        *exit_code = (i32)code;
+        
+        Process_Usage child_usage = {0};
+        
+        FILETIME creation_time = {0};
+        FILETIME exit_time     = {0};
+        FILETIME kernel_time   = {0};
+        FILETIME user_time     = {0};
+        
+        if(GetProcessTimes(process_info.hProcess, &creation_time, &exit_time, &kernel_time, &user_time)) {
+            child_usage.user_time   = (((i64)user_time.dwHighDateTime   << 32) | user_time.dwLowDateTime)   * 100;
+            child_usage.system_time = (((i64)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime) * 100;
+        }
+        
+        PROCESS_MEMORY_COUNTERS counters = {0};
+        
+        if(GetProcessMemoryInfo(process_info.hProcess, &counters, sizeof(counters))) {
+            child_usage.peak_memory = counters.PeakWorkingSetSize;
+        }
+        
+        *usage = child_usage;
+        
+        CloseHandle(process_info.hThread);
+        CloseHandle(process_info.hProcess);
+    }
+    
+    return result;
+}
+
+
+//~~~~~~~~~~~~~~~~
+//
+// THREAD
+//
+static DWORD WINAPI
+win32_thread_start(LPVOID data) {
+    Win32_Thread_Start start = *(Win32_Thread_Start*)data;
+    
+    win32_free(data);
+    
+    start.proc(start.data);
+    
+    return 0;
+}
+
+static
+PLATFORM_CREATE_THREAD(win32_create_thread) {
+    Win32_Thread_Start *start = (Win32_Thread_Start*)win32_alloc(sizeof(Win32_Thread_Start));
+    start->proc = proc;
+    start->data = data;
+    
+    HANDLE result = CreateThread(0, 0, win32_thread_start, start, 0, 0);
+    
+    if(!result) {
+        win32_free(start);
+    }
+    
+    return result;
+}
+
+static
+PLATFORM_JOIN_THREAD(win32_join_thread) {
+    if(handle) {
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+    }
+}
+
+static
+PLATFORM_CREATE_SEMAPHORE(win32_create_semaphore) {
+    return CreateSemaphoreA(0, initial_count, 0x7FFFFFFF, 0);
+}
+
+static
+PLATFORM_WAIT_SEMAPHORE(win32_wait_semaphore) {
+    WaitForSingleObject(handle, INFINITE);
+}
+
+static
+PLATFORM_SIGNAL_SEMAPHORE(win32_signal_semaphore) {
+    ReleaseSemaphore(handle, 1, 0);
+}
+
+static
+PLATFORM_FREE_SEMAPHORE(win32_free_semaphore) {
+    if(handle) {
+        CloseHandle(handle);
+    }
+}
+
+static
+PLATFORM_ATOMIC_ADD(win32_atomic_add) {
+    return InterlockedExchangeAdd64(value, amount);
+}
+
+static
+PLATFORM_GET_PROCESSOR_COUNT(win32_get_processor_count) {
+    SYSTEM_INFO info = {0};
+    GetSystemInfo(&info);
+    
+    return (i32)info.dwNumberOfProcessors;
+}
+
+//~ NOTE(Patrik): Windows has no low per process handle limit like
+// RLIMIT_NOFILE, this only keeps the handle cache from growing without end.
+static
+PLATFORM_GET_MAX_OPEN_FILES(win32_get_max_open_files) {
+    return 16384;
+}